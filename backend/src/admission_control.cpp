@@ -0,0 +1,105 @@
+#include "admission_control.hpp"
+#include <algorithm>
+
+namespace {
+
+const std::size_t kMinPruneAt = 1024;
+
+} // namespace
+
+bool AdmissionControl::Address::take(RateClass rateClass, std::chrono::steady_clock::time_point now) {
+    std::size_t index = static_cast<std::size_t>(rateClass);
+    std::lock_guard<std::mutex> lock(mutex);
+    return buckets[index].take(limits.messageRates[index], now);
+}
+
+bool AdmissionControl::Address::idle(std::chrono::steady_clock::time_point now) const {
+    if (connections > 0 || !connects.idle(limits.connectRate, now)) {
+        return false;
+    }
+    for (std::size_t i = 0; i < kRateClasses; ++i) {
+        if (!buckets[i].idle(limits.messageRates[i], now)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+AdmissionControl::Ticket::Ticket(std::shared_ptr<std::atomic<std::size_t>> open, std::shared_ptr<Address> address)
+    : openConnections(std::move(open)), clientAddress(std::move(address)) {}
+
+AdmissionControl::Ticket::~Ticket() {
+    openConnections->fetch_sub(1, std::memory_order_relaxed);
+    if (clientAddress) {
+        std::lock_guard<std::mutex> lock(clientAddress->mutex);
+        --clientAddress->connections;
+    }
+}
+
+AdmissionControl::AdmissionControl(const Limits& admissionLimits)
+    : limits(admissionLimits), open(std::make_shared<std::atomic<std::size_t>>(0)), pruneAt(kMinPruneAt) {}
+
+AdmissionControl::Decision AdmissionControl::admit(const std::string& address, std::unique_ptr<Ticket>& ticket) {
+    // Optimistic increment, so concurrent handshakes cannot overshoot the cap
+    std::size_t previous = open->fetch_add(1, std::memory_order_relaxed);
+    if (limits.maxConnections > 0 && previous >= limits.maxConnections) {
+        open->fetch_sub(1, std::memory_order_relaxed);
+        return Decision::ServerFull;
+    }
+    if (address.empty()) {
+        ticket = std::make_unique<Ticket>(open, nullptr);
+        return Decision::Admitted;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    std::shared_ptr<Address> entry;
+    {
+        std::lock_guard<std::mutex> lock(addressesMutex);
+        if (addresses.size() >= pruneAt) {
+            pruneAddresses(now);
+        }
+        std::shared_ptr<Address>& slot = addresses[address];
+        if (!slot) {
+            slot.reset(new Address(limits));
+        }
+        entry = slot;
+    }
+
+    Decision decision = Decision::Admitted;
+    {
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        if (limits.maxConnectionsPerAddress > 0 && entry->connections >= limits.maxConnectionsPerAddress) {
+            decision = Decision::AddressFull;
+        } else if (!entry->connects.take(limits.connectRate, now)) {
+            decision = Decision::ConnectRate;
+        } else {
+            ++entry->connections;
+        }
+    }
+    if (decision != Decision::Admitted) {
+        open->fetch_sub(1, std::memory_order_relaxed);
+        return decision;
+    }
+    ticket = std::make_unique<Ticket>(open, std::move(entry));
+    return Decision::Admitted;
+}
+
+void AdmissionControl::pruneAddresses(std::chrono::steady_clock::time_point now) {
+    for (auto it = addresses.begin(); it != addresses.end();) {
+        // Tickets and handshakes in progress hold their own references, and
+        // new ones can only be taken under addressesMutex
+        bool idle = it->second.use_count() == 1;
+        if (idle) {
+            std::lock_guard<std::mutex> lock(it->second->mutex);
+            idle = it->second->idle(now);
+        }
+        it = idle ? addresses.erase(it) : std::next(it);
+    }
+    // Amortized: the next sweep waits until the table has doubled
+    pruneAt = std::max(kMinPruneAt, addresses.size() * 2);
+}
+
+std::size_t AdmissionControl::trackedAddresses() const {
+    std::lock_guard<std::mutex> lock(addressesMutex);
+    return addresses.size();
+}
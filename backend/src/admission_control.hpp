@@ -0,0 +1,91 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "rate_limiter.hpp"
+
+// Decides which WebSocket handshakes to accept: at most maxConnections open
+// connections overall and maxConnectionsPerAddress from one client address,
+// and at most connectRate handshakes a second from one address. Each address
+// also carries message buckets shared by all of its connections.
+//
+// An admitted connection holds a Ticket until it is gone, so the counts stay
+// right however the connection ends.
+class AdmissionControl {
+public:
+    struct Limits {
+        std::size_t maxConnections = 0;             // 0 means unlimited
+        std::size_t maxConnectionsPerAddress = 0;   // 0 means unlimited
+        RateLimit connectRate;                      // Handshakes per address
+        RateLimits messageRates;                    // Shared by an address's connections
+    };
+
+    enum class Decision {
+        Admitted,
+        ServerFull,          // maxConnections reached
+        AddressFull,         // maxConnectionsPerAddress reached
+        ConnectRate          // Too many handshakes from the address
+    };
+    static constexpr std::size_t kDecisions = 4;
+
+    // One client address
+    class Address {
+    public:
+        // Takes a message token from the address's bucket for rateClass
+        bool take(RateClass rateClass, std::chrono::steady_clock::time_point now);
+
+    private:
+        friend class AdmissionControl;
+
+        explicit Address(const Limits& addressLimits) : limits(addressLimits) {}
+        bool idle(std::chrono::steady_clock::time_point now) const;
+
+        const Limits& limits;
+        std::mutex mutex;
+        std::size_t connections = 0;
+        TokenBucket connects;
+        std::array<TokenBucket, kRateClasses> buckets;
+    };
+
+    class Ticket {
+    public:
+        Ticket(std::shared_ptr<std::atomic<std::size_t>> open, std::shared_ptr<Address> address);
+        ~Ticket();
+        Ticket(const Ticket&) = delete;
+        Ticket& operator=(const Ticket&) = delete;
+
+        // Null for exempt peers
+        const std::shared_ptr<Address>& address() const { return clientAddress; }
+
+    private:
+        std::shared_ptr<std::atomic<std::size_t>> openConnections;
+        std::shared_ptr<Address> clientAddress;
+    };
+
+    explicit AdmissionControl(const Limits& admissionLimits);
+
+    // An empty address skips the per-address limits, e.g. for loopback peers.
+    // The ticket is set only when the connection is admitted.
+    Decision admit(const std::string& address, std::unique_ptr<Ticket>& ticket);
+
+    std::size_t openConnections() const { return open->load(std::memory_order_relaxed); }
+    std::size_t trackedAddresses() const;
+
+private:
+    // Forgets addresses with no connections whose buckets have refilled;
+    // they would behave exactly like new ones. Caller holds addressesMutex.
+    void pruneAddresses(std::chrono::steady_clock::time_point now);
+
+    Limits limits;
+    // Shared with tickets, which may outlive this object during shutdown
+    std::shared_ptr<std::atomic<std::size_t>> open;
+
+    mutable std::mutex addressesMutex;
+    std::unordered_map<std::string, std::shared_ptr<Address>> addresses;
+    std::size_t pruneAt;
+};
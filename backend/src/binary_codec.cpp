@@ -0,0 +1,377 @@
+#include "binary_codec.hpp"
+#include <stdexcept>
+#include <vector>
+
+const char* const BinaryCodec::kSubprotocol = "lobby.bin.v1";
+
+namespace {
+
+enum class FieldKind { String, Bool, Int, Object, StringList, ObjectList };
+
+struct FieldSchema {
+    const char* name;
+    FieldKind kind;
+    const std::vector<FieldSchema>* fields;  // For Object and ObjectList
+};
+
+struct MessageSchema {
+    std::uint8_t code;
+    const char* type;
+    std::vector<FieldSchema> fields;
+};
+
+const std::vector<FieldSchema> kRoomFields = {
+    {"id", FieldKind::String, nullptr},
+    {"name", FieldKind::String, nullptr},
+    {"gameType", FieldKind::String, nullptr},
+    {"players", FieldKind::StringList, nullptr},
+    {"maxPlayers", FieldKind::Int, nullptr},
+    {"status", FieldKind::Int, nullptr},
+    {"version", FieldKind::Int, nullptr},
+};
+
+const std::vector<FieldSchema> kUserFields = {
+    {"id", FieldKind::String, nullptr},
+    {"username", FieldKind::String, nullptr},
+    {"currentRoom", FieldKind::String, nullptr},
+};
+
+const std::vector<FieldSchema> kChatFields = {
+    {"roomId", FieldKind::String, nullptr},
+    {"userId", FieldKind::String, nullptr},
+    {"username", FieldKind::String, nullptr},
+    {"message", FieldKind::String, nullptr},
+    {"timestamp", FieldKind::Int, nullptr},
+};
+
+const std::vector<FieldSchema> kAuthData = {
+    {"userId", FieldKind::String, nullptr},
+    {"username", FieldKind::String, nullptr},
+};
+
+const std::vector<FieldSchema> kCreateRoomData = {
+    {"name", FieldKind::String, nullptr},
+    {"gameType", FieldKind::String, nullptr},
+};
+
+const std::vector<FieldSchema> kRoomIdData = {
+    {"roomId", FieldKind::String, nullptr},
+};
+
+const std::vector<FieldSchema> kChatData = {
+    {"roomId", FieldKind::String, nullptr},
+    {"message", FieldKind::String, nullptr},
+};
+
+const std::vector<FieldSchema> kQuickMatchData = {
+    {"gameType", FieldKind::String, nullptr},
+};
+
+const std::vector<FieldSchema> kEmptyData = {};
+
+const std::vector<MessageSchema> kClientMessages = {
+    {1, "auth", {{"data", FieldKind::Object, &kAuthData}}},
+    {2, "create_room", {{"data", FieldKind::Object, &kCreateRoomData}}},
+    {3, "join_room", {{"data", FieldKind::Object, &kRoomIdData}}},
+    {4, "leave_room", {{"data", FieldKind::Object, &kRoomIdData}}},
+    {5, "chat_message", {{"data", FieldKind::Object, &kChatData}}},
+    {6, "get_rooms", {{"data", FieldKind::Object, &kEmptyData}}},
+    {7, "get_users", {{"data", FieldKind::Object, &kEmptyData}}},
+    {8, "quick_match", {{"data", FieldKind::Object, &kQuickMatchData}}},
+    {9, "get_room", {{"data", FieldKind::Object, &kRoomIdData}}},
+};
+
+const std::vector<MessageSchema> kServerMessages = {
+    {1, "auth_success", {{"user", FieldKind::Object, &kUserFields}}},
+    {2, "room_created", {{"roomId", FieldKind::String, nullptr}}},
+    {3, "room_joined", {{"roomId", FieldKind::String, nullptr}}},
+    {4, "room_left", {{"roomId", FieldKind::String, nullptr}}},
+    {5, "chat_message", {
+        {"roomId", FieldKind::String, nullptr},
+        {"userId", FieldKind::String, nullptr},
+        {"username", FieldKind::String, nullptr},
+        {"message", FieldKind::String, nullptr},
+    }},
+    {6, "room_update", {
+        {"room", FieldKind::Object, &kRoomFields},
+        {"rooms", FieldKind::ObjectList, &kRoomFields},
+    }},
+    {7, "lobby_delta", {
+        {"updated", FieldKind::ObjectList, &kRoomFields},
+        {"removed", FieldKind::StringList, nullptr},
+    }},
+    {8, "user_update", {{"users", FieldKind::ObjectList, &kUserFields}}},
+    {9, "error", {
+        {"success", FieldKind::Bool, nullptr},
+        {"data", FieldKind::String, nullptr},
+        {"error", FieldKind::String, nullptr},
+    }},
+    {10, "chat_history", {
+        {"roomId", FieldKind::String, nullptr},
+        {"messages", FieldKind::ObjectList, &kChatFields},
+    }},
+    {11, "player_joined", {
+        {"roomId", FieldKind::String, nullptr},
+        {"userId", FieldKind::String, nullptr},
+        {"version", FieldKind::Int, nullptr},
+    }},
+    {12, "player_left", {
+        {"roomId", FieldKind::String, nullptr},
+        {"userId", FieldKind::String, nullptr},
+        {"version", FieldKind::Int, nullptr},
+    }},
+    {13, "status_changed", {
+        {"roomId", FieldKind::String, nullptr},
+        {"status", FieldKind::Int, nullptr},
+        {"version", FieldKind::Int, nullptr},
+    }},
+    {14, "user_delta", {
+        {"updated", FieldKind::ObjectList, &kUserFields},
+        {"removed", FieldKind::StringList, nullptr},
+    }},
+};
+
+const MessageSchema* findByType(const std::vector<MessageSchema>& table, const std::string& type) {
+    for (const auto& schema : table) {
+        if (type == schema.type) {
+            return &schema;
+        }
+    }
+    return nullptr;
+}
+
+const MessageSchema* findByCode(const std::vector<MessageSchema>& table, std::uint8_t code) {
+    // Codes are assigned densely from 1
+    if (code == 0 || code > table.size()) {
+        return nullptr;
+    }
+    return &table[code - 1];
+}
+
+class Writer {
+private:
+    std::string& out;
+
+public:
+    explicit Writer(std::string& buffer) : out(buffer) {}
+
+    void writeVarint(std::uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    void writeString(const Json::Value& value) {
+        const char* begin = nullptr;
+        const char* end = nullptr;
+        if (!value.getString(&begin, &end)) {
+            std::string text = value.asString();
+            writeVarint(text.size());
+            out.append(text);
+            return;
+        }
+        writeVarint(static_cast<std::uint64_t>(end - begin));
+        out.append(begin, end);
+    }
+
+    void writeField(const FieldSchema& field, const Json::Value& value) {
+        switch (field.kind) {
+        case FieldKind::String:
+            writeString(value);
+            break;
+        case FieldKind::Bool:
+            out.push_back(value.asBool() ? 1 : 0);
+            break;
+        case FieldKind::Int: {
+            std::int64_t n = value.asInt64();
+            writeVarint((static_cast<std::uint64_t>(n) << 1) ^ static_cast<std::uint64_t>(n >> 63));
+            break;
+        }
+        case FieldKind::Object:
+            writeObject(*field.fields, value);
+            break;
+        case FieldKind::StringList:
+            writeVarint(value.size());
+            for (const auto& item : value) {
+                writeString(item);
+            }
+            break;
+        case FieldKind::ObjectList:
+            writeVarint(value.size());
+            for (const auto& item : value) {
+                writeObject(*field.fields, item);
+            }
+            break;
+        }
+    }
+
+    void writeObject(const std::vector<FieldSchema>& fields, const Json::Value& object) {
+        std::uint64_t presence = 0;
+        std::vector<const Json::Value*> values(fields.size(), nullptr);
+        if (object.isObject()) {
+            for (std::size_t i = 0; i < fields.size(); ++i) {
+                const char* name = fields[i].name;
+                const Json::Value* value = object.find(name, name + std::char_traits<char>::length(name));
+                if (value && !value->isNull()) {
+                    values[i] = value;
+                    presence |= (std::uint64_t{1} << i);
+                }
+            }
+        }
+        writeVarint(presence);
+        for (std::size_t i = 0; i < fields.size(); ++i) {
+            if (values[i]) {
+                writeField(fields[i], *values[i]);
+            }
+        }
+    }
+};
+
+class Reader {
+private:
+    const unsigned char* pos;
+    const unsigned char* end;
+
+    void require(std::size_t count) const {
+        if (static_cast<std::size_t>(end - pos) < count) {
+            throw std::runtime_error("Truncated binary message");
+        }
+    }
+
+public:
+    Reader(const char* data, std::size_t length)
+        : pos(reinterpret_cast<const unsigned char*>(data)),
+          end(reinterpret_cast<const unsigned char*>(data) + length) {}
+
+    bool atEnd() const { return pos == end; }
+
+    std::uint8_t readByte() {
+        require(1);
+        return *pos++;
+    }
+
+    std::uint64_t readVarint() {
+        std::uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            std::uint8_t byte = readByte();
+            value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        throw std::runtime_error("Malformed varint");
+    }
+
+    Json::Value readString() {
+        std::uint64_t length = readVarint();
+        require(length);
+        const char* begin = reinterpret_cast<const char*>(pos);
+        pos += length;
+        return Json::Value(begin, begin + length);
+    }
+
+    std::uint64_t readCount() {
+        std::uint64_t count = readVarint();
+        // Every list item takes at least one byte
+        require(count);
+        return count;
+    }
+
+    Json::Value readField(const FieldSchema& field) {
+        switch (field.kind) {
+        case FieldKind::String:
+            return readString();
+        case FieldKind::Bool:
+            return Json::Value(readByte() != 0);
+        case FieldKind::Int: {
+            std::uint64_t raw = readVarint();
+            return Json::Value(static_cast<Json::Int64>((raw >> 1) ^ (~(raw & 1) + 1)));
+        }
+        case FieldKind::Object:
+            return readObject(*field.fields);
+        case FieldKind::StringList: {
+            Json::Value list(Json::arrayValue);
+            for (std::uint64_t i = 0, n = readCount(); i < n; ++i) {
+                list.append(readString());
+            }
+            return list;
+        }
+        case FieldKind::ObjectList: {
+            Json::Value list(Json::arrayValue);
+            for (std::uint64_t i = 0, n = readCount(); i < n; ++i) {
+                list.append(readObject(*field.fields));
+            }
+            return list;
+        }
+        }
+        throw std::runtime_error("Unknown field kind");
+    }
+
+    Json::Value readObject(const std::vector<FieldSchema>& fields) {
+        Json::Value object(Json::objectValue);
+        std::uint64_t presence = readVarint();
+        if (fields.size() < 64 && (presence >> fields.size()) != 0) {
+            throw std::runtime_error("Unknown field in binary message");
+        }
+        for (std::size_t i = 0; i < fields.size(); ++i) {
+            if (presence & (std::uint64_t{1} << i)) {
+                object[fields[i].name] = readField(fields[i]);
+            }
+        }
+        return object;
+    }
+};
+
+std::string encode(const std::vector<MessageSchema>& table, const Json::Value& message) {
+    std::string type = message.get("type", "").asString();
+    const MessageSchema* schema = findByType(table, type);
+    if (!schema) {
+        throw std::runtime_error("No binary schema for message type: " + type);
+    }
+
+    std::string out;
+    out.reserve(64);
+    out.push_back(static_cast<char>(schema->code));
+    Writer(out).writeObject(schema->fields, message);
+    return out;
+}
+
+Json::Value decode(const std::vector<MessageSchema>& table, const char* data, std::size_t length) {
+    Reader reader(data, length);
+    const MessageSchema* schema = findByCode(table, reader.readByte());
+    if (!schema) {
+        throw std::runtime_error("Unknown binary message type");
+    }
+
+    Json::Value message = reader.readObject(schema->fields);
+    if (!reader.atEnd()) {
+        throw std::runtime_error("Trailing bytes in binary message");
+    }
+    message["type"] = schema->type;
+    return message;
+}
+
+} // namespace
+
+std::string BinaryCodec::encodeServerMessage(const Json::Value& message) {
+    return encode(kServerMessages, message);
+}
+
+Json::Value BinaryCodec::decodeClientMessage(const char* data, std::size_t length) {
+    return decode(kClientMessages, data, length);
+}
+
+std::string_view BinaryCodec::peekClientMessageType(const char* data, std::size_t length) {
+    const MessageSchema* schema = length > 0 ? findByCode(kClientMessages, static_cast<std::uint8_t>(data[0])) : nullptr;
+    return schema ? std::string_view(schema->type) : std::string_view();
+}
+
+std::string BinaryCodec::encodeClientMessage(const Json::Value& message) {
+    return encode(kClientMessages, message);
+}
+
+Json::Value BinaryCodec::decodeServerMessage(const char* data, std::size_t length) {
+    return decode(kServerMessages, data, length);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <json/json.h>
+
+// Compact binary encoding of the lobby protocol, negotiated with the
+// "lobby.bin.v1" WebSocket subprotocol and sent in binary frames.
+//
+// Every message type has a fixed schema (see binary_codec.cpp), so field names
+// never go on the wire:
+//   message := type-code:u8 object
+//   object  := presence:varint field*        (bit i set => schema field i follows)
+//   string  := length:varint bytes
+//   int     := zigzag varint, bool := u8
+//   list    := count:varint item*
+// Client and server messages use separate code tables. Messages decode to the
+// same Json::Value shape the JSON protocol uses, so handlers see one format.
+class BinaryCodec {
+public:
+    static const char* const kSubprotocol;
+
+    static std::string encodeServerMessage(const Json::Value& message);
+    static Json::Value decodeClientMessage(const char* data, std::size_t length);
+    // Type of a client message from its type code alone, without decoding it;
+    // empty for an unknown code
+    static std::string_view peekClientMessageType(const char* data, std::size_t length);
+
+    // Inverse directions, used by the load generator and tests of the wire format
+    static std::string encodeClientMessage(const Json::Value& message);
+    static Json::Value decodeServerMessage(const char* data, std::size_t length);
+};
@@ -0,0 +1,99 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+// Bounded multi-producer/multi-consumer queue (Vyukov). Each slot carries a
+// sequence number, so push/pop are a single CAS on the head or tail index and
+// never take a lock. Capacity is rounded up to a power of two.
+template <typename T>
+class BoundedQueue {
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    static constexpr std::size_t kCacheLine = 64;
+
+    std::unique_ptr<Cell[]> cells;
+    std::size_t mask;
+    alignas(kCacheLine) std::atomic<std::size_t> enqueuePos;
+    alignas(kCacheLine) std::atomic<std::size_t> dequeuePos;
+
+    static std::size_t roundUpPowerOfTwo(std::size_t value) {
+        std::size_t result = 2;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+public:
+    explicit BoundedQueue(std::size_t capacity)
+        : mask(roundUpPowerOfTwo(capacity) - 1), enqueuePos(0), dequeuePos(0) {
+        if (capacity == 0) {
+            throw std::invalid_argument("BoundedQueue capacity must be positive");
+        }
+        cells.reset(new Cell[mask + 1]);
+        for (std::size_t i = 0; i <= mask; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Returns false when the queue is full
+    bool tryPush(T&& value) {
+        std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false when the queue is empty
+    bool tryPop(T& out) {
+        std::size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    out = std::move(cell.value);
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Approximate number of queued items (exact when producers are idle)
+    std::size_t size() const {
+        std::size_t tail = enqueuePos.load(std::memory_order_relaxed);
+        std::size_t head = dequeuePos.load(std::memory_order_relaxed);
+        return tail >= head ? tail - head : 0;
+    }
+
+    std::size_t capacity() const { return mask + 1; }
+};
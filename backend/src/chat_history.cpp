@@ -0,0 +1,111 @@
+#include "chat_history.hpp"
+#include <json/json.h>
+
+std::size_t ChatHistory::Ring::push(Entry entry, const Options& options) {
+    if (slots.size() != options.maxEntries) {
+        slots.assign(options.maxEntries, nullptr);
+        head = count = bytes = 0;
+    }
+
+    std::size_t dropped = 0;
+    while (count > 0 && (count == slots.size() || bytes + entry->size() > options.maxBytes)) {
+        bytes -= slots[head]->size();
+        slots[head].reset();
+        head = (head + 1) % slots.size();
+        --count;
+        ++dropped;
+    }
+
+    bytes += entry->size();
+    slots[(head + count) % slots.size()] = std::move(entry);
+    ++count;
+    return dropped;
+}
+
+void ChatHistory::Ring::copyTo(std::vector<Entry>& out) const {
+    out.reserve(out.size() + count);
+    for (std::size_t i = 0; i < count; ++i) {
+        out.push_back(slots[(head + i) % slots.size()]);
+    }
+}
+
+ChatHistory::ChatHistory(const Options& opts) : options(opts) {
+    if (options.maxEntries == 0) {
+        options.maxEntries = 1;
+    }
+}
+
+void ChatHistory::addRoom(const std::string& roomId) {
+    rooms.modify(roomId, [&](auto& items) {
+        items.try_emplace(roomId);
+    });
+}
+
+void ChatHistory::removeRoom(const std::string& roomId) {
+    rooms.modify(roomId, [&](auto& items) {
+        items.erase(roomId);
+    });
+}
+
+void ChatHistory::append(const ChatMessage& message) {
+    // Serialize before taking the shard lock
+    Entry entry = std::make_shared<const std::string>(serialize(message));
+    std::size_t dropped = rooms.modify(message.roomId, [&](auto& items) -> std::size_t {
+        auto it = items.find(message.roomId);
+        if (it == items.end()) {
+            return 0;
+        }
+        appended.fetch_add(1, std::memory_order_relaxed);
+        return it->second.push(std::move(entry), options);
+    });
+    evicted.fetch_add(dropped, std::memory_order_relaxed);
+}
+
+void ChatHistory::warm(const std::string& roomId, const std::vector<ChatMessage>& messages) {
+    Ring ring;
+    for (const auto& message : messages) {
+        ring.push(std::make_shared<const std::string>(serialize(message)), options);
+    }
+    rooms.modify(roomId, [&](auto& items) {
+        items.try_emplace(roomId, std::move(ring));
+    });
+}
+
+bool ChatHistory::get(const std::string& roomId, std::vector<Entry>& out) {
+    bool found = rooms.read(roomId, [&](const auto& items) {
+        auto it = items.find(roomId);
+        if (it == items.end()) {
+            return false;
+        }
+        it->second.copyTo(out);
+        return true;
+    });
+    (found ? hits : misses).fetch_add(1, std::memory_order_relaxed);
+    return found;
+}
+
+ChatHistoryStats ChatHistory::getStats() const {
+    ChatHistoryStats stats;
+    stats.hits = hits.load(std::memory_order_relaxed);
+    stats.misses = misses.load(std::memory_order_relaxed);
+    stats.appended = appended.load(std::memory_order_relaxed);
+    stats.evicted = evicted.load(std::memory_order_relaxed);
+    return stats;
+}
+
+std::string ChatHistory::serialize(const ChatMessage& message) {
+    Json::Value entry;
+    entry["roomId"] = message.roomId;
+    entry["userId"] = message.userId;
+    entry["username"] = message.username;
+    entry["message"] = message.message;
+    entry["timestamp"] = static_cast<Json::Int64>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        message.timestamp.time_since_epoch()).count());
+
+    static const Json::StreamWriterBuilder compactWriter = []() {
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        return builder;
+    }();
+    return Json::writeString(compactWriter, entry);
+}
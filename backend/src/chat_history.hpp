@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "chat_message.hpp"
+#include "sharded_map.hpp"
+
+struct ChatHistoryStats {
+    std::uint64_t hits = 0;       // History requests served from memory
+    std::uint64_t misses = 0;     // Requests for rooms without a ring
+    std::uint64_t appended = 0;
+    std::uint64_t evicted = 0;    // Entries dropped to stay within the caps
+};
+
+// Recent chat for each live room in a fixed-capacity ring. Entries are stored
+// as compact JSON objects, serialized once on append, so history is sent on
+// join without a database read or re-encoding. Each ring is capped both by
+// entry count and by total payload bytes.
+class ChatHistory {
+public:
+    struct Options {
+        std::size_t maxEntries = 50;
+        std::size_t maxBytes = 32 * 1024;
+    };
+
+    using Entry = std::shared_ptr<const std::string>;
+
+private:
+    class Ring {
+    private:
+        std::vector<Entry> slots;
+        std::size_t head = 0;    // Oldest entry
+        std::size_t count = 0;
+        std::size_t bytes = 0;
+
+    public:
+        // Returns how many old entries were evicted to make room
+        std::size_t push(Entry entry, const Options& options);
+        void copyTo(std::vector<Entry>& out) const;
+    };
+
+    Options options;
+    ShardedMap<Ring> rooms;
+
+    std::atomic<std::uint64_t> hits{0};
+    std::atomic<std::uint64_t> misses{0};
+    std::atomic<std::uint64_t> appended{0};
+    std::atomic<std::uint64_t> evicted{0};
+
+public:
+    explicit ChatHistory(const Options& opts);
+    ChatHistory() : ChatHistory(Options()) {}
+
+    const Options& getOptions() const { return options; }
+
+    // Starts an empty ring for a new room
+    void addRoom(const std::string& roomId);
+    void removeRoom(const std::string& roomId);
+
+    // Appends to the room's ring; messages for rooms without a ring are dropped
+    void append(const ChatMessage& message);
+
+    // Seeds a ring from messages loaded elsewhere (oldest first). A ring that
+    // already exists is kept, since it may hold messages newer than the load.
+    void warm(const std::string& roomId, const std::vector<ChatMessage>& messages);
+
+    // Fills out with the room's entries, oldest first. Returns false (a miss)
+    // when the room has no ring.
+    bool get(const std::string& roomId, std::vector<Entry>& out);
+
+    ChatHistoryStats getStats() const;
+
+    static std::string serialize(const ChatMessage& message);
+};
@@ -0,0 +1,17 @@
+#pragma once
+#include <string>
+#include <chrono>
+
+struct ChatMessage {
+    std::string roomId;
+    std::string userId;
+    std::string username;
+    std::string message;
+    std::chrono::system_clock::time_point timestamp;
+
+    ChatMessage() {}
+    ChatMessage(const std::string& room, const std::string& user,
+                const std::string& name, const std::string& text)
+        : roomId(room), userId(user), username(name), message(text),
+          timestamp(std::chrono::system_clock::now()) {}
+};
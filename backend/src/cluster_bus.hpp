@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+
+struct ClusterBusStats {
+    std::uint64_t sent = 0;
+    std::uint64_t received = 0;
+    std::uint64_t dropped = 0;    // Sends that could not be handed to the transport
+};
+
+// Transport between the nodes of a cluster. Messages are opaque payloads
+// addressed by node id; delivery is best effort and each sender's messages
+// arrive in order. Implementations choose how nodes find each other from the
+// CLUSTER_BUS URI.
+class ClusterBus {
+public:
+    using Handler = std::function<void(std::uint16_t from, const std::string& payload)>;
+
+    virtual ~ClusterBus() = default;
+
+    // Delivers incoming messages to handler, one at a time on the bus's own
+    // thread, until stop()
+    virtual bool start(Handler handler) = 0;
+    virtual void stop() = 0;
+
+    // Never blocks; false when the message was dropped (peer down, backed up
+    // or the payload is over maxMessageBytes())
+    virtual bool send(std::uint16_t node, const std::string& payload) = 0;
+    virtual std::size_t maxMessageBytes() const = 0;
+    virtual ClusterBusStats getStats() const = 0;
+};
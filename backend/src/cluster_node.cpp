@@ -0,0 +1,419 @@
+#include "cluster_node.hpp"
+#include "logger.hpp"
+#include <algorithm>
+
+namespace {
+
+std::string writeCompact(const Json::Value& value) {
+    static const Json::StreamWriterBuilder compactWriter = []() {
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        return builder;
+    }();
+    return Json::writeString(compactWriter, value);
+}
+
+std::int64_t toMillis(std::chrono::system_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+}
+
+// Room list items of one summary message, written out once the message is full
+class SummaryWriter {
+public:
+    SummaryWriter(std::size_t maxBytes, bool full) : limit(maxBytes), isFull(full) {}
+
+    // Returns a finished message when item did not fit in the current one
+    bool add(const std::string& item, std::string& finished) {
+        bool flushed = false;
+        if (!items.empty() && size + item.size() + kEnvelopeBytes > limit) {
+            finished = take(false);
+            flushed = true;
+        }
+        size += item.size() + 1;
+        items.push_back(item);
+        return flushed;
+    }
+
+    std::string finish(const std::string& removed) {
+        return take(true, removed);
+    }
+
+private:
+    static constexpr std::size_t kEnvelopeBytes = 96;
+
+    std::size_t limit;
+    bool isFull;
+    bool first = true;
+    std::size_t size = 0;
+    std::vector<std::string> items;
+
+    std::string take(bool last, const std::string& removed = "[]") {
+        std::string message = "{\"type\":\"summary\",\"full\":";
+        message += isFull ? "true" : "false";
+        message += ",\"first\":";
+        message += first ? "true" : "false";
+        message += ",\"last\":";
+        message += last ? "true" : "false";
+        message += ",\"removed\":";
+        message += removed;
+        message += ",\"rooms\":[";
+        for (std::size_t i = 0; i < items.size(); ++i) {
+            if (i > 0) {
+                message += ',';
+            }
+            message += items[i];
+        }
+        message += "]}";
+        first = false;
+        size = 0;
+        items.clear();
+        return message;
+    }
+};
+
+} // namespace
+
+bool RemoteRooms::update(const Room& room, std::uint16_t owner) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto now = std::chrono::steady_clock::now();
+    auto it = rooms.find(room.id);
+    if (it == rooms.end()) {
+        rooms.emplace(room.id, Entry{room, owner, now});
+        return true;
+    }
+    if (it->second.room.version >= room.version) {
+        // Still current as far as the owner knows, or the message is stale
+        if (it->second.room.version == room.version) {
+            it->second.seen = now;
+        }
+        return false;
+    }
+    it->second = Entry{room, owner, now};
+    return true;
+}
+
+bool RemoteRooms::remove(const std::string& roomId) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    return rooms.erase(roomId) > 0;
+}
+
+Room RemoteRooms::get(const std::string& roomId) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = rooms.find(roomId);
+    return it != rooms.end() ? it->second.room : Room();
+}
+
+std::vector<Room> RemoteRooms::all() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    std::vector<Room> result;
+    result.reserve(rooms.size());
+    for (const auto& [roomId, entry] : rooms) {
+        result.push_back(entry.room);
+    }
+    return result;
+}
+
+std::size_t RemoteRooms::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return rooms.size();
+}
+
+void RemoteRooms::beginSync(std::uint16_t owner) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    syncStarted[owner] = std::chrono::steady_clock::now();
+}
+
+std::vector<std::string> RemoteRooms::endSync(std::uint16_t owner) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    std::vector<std::string> dropped;
+    auto started = syncStarted.find(owner);
+    if (started == syncStarted.end()) {
+        return dropped;
+    }
+    // Anything the owner reported during the sync, by summary or event, was refreshed after it began
+    for (auto it = rooms.begin(); it != rooms.end();) {
+        if (it->second.owner == owner && it->second.seen < started->second) {
+            dropped.push_back(it->first);
+            it = rooms.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    syncStarted.erase(started);
+    return dropped;
+}
+
+ClusterNode::ClusterNode(const Options& opts, std::unique_ptr<ClusterBus> transport)
+    : options(opts), ring(opts.nodes), bus(std::move(transport)) {}
+
+ClusterNode::~ClusterNode() {
+    stop();
+}
+
+bool ClusterNode::start(Handler messageHandler) {
+    handler = std::move(messageHandler);
+    return bus->start([this](std::uint16_t from, const std::string& payload) { onBusMessage(from, payload); });
+}
+
+void ClusterNode::stop() {
+    bus->stop();
+}
+
+void ClusterNode::onBusMessage(std::uint16_t from, const std::string& payload) {
+    thread_local std::unique_ptr<Json::CharReader> reader = []() {
+        Json::CharReaderBuilder builder;
+        return std::unique_ptr<Json::CharReader>(builder.newCharReader());
+    }();
+    Json::Value message;
+    std::string errors;
+    if (!reader->parse(payload.data(), payload.data() + payload.size(), &message, &errors) || !message.isObject()) {
+        LOG_WARN << "Ignoring malformed cluster message from node " << from;
+        return;
+    }
+
+    if (message["type"].asString() != "reply") {
+        handler(from, message);
+        return;
+    }
+    ReplyCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        auto it = pending.find(message["id"].asUInt64());
+        if (it == pending.end()) {
+            return;   // Already timed out
+        }
+        callback = std::move(it->second.callback);
+        pending.erase(it);
+    }
+    callback(true, message);
+}
+
+void ClusterNode::sendPayload(std::uint16_t node, const std::string& payload) {
+    // Drops are counted by the bus; a peer that is down would flood the log
+    bus->send(node, payload);
+}
+
+void ClusterNode::send(std::uint16_t node, const Json::Value& message) {
+    sendPayload(node, writeCompact(message));
+}
+
+void ClusterNode::broadcast(const Json::Value& message) {
+    std::string payload = writeCompact(message);
+    for (std::uint16_t node : options.nodes) {
+        if (node != options.self) {
+            sendPayload(node, payload);
+        }
+    }
+}
+
+void ClusterNode::request(std::uint16_t node, Json::Value message, ReplyCallback callback) {
+    std::uint64_t id = nextRequestId.fetch_add(1, std::memory_order_relaxed);
+    message["id"] = static_cast<Json::UInt64>(id);
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        pending[id] = PendingRequest{std::move(callback),
+                                     std::chrono::steady_clock::now() + options.requestTimeout};
+    }
+    // A dropped request fails when it times out, like a lost reply
+    send(node, message);
+}
+
+void ClusterNode::reply(std::uint16_t node, const Json::Value& request, Json::Value response) {
+    response["type"] = "reply";
+    response["id"] = request["id"];
+    send(node, response);
+}
+
+void ClusterNode::expireRequests() {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<ReplyCallback> expired;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (it->second.deadline <= now) {
+                expired.push_back(std::move(it->second.callback));
+                it = pending.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    requestsFailed.fetch_add(expired.size(), std::memory_order_relaxed);
+    for (auto& callback : expired) {
+        callback(false, Json::Value());
+    }
+}
+
+void ClusterNode::setMemberHome(const std::string& userId, std::uint16_t node) {
+    std::lock_guard<std::mutex> lock(homesMutex);
+    memberHomes[userId] = node;
+}
+
+void ClusterNode::forgetMember(const std::string& userId) {
+    std::lock_guard<std::mutex> lock(homesMutex);
+    memberHomes.erase(userId);
+}
+
+std::vector<std::uint16_t> ClusterNode::homesOf(const Room& room, const std::string& extraUser) const {
+    std::vector<std::uint16_t> homes;
+    auto addHome = [&](const std::string& userId) {
+        auto it = memberHomes.find(userId);
+        if (it != memberHomes.end() && std::find(homes.begin(), homes.end(), it->second) == homes.end()) {
+            homes.push_back(it->second);
+        }
+    };
+    std::lock_guard<std::mutex> lock(homesMutex);
+    for (const auto& player : room.players) {
+        addHome(player.str());
+    }
+    if (!extraUser.empty()) {
+        addHome(extraUser);
+    }
+    return homes;
+}
+
+void ClusterNode::forwardRoomEvent(const RoomEvent& event) {
+    markChanged(event.roomId);
+    std::vector<std::uint16_t> homes = homesOf(event.room, event.userId);
+    if (homes.empty()) {
+        return;
+    }
+    Json::Value message;
+    message["type"] = "room_event";
+    message["event"] = encodeEvent(event);
+    std::string payload = writeCompact(message);
+    for (std::uint16_t node : homes) {
+        sendPayload(node, payload);
+    }
+}
+
+void ClusterNode::noteOwnerContacted(const std::string& userId, std::uint16_t node) {
+    std::lock_guard<std::mutex> lock(ownersMutex);
+    contactedOwners[userId].insert(node);
+}
+
+std::vector<std::uint16_t> ClusterNode::takeContactedOwners(const std::string& userId) {
+    std::lock_guard<std::mutex> lock(ownersMutex);
+    std::vector<std::uint16_t> owners;
+    auto it = contactedOwners.find(userId);
+    if (it != contactedOwners.end()) {
+        owners.assign(it->second.begin(), it->second.end());
+        contactedOwners.erase(it);
+    }
+    return owners;
+}
+
+void ClusterNode::markChanged(const std::string& roomId) {
+    std::lock_guard<std::mutex> lock(changedMutex);
+    changedRooms.insert(roomId);
+}
+
+std::vector<std::string> ClusterNode::takeChanged() {
+    std::unordered_set<std::string> taken;
+    {
+        std::lock_guard<std::mutex> lock(changedMutex);
+        taken.swap(changedRooms);
+    }
+    return std::vector<std::string>(taken.begin(), taken.end());
+}
+
+void ClusterNode::publishSummary(const std::vector<Room>& rooms, const std::vector<std::string>& removed,
+                                 bool full, std::uint16_t target) {
+    auto deliver = [&](const std::string& payload) {
+        if (target != kEveryPeer) {
+            sendPayload(target, payload);
+            return;
+        }
+        for (std::uint16_t node : options.nodes) {
+            if (node != options.self) {
+                sendPayload(node, payload);
+            }
+        }
+    };
+
+    Json::Value removedIds(Json::arrayValue);
+    for (const auto& roomId : removed) {
+        removedIds.append(roomId);
+    }
+    // Removals ride on the last message; a removal list too big for one
+    // message is left to the next full summary
+    std::string removedJson = writeCompact(removedIds);
+    if (removedJson.size() > bus->maxMessageBytes() / 2) {
+        removedJson = "[]";
+    }
+
+    std::lock_guard<std::mutex> lock(summaryMutex);
+    SummaryWriter writer(bus->maxMessageBytes() - removedJson.size(), full);
+    std::string finished;
+    for (const auto& room : rooms) {
+        if (writer.add(writeCompact(encodeRoom(room)), finished)) {
+            deliver(finished);
+        }
+    }
+    deliver(writer.finish(removedJson));
+}
+
+ClusterStats ClusterNode::getStats() const {
+    ClusterStats stats;
+    stats.bus = bus->getStats();
+    stats.requestsFailed = requestsFailed.load(std::memory_order_relaxed);
+    stats.remoteRooms = remote.size();
+    return stats;
+}
+
+Json::Value ClusterNode::encodeRoom(const Room& room) {
+    Json::Value value;
+    value["id"] = room.id;
+    value["name"] = room.name;
+    value["gameType"] = room.gameType;
+    value["createdBy"] = room.createdBy.str();
+    value["createdAt"] = static_cast<Json::Int64>(toMillis(room.createdAt));
+    value["maxPlayers"] = room.maxPlayers;
+    value["status"] = static_cast<int>(room.status);
+    value["version"] = static_cast<Json::UInt64>(room.version);
+    value["players"] = Json::Value(Json::arrayValue);
+    for (const auto& player : room.players) {
+        value["players"].append(player.str());
+    }
+    return value;
+}
+
+Room ClusterNode::decodeRoom(const Json::Value& value) {
+    Room room;
+    room.id = value["id"].asString();
+    room.name = value["name"].asString();
+    room.gameType = value["gameType"].asString();
+    room.createdBy = InternedId(value["createdBy"].asString());
+    room.createdAt = std::chrono::system_clock::time_point(std::chrono::milliseconds(value["createdAt"].asInt64()));
+    // Peers send clamped rooms; a peer built with a smaller capacity cannot
+    room.maxPlayers = Room::clampMaxPlayers(value["maxPlayers"].asInt());
+    room.status = static_cast<RoomStatus>(value["status"].asInt());
+    room.version = value["version"].asUInt64();
+    for (const auto& player : value["players"]) {
+        if (!room.players.add(player.asString())) {
+            LOG_WARN << "Room " << room.id << " from a peer has more than " << PlayerList::kCapacity << " players";
+            break;
+        }
+    }
+    return room;
+}
+
+Json::Value ClusterNode::encodeEvent(const RoomEvent& event) {
+    Json::Value value;
+    value["type"] = static_cast<int>(event.type);
+    value["roomId"] = event.roomId;
+    value["userId"] = event.userId;
+    if (event.type != RoomEvent::Type::Deleted) {
+        value["room"] = encodeRoom(event.room);
+    }
+    return value;
+}
+
+RoomEvent ClusterNode::decodeEvent(const Json::Value& value) {
+    RoomEvent event{static_cast<RoomEvent::Type>(value["type"].asInt()), value["roomId"].asString(),
+                    value["userId"].asString(), Room()};
+    if (value.isMember("room")) {
+        event.room = decodeRoom(value["room"]);
+    }
+    return event;
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <json/json.h>
+#include "cluster_bus.hpp"
+#include "hash_ring.hpp"
+#include "room_manager.hpp"
+
+struct ClusterStats {
+    ClusterBusStats bus;
+    std::uint64_t requestsFailed = 0;   // Forwarded requests that timed out
+    std::size_t remoteRooms = 0;
+};
+
+// Rooms owned by other nodes, as last reported by their owners through room
+// events and lobby summaries. Serves lobby listings and room lookups for
+// rooms this node does not hold.
+class RemoteRooms {
+private:
+    struct Entry {
+        Room room;
+        std::uint16_t owner;
+        std::chrono::steady_clock::time_point seen;
+    };
+
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, Entry> rooms;
+    std::unordered_map<std::uint16_t, std::chrono::steady_clock::time_point> syncStarted;
+
+public:
+    // True when the room is new or newer than the stored copy
+    bool update(const Room& room, std::uint16_t owner);
+    bool remove(const std::string& roomId);
+    // Empty room when unknown
+    Room get(const std::string& roomId) const;
+    std::vector<Room> all() const;
+    std::size_t size() const;
+
+    // A full summary from owner arrives between these; rooms of owner it did
+    // not mention are dropped, and their ids returned
+    void beginSync(std::uint16_t owner);
+    std::vector<std::string> endSync(std::uint16_t owner);
+};
+
+// This process's view of the cluster. Rooms belong to the node the hash ring
+// assigns their id to; users belong to the node they are connected to (their
+// home). Requests for rooms owned elsewhere are forwarded to the owner, which
+// sends each room event and chat message to the home nodes of the room's
+// players, and every node periodically tells the others what changed in its
+// rooms so lobby listings span the cluster.
+//
+// Messages are JSON objects with a "type" field. Requests carry an "id" that
+// the owner echoes in a "reply"; a request without a reply within
+// requestTimeout fails.
+class ClusterNode {
+public:
+    struct Options {
+        std::uint16_t self = 0;
+        std::vector<std::uint16_t> nodes;       // Every node, self included
+        std::chrono::milliseconds requestTimeout{2000};
+    };
+
+    using Handler = std::function<void(std::uint16_t from, const Json::Value& message)>;
+    using ReplyCallback = std::function<void(bool ok, const Json::Value& reply)>;
+
+private:
+    struct PendingRequest {
+        ReplyCallback callback;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    Options options;
+    HashRing ring;
+    std::unique_ptr<ClusterBus> bus;
+    Handler handler;
+
+    std::mutex pendingMutex;
+    std::unordered_map<std::uint64_t, PendingRequest> pending;
+    std::atomic<std::uint64_t> nextRequestId{1};
+    std::atomic<std::uint64_t> requestsFailed{0};
+
+    // Owner side: the home node of each remote player in this node's rooms
+    mutable std::mutex homesMutex;
+    std::unordered_map<std::string, std::uint16_t> memberHomes;
+
+    // Home side: nodes each local user has joined rooms on, told when the user goes
+    std::mutex ownersMutex;
+    std::unordered_map<std::string, std::unordered_set<std::uint16_t>> contactedOwners;
+
+    // This node's rooms changed since the last summary
+    std::mutex changedMutex;
+    std::unordered_set<std::string> changedRooms;
+    // Summaries go out one at a time, so a peer never sees two full syncs interleaved
+    std::mutex summaryMutex;
+
+    RemoteRooms remote;
+
+    void onBusMessage(std::uint16_t from, const std::string& payload);
+    void sendPayload(std::uint16_t node, const std::string& payload);
+
+public:
+    ClusterNode(const Options& opts, std::unique_ptr<ClusterBus> transport);
+    ~ClusterNode();
+
+    // handler receives every message except replies, on the bus thread
+    bool start(Handler messageHandler);
+    void stop();
+
+    std::uint16_t self() const { return options.self; }
+    const std::vector<std::uint16_t>& nodes() const { return options.nodes; }
+    std::uint16_t ownerOf(const std::string& roomId) const { return ring.ownerOf(roomId); }
+    bool owns(const std::string& roomId) const { return ring.ownerOf(roomId) == options.self; }
+
+    void send(std::uint16_t node, const Json::Value& message);
+    // Every node but this one
+    void broadcast(const Json::Value& message);
+    // callback runs on the bus thread with the reply, or with ok == false
+    // from expireRequests() once the request times out
+    void request(std::uint16_t node, Json::Value message, ReplyCallback callback);
+    void reply(std::uint16_t node, const Json::Value& request, Json::Value response);
+    void expireRequests();
+
+    // Owner side
+    void setMemberHome(const std::string& userId, std::uint16_t node);
+    void forgetMember(const std::string& userId);
+    // Remote nodes hosting the room's players or extraUser
+    std::vector<std::uint16_t> homesOf(const Room& room, const std::string& extraUser) const;
+    void forwardRoomEvent(const RoomEvent& event);
+
+    // Home side
+    void noteOwnerContacted(const std::string& userId, std::uint16_t node);
+    std::vector<std::uint16_t> takeContactedOwners(const std::string& userId);
+
+    // Lobby summaries. Changed rooms are sent to every peer each tick; a full
+    // summary resends all of them so peers converge after lost messages or a
+    // restart.
+    static constexpr std::uint16_t kEveryPeer = 0xFFFF;   // Beyond any node id
+    void markChanged(const std::string& roomId);
+    std::vector<std::string> takeChanged();
+    void publishSummary(const std::vector<Room>& rooms, const std::vector<std::string>& removed,
+                        bool full, std::uint16_t target = kEveryPeer);
+
+    RemoteRooms& remoteRooms() { return remote; }
+    ClusterStats getStats() const;
+
+    static Json::Value encodeRoom(const Room& room);
+    static Room decodeRoom(const Json::Value& value);
+    static Json::Value encodeEvent(const RoomEvent& event);
+    static RoomEvent decodeEvent(const Json::Value& value);
+};
@@ -0,0 +1,114 @@
+#include "compression.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <zlib.h>
+
+namespace {
+
+std::string trim(const std::string& text, std::size_t begin, std::size_t end) {
+    while (begin < end && std::isspace(static_cast<unsigned char>(text[begin]))) {
+        ++begin;
+    }
+    while (end > begin && std::isspace(static_cast<unsigned char>(text[end - 1]))) {
+        --end;
+    }
+    return text.substr(begin, end - begin);
+}
+
+// A zlib stream per thread, reset for each message: setting one up allocates
+// a few hundred KB, far more work than compressing a lobby message
+struct ThreadDeflater {
+    z_stream stream{};
+    int level = 0;
+    int windowBits = 0;
+    bool ready = false;
+
+    ~ThreadDeflater() {
+        if (ready) {
+            deflateEnd(&stream);
+        }
+    }
+
+    z_stream* acquire(int wantedLevel, int wantedWindowBits) {
+        if (ready && (level != wantedLevel || windowBits != wantedWindowBits)) {
+            deflateEnd(&stream);
+            ready = false;
+        }
+        if (ready) {
+            return deflateReset(&stream) == Z_OK ? &stream : nullptr;
+        }
+        stream = z_stream{};
+        // Negative window bits: raw DEFLATE, no zlib header or checksum
+        if (deflateInit2(&stream, wantedLevel, Z_DEFLATED, -wantedWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return nullptr;
+        }
+        ready = true;
+        level = wantedLevel;
+        windowBits = wantedWindowBits;
+        return &stream;
+    }
+};
+
+} // namespace
+
+DeflateNegotiation DeflateNegotiation::fromResponse(const std::string& extensions) {
+    // e.g. "permessage-deflate; server_no_context_takeover; client_max_window_bits=10"
+    DeflateNegotiation negotiation;
+    std::size_t extensionEnd = extensions.find(',');
+    if (extensionEnd == std::string::npos) {
+        extensionEnd = extensions.size();
+    }
+    std::size_t start = 0;
+    while (start <= extensionEnd) {
+        std::size_t end = std::min(extensions.find(';', start), extensionEnd);
+        std::string parameter = trim(extensions, start, end);
+        if (start == 0) {
+            if (parameter != "permessage-deflate") {
+                return negotiation;
+            }
+            negotiation.enabled = true;
+        } else if (parameter == "server_no_context_takeover") {
+            negotiation.serverContextTakeover = false;
+        } else if (parameter.compare(0, 23, "server_max_window_bits=") == 0) {
+            int bits = std::atoi(parameter.c_str() + 23);
+            if (bits >= 8 && bits <= 15) {
+                negotiation.serverWindowBits = bits;
+            }
+        }
+        start = end + 1;
+    }
+    return negotiation;
+}
+
+MessageDeflater::MessageDeflater(const CompressionOptions& options)
+    : level(std::max(0, std::min(9, options.level))),
+      // zlib cannot compress with an 8-bit window
+      windowBits(std::max(9, std::min(15, options.serverWindowBits))) {}
+
+bool MessageDeflater::deflate(const std::string& payload, std::string& out) const {
+    thread_local ThreadDeflater local;
+    z_stream* stream = local.acquire(level, windowBits);
+    if (!stream) {
+        return false;
+    }
+
+    // Room for the sync flush markers on top of the worst case
+    out.resize(deflateBound(stream, static_cast<uLong>(payload.size())) + 16);
+    stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(payload.data()));
+    stream->avail_in = static_cast<uInt>(payload.size());
+    stream->next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream->avail_out = static_cast<uInt>(out.size());
+    if (::deflate(stream, Z_SYNC_FLUSH) != Z_OK || stream->avail_in != 0 || stream->avail_out == 0) {
+        return false;
+    }
+
+    // The sync flush ends in an empty stored block, 00 00 ff ff, which the
+    // receiver adds back (RFC 7692 section 7.2.1)
+    std::size_t size = out.size() - stream->avail_out;
+    if (size < 4) {
+        return false;
+    }
+    out.resize(size - 4);
+    return true;
+}
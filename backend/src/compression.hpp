@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// permessage-deflate (RFC 7692) settings. Window bits are the base-2 log of
+// the LZ77 window (9-15). With server context takeover off, every outgoing
+// message is compressed on its own, which costs some ratio but lets one
+// compressed fan-out frame go to every recipient.
+struct CompressionOptions {
+    bool enabled = true;
+    std::size_t minBytes = 256;         // Smaller messages are sent uncompressed
+    int level = 6;                      // zlib level for frames shared by a fan-out
+    int serverWindowBits = 15;
+    int clientWindowBits = 15;
+    bool serverContextTakeover = false;
+    bool clientContextTakeover = true;
+};
+
+// The terms a handshake settled on, read back from the
+// Sec-WebSocket-Extensions response header
+struct DeflateNegotiation {
+    bool enabled = false;
+    bool serverContextTakeover = true;
+    int serverWindowBits = 15;
+
+    static DeflateNegotiation fromResponse(const std::string& extensions);
+};
+
+// Compresses one message into a standalone permessage-deflate payload (raw
+// DEFLATE, sync-flushed, trailing 00 00 ff ff removed). The payload never
+// refers to earlier messages, so it is valid on every connection that
+// negotiated the extension without server context takeover and with a
+// server window of at least windowBits.
+class MessageDeflater {
+public:
+    explicit MessageDeflater(const CompressionOptions& options);
+
+    // False if zlib fails
+    bool deflate(const std::string& payload, std::string& out) const;
+
+    int getWindowBits() const { return windowBits; }
+
+private:
+    int level;
+    int windowBits;
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include <websocketpp/common/connection_hdl.hpp>
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "admission_control.hpp"
+#include "outbound_queue.hpp"
+#include "rate_limiter.hpp"
+
+enum class WireProtocol {
+    Json,    // Text frames, the default
+    Binary   // BinaryCodec frames, negotiated via subprotocol
+};
+
+// How fan-out frames are compressed for a connection (permessage-deflate)
+enum class FrameCompression {
+    None,           // Not negotiated
+    Shared,         // Takes the frames a fan-out compresses once for everyone
+    PerConnection   // Server context takeover or a small window: compressed per connection
+};
+
+// Per-connection session data shared by the connection and user lookup maps
+struct ConnectionState {
+    websocketpp::connection_hdl hdl;
+    std::string userId;      // Empty until authenticated; guarded by connectionsMutex
+    WireProtocol protocol;
+    FrameCompression compression = FrameCompression::None;   // Set before the state is shared
+
+    // Every frame for this connection goes through here, in send order
+    OutboundQueue<websocketpp::config::asio::message_type::ptr> outbox;
+    std::atomic<bool> evicted{false};   // Set once when closed as a slow consumer
+
+    // Liveness, in steady_clock ticks. Handlers only store the time; the
+    // timeout sweep reads it when the connection's timer comes due.
+    std::atomic<std::int64_t> lastReceived;   // Any frame, pings and pongs included
+    std::atomic<std::int64_t> lastMessage;    // Lobby messages only
+    std::int64_t pingSent = 0;                // Owned by the timeout sweep; 0 when no ping is outstanding
+    std::atomic<bool> closed{false};          // Set by cleanup so the sweep stops re-arming
+
+    // Message rate limits. Only the message handler touches these, and
+    // websocketpp runs one connection's handlers one at a time.
+    std::array<TokenBucket, kRateClasses> rateBuckets;
+    std::shared_ptr<AdmissionControl::Address> address;   // Null for peers exempt from per-address limits
+    std::uint32_t refusedInRow = 0;
+
+    ConnectionState(websocketpp::connection_hdl handle, WireProtocol wireProtocol)
+        : hdl(handle), protocol(wireProtocol),
+          lastReceived(std::chrono::steady_clock::now().time_since_epoch().count()),
+          lastMessage(lastReceived.load()) {}
+};
@@ -1,52 +1,432 @@
 #include "database_manager.hpp"
-#include <iostream>
+#include "logger.hpp"
+#include "persistence_queue.hpp"
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/builder/stream/array.hpp>
 #include <bsoncxx/builder/stream/document.hpp>
 #include <bsoncxx/json.hpp>
+#include <bsoncxx/types.hpp>
+#include <mongocxx/bulk_write.hpp>
 #include <mongocxx/exception/exception.hpp>
+#include <mongocxx/instance.hpp>
+#include <mongocxx/model/delete_one.hpp>
+#include <mongocxx/model/insert_one.hpp>
+#include <mongocxx/model/replace_one.hpp>
+#include <mongocxx/model/update_one.hpp>
+#include <mongocxx/options/bulk_write.hpp>
+#include <mongocxx/options/find.hpp>
+#include <mongocxx/options/update.hpp>
+#include <algorithm>
+#include <unordered_map>
 
+using bsoncxx::builder::stream::close_document;
 using bsoncxx::builder::stream::document;
 using bsoncxx::builder::stream::finalize;
+using bsoncxx::builder::stream::open_document;
 
-DatabaseManager::DatabaseManager(const std::string& connectionString) {
+namespace {
+
+bsoncxx::document::value userDocument(const User& user) {
+    return document{}
+        << "id" << user.id.str()
+        << "username" << user.username
+        << "currentRoom" << user.currentRoom.str()
+        << "isOnline" << user.isOnline
+        << "lastActivity" << bsoncxx::types::b_date{user.lastActivity}
+        << "homeNode" << user.homeNode
+        << "updatedAt" << bsoncxx::types::b_date{std::chrono::system_clock::now()}
+        << finalize;
+}
+
+bsoncxx::document::value roomDocument(const Room& room) {
+    bsoncxx::builder::stream::array players;
+    for (const auto& playerId : room.players) {
+        players << playerId.str();
+    }
+
+    return document{}
+        << "id" << room.id
+        << "name" << room.name
+        << "gameType" << room.gameType
+        << "players" << bsoncxx::types::b_array{players.view()}
+        << "createdBy" << room.createdBy.str()
+        << "maxPlayers" << room.maxPlayers
+        << "status" << static_cast<int>(room.status)
+        << "createdAt" << bsoncxx::types::b_date{room.createdAt}
+        << "version" << static_cast<std::int64_t>(room.version)
+        << "updatedAt" << bsoncxx::types::b_date{std::chrono::system_clock::now()}
+        << finalize;
+}
+
+std::string stringField(const bsoncxx::document::view& view, const char* key) {
+    auto element = view[key];
+    return (element && element.type() == bsoncxx::type::k_utf8) ? element.get_utf8().value.to_string()
+                                                                : std::string();
+}
+
+std::int64_t integerField(const bsoncxx::document::view& view, const char* key, std::int64_t fallback) {
+    auto element = view[key];
+    if (element && element.type() == bsoncxx::type::k_int32) {
+        return element.get_int32().value;
+    }
+    if (element && element.type() == bsoncxx::type::k_int64) {
+        return element.get_int64().value;
+    }
+    return fallback;
+}
+
+std::chrono::system_clock::time_point dateField(const bsoncxx::document::view& view, const char* key) {
+    auto element = view[key];
+    return (element && element.type() == bsoncxx::type::k_date) ? std::chrono::system_clock::time_point(
+        element.get_date().value) : std::chrono::system_clock::time_point();
+}
+
+User userFromDocument(const bsoncxx::document::view& view) {
+    User user;
+    user.id = InternedId(stringField(view, "id"));
+    user.username = stringField(view, "username");
+    user.currentRoom = InternedId(stringField(view, "currentRoom"));
+    auto online = view["isOnline"];
+    user.isOnline = online && online.type() == bsoncxx::type::k_bool && online.get_bool().value;
+    user.lastActivity = dateField(view, "lastActivity");
+    user.homeNode = static_cast<int>(integerField(view, "homeNode", -1));
+    return user;
+}
+
+Room roomFromDocument(const bsoncxx::document::view& view) {
+    Room room;
+    room.id = stringField(view, "id");
+    room.name = stringField(view, "name");
+    room.gameType = stringField(view, "gameType");
+    room.createdBy = InternedId(stringField(view, "createdBy"));
+    int storedMax = static_cast<int>(integerField(view, "maxPlayers", room.maxPlayers));
+    room.maxPlayers = Room::clampMaxPlayers(storedMax);
+    room.status = static_cast<RoomStatus>(integerField(view, "status", 0));
+    room.createdAt = dateField(view, "createdAt");
+    room.version = static_cast<std::uint64_t>(integerField(view, "version", 1));
+    std::size_t overflow = 0;
+    auto players = view["players"];
+    if (players && players.type() == bsoncxx::type::k_array) {
+        for (const auto& player : players.get_array().value) {
+            if (player.type() == bsoncxx::type::k_utf8 && !room.players.add(player.get_utf8().value.to_string())) {
+                ++overflow;
+            }
+        }
+    }
+    if (storedMax != room.maxPlayers || overflow > 0) {
+        LOG_WARN << "Room " << room.id << " is stored with maxPlayers " << storedMax << "; loaded with "
+                 << room.maxPlayers << (overflow > 0 ? " and without its last " + std::to_string(overflow) +
+                 " players" : std::string());
+    }
+    return room;
+}
+
+// {id: {$gte: from, $lt: to}, updatedAt: {$gte: since}} without the open parts
+bsoncxx::document::value rangeFilter(const IdRange& range, std::int64_t sinceMs) {
+    using bsoncxx::builder::basic::kvp;
+    bsoncxx::builder::basic::document bounds;
+    if (!range.from.empty()) {
+        bounds.append(kvp("$gte", range.from));
+    }
+    if (!range.to.empty()) {
+        bounds.append(kvp("$lt", range.to));
+    }
+    bsoncxx::builder::basic::document since;
+    since.append(kvp("$gte", bsoncxx::types::b_date{std::chrono::milliseconds(sinceMs)}));
+
+    bsoncxx::builder::basic::document filter;
+    if (!range.from.empty() || !range.to.empty()) {
+        filter.append(kvp("id", bsoncxx::types::b_document{bounds.view()}));
+    }
+    if (sinceMs > 0) {
+        filter.append(kvp("updatedAt", bsoncxx::types::b_document{since.view()}));
+    }
+    return filter.extract();
+}
+
+// Fields read back by the load and lookup queries; the stored updatedAt is only filtered on
+bsoncxx::document::value userProjection() {
+    return document{} << "_id" << 0 << "id" << 1 << "username" << 1 << "currentRoom" << 1
+                      << "isOnline" << 1 << "lastActivity" << 1 << "homeNode" << 1 << finalize;
+}
+
+bsoncxx::document::value roomProjection() {
+    return document{} << "_id" << 0 << "updatedAt" << 0 << finalize;
+}
+
+// What a message counts against kChatBucketMaxBytes
+std::int64_t chatEntryBytes(const ChatMessage& message) {
+    return static_cast<std::int64_t>(message.userId.size() + message.username.size() + message.message.size());
+}
+
+// A bucket of the room with room for count more messages of bytes in total,
+// matched by the upsert that appends them. When no bucket of the room has
+// that much space left the upsert starts a new one.
+bsoncxx::document::value openBucketFilter(const std::string& roomId, std::int32_t count, std::int64_t bytes) {
+    return document{}
+        << "roomId" << roomId
+        << "count" << open_document << "$lte" << DatabaseManager::kChatBucketCapacity - count << close_document
+        << "bytes" << open_document << "$lte" << DatabaseManager::kChatBucketMaxBytes - bytes << close_document
+        << finalize;
+}
+
+// Appends messages [first, last) of one room, oldest first, to a bucket and
+// widens the bucket's time span to cover them. bytes is their chatEntryBytes total.
+bsoncxx::document::value bucketAppend(const ChatMessage* const* first, const ChatMessage* const* last,
+                                      std::int64_t bytes) {
+    bsoncxx::builder::stream::array entries;
+    for (auto it = first; it != last; ++it) {
+        const ChatMessage& message = **it;
+        entries << open_document
+                << "userId" << message.userId
+                << "username" << message.username
+                << "message" << message.message
+                << "timestamp" << bsoncxx::types::b_date{message.timestamp}
+                << close_document;
+    }
+    return document{}
+        << "$push" << open_document
+            << "messages" << open_document << "$each" << bsoncxx::types::b_array{entries.view()} << close_document
+        << close_document
+        << "$inc" << open_document
+            << "count" << static_cast<std::int32_t>(last - first)
+            << "bytes" << bytes
+        << close_document
+        << "$min" << open_document << "startAt" << bsoncxx::types::b_date{(*first)->timestamp} << close_document
+        << "$max" << open_document << "lastAt" << bsoncxx::types::b_date{(*(last - 1))->timestamp} << close_document
+        << finalize;
+}
+
+
+struct IndexSpec {
+    const char* name;
+    bsoncxx::document::value keys;
+    bool unique;
+};
+
+// Builds any missing index, then lists the collection's indexes to confirm
+// each one exists under its name with the expected uniqueness
+bool ensureCollectionIndexes(mongocxx::collection& collection, const char* collectionName,
+                             const std::vector<IndexSpec>& specs) {
+    using bsoncxx::builder::basic::kvp;
+    bool ok = true;
+    for (const auto& spec : specs) {
+        try {
+            bsoncxx::builder::basic::document options;
+            options.append(kvp("name", spec.name));
+            if (spec.unique) {
+                options.append(kvp("unique", true));
+            }
+            collection.create_index(spec.keys.view(), options.view());
+        } catch (const mongocxx::exception& e) {
+            LOG_ERROR << "Error creating index " << collectionName << "." << spec.name << ": " << e.what();
+            ok = false;
+        }
+    }
+
+    std::unordered_map<std::string, bool> existing;   // Index name to unique
+    for (auto&& index : collection.list_indexes()) {
+        auto unique = index["unique"];
+        existing[stringField(index, "name")] = unique && unique.type() == bsoncxx::type::k_bool &&
+                                               unique.get_bool().value;
+    }
+    for (const auto& spec : specs) {
+        auto it = existing.find(spec.name);
+        if (it == existing.end()) {
+            LOG_WARN << "Index " << collectionName << "." << spec.name << " is missing";
+            ok = false;
+        } else if (it->second != spec.unique) {
+            LOG_WARN << "Index " << collectionName << "." << spec.name << " should "
+                     << (spec.unique ? "" : "not ") << "be unique";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// Users and rooms are looked up and upserted by id, and read back by updatedAt at warm start
+std::vector<IndexSpec> entityIndexes() {
+    std::vector<IndexSpec> specs;
+    specs.push_back({"id_unique", document{} << "id" << 1 << finalize, true});
+    specs.push_back({"updatedAt", document{} << "updatedAt" << 1 << finalize, false});
+    return specs;
+}
+
+// History reads the newest buckets of a room; appends match on the room's open bucket
+std::vector<IndexSpec> chatBucketIndexes() {
+    std::vector<IndexSpec> specs;
+    specs.push_back({"roomId_startAt", document{} << "roomId" << 1 << "startAt" << -1 << finalize, false});
+    return specs;
+}
+
+// Legacy one-document-per-message chat, read when a room's buckets hold too
+// little history
+std::vector<IndexSpec> legacyChatIndexes() {
+    std::vector<IndexSpec> specs;
+    specs.push_back({"roomId_timestamp", document{} << "roomId" << 1 << "timestamp" << -1 << finalize, false});
+    return specs;
+}
+
+// The pool size is a URI option; an explicit maxPoolSize in the URI wins
+std::string withPoolSize(const std::string& connectionString, std::size_t poolSize) {
+    if (connectionString.find("maxPoolSize=") != std::string::npos) {
+        return connectionString;
+    }
+    std::string separator;
+    if (connectionString.find('?') != std::string::npos) {
+        separator = "&";
+    } else {
+        // Options need a path component before the query, e.g. host:port/?opt
+        std::size_t hosts = connectionString.find("://");
+        hosts = hosts == std::string::npos ? 0 : hosts + 3;
+        separator = connectionString.find('/', hosts) == std::string::npos ? "/?" : "?";
+    }
+    return connectionString + separator + "maxPoolSize=" + std::to_string(poolSize);
+}
+
+// The driver allows one instance per process, created before any other driver
+// object; every Mongo-backed manager shares it
+std::unique_ptr<mongocxx::pool> makePool(const std::string& connectionString, std::size_t poolSize) {
+    static mongocxx::instance instance{};
+    return std::make_unique<mongocxx::pool>(mongocxx::uri{withPoolSize(connectionString, poolSize)});
+}
+
+// Documents per cursor batch for warm-start reads; id scans return tiny documents
+const std::int32_t kLoadBatchSize = 2000;
+const std::int32_t kScanBatchSize = 20000;
+
+std::uint64_t microsSince(std::chrono::steady_clock::time_point start) {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+} // namespace
+
+const char* DatabaseManager::operationName(Operation operation) {
+    switch (operation) {
+        case Operation::InsertUser: return "insert_user";
+        case Operation::UpdateUser: return "update_user";
+        case Operation::GetUser: return "get_user";
+        case Operation::InsertRoom: return "insert_room";
+        case Operation::BulkWrite: return "bulk_write";
+        case Operation::InsertChatMessage: return "insert_chat_message";
+        case Operation::GetChatHistory: return "get_chat_history";
+        case Operation::Ping: return "ping";
+        case Operation::LoadUsers: return "load_users";
+        case Operation::LoadRooms: return "load_rooms";
+        case Operation::ScanIds: return "scan_ids";
+        case Operation::EnsureIndexes: return "ensure_indexes";
+        case Operation::Count: break;
+    }
+    return "unknown";
+}
+
+DatabaseManager::Lease::Lease(const DatabaseManager& manager, Operation op)
+    : owner(manager),
+      operation(op),
+      started(std::chrono::steady_clock::now()),
+      exceptionsAtStart(std::uncaught_exceptions()),
+      session(manager.acquireSession()) {
+    owner.totalAcquireUs.fetch_add(microsSince(started), std::memory_order_relaxed);
+}
+
+DatabaseManager::Lease::~Lease() {
+    owner.releaseSession(std::move(session));
+    owner.recordOperation(operation, std::chrono::steady_clock::now() - started,
+                          std::uncaught_exceptions() > exceptionsAtStart);
+}
+
+DatabaseManager::DatabaseManager(const std::string& connectionString, std::size_t size)
+    : poolSize(size > 0 ? size : 1),
+      pool(makePool(connectionString, poolSize)) {
+    LOG_INFO << "MongoDB client pool ready (" << poolSize << " clients)";
+}
+
+DatabaseManager::DatabaseManager(WithoutPool) : poolSize(0) {}
+
+DatabaseManager::~DatabaseManager() = default;
+
+void DatabaseManager::recordOperation(Operation operation, std::chrono::steady_clock::duration elapsedTime,
+                                      bool failed) const {
+    latency[static_cast<std::size_t>(operation)].record(static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsedTime).count()));
+    std::uint64_t elapsed = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(elapsedTime).count());
+    operations.fetch_add(1, std::memory_order_relaxed);
+    totalLatencyUs.fetch_add(elapsed, std::memory_order_relaxed);
+    if (failed) {
+        failures.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::uint64_t seen = maxLatencyUs.load(std::memory_order_relaxed);
+    while (elapsed > seen && !maxLatencyUs.compare_exchange_weak(seen, elapsed, std::memory_order_relaxed)) {
+    }
+}
+
+std::unique_ptr<DatabaseManager::Session> DatabaseManager::acquireSession() const {
+    {
+        std::unique_lock<std::mutex> lock(sessionsMutex);
+        sessionReleased.wait(lock, [this]() {
+            return !idleSessions.empty() || sessionsCreated < poolSize;
+        });
+        if (!idleSessions.empty()) {
+            std::unique_ptr<Session> session = std::move(idleSessions.back());
+            idleSessions.pop_back();
+            return session;
+        }
+        ++sessionsCreated;
+    }
+
+    // Sessions are created lazily, outside the lock, up to the pool size
     try {
-        client = std::make_unique<mongocxx::client>(mongocxx::uri{connectionString});
-        db = client->database("game_lobby");
-        std::cout << "Connected to MongoDB successfully" << std::endl;
-    } catch (const mongocxx::exception& e) {
-        std::cerr << "MongoDB connection error: " << e.what() << std::endl;
+        auto session = std::make_unique<Session>();
+        session->client = pool->acquire();
+        session->db = session->client->database("game_lobby");
+        session->users = session->db.collection("users");
+        session->rooms = session->db.collection("rooms");
+        session->chatBuckets = session->db.collection("chat_buckets");
+        session->legacyChat = session->db.collection("chat_messages");
+        return session;
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(sessionsMutex);
+        --sessionsCreated;
+        sessionReleased.notify_one();
         throw;
     }
 }
 
-DatabaseManager::~DatabaseManager() = default;
+void DatabaseManager::releaseSession(std::unique_ptr<Session> session) const {
+    {
+        std::lock_guard<std::mutex> lock(sessionsMutex);
+        idleSessions.push_back(std::move(session));
+    }
+    sessionReleased.notify_one();
+}
 
 bool DatabaseManager::insertUser(const User& user) {
     try {
-        auto collection = db.collection("users");
-        auto doc = document{}
-            << "id" << user.id
-            << "username" << user.username
-            << "currentRoom" << user.currentRoom
-            << "isOnline" << user.isOnline
-            << "lastActivity" << bsoncxx::types::b_date{user.lastActivity}
-            << finalize;
+        Lease lease(*this, Operation::InsertUser);
+        auto& collection = lease.users();
+        auto doc = userDocument(user);
 
         auto result = collection.insert_one(doc.view());
         return result.has_value();
     } catch (const mongocxx::exception& e) {
-        std::cerr << "Error inserting user: " << e.what() << std::endl;
+        LOG_ERROR << "Error inserting user: " << e.what();
         return false;
     }
 }
 
 bool DatabaseManager::updateUser(const User& user) {
     try {
-        auto collection = db.collection("users");
-        auto filter = document{} << "id" << user.id << finalize;
+        Lease lease(*this, Operation::UpdateUser);
+        auto& collection = lease.users();
+        auto filter = document{} << "id" << user.id.str() << finalize;
         auto update = document{}
             << "$set" << bsoncxx::builder::stream::open_document
             << "username" << user.username
-            << "currentRoom" << user.currentRoom
+            << "currentRoom" << user.currentRoom.str()
             << "isOnline" << user.isOnline
             << "lastActivity" << bsoncxx::types::b_date{user.lastActivity}
             << bsoncxx::builder::stream::close_document
@@ -55,79 +435,328 @@ bool DatabaseManager::updateUser(const User& user) {
         auto result = collection.update_one(filter.view(), update.view());
         return result && result->modified_count() > 0;
     } catch (const mongocxx::exception& e) {
-        std::cerr << "Error updating user: " << e.what() << std::endl;
+        LOG_ERROR << "Error updating user: " << e.what();
         return false;
     }
 }
 
 User DatabaseManager::getUserById(const std::string& userId) {
     try {
-        auto collection = db.collection("users");
+        Lease lease(*this, Operation::GetUser);
+        auto& collection = lease.users();
         auto filter = document{} << "id" << userId << finalize;
-        auto result = collection.find_one(filter.view());
+        mongocxx::options::find options;
+        options.projection(userProjection());
+        auto result = collection.find_one(filter.view(), options);
 
         if (result) {
-            User user;
-            auto view = result->view();
-            user.id = view["id"].get_utf8().value.to_string();
-            user.username = view["username"].get_utf8().value.to_string();
-            user.currentRoom = view["currentRoom"].get_utf8().value.to_string();
-            user.isOnline = view["isOnline"].get_bool();
-            user.lastActivity = view["lastActivity"].get_date();
-            return user;
+            return userFromDocument(result->view());
         }
     } catch (const mongocxx::exception& e) {
-        std::cerr << "Error getting user: " << e.what() << std::endl;
+        LOG_ERROR << "Error getting user: " << e.what();
     }
     return User{};
 }
 
 bool DatabaseManager::insertRoom(const Room& room) {
     try {
-        auto collection = db.collection("rooms");
-        auto doc = document{}
-            << "id" << room.id
-            << "name" << room.name
-            << "gameType" << room.gameType
-            << "createdBy" << room.createdBy
-            << "maxPlayers" << room.maxPlayers
-            << "status" << static_cast<int>(room.status)
-            << "createdAt" << bsoncxx::types::b_date{room.createdAt}
-            << finalize;
+        Lease lease(*this, Operation::InsertRoom);
+        auto& collection = lease.rooms();
+        auto doc = roomDocument(room);
 
         auto result = collection.insert_one(doc.view());
         return result.has_value();
     } catch (const mongocxx::exception& e) {
-        std::cerr << "Error inserting room: " << e.what() << std::endl;
+        LOG_ERROR << "Error inserting room: " << e.what();
         return false;
     }
 }
 
+std::size_t DatabaseManager::bulkWrite(const std::vector<PersistenceRecord>& records) {
+    mongocxx::options::bulk_write options;
+    options.ordered(false);
+    // A room's appends must reach its open bucket in order
+    mongocxx::options::bulk_write chatOptions;
+    chatOptions.ordered(true);
+
+    // Leasing a session and building the batches can throw too; the whole
+    // batch then counts as failed
+    std::size_t applied = 0;
+    try {
+        Lease lease(*this, Operation::BulkWrite);
+        auto& users = lease.users();
+        auto& rooms = lease.rooms();
+        auto& chatBuckets = lease.chatBuckets();
+        auto userBulk = users.create_bulk_write(options);
+        auto roomBulk = rooms.create_bulk_write(options);
+        auto chatBulk = chatBuckets.create_bulk_write(chatOptions);
+        std::size_t userOps = 0;
+        std::size_t roomOps = 0;
+        std::size_t chatOps = 0;
+
+        // Chat messages grouped by room, in arrival order within each room
+        std::vector<std::pair<std::string, std::vector<const ChatMessage*>>> chatByRoom;
+        std::unordered_map<std::string, std::size_t> chatGroup;
+
+        for (const auto& record : records) {
+            if (record.kind == PersistenceRecord::Kind::Chat) {
+                auto group = chatGroup.emplace(record.chat.roomId, chatByRoom.size());
+                if (group.second) {
+                    chatByRoom.emplace_back(record.chat.roomId, std::vector<const ChatMessage*>());
+                }
+                chatByRoom[group.first->second].second.push_back(&record.chat);
+                ++chatOps;
+                continue;
+            }
+
+            bool isUser = record.kind == PersistenceRecord::Kind::User;
+            auto& bulk = isUser ? userBulk : roomBulk;
+            auto filter = document{} << "id" << record.id << finalize;
+
+            if (record.op == PersistenceRecord::Op::Delete) {
+                bulk.append(mongocxx::model::delete_one{std::move(filter)});
+            } else {
+                mongocxx::model::replace_one replace{
+                    std::move(filter), isUser ? userDocument(record.user) : roomDocument(record.room)};
+                replace.upsert(true);
+                bulk.append(replace);
+            }
+            ++(isUser ? userOps : roomOps);
+        }
+
+        // One append per room and bucket's worth of messages instead of one insert
+        // per message. Each chunk fits an empty bucket, and lands in an open one
+        // only if that has space for all of it.
+        for (const auto& [roomId, messages] : chatByRoom) {
+            std::size_t start = 0;
+            while (start < messages.size()) {
+                std::size_t end = start + 1;
+                std::int64_t bytes = chatEntryBytes(*messages[start]);
+                while (end < messages.size() && end - start < static_cast<std::size_t>(kChatBucketCapacity) &&
+                       bytes + chatEntryBytes(*messages[end]) <= kChatBucketMaxBytes) {
+                    bytes += chatEntryBytes(*messages[end]);
+                    ++end;
+                }
+                std::int32_t count = static_cast<std::int32_t>(end - start);
+                mongocxx::model::update_one append{
+                    openBucketFilter(roomId, count, bytes), bucketAppend(messages.data() + start, messages.data() + end, bytes)};
+                append.upsert(true);
+                chatBulk.append(append);
+                start = end;
+            }
+        }
+
+        try {
+            if (userOps > 0) {
+                users.bulk_write(userBulk);
+            }
+            applied += userOps;
+        } catch (const mongocxx::exception& e) {
+            LOG_ERROR << "Error writing user batch: " << e.what();
+        }
+        try {
+            if (roomOps > 0) {
+                rooms.bulk_write(roomBulk);
+            }
+            applied += roomOps;
+        } catch (const mongocxx::exception& e) {
+            LOG_ERROR << "Error writing room batch: " << e.what();
+        }
+        try {
+            if (chatOps > 0) {
+                chatBuckets.bulk_write(chatBulk);
+            }
+            applied += chatOps;
+        } catch (const mongocxx::exception& e) {
+            LOG_ERROR << "Error writing chat batch: " << e.what();
+        }
+    } catch (const mongocxx::exception& e) {
+        LOG_ERROR << "Error preparing write batch: " << e.what();
+    }
+    return applied;
+}
+
 bool DatabaseManager::insertChatMessage(const std::string& roomId, const std::string& userId,
                                        const std::string& username, const std::string& message) {
     try {
-        auto collection = db.collection("chat_messages");
-        auto doc = document{}
-            << "roomId" << roomId
-            << "userId" << userId
-            << "username" << username
-            << "message" << message
-            << "timestamp" << bsoncxx::types::b_date{std::chrono::system_clock::now()}
-            << finalize;
+        Lease lease(*this, Operation::InsertChatMessage);
+        auto& collection = lease.chatBuckets();
+        ChatMessage chat(roomId, userId, username, message);
+        const ChatMessage* appended = &chat;
+        std::int64_t bytes = chatEntryBytes(chat);
+        mongocxx::options::update options;
+        options.upsert(true);
 
-        auto result = collection.insert_one(doc.view());
+        auto result = collection.update_one(openBucketFilter(roomId, 1, bytes).view(),
+                                            bucketAppend(&appended, &appended + 1, bytes).view(), options);
         return result.has_value();
     } catch (const mongocxx::exception& e) {
-        std::cerr << "Error inserting chat message: " << e.what() << std::endl;
+        LOG_ERROR << "Error inserting chat message: " << e.what();
+        return false;
+    }
+}
+
+std::vector<ChatMessage> DatabaseManager::getChatHistory(const std::string& roomId, int limit) {
+    std::vector<ChatMessage> history;
+    try {
+        if (limit <= 0) {
+            return history;
+        }
+        Lease lease(*this, Operation::GetChatHistory);
+        auto& collection = lease.chatBuckets();
+        auto filter = document{} << "roomId" << roomId << finalize;
+        // The newest bucket may hold a single message; full ones before it cover the rest
+        mongocxx::options::find options;
+        options.sort(document{} << "startAt" << -1 << finalize);
+        options.limit((limit + kChatBucketCapacity - 1) / kChatBucketCapacity + 1);
+        options.projection(document{} << "_id" << 0 << "messages" << 1 << finalize);
+
+        for (auto&& view : collection.find(filter.view(), options)) {
+            auto messages = view["messages"];
+            if (!messages || messages.type() != bsoncxx::type::k_array) {
+                continue;
+            }
+            for (const auto& entry : messages.get_array().value) {
+                if (entry.type() != bsoncxx::type::k_document) {
+                    continue;
+                }
+                auto stored = entry.get_document().value;
+                ChatMessage message;
+                message.roomId = roomId;
+                message.userId = stringField(stored, "userId");
+                message.username = stringField(stored, "username");
+                message.message = stringField(stored, "message");
+                message.timestamp = dateField(stored, "timestamp");
+                history.push_back(std::move(message));
+            }
+        }
+
+        // Older messages may still sit one per document in chat_messages
+        std::size_t wanted = static_cast<std::size_t>(limit);
+        if (history.size() < wanted && hasLegacyChat.load(std::memory_order_relaxed)) {
+            document legacyFilter;
+            legacyFilter << "roomId" << roomId;
+            if (!history.empty()) {
+                auto oldest = std::min_element(history.begin(), history.end(),
+                    [](const ChatMessage& a, const ChatMessage& b) { return a.timestamp < b.timestamp; });
+                legacyFilter << "timestamp" << open_document << "$lt" << bsoncxx::types::b_date{oldest->timestamp}
+                             << close_document;
+            }
+            mongocxx::options::find legacyOptions;
+            legacyOptions.sort(document{} << "timestamp" << -1 << finalize);
+            legacyOptions.limit(static_cast<std::int64_t>(wanted - history.size()));
+            legacyOptions.projection(document{} << "_id" << 0 << "userId" << 1 << "username" << 1 << "message" << 1
+                                                << "timestamp" << 1 << finalize);
+            for (auto&& stored : lease.legacyChat().find(legacyFilter.view(), legacyOptions)) {
+                ChatMessage message;
+                message.roomId = roomId;
+                message.userId = stringField(stored, "userId");
+                message.username = stringField(stored, "username");
+                message.message = stringField(stored, "message");
+                message.timestamp = dateField(stored, "timestamp");
+                history.push_back(std::move(message));
+            }
+        }
+    } catch (const mongocxx::exception& e) {
+        LOG_ERROR << "Error getting chat history: " << e.what();
+    }
+    // Buckets started concurrently can overlap in time
+    std::stable_sort(history.begin(), history.end(), [](const ChatMessage& a, const ChatMessage& b) {
+        return a.timestamp < b.timestamp;
+    });
+    if (history.size() > static_cast<std::size_t>(limit)) {
+        history.erase(history.begin(), history.end() - limit);
+    }
+    return history;
+}
+
+bool DatabaseManager::loadUsers(const IdRange& range, std::int64_t sinceMs, std::vector<User>& out) {
+    try {
+        Lease lease(*this, Operation::LoadUsers);
+        mongocxx::options::find options;
+        options.projection(userProjection());
+        options.batch_size(kLoadBatchSize);
+        for (auto&& view : lease.users().find(rangeFilter(range, sinceMs).view(), options)) {
+            out.push_back(userFromDocument(view));
+        }
+        return true;
+    } catch (const mongocxx::exception& e) {
+        LOG_ERROR << "Error loading users: " << e.what();
+        return false;
+    }
+}
+
+bool DatabaseManager::loadRooms(const IdRange& range, std::int64_t sinceMs, std::vector<Room>& out) {
+    try {
+        Lease lease(*this, Operation::LoadRooms);
+        mongocxx::options::find options;
+        options.projection(roomProjection());
+        options.batch_size(kLoadBatchSize);
+        for (auto&& view : lease.rooms().find(rangeFilter(range, sinceMs).view(), options)) {
+            out.push_back(roomFromDocument(view));
+        }
+        return true;
+    } catch (const mongocxx::exception& e) {
+        LOG_ERROR << "Error loading rooms: " << e.what();
+        return false;
+    }
+}
+
+bool DatabaseManager::scanIds(Collection collection, const IdRange& range, std::vector<std::string>& out) {
+    try {
+        Lease lease(*this, Operation::ScanIds);
+        mongocxx::options::find options;
+        options.projection(document{} << "_id" << 0 << "id" << 1 << finalize);
+        options.batch_size(kScanBatchSize);
+        auto& source = collection == Collection::Users ? lease.users() : lease.rooms();
+        for (auto&& view : source.find(rangeFilter(range, 0).view(), options)) {
+            out.push_back(stringField(view, "id"));
+        }
+        return true;
+    } catch (const mongocxx::exception& e) {
+        LOG_ERROR << "Error scanning ids: " << e.what();
+        return false;
+    }
+}
+
+bool DatabaseManager::ensureIndexes() {
+    try {
+        Lease lease(*this, Operation::EnsureIndexes);
+        bool users = ensureCollectionIndexes(lease.users(), "users", entityIndexes());
+        bool rooms = ensureCollectionIndexes(lease.rooms(), "rooms", entityIndexes());
+        bool chat = ensureCollectionIndexes(lease.chatBuckets(), "chat_buckets", chatBucketIndexes());
+        // Only when an older version left one behind; creating the index would create the collection
+        if (lease.db().has_collection("chat_messages")) {
+            chat = ensureCollectionIndexes(lease.legacyChat(), "chat_messages", legacyChatIndexes()) && chat;
+            hasLegacyChat.store(true, std::memory_order_relaxed);
+        }
+        if (users && rooms && chat) {
+            LOG_INFO << "Database indexes verified";
+        }
+        return users && rooms && chat;
+    } catch (const mongocxx::exception& e) {
+        LOG_ERROR << "Error ensuring indexes: " << e.what();
         return false;
     }
 }
 
 bool DatabaseManager::isConnected() const {
     try {
-        client->database("admin").run_command(document{} << "ping" << 1 << finalize);
+        Lease lease(*this, Operation::Ping);
+        lease.client().database("admin").run_command(document{} << "ping" << 1 << finalize);
         return true;
     } catch (const mongocxx::exception&) {
         return false;
     }
 }
+
+DatabaseStats DatabaseManager::getStats() const {
+    DatabaseStats stats;
+    stats.poolSize = poolSize;
+    stats.operations = operations.load(std::memory_order_relaxed);
+    stats.failures = failures.load(std::memory_order_relaxed);
+    stats.totalLatencyUs = totalLatencyUs.load(std::memory_order_relaxed);
+    stats.maxLatencyUs = maxLatencyUs.load(std::memory_order_relaxed);
+    stats.totalAcquireUs = totalAcquireUs.load(std::memory_order_relaxed);
+    return stats;
+}
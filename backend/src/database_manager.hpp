@@ -2,41 +2,184 @@
 #include <mongocxx/client.hpp>
 #include <mongocxx/database.hpp>
 #include <mongocxx/collection.hpp>
-#include <mongocxx/instance.hpp>
+#include <mongocxx/pool.hpp>
 #include <bsoncxx/json.hpp>
 #include <bsoncxx/builder/stream/document.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
 #include "user.hpp"
 #include "room.hpp"
+#include "chat_message.hpp"
+#include "metrics.hpp"
 
+struct PersistenceRecord;
+
+// Half-open range [from, to) of entity ids; an empty bound is open
+struct IdRange {
+    std::string from;
+    std::string to;
+};
+
+struct DatabaseStats {
+    std::size_t poolSize = 0;
+    std::uint64_t operations = 0;
+    std::uint64_t failures = 0;
+    std::uint64_t totalLatencyUs = 0;   // Lease acquire to release, summed
+    std::uint64_t maxLatencyUs = 0;
+    std::uint64_t totalAcquireUs = 0;   // Time spent waiting for a free session
+};
+
+// Every operation leases a session for its duration, so callers on any thread
+// can use the manager concurrently. A session keeps one client from the
+// mongocxx::pool checked out together with its collection handles, so handles
+// are built once per client rather than once per call. At most poolSize
+// sessions exist; further callers wait for one to be released.
 class DatabaseManager {
+public:
+    // Per-operation latency histograms are kept in this order
+    enum class Operation {
+        InsertUser,
+        UpdateUser,
+        GetUser,
+        InsertRoom,
+        BulkWrite,
+        InsertChatMessage,
+        GetChatHistory,
+        Ping,
+        LoadUsers,
+        LoadRooms,
+        ScanIds,
+        EnsureIndexes,
+        Count
+    };
+    static const char* operationName(Operation operation);
+
 private:
-    mongocxx::instance instance{};
-    std::unique_ptr<mongocxx::client> client;
-    mongocxx::database db;
+    struct Session {
+        mongocxx::pool::entry client;
+        mongocxx::database db;
+        mongocxx::collection users;
+        mongocxx::collection rooms;
+        mongocxx::collection chatBuckets;
+        mongocxx::collection legacyChat;    // chat_messages, from before buckets; read only
+    };
+
+    // Holds one session for a single operation. Latency is recorded on
+    // release, and a release during stack unwinding counts as a failure.
+    class Lease {
+    public:
+        Lease(const DatabaseManager& owner, Operation operation);
+        ~Lease();
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        mongocxx::client& client() { return *session->client; }
+        mongocxx::collection& users() { return session->users; }
+        mongocxx::collection& rooms() { return session->rooms; }
+        mongocxx::database& db() { return session->db; }
+        mongocxx::collection& chatBuckets() { return session->chatBuckets; }
+        mongocxx::collection& legacyChat() { return session->legacyChat; }
+
+    private:
+        const DatabaseManager& owner;
+        Operation operation;
+        std::chrono::steady_clock::time_point started;
+        int exceptionsAtStart;
+        std::unique_ptr<Session> session;
+    };
+
+    std::size_t poolSize;
+    std::unique_ptr<mongocxx::pool> pool;   // Null for stores built WithoutPool
+
+    // Declared after the pool so sessions return their clients before it closes
+    mutable std::mutex sessionsMutex;
+    mutable std::condition_variable sessionReleased;
+    mutable std::vector<std::unique_ptr<Session>> idleSessions;
+    mutable std::size_t sessionsCreated = 0;
+
+    // Set by ensureIndexes when a chat_messages collection exists; history
+    // reads then fill up from it once a room's buckets run out
+    std::atomic<bool> hasLegacyChat{false};
+
+    mutable std::atomic<std::uint64_t> operations{0};
+    mutable std::atomic<std::uint64_t> failures{0};
+    mutable std::atomic<std::uint64_t> totalLatencyUs{0};
+    mutable std::atomic<std::uint64_t> maxLatencyUs{0};
+    mutable std::atomic<std::uint64_t> totalAcquireUs{0};
+    mutable std::array<Histogram, static_cast<std::size_t>(Operation::Count)> latency;   // Nanoseconds, lease to release
+
+    std::unique_ptr<Session> acquireSession() const;
+    void releaseSession(std::unique_ptr<Session> session) const;
+
+protected:
+    // For stores that override every implemented operation and never lease a
+    // session; no driver object, the process-wide instance included, is created
+    struct WithoutPool {};
+    explicit DatabaseManager(WithoutPool);
+
+    void recordOperation(Operation operation, std::chrono::steady_clock::duration elapsed, bool failed) const;
 
 public:
-    DatabaseManager(const std::string& connectionString = "mongodb://localhost:27017");
-    ~DatabaseManager();
+    DatabaseManager(const std::string& connectionString = "mongodb://localhost:27017",
+                    std::size_t poolSize = 16);
+    virtual ~DatabaseManager();
 
     // User operations
-    bool insertUser(const User& user);
-    bool updateUser(const User& user);
-    User getUserById(const std::string& userId);
+    virtual bool insertUser(const User& user);
+    virtual bool updateUser(const User& user);
+    virtual User getUserById(const std::string& userId);
     std::vector<User> getOnlineUsers();
     bool deleteUser(const std::string& userId);
 
     // Room operations
-    bool insertRoom(const Room& room);
+    virtual bool insertRoom(const Room& room);
     bool updateRoom(const Room& room);
     Room getRoomById(const std::string& roomId);
     std::vector<Room> getAvailableRooms();
     bool deleteRoom(const std::string& roomId);
 
-    // Chat operations
-    bool insertChatMessage(const std::string& roomId, const std::string& userId, 
-                          const std::string& username, const std::string& message);
-    std::vector<std::string> getChatHistory(const std::string& roomId, int limit = 50);
+    // Write-behind flush: upserts/deletes/chat inserts grouped into one unordered
+    // bulk_write per collection. Returns how many records were applied.
+    virtual std::size_t bulkWrite(const std::vector<PersistenceRecord>& records);
+
+    // Chat operations. Messages are stored in per-room bucket documents of up
+    // to kChatBucketCapacity messages each, so a room's recent history is read
+    // from its newest one or two buckets rather than one document per message.
+    // A bucket also closes once its text passes kChatBucketMaxBytes, which keeps
+    // it far below the document size limit. Appends only go to a bucket with
+    // space for all of them, so both limits are hard caps. Messages stored one
+    // per document in chat_messages by older versions are still read.
+    static constexpr int kChatBucketCapacity = 100;
+    static constexpr std::int64_t kChatBucketMaxBytes = 1 << 20;
+    virtual bool insertChatMessage(const std::string& roomId, const std::string& userId,
+                                   const std::string& username, const std::string& message);
+    // Most recent messages for the room, oldest first
+    virtual std::vector<ChatMessage> getChatHistory(const std::string& roomId, int limit = 50);
+
+    // Warm-start reconciliation. Reads one id range with a projected, batched
+    // cursor, so callers can split a collection across threads. The load
+    // calls return documents written at or after sinceMs (0 for all of them).
+    enum class Collection { Users, Rooms };
+    virtual bool loadUsers(const IdRange& range, std::int64_t sinceMs, std::vector<User>& out);
+    virtual bool loadRooms(const IdRange& range, std::int64_t sinceMs, std::vector<Room>& out);
+    virtual bool scanIds(Collection collection, const IdRange& range, std::vector<std::string>& out);
+    // False for stores that do not outlive the process
+    virtual bool isDurable() const { return true; }
+
+    // Creates the indexes every query above relies on, then lists them back to
+    // check each exists with the expected options. Safe to repeat; false when
+    // any index is missing or could not be built.
+    virtual bool ensureIndexes();
 
-    bool isConnected() const;
+    virtual bool isConnected() const;
+    DatabaseStats getStats() const;
+    const Histogram& getLatency(Operation operation) const {
+        return latency[static_cast<std::size_t>(operation)];
+    }
 };
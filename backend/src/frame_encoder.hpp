@@ -0,0 +1,92 @@
+#pragma once
+#include <websocketpp/frame.hpp>
+#include <websocketpp/processor/hybi13.hpp>
+#include <mutex>
+#include <string>
+#include "compression.hpp"
+
+// Frames a payload once so the same prepared message can be queued on many
+// connections. websocketpp sends prepared messages as-is (no per-connection
+// copy or header rebuild), and server frames are unmasked, so one encoding is
+// valid for every hybi13 connection on the endpoint. Compressed frames are
+// likewise built once, for the connections whose negotiated
+// permessage-deflate terms accept a standalone compressed message.
+template <typename config>
+class FrameEncoder {
+public:
+    typedef typename config::message_type::ptr message_ptr;
+
+private:
+    typedef typename config::con_msg_manager_type msg_manager_type;
+    typedef typename config::rng_type rng_type;
+
+    typename msg_manager_type::ptr msgManager;
+    rng_type rng;
+    websocketpp::processor::hybi13<config> processor;
+    std::mutex processorMutex;
+    CompressionOptions compression;
+    MessageDeflater deflater;
+
+public:
+    explicit FrameEncoder(const CompressionOptions& compressionOptions = CompressionOptions())
+        : msgManager(std::make_shared<msg_manager_type>()),
+          processor(false, true, msgManager, rng),
+          compression(compressionOptions), deflater(compressionOptions) {}
+
+    bool shouldCompress(std::size_t payloadSize) const {
+        return compression.enabled && payloadSize >= compression.minBytes;
+    }
+    int deflateWindowBits() const { return deflater.getWindowBits(); }
+
+    // Unframed message for a single connection; websocketpp frames it on send,
+    // compressing it with the connection's own deflate context if large
+    // enough and the extension was negotiated. Needs no lock, so unicast
+    // replies skip the shared processor.
+    message_ptr wrap(const std::string& payload,
+                     websocketpp::frame::opcode::value opcode = websocketpp::frame::opcode::text) {
+        message_ptr message = msgManager->get_message(opcode, payload.size());
+        if (message) {
+            message->set_payload(payload);
+            message->set_compressed(shouldCompress(payload.size()));
+        }
+        return message;
+    }
+
+    // Compressed frame (RSV1 set) for connections that can take a standalone
+    // compressed message. Returns nullptr when the payload is under the
+    // threshold or would not shrink.
+    message_ptr encodeDeflated(const std::string& payload,
+                               websocketpp::frame::opcode::value opcode = websocketpp::frame::opcode::text) {
+        std::string deflated;
+        if (!shouldCompress(payload.size()) || !deflater.deflate(payload, deflated) ||
+            deflated.size() >= payload.size()) {
+            return message_ptr();
+        }
+        message_ptr out = msgManager->get_message(opcode, deflated.size());
+        if (!out) {
+            return message_ptr();
+        }
+        websocketpp::frame::basic_header header(opcode, deflated.size(), true, false, true);
+        out->set_header(websocketpp::frame::prepare_header(header, websocketpp::frame::extended_header(deflated.size())));
+        out->get_raw_payload().swap(deflated);
+        out->set_prepared(true);
+        return out;
+    }
+
+    // Returns nullptr if the frame could not be prepared
+    message_ptr encode(const std::string& payload,
+                       websocketpp::frame::opcode::value opcode = websocketpp::frame::opcode::text) {
+        message_ptr in = msgManager->get_message(opcode, payload.size());
+        message_ptr out = msgManager->get_message(opcode, payload.size());
+        if (!in || !out) {
+            return message_ptr();
+        }
+        in->set_payload(payload);
+
+        std::lock_guard<std::mutex> lock(processorMutex);
+        if (processor.prepare_data_frame(in, out)) {
+            return message_ptr();
+        }
+        return out;
+    }
+};
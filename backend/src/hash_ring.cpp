@@ -0,0 +1,35 @@
+#include "hash_ring.hpp"
+#include <algorithm>
+
+HashRing::HashRing(const std::vector<std::uint16_t>& nodes) {
+    points.reserve(nodes.size() * kVirtualNodes);
+    for (std::uint16_t node : nodes) {
+        for (std::size_t replica = 0; replica < kVirtualNodes; ++replica) {
+            points.emplace_back(hash("node-" + std::to_string(node) + "#" + std::to_string(replica)), node);
+        }
+    }
+    std::sort(points.begin(), points.end());
+}
+
+std::uint16_t HashRing::ownerOf(const std::string& key) const {
+    if (points.empty()) {
+        return 0;
+    }
+    // First point at or after the key's hash, wrapping past the end
+    auto it = std::lower_bound(points.begin(), points.end(), std::make_pair(hash(key), std::uint16_t{0}));
+    return (it != points.end() ? it : points.begin())->second;
+}
+
+std::uint64_t HashRing::hash(const std::string& key) {
+    // FNV-1a, then a 64-bit finalizer so similar keys land far apart
+    std::uint64_t value = 0xCBF29CE484222325ull;
+    for (unsigned char c : key) {
+        value = (value ^ c) * 0x100000001B3ull;
+    }
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDull;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ull;
+    value ^= value >> 33;
+    return value;
+}
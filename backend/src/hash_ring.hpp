@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Consistent hash ring mapping keys (room ids) to owner nodes. Each node is
+// placed at kVirtualNodes points so keys spread evenly, and adding or removing
+// a node only moves the keys between it and its neighbours. The hash is
+// computed here rather than with std::hash so every process, whatever its
+// build, agrees on the owner of a key.
+class HashRing {
+public:
+    static constexpr std::size_t kVirtualNodes = 128;
+
+private:
+    std::vector<std::pair<std::uint64_t, std::uint16_t>> points;   // Sorted by hash
+
+public:
+    explicit HashRing(const std::vector<std::uint16_t>& nodes);
+
+    // Owner of the key; 0 when the ring is empty
+    std::uint16_t ownerOf(const std::string& key) const;
+    bool empty() const { return points.empty(); }
+
+    static std::uint64_t hash(const std::string& key);
+};
@@ -0,0 +1,199 @@
+#include "id_interner.hpp"
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+namespace {
+
+std::uint32_t hashId(std::string_view value) {
+    return static_cast<std::uint32_t>(std::hash<std::string_view>{}(value));
+}
+
+// The low hash bits pick the shard, so table positions use the bits above them
+std::size_t homePosition(std::uint32_t hash, std::size_t mask) {
+    return (hash >> 4) & mask;
+}
+
+} // namespace
+
+IdInterner::~IdInterner() {
+    for (auto& shard : shards) {
+        for (auto& chunk : shard.chunks) {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+IdInterner& IdInterner::instance() {
+    static IdInterner* table = new IdInterner();
+    return *table;
+}
+
+std::size_t IdInterner::probe(std::size_t shardIndex, std::string_view value, std::uint32_t hash) const {
+    const Shard& shard = shards[shardIndex];
+    std::size_t mask = shard.table.size() - 1;
+    for (std::size_t position = homePosition(hash, mask);; position = (position + 1) & mask) {
+        std::uint32_t entry = shard.table[position];
+        if (entry == 0) {
+            return position;
+        }
+        const Slot& slot = slotAt(shardIndex, entry - 1);
+        if (slot.hash == hash && slot.value == value) {
+            return position;
+        }
+    }
+}
+
+void IdInterner::insertIndex(std::size_t shardIndex, std::uint32_t slotIndex) {
+    Shard& shard = shards[shardIndex];
+    if ((shard.live + 1) * 2 > shard.table.size()) {
+        // Keep the table at most half full so probes stay short
+        std::vector<std::uint32_t> old(std::max<std::size_t>(16, shard.table.size() * 2), 0);
+        old.swap(shard.table);
+        std::size_t mask = shard.table.size() - 1;
+        for (std::uint32_t entry : old) {
+            if (entry != 0) {
+                std::size_t position = homePosition(slotAt(shardIndex, entry - 1).hash, mask);
+                while (shard.table[position] != 0) {
+                    position = (position + 1) & mask;
+                }
+                shard.table[position] = entry;
+            }
+        }
+    }
+
+    const Slot& slot = slotAt(shardIndex, slotIndex);
+    shard.table[probe(shardIndex, slot.value, slot.hash)] = slotIndex + 1;
+    ++shard.live;
+}
+
+void IdInterner::eraseIndex(std::size_t shardIndex, std::size_t position) {
+    // Backward-shift deletion: later entries of the probe run move up so
+    // lookups never need tombstones
+    Shard& shard = shards[shardIndex];
+    std::size_t mask = shard.table.size() - 1;
+    std::size_t hole = position;
+    for (std::size_t next = (hole + 1) & mask; shard.table[next] != 0; next = (next + 1) & mask) {
+        std::size_t home = homePosition(slotAt(shardIndex, shard.table[next] - 1).hash, mask);
+        // Move the entry unless its home lies cyclically in (hole, next]
+        bool stays = (hole <= next) ? (hole < home && home <= next) : (hole < home || home <= next);
+        if (!stays) {
+            shard.table[hole] = shard.table[next];
+            hole = next;
+        }
+    }
+    shard.table[hole] = 0;
+    --shard.live;
+}
+
+IdInterner::Handle IdInterner::acquire(std::string_view value) {
+    if (value.empty()) {
+        return 0;
+    }
+
+    std::uint32_t hash = hashId(value);
+    std::size_t shardIndex = hash & (kShardCount - 1);
+    Shard& shard = shards[shardIndex];
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+
+    if (!shard.table.empty()) {
+        std::uint32_t entry = shard.table[probe(shardIndex, value, hash)];
+        if (entry != 0) {
+            Slot& slot = slotAt(shardIndex, entry - 1);
+            slot.refs.fetch_add(1, std::memory_order_relaxed);
+            return makeHandle(slot.generation, shardIndex, entry - 1);
+        }
+    }
+
+    std::uint32_t slotIndex;
+    if (!shard.freeSlots.empty()) {
+        slotIndex = shard.freeSlots.back();
+        shard.freeSlots.pop_back();
+    } else {
+        if (shard.slotsUsed == kChunkCount * kChunkSize) {
+            throw std::runtime_error("Id table full");
+        }
+        slotIndex = shard.slotsUsed++;
+        auto& chunk = shard.chunks[slotIndex / kChunkSize];
+        if (!chunk.load(std::memory_order_relaxed)) {
+            chunk.store(new Slot[kChunkSize], std::memory_order_release);
+        }
+    }
+
+    Slot& slot = slotAt(shardIndex, slotIndex);
+    slot.value.assign(value.data(), value.size());
+    slot.hash = hash;
+    slot.refs.store(1, std::memory_order_relaxed);
+    insertIndex(shardIndex, slotIndex);
+    return makeHandle(slot.generation, shardIndex, slotIndex);
+}
+
+void IdInterner::retain(Handle handle) {
+    if (handle) {
+        slotAt(shardOf(handle), slotOf(handle)).refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void IdInterner::release(Handle handle) {
+    if (!handle) {
+        return;
+    }
+    Slot& slot = slotAt(shardOf(handle), slotOf(handle));
+    if (slot.refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    // Last reference: free the slot unless acquire() revived it meanwhile or
+    // another releaser already freed it
+    std::size_t shardIndex = shardOf(handle);
+    Shard& shard = shards[shardIndex];
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    if (slot.refs.load(std::memory_order_acquire) != 0 || slot.generation != generationOf(handle)) {
+        return;
+    }
+    eraseIndex(shardIndex, probe(shardIndex, slot.value, slot.hash));
+    slot.value.clear();
+    slot.value.shrink_to_fit();
+    slot.generation = static_cast<std::uint8_t>(slot.generation + 1);
+    if (slot.generation == 0) {
+        slot.generation = 1;   // Keeps handle 0 unused
+    }
+    shard.freeSlots.push_back(slotOf(handle));
+}
+
+IdInterner::Handle IdInterner::find(std::string_view value) const {
+    if (value.empty()) {
+        return 0;
+    }
+    std::uint32_t hash = hashId(value);
+    std::size_t shardIndex = hash & (kShardCount - 1);
+    const Shard& shard = shards[shardIndex];
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    if (shard.table.empty()) {
+        return 0;
+    }
+    std::uint32_t entry = shard.table[probe(shardIndex, value, hash)];
+    if (entry == 0) {
+        return 0;
+    }
+    return makeHandle(slotAt(shardIndex, entry - 1).generation, shardIndex, entry - 1);
+}
+
+std::string IdInterner::name(Handle handle) const {
+    if (!handle) {
+        return std::string();
+    }
+    const Shard& shard = shards[shardOf(handle)];
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    const Slot& slot = slotAt(shardOf(handle), slotOf(handle));
+    return slot.generation == generationOf(handle) ? slot.value : std::string();
+}
+
+std::size_t IdInterner::size() const {
+    std::size_t total = 0;
+    for (const auto& shard : shards) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        total += shard.live;
+    }
+    return total;
+}
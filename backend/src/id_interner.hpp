@@ -0,0 +1,123 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Process-wide table of user and room id strings. Each distinct id is stored
+// once and named by a 32-bit handle, reference counted so the string is freed
+// when the last holder lets go. Handles carry a generation, so a handle kept
+// past its release resolves to an empty string instead of a reused id.
+//
+// Handle layout: generation (8 bits) | shard (4 bits) | slot (20 bits).
+// Handle 0 is never issued and stands for "no id".
+class IdInterner {
+public:
+    using Handle = std::uint32_t;
+
+private:
+    static constexpr std::size_t kShardBits = 4;
+    static constexpr std::size_t kSlotBits = 20;
+    static constexpr std::size_t kShardCount = std::size_t{1} << kShardBits;
+    static constexpr std::size_t kChunkSize = 4096;
+    static constexpr std::size_t kChunkCount = (std::size_t{1} << kSlotBits) / kChunkSize;
+
+    struct Slot {
+        std::atomic<std::uint32_t> refs{0};
+        std::uint32_t hash = 0;        // Written under the shard lock
+        std::uint8_t generation = 1;
+        std::string value;
+    };
+
+    // Slots live in fixed chunks that never move, so holders can adjust
+    // reference counts without taking the shard lock. The lookup table is open
+    // addressed (slot + 1, 0 = empty) so an id costs four bytes of index
+    // rather than a hash node.
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        std::vector<std::uint32_t> table;
+        std::size_t live = 0;
+        std::vector<std::uint32_t> freeSlots;
+        std::uint32_t slotsUsed = 0;
+        std::array<std::atomic<Slot*>, kChunkCount> chunks{};
+    };
+
+    std::array<Shard, kShardCount> shards;
+
+    static Handle makeHandle(std::uint8_t generation, std::size_t shard, std::uint32_t slot) {
+        return (static_cast<Handle>(generation) << (kShardBits + kSlotBits)) |
+               (static_cast<Handle>(shard) << kSlotBits) | slot;
+    }
+    static std::uint8_t generationOf(Handle handle) {
+        return static_cast<std::uint8_t>(handle >> (kShardBits + kSlotBits));
+    }
+    static std::size_t shardOf(Handle handle) {
+        return (handle >> kSlotBits) & (kShardCount - 1);
+    }
+    static std::uint32_t slotOf(Handle handle) {
+        return handle & ((Handle{1} << kSlotBits) - 1);
+    }
+
+    Slot& slotAt(std::size_t shard, std::uint32_t slot) const {
+        return shards[shard].chunks[slot / kChunkSize].load(std::memory_order_acquire)[slot % kChunkSize];
+    }
+
+    // Table position holding value, or the empty position where it would go.
+    // Caller holds the shard lock.
+    std::size_t probe(std::size_t shard, std::string_view value, std::uint32_t hash) const;
+    void insertIndex(std::size_t shard, std::uint32_t slot);
+    void eraseIndex(std::size_t shard, std::size_t position);
+
+public:
+    IdInterner() = default;
+    ~IdInterner();
+    IdInterner(const IdInterner&) = delete;
+    IdInterner& operator=(const IdInterner&) = delete;
+
+    // The shared table; never destroyed, so ids held by statics stay valid
+    static IdInterner& instance();
+
+    // Handle for value with one more reference (0 for an empty value)
+    Handle acquire(std::string_view value);
+    // Adds a reference to a handle the caller already holds
+    void retain(Handle handle);
+    void release(Handle handle);
+
+    // Handle for value if it is interned, without taking a reference
+    Handle find(std::string_view value) const;
+    std::string name(Handle handle) const;
+
+    // Distinct ids currently held
+    std::size_t size() const;
+};
+
+// Owning reference to an interned id: four bytes, and copying one bumps a
+// counter instead of allocating a string.
+class InternedId {
+private:
+    IdInterner::Handle handle = 0;
+
+public:
+    InternedId() = default;
+    explicit InternedId(std::string_view value) : handle(IdInterner::instance().acquire(value)) {}
+    InternedId(const InternedId& other) : handle(other.handle) { IdInterner::instance().retain(handle); }
+    InternedId(InternedId&& other) noexcept : handle(std::exchange(other.handle, 0)) {}
+    ~InternedId() { IdInterner::instance().release(handle); }
+
+    InternedId& operator=(InternedId other) noexcept {
+        std::swap(handle, other.handle);
+        return *this;
+    }
+
+    bool empty() const { return handle == 0; }
+    IdInterner::Handle get() const { return handle; }
+    std::string str() const { return handle ? IdInterner::instance().name(handle) : std::string(); }
+
+    friend bool operator==(const InternedId& a, const InternedId& b) { return a.handle == b.handle; }
+    friend bool operator!=(const InternedId& a, const InternedId& b) { return a.handle != b.handle; }
+};
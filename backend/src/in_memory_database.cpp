@@ -0,0 +1,176 @@
+#include "in_memory_database.hpp"
+#include "logger.hpp"
+#include "persistence_queue.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+
+namespace {
+
+const char* const kUriScheme = "memory://";
+
+std::int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool inRange(const std::string& id, const IdRange& range) {
+    return (range.from.empty() || id >= range.from) && (range.to.empty() || id < range.to);
+}
+
+long latencyFromUri(const std::string& connectionString) {
+    std::size_t option = connectionString.find("latencyUs=");
+    if (option == std::string::npos) {
+        return 0;
+    }
+    return std::max(0L, std::strtol(connectionString.c_str() + option + 10, nullptr, 10));
+}
+
+} // namespace
+
+bool InMemoryDatabase::handles(const std::string& connectionString) {
+    return connectionString.compare(0, std::char_traits<char>::length(kUriScheme), kUriScheme) == 0;
+}
+
+InMemoryDatabase::InMemoryDatabase(const std::string& connectionString)
+    : DatabaseManager(WithoutPool{}), latency(latencyFromUri(connectionString)) {
+    LOG_INFO << "In-memory database ready (simulated latency " << latency.count() << "us)";
+}
+
+InMemoryDatabase::Call::Call(const InMemoryDatabase& db, Operation op)
+    : owner(db), operation(op), started(std::chrono::steady_clock::now()) {
+    if (owner.latency.count() > 0) {
+        std::this_thread::sleep_for(owner.latency);
+    }
+}
+
+InMemoryDatabase::Call::~Call() {
+    owner.recordOperation(operation, std::chrono::steady_clock::now() - started, false);
+}
+
+void InMemoryDatabase::appendChat(const ChatMessage& message) {
+    auto& messages = chat[message.roomId];
+    messages.push_back(message);
+    if (messages.size() > kChatPerRoom) {
+        messages.pop_front();
+    }
+}
+
+bool InMemoryDatabase::insertUser(const User& user) {
+    Call call(*this, Operation::InsertUser);
+    std::lock_guard<std::mutex> lock(mutex);
+    return users.emplace(user.id.str(), Stored<User>{user, nowMs()}).second;
+}
+
+bool InMemoryDatabase::updateUser(const User& user) {
+    Call call(*this, Operation::UpdateUser);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = users.find(user.id.str());
+    if (it == users.end()) {
+        return false;
+    }
+    it->second = Stored<User>{user, nowMs()};
+    return true;
+}
+
+User InMemoryDatabase::getUserById(const std::string& userId) {
+    Call call(*this, Operation::GetUser);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = users.find(userId);
+    return it != users.end() ? it->second.value : User();
+}
+
+bool InMemoryDatabase::insertRoom(const Room& room) {
+    Call call(*this, Operation::InsertRoom);
+    std::lock_guard<std::mutex> lock(mutex);
+    return rooms.emplace(room.id, Stored<Room>{room, nowMs()}).second;
+}
+
+std::size_t InMemoryDatabase::bulkWrite(const std::vector<PersistenceRecord>& records) {
+    Call call(*this, Operation::BulkWrite);
+    std::lock_guard<std::mutex> lock(mutex);
+    std::int64_t writtenAt = nowMs();
+    for (const auto& record : records) {
+        if (record.kind == PersistenceRecord::Kind::Chat) {
+            appendChat(record.chat);
+        } else if (record.kind == PersistenceRecord::Kind::User) {
+            if (record.op == PersistenceRecord::Op::Delete) {
+                users.erase(record.id);
+            } else {
+                users[record.id] = Stored<User>{record.user, writtenAt};
+            }
+        } else {
+            if (record.op == PersistenceRecord::Op::Delete) {
+                rooms.erase(record.id);
+                chat.erase(record.id);   // Room ids are never reused; keeps long runs bounded
+            } else {
+                rooms[record.id] = Stored<Room>{record.room, writtenAt};
+            }
+        }
+    }
+    return records.size();
+}
+
+bool InMemoryDatabase::insertChatMessage(const std::string& roomId, const std::string& userId,
+                                         const std::string& username, const std::string& message) {
+    Call call(*this, Operation::InsertChatMessage);
+    std::lock_guard<std::mutex> lock(mutex);
+    appendChat(ChatMessage(roomId, userId, username, message));
+    return true;
+}
+
+std::vector<ChatMessage> InMemoryDatabase::getChatHistory(const std::string& roomId, int limit) {
+    Call call(*this, Operation::GetChatHistory);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = chat.find(roomId);
+    if (it == chat.end() || limit <= 0) {
+        return {};
+    }
+    std::size_t count = std::min(it->second.size(), static_cast<std::size_t>(limit));
+    return std::vector<ChatMessage>(it->second.end() - static_cast<std::ptrdiff_t>(count), it->second.end());
+}
+
+bool InMemoryDatabase::loadUsers(const IdRange& range, std::int64_t sinceMs, std::vector<User>& out) {
+    Call call(*this, Operation::LoadUsers);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& [id, stored] : users) {
+        if (inRange(id, range) && stored.updatedAtMs >= sinceMs) {
+            out.push_back(stored.value);
+        }
+    }
+    return true;
+}
+
+bool InMemoryDatabase::loadRooms(const IdRange& range, std::int64_t sinceMs, std::vector<Room>& out) {
+    Call call(*this, Operation::LoadRooms);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& [id, stored] : rooms) {
+        if (inRange(id, range) && stored.updatedAtMs >= sinceMs) {
+            out.push_back(stored.value);
+        }
+    }
+    return true;
+}
+
+bool InMemoryDatabase::scanIds(Collection collection, const IdRange& range, std::vector<std::string>& out) {
+    Call call(*this, Operation::ScanIds);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto collect = [&](const auto& documents) {
+        for (const auto& entry : documents) {
+            if (inRange(entry.first, range)) {
+                out.push_back(entry.first);
+            }
+        }
+    };
+    if (collection == Collection::Users) {
+        collect(users);
+    } else {
+        collect(rooms);
+    }
+    return true;
+}
+
+bool InMemoryDatabase::isConnected() const {
+    Call call(*this, Operation::Ping);
+    return true;
+}
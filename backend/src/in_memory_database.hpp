@@ -0,0 +1,66 @@
+#pragma once
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "database_manager.hpp"
+
+// Stand-in for MongoDB, selected with MONGODB_URI=memory:// so the server can
+// be load tested without a mongod. memory://?latencyUs=N adds a simulated
+// round trip to every call. Documents live in process memory and are lost on
+// exit; calls are counted in the same stats and histograms as Mongo calls.
+class InMemoryDatabase : public DatabaseManager {
+public:
+    static bool handles(const std::string& connectionString);
+
+    explicit InMemoryDatabase(const std::string& connectionString);
+
+    bool insertUser(const User& user) override;
+    bool updateUser(const User& user) override;
+    User getUserById(const std::string& userId) override;
+    bool insertRoom(const Room& room) override;
+    std::size_t bulkWrite(const std::vector<PersistenceRecord>& records) override;
+    bool insertChatMessage(const std::string& roomId, const std::string& userId,
+                           const std::string& username, const std::string& message) override;
+    std::vector<ChatMessage> getChatHistory(const std::string& roomId, int limit = 50) override;
+    bool loadUsers(const IdRange& range, std::int64_t sinceMs, std::vector<User>& out) override;
+    bool loadRooms(const IdRange& range, std::int64_t sinceMs, std::vector<Room>& out) override;
+    bool scanIds(Collection collection, const IdRange& range, std::vector<std::string>& out) override;
+    bool isDurable() const override { return false; }
+    bool ensureIndexes() override { return true; }
+    bool isConnected() const override;
+
+private:
+    // Messages kept per room; more than any history request asks for
+    static constexpr std::size_t kChatPerRoom = 200;
+
+    // Waits out the simulated latency and records the call on destruction
+    class Call {
+    public:
+        Call(const InMemoryDatabase& owner, Operation operation);
+        ~Call();
+        Call(const Call&) = delete;
+        Call& operator=(const Call&) = delete;
+
+    private:
+        const InMemoryDatabase& owner;
+        Operation operation;
+        std::chrono::steady_clock::time_point started;
+    };
+
+    // A document and when it was last written, like Mongo's updatedAt
+    template <typename T>
+    struct Stored {
+        T value;
+        std::int64_t updatedAtMs = 0;
+    };
+
+    std::chrono::microseconds latency;
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Stored<User>> users;
+    std::unordered_map<std::string, Stored<Room>> rooms;
+    std::unordered_map<std::string, std::deque<ChatMessage>> chat;
+
+    void appendChat(const ChatMessage& message);
+};
@@ -0,0 +1,60 @@
+#include "interest_index.hpp"
+#include <mutex>
+
+void InterestIndex::setRoomMembers(const std::string& roomId, const std::vector<std::string>& members) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    roomMembers[roomId] = members;
+}
+
+void InterestIndex::removeRoom(const std::string& roomId) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    roomMembers.erase(roomId);
+}
+
+std::vector<std::string> InterestIndex::getRoomMembers(const std::string& roomId) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = roomMembers.find(roomId);
+    return (it != roomMembers.end()) ? it->second : std::vector<std::string>{};
+}
+
+void InterestIndex::addLobbyWatcher(const std::string& userId) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    lobbyWatchers.insert(userId);
+}
+
+void InterestIndex::removeLobbyWatcher(const std::string& userId) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    lobbyWatchers.erase(userId);
+}
+
+std::vector<std::string> InterestIndex::getLobbyWatchers() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return std::vector<std::string>(lobbyWatchers.begin(), lobbyWatchers.end());
+}
+
+bool InterestIndex::hasLobbyWatchers() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return !lobbyWatchers.empty();
+}
+
+void InterestIndex::markRoomChanged(const std::string& roomId) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    removedRooms.erase(roomId);
+    changedRooms.insert(roomId);
+}
+
+void InterestIndex::markRoomRemoved(const std::string& roomId) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    changedRooms.erase(roomId);
+    removedRooms.insert(roomId);
+}
+
+InterestIndex::LobbyDelta InterestIndex::takeLobbyDelta() {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    LobbyDelta delta;
+    delta.changedRooms.assign(changedRooms.begin(), changedRooms.end());
+    delta.removedRooms.assign(removedRooms.begin(), removedRooms.end());
+    changedRooms.clear();
+    removedRooms.clear();
+    return delta;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Tracks who is interested in which lobby events: the members of each room
+// (targets of room-scoped messages) and the users watching the lobby listing.
+// Changes to the listing are accumulated here and drained as one delta per tick.
+class InterestIndex {
+public:
+    struct LobbyDelta {
+        std::vector<std::string> changedRooms;
+        std::vector<std::string> removedRooms;
+
+        bool empty() const { return changedRooms.empty() && removedRooms.empty(); }
+    };
+
+private:
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, std::vector<std::string>> roomMembers;
+    std::unordered_set<std::string> lobbyWatchers;
+    std::unordered_set<std::string> changedRooms;
+    std::unordered_set<std::string> removedRooms;
+
+public:
+    // Room membership mirrors Room::players after every room event
+    void setRoomMembers(const std::string& roomId, const std::vector<std::string>& members);
+    void removeRoom(const std::string& roomId);
+    std::vector<std::string> getRoomMembers(const std::string& roomId) const;
+
+    void addLobbyWatcher(const std::string& userId);
+    void removeLobbyWatcher(const std::string& userId);
+    std::vector<std::string> getLobbyWatchers() const;
+    bool hasLobbyWatchers() const;
+
+    // Lobby listing changes pending for the next delta
+    void markRoomChanged(const std::string& roomId);
+    void markRoomRemoved(const std::string& roomId);
+    LobbyDelta takeLobbyDelta();
+};
@@ -0,0 +1,135 @@
+#include "json_codec.hpp"
+#include <memory>
+#include <stdexcept>
+
+namespace {
+
+std::size_t skipJsonSpace(std::string_view text, std::size_t i) {
+    while (i < text.size() && (text[i] == ' ' || text[i] == '\t' || text[i] == '\n' || text[i] == '\r')) {
+        ++i;
+    }
+    return i;
+}
+
+// Index just past the JSON string opening at text[i], or npos
+std::size_t skipJsonString(std::string_view text, std::size_t i) {
+    for (++i; i < text.size(); ++i) {
+        if (text[i] == '\\') {
+            ++i;
+        } else if (text[i] == '"') {
+            return i + 1;
+        }
+    }
+    return std::string_view::npos;
+}
+
+// Index just past the JSON value starting at text[i], or npos. Only brackets
+// and strings are tracked; scalars end at the next ',' or closing bracket.
+std::size_t skipJsonValue(std::string_view text, std::size_t i) {
+    std::size_t depth = 0;
+    while (i < text.size()) {
+        char c = text[i];
+        if (c == '"') {
+            i = skipJsonString(text, i);
+            if (i == std::string_view::npos || depth == 0) {
+                return i;
+            }
+            continue;
+        }
+        if (c == '{' || c == '[') {
+            ++depth;
+        } else if (c == '}' || c == ']') {
+            if (depth == 0) {
+                return i;
+            }
+            if (--depth == 0) {
+                return i + 1;
+            }
+        } else if (c == ',' && depth == 0) {
+            return i;
+        }
+        ++i;
+    }
+    return std::string_view::npos;
+}
+
+} // namespace
+
+Json::Value JsonCodec::parse(const char* begin, const char* end, const char* errorMessage) {
+    // One reader per worker thread instead of a builder and reader per message
+    thread_local std::unique_ptr<Json::CharReader> reader = []() {
+        Json::CharReaderBuilder builder;
+        return std::unique_ptr<Json::CharReader>(builder.newCharReader());
+    }();
+
+    Json::Value value;
+    if (!reader->parse(begin, end, &value, nullptr)) {
+        throw std::runtime_error(errorMessage);
+    }
+    return value;
+}
+
+std::string_view JsonCodec::messageType(const Json::Value& root) {
+    const char* typeBegin = nullptr;
+    const char* typeEnd = nullptr;
+    const Json::Value* type = root.isObject() ? root.find("type", "type" + 4) : nullptr;
+    if (!type || !type->getString(&typeBegin, &typeEnd)) {
+        throw std::runtime_error("Missing message type");
+    }
+    return std::string_view(typeBegin, typeEnd - typeBegin);
+}
+
+const Json::Value& JsonCodec::messageData(const Json::Value& root, Json::Value& legacyData) {
+    static const Json::Value emptyData(Json::objectValue);
+    const Json::Value* data = root.isObject() ? root.find("data", "data" + 4) : nullptr;
+    if (!data) {
+        return emptyData;
+    }
+    if (data->isString()) {
+        const char* dataBegin = nullptr;
+        const char* dataEnd = nullptr;
+        data->getString(&dataBegin, &dataEnd);
+        legacyData = parse(dataBegin, dataEnd, "Invalid message data");
+        return legacyData;
+    }
+    return *data;
+}
+
+std::string_view JsonCodec::peekMessageType(std::string_view text) {
+    const std::size_t npos = std::string_view::npos;
+    std::size_t i = skipJsonSpace(text, 0);
+    if (i >= text.size() || text[i] != '{') {
+        return {};
+    }
+    i = skipJsonSpace(text, i + 1);
+    while (i < text.size() && text[i] == '"') {
+        std::size_t keyEnd = skipJsonString(text, i);
+        if (keyEnd == npos) {
+            return {};
+        }
+        std::string_view key = text.substr(i + 1, keyEnd - i - 2);
+        i = skipJsonSpace(text, keyEnd);
+        if (i >= text.size() || text[i] != ':') {
+            return {};
+        }
+        i = skipJsonSpace(text, i + 1);
+        if (key == "type") {
+            std::size_t valueEnd = (i < text.size() && text[i] == '"') ? skipJsonString(text, i) : npos;
+            if (valueEnd == npos) {
+                return {};
+            }
+            std::string_view value = text.substr(i + 1, valueEnd - i - 2);
+            return value.find('\\') == npos ? value : std::string_view();
+        }
+        i = skipJsonValue(text, i);
+        if (i == npos) {
+            return {};
+        }
+        i = skipJsonSpace(text, i);
+        if (i >= text.size() || text[i] != ',') {
+            return {};
+        }
+        i = skipJsonSpace(text, i + 1);
+    }
+    return {};
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <string_view>
+#include <json/json.h>
+
+// Decoding of client messages sent with the JSON protocol ("lobby.json.v1").
+// The envelope and its data are parsed in one pass into a single DOM, and the
+// type is read in place, so dispatch allocates nothing beyond the parse.
+class JsonCodec {
+public:
+    // Parses with a reader kept per thread. Throws std::runtime_error with
+    // errorMessage if the text is not valid JSON.
+    static Json::Value parse(const char* begin, const char* end, const char* errorMessage);
+
+    // The message's "type", pointing into root. Throws if it is missing or not a string.
+    static std::string_view messageType(const Json::Value& root);
+
+    // The message's "data", or an empty object. Older clients send data as a
+    // JSON-encoded string; that is parsed into legacyData, which is returned.
+    static const Json::Value& messageData(const Json::Value& root, Json::Value& legacyData);
+
+    // The top-level "type" member of a JSON text frame, found by skimming the
+    // frame instead of parsing it, so rate limits can be applied first. Empty
+    // if it is not a plain string member; points into text.
+    static std::string_view peekMessageType(std::string_view text);
+};
@@ -0,0 +1,155 @@
+#include "local_bus.hpp"
+#include "logger.hpp"
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+const char* const kScheme = "unix://";
+
+// Every datagram starts with the sending node's id
+const std::size_t kHeaderBytes = 2;
+
+// Kernel buffers sized for bursts of summaries and fan-out
+const int kSocketBufferBytes = 4 * 1024 * 1024;
+
+bool fillAddress(const std::string& path, sockaddr_un& address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+} // namespace
+
+bool LocalBus::handles(const std::string& uri) {
+    return uri.compare(0, std::strlen(kScheme), kScheme) == 0;
+}
+
+LocalBus::LocalBus(const std::string& uri, std::uint16_t selfNode)
+    : directory(uri.substr(std::strlen(kScheme))), self(selfNode), socketFd(-1), running(false),
+      sent(0), received(0), dropped(0) {
+    if (directory.empty()) {
+        directory = "/tmp";
+    }
+}
+
+LocalBus::~LocalBus() {
+    stop();
+}
+
+std::string LocalBus::socketPath(std::uint16_t node) const {
+    return directory + "/lobby-node-" + std::to_string(node) + ".sock";
+}
+
+bool LocalBus::start(Handler handler) {
+    ::mkdir(directory.c_str(), 0755);
+    std::string path = socketPath(self);
+    sockaddr_un address;
+    if (!fillAddress(path, address)) {
+        LOG_ERROR << "Cluster bus path too long: " << path;
+        return false;
+    }
+
+    socketFd = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (socketFd < 0) {
+        LOG_ERROR << "Cannot create cluster bus socket: " << std::strerror(errno);
+        return false;
+    }
+    ::setsockopt(socketFd, SOL_SOCKET, SO_SNDBUF, &kSocketBufferBytes, sizeof(kSocketBufferBytes));
+    ::setsockopt(socketFd, SOL_SOCKET, SO_RCVBUF, &kSocketBufferBytes, sizeof(kSocketBufferBytes));
+
+    // A socket file left by a previous run of this node would block the bind
+    ::unlink(path.c_str());
+    if (::bind(socketFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        LOG_ERROR << "Cannot bind cluster bus socket " << path << ": " << std::strerror(errno);
+        ::close(socketFd);
+        socketFd = -1;
+        return false;
+    }
+
+    running = true;
+    receiver = std::thread([this, handler]() { receiveLoop(handler); });
+    LOG_INFO << "Cluster bus listening on " << path;
+    return true;
+}
+
+void LocalBus::stop() {
+    bool expected = true;
+    if (!running.compare_exchange_strong(expected, false)) {
+        return;
+    }
+    // An empty datagram to ourselves wakes the receiver so it sees running == false
+    send(self, std::string());
+    if (receiver.joinable()) {
+        receiver.join();
+    }
+    ::close(socketFd);
+    socketFd = -1;
+    ::unlink(socketPath(self).c_str());
+}
+
+void LocalBus::receiveLoop(Handler handler) {
+    std::vector<char> buffer(kHeaderBytes + kMaxMessageBytes);
+    while (running) {
+        ssize_t length = ::recv(socketFd, buffer.data(), buffer.size(), 0);
+        if (length < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR << "Cluster bus receive failed: " << std::strerror(errno);
+            break;
+        }
+        if (!running) {
+            break;
+        }
+        if (static_cast<std::size_t>(length) <= kHeaderBytes) {
+            continue;
+        }
+
+        std::uint16_t from;
+        std::memcpy(&from, buffer.data(), kHeaderBytes);
+        received.fetch_add(1, std::memory_order_relaxed);
+        try {
+            handler(from, std::string(buffer.data() + kHeaderBytes, static_cast<std::size_t>(length) - kHeaderBytes));
+        } catch (const std::exception& e) {
+            LOG_ERROR << "Error handling cluster message from node " << from << ": " << e.what();
+        }
+    }
+}
+
+bool LocalBus::send(std::uint16_t node, const std::string& payload) {
+    sockaddr_un address;
+    if (socketFd < 0 || payload.size() > kMaxMessageBytes || !fillAddress(socketPath(node), address)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    std::string datagram(kHeaderBytes, '\0');
+    std::memcpy(&datagram[0], &self, kHeaderBytes);
+    datagram += payload;
+    ssize_t written = ::sendto(socketFd, datagram.data(), datagram.size(), MSG_DONTWAIT,
+                               reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    if (written != static_cast<ssize_t>(datagram.size())) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    sent.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+ClusterBusStats LocalBus::getStats() const {
+    ClusterBusStats stats;
+    stats.sent = sent.load(std::memory_order_relaxed);
+    stats.received = received.load(std::memory_order_relaxed);
+    stats.dropped = dropped.load(std::memory_order_relaxed);
+    return stats;
+}
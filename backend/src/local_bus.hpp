@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <thread>
+#include "cluster_bus.hpp"
+
+// Cluster transport for nodes on one host, selected with
+// CLUSTER_BUS=unix:///some/directory. Each node binds a Unix datagram socket
+// named after its node id in that directory and sends to its peers' sockets,
+// so several processes can run as a cluster without any network setup. A
+// stand-in for a networked bus in development and tests.
+class LocalBus : public ClusterBus {
+public:
+    static constexpr std::size_t kMaxMessageBytes = 60 * 1024;
+
+private:
+    std::string directory;
+    std::uint16_t self;
+    int socketFd;
+    std::thread receiver;
+    std::atomic<bool> running;
+    std::atomic<std::uint64_t> sent;
+    std::atomic<std::uint64_t> received;
+    std::atomic<std::uint64_t> dropped;
+
+    std::string socketPath(std::uint16_t node) const;
+    void receiveLoop(Handler handler);
+
+public:
+    static bool handles(const std::string& uri);
+
+    LocalBus(const std::string& uri, std::uint16_t selfNode);
+    ~LocalBus() override;
+
+    bool start(Handler handler) override;
+    void stop() override;
+    bool send(std::uint16_t node, const std::string& payload) override;
+    std::size_t maxMessageBytes() const override { return kMaxMessageBytes; }
+    ClusterBusStats getStats() const override;
+};
@@ -0,0 +1,305 @@
+#include "logger.hpp"
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+namespace {
+
+const std::uint32_t kNoThread = UINT32_MAX;
+
+std::int64_t wallMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+struct Logger::ThreadRing {
+    std::shared_ptr<Ring> ring;
+
+    ~ThreadRing() {
+        if (ring) {
+            ring->retired.store(true, std::memory_order_release);
+        }
+    }
+};
+
+Logger& Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::~Logger() {
+    stop();
+}
+
+const char* Logger::levelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "debug";
+        case LogLevel::Info: return "info";
+        case LogLevel::Warn: return "warn";
+        case LogLevel::Error: return "error";
+        case LogLevel::Off: return "off";
+    }
+    return "unknown";
+}
+
+bool Logger::parseLevel(const std::string& text, LogLevel& level) {
+    std::string name;
+    for (char c : text) {
+        name += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    if (name == "warning") {
+        name = "warn";
+    }
+    for (LogLevel candidate : {LogLevel::Debug, LogLevel::Info, LogLevel::Warn, LogLevel::Error, LogLevel::Off}) {
+        if (name == levelName(candidate)) {
+            level = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Logger::start(const Options& opts) {
+    if (running.load()) {
+        return;
+    }
+    options = opts;
+    std::size_t slots = 1;
+    while (slots < options.ringSlots) {
+        slots <<= 1;
+    }
+    options.ringSlots = slots;
+    setLevel(options.level);
+
+    if (!options.path.empty()) {
+        file = std::fopen(options.path.c_str(), "a");
+        if (!file) {
+            LOG_ERROR << "Cannot open log file " << options.path << ": " << std::strerror(errno)
+                      << "; logging to stdout";
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        stopRequested = false;
+    }
+    running.store(true, std::memory_order_release);
+    writer = std::thread(&Logger::run, this);
+}
+
+void Logger::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        stopRequested = true;
+    }
+    writerWake.notify_all();
+    writer.join();
+
+    // Lines queued while the writer was finishing
+    std::string normal;
+    std::string urgent;
+    drain(normal, urgent);
+    flush(normal, urgent);
+    std::lock_guard<std::mutex> lock(outputMutex);
+    if (file) {
+        std::fclose(file);
+        file = nullptr;
+    }
+}
+
+Logger::Ring* Logger::ringForThisThread() {
+    thread_local ThreadRing local;
+    if (!local.ring) {
+        auto ring = std::make_shared<Ring>();
+        ring->slots.reset(new Slot[options.ringSlots]);
+        ring->mask = options.ringSlots - 1;
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        ring->thread = nextThread++;
+        rings.push_back(ring);
+        local.ring = std::move(ring);
+    }
+    return local.ring.get();
+}
+
+void Logger::write(LogLevel level, const char* text, std::size_t size) {
+    size = std::min(size, kMaxLineBytes);
+    std::int64_t now = wallMicros();
+    if (!running.load(std::memory_order_acquire)) {
+        writeNow(level, now, kNoThread, text, size);
+        return;
+    }
+
+    Ring* ring = ringForThisThread();
+    std::uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) > ring->mask) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Slot& slot = ring->slots[head & ring->mask];
+    slot.timeUs = now;
+    slot.level = level;
+    slot.size = static_cast<std::uint32_t>(size);
+    std::memcpy(slot.text, text, size);
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void Logger::run() {
+    std::string normal;
+    std::string urgent;
+    std::unique_lock<std::mutex> lock(writerMutex);
+    while (true) {
+        bool stopping = stopRequested;
+        lock.unlock();
+        normal.clear();
+        urgent.clear();
+        if (drain(normal, urgent)) {
+            flush(normal, urgent);
+        }
+        lock.lock();
+        if (stopping) {
+            return;
+        }
+        writerWake.wait_for(lock, options.flushInterval, [this]() { return stopRequested; });
+    }
+}
+
+bool Logger::drain(std::string& normal, std::string& urgent) {
+    std::vector<std::shared_ptr<Ring>> current;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        current = rings;
+    }
+
+    // Slots stay put until their ring's tail moves past them
+    struct Queued {
+        const Slot* slot;
+        std::uint32_t thread;
+    };
+    std::vector<Queued> lines;
+    std::vector<std::uint64_t> heads(current.size());
+    for (std::size_t i = 0; i < current.size(); ++i) {
+        Ring& ring = *current[i];
+        std::uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+        heads[i] = ring.head.load(std::memory_order_acquire);
+        for (std::uint64_t position = tail; position < heads[i]; ++position) {
+            lines.push_back({&ring.slots[position & ring.mask], ring.thread});
+        }
+    }
+    std::stable_sort(lines.begin(), lines.end(), [](const Queued& a, const Queued& b) {
+        return a.slot->timeUs < b.slot->timeUs;
+    });
+
+    std::uint64_t droppedNow = dropped.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        for (const auto& line : lines) {
+            // With one file everything goes to it; on the console problems go to stderr
+            std::string& out = (!file && line.slot->level >= LogLevel::Warn) ? urgent : normal;
+            appendLine(out, line.slot->level, line.slot->timeUs, line.thread, line.slot->text, line.slot->size);
+        }
+        if (droppedNow > droppedReported) {
+            std::string notice = "Dropped " + std::to_string(droppedNow - droppedReported) +
+                                 " log lines from full per-thread buffers";
+            appendLine(file ? normal : urgent, LogLevel::Warn, wallMicros(), kNoThread, notice.data(), notice.size());
+            droppedReported = droppedNow;
+        }
+    }
+    written.fetch_add(lines.size(), std::memory_order_relaxed);
+
+    for (std::size_t i = 0; i < current.size(); ++i) {
+        current[i]->tail.store(heads[i], std::memory_order_release);
+    }
+
+    // Rings of exited threads go once they are empty
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        rings.erase(std::remove_if(rings.begin(), rings.end(), [](const std::shared_ptr<Ring>& ring) {
+            return ring->retired.load(std::memory_order_acquire) &&
+                   ring->tail.load(std::memory_order_relaxed) == ring->head.load(std::memory_order_acquire);
+        }), rings.end());
+    }
+    return !normal.empty() || !urgent.empty();
+}
+
+void Logger::writeNow(LogLevel level, std::int64_t timeUs, std::uint32_t thread, const char* text,
+                      std::size_t size) {
+    std::string line;
+    std::lock_guard<std::mutex> lock(outputMutex);
+    appendLine(line, level, timeUs, thread, text, size);
+    std::FILE* out = file ? file : (level >= LogLevel::Warn ? stderr : stdout);
+    std::fwrite(line.data(), 1, line.size(), out);
+    std::fflush(out);
+    written.fetch_add(1, std::memory_order_relaxed);
+}
+
+// 2026-01-31T12:34:56.789Z INFO  [3] text
+void Logger::appendLine(std::string& out, LogLevel level, std::int64_t timeUs, std::uint32_t thread,
+                        const char* text, std::size_t size) {
+    std::int64_t second = timeUs / 1000000;
+    if (second != cachedSecond) {
+        std::time_t seconds = static_cast<std::time_t>(second);
+        std::tm utc;
+        gmtime_r(&seconds, &utc);
+        std::strftime(cachedPrefix, sizeof(cachedPrefix), "%Y-%m-%dT%H:%M:%S", &utc);
+        cachedSecond = second;
+    }
+    static const char* const labels[] = {"DEBUG", "INFO", "WARN", "ERROR", "OFF"};
+    char prefix[64];
+    int length = std::snprintf(prefix, sizeof(prefix), "%s.%03dZ %-5s ", cachedPrefix,
+                               static_cast<int>(timeUs / 1000 % 1000), labels[static_cast<int>(level)]);
+    out.append(prefix, static_cast<std::size_t>(length));
+    if (thread != kNoThread) {
+        out += '[';
+        out += std::to_string(thread);
+        out += "] ";
+    }
+    out.append(text, size);
+    out += '\n';
+}
+
+void Logger::flush(const std::string& normal, const std::string& urgent) {
+    std::lock_guard<std::mutex> lock(outputMutex);
+    if (!normal.empty()) {
+        std::FILE* out = file ? file : stdout;
+        std::fwrite(normal.data(), 1, normal.size(), out);
+        std::fflush(out);
+    }
+    if (!urgent.empty()) {
+        std::fwrite(urgent.data(), 1, urgent.size(), stderr);
+        std::fflush(stderr);
+    }
+}
+
+LoggerStats Logger::getStats() const {
+    LoggerStats stats;
+    stats.written = written.load(std::memory_order_relaxed);
+    stats.dropped = dropped.load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool LogSampler::sample(LogLevel level, std::uint64_t& skipped) {
+    skipped = 0;
+    if (!Logger::instance().enabled(level)) {
+        return false;
+    }
+    if (perSecond == 0) {
+        return true;
+    }
+    std::int64_t second = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    std::int64_t current = window.load(std::memory_order_relaxed);
+    if (second != current && window.compare_exchange_strong(current, second, std::memory_order_relaxed)) {
+        inWindow.store(0, std::memory_order_relaxed);
+    }
+    if (inWindow.fetch_add(1, std::memory_order_relaxed) >= perSecond) {
+        suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    skipped = suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+}
@@ -0,0 +1,196 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+enum class LogLevel : int { Debug, Info, Warn, Error, Off };
+
+struct LoggerStats {
+    std::uint64_t written = 0;
+    std::uint64_t dropped = 0;   // Lines lost to a full ring
+};
+
+// Asynchronous logger. Each thread that logs gets its own single-producer
+// ring of fixed-size line slots, so logging never takes a lock or touches
+// the console on the calling thread: a full ring drops the line and counts
+// it. A background writer drains every ring on a short interval, orders the
+// lines by time and writes them in one call.
+//
+// Until start() and after stop() lines are written synchronously, so startup
+// and tools without a writer still see their output. The level can be
+// changed at any time.
+class Logger {
+public:
+    // Text longer than this is truncated
+    static constexpr std::size_t kMaxLineBytes = 496;
+
+    struct Options {
+        LogLevel level = LogLevel::Info;
+        std::string path;                                   // Empty: stdout, warnings and errors to stderr
+        std::size_t ringSlots = 1024;                       // Per thread, rounded up to a power of two
+        std::chrono::milliseconds flushInterval{50};
+    };
+
+    static Logger& instance();
+
+    void start(const Options& options);
+    // Drains every ring and stops the writer
+    void stop();
+
+    bool enabled(LogLevel level) const {
+        return static_cast<int>(level) >= minimumLevel.load(std::memory_order_relaxed);
+    }
+    LogLevel getLevel() const { return static_cast<LogLevel>(minimumLevel.load(std::memory_order_relaxed)); }
+    void setLevel(LogLevel level) { minimumLevel.store(static_cast<int>(level), std::memory_order_relaxed); }
+
+    void write(LogLevel level, const char* text, std::size_t size);
+    LoggerStats getStats() const;
+
+    static const char* levelName(LogLevel level);
+    // Accepts debug, info, warn, warning, error and off in any case
+    static bool parseLevel(const std::string& text, LogLevel& level);
+
+private:
+    struct Slot {
+        std::int64_t timeUs;
+        LogLevel level;
+        std::uint32_t size;
+        char text[kMaxLineBytes];
+    };
+
+    // Written only by its thread, read only by the writer
+    struct Ring {
+        std::unique_ptr<Slot[]> slots;
+        std::size_t mask = 0;
+        std::uint32_t thread = 0;
+        alignas(64) std::atomic<std::uint64_t> head{0};
+        alignas(64) std::atomic<std::uint64_t> tail{0};
+        std::atomic<bool> retired{false};   // Its thread exited
+    };
+
+    struct ThreadRing;
+    friend struct ThreadRing;
+
+    Logger() = default;
+    ~Logger();
+
+    Ring* ringForThisThread();
+    void run();
+    // Formats every queued line into normal or urgent (stderr) output; false when there were none
+    bool drain(std::string& normal, std::string& urgent);
+    void writeNow(LogLevel level, std::int64_t timeUs, std::uint32_t thread, const char* text, std::size_t size);
+    void appendLine(std::string& out, LogLevel level, std::int64_t timeUs, std::uint32_t thread,
+                    const char* text, std::size_t size);
+    void flush(const std::string& normal, const std::string& urgent);
+
+    std::atomic<int> minimumLevel{static_cast<int>(LogLevel::Info)};
+    std::atomic<bool> running{false};
+    Options options;
+
+    std::mutex ringsMutex;
+    std::vector<std::shared_ptr<Ring>> rings;
+    std::uint32_t nextThread = 0;
+
+    std::mutex writerMutex;
+    std::condition_variable writerWake;
+    bool stopRequested = false;
+    std::thread writer;
+    std::FILE* file = nullptr;
+
+    std::mutex outputMutex;   // Serializes synchronous writes with the writer
+    std::int64_t cachedSecond = -1;
+    char cachedPrefix[32] = {};
+
+    std::atomic<std::uint64_t> written{0};
+    std::atomic<std::uint64_t> dropped{0};
+    std::uint64_t droppedReported = 0;
+};
+
+struct LogSuppressed;
+
+// One log line, formatted into a stack buffer and handed to the logger when
+// the statement ends. Use through the LOG_* macros, which skip formatting
+// entirely when the level is disabled.
+class LogLine {
+public:
+    explicit LogLine(LogLevel lineLevel) : level(lineLevel) {}
+    ~LogLine() { Logger::instance().write(level, buffer, size); }
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+
+    LogLine& operator<<(std::string_view text) {
+        std::size_t count = std::min(text.size(), Logger::kMaxLineBytes - size);
+        text.copy(buffer + size, count);
+        size += count;
+        return *this;
+    }
+    LogLine& operator<<(const std::string& text) { return *this << std::string_view(text); }
+    LogLine& operator<<(const char* text) { return *this << std::string_view(text ? text : "(null)"); }
+    LogLine& operator<<(char c) { return *this << std::string_view(&c, 1); }
+    LogLine& operator<<(double value) {
+        char digits[32];
+        int length = std::snprintf(digits, sizeof(digits), "%g", value);
+        return *this << std::string_view(digits, length > 0 ? static_cast<std::size_t>(length) : 0);
+    }
+    LogLine& operator<<(const LogSuppressed& note);
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, char> &&
+                                                    !std::is_same_v<T, bool>>>
+    LogLine& operator<<(T value) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        return *this << std::string_view(digits, static_cast<std::size_t>(result.ptr - digits));
+    }
+
+private:
+    LogLevel level;
+    std::size_t size = 0;
+    char buffer[Logger::kMaxLineBytes];
+};
+
+// Appends " (N similar lines suppressed)" when count is not 0
+struct LogSuppressed {
+    std::uint64_t count;
+};
+
+inline LogLine& LogLine::operator<<(const LogSuppressed& note) {
+    if (note.count > 0) {
+        *this << " (" << note.count << " similar lines suppressed)";
+    }
+    return *this;
+}
+
+// At most perSecond calls a second pass; the rest are counted and the count
+// is reported by the next call that passes. For high-frequency events such
+// as connection opens, where one line per event would flood the log. A limit
+// of 0 passes every call.
+class LogSampler {
+public:
+    explicit LogSampler(std::uint32_t limitPerSecond) : perSecond(limitPerSecond) {}
+
+    // False without counting anything when level is disabled. skipped is set
+    // to the calls suppressed since the last one that passed.
+    bool sample(LogLevel level, std::uint64_t& skipped);
+
+private:
+    std::uint32_t perSecond;
+    std::atomic<std::int64_t> window{0};
+    std::atomic<std::uint32_t> inWindow{0};
+    std::atomic<std::uint64_t> suppressed{0};
+};
+
+#define LOG_AT(level) if (!Logger::instance().enabled(level)) {} else LogLine(level)
+#define LOG_DEBUG LOG_AT(LogLevel::Debug)
+#define LOG_INFO LOG_AT(LogLevel::Info)
+#define LOG_WARN LOG_AT(LogLevel::Warn)
+#define LOG_ERROR LOG_AT(LogLevel::Error)
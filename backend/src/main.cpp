@@ -1,45 +1,62 @@
-#include <iostream>
+#include <pthread.h>
 #include <signal.h>
-#include <thread>
-#include <chrono>
+#include <cstring>
+#include <iostream>
+#include "logger.hpp"
 #include "websocket_server.hpp"
 
-std::unique_ptr<WebSocketServer> server;
-
-void signalHandler(int signal) {
-    std::cout << "
-Shutting down server gracefully..." << std::endl;
-    if (server) {
-        server->stop();
-    }
-    exit(0);
-}
-
 int main(int argc, char* argv[]) {
-    // Set up signal handling
-    signal(SIGINT, signalHandler);
-    signal(SIGTERM, signalHandler);
+    // Block the shutdown signals before any thread exists, so every thread
+    // inherits the mask and they can only arrive through sigwait below.
+    // Stopping joins the workers, the persistence writer and the logger, none
+    // of which may run on the thread being joined.
+    sigset_t shutdownSignals;
+    sigemptyset(&shutdownSignals);
+    sigaddset(&shutdownSignals, SIGINT);
+    sigaddset(&shutdownSignals, SIGTERM);
+    int maskError = pthread_sigmask(SIG_BLOCK, &shutdownSignals, nullptr);
+    if (maskError != 0) {
+        std::cerr << "Cannot block shutdown signals: " << std::strerror(maskError) << std::endl;
+        return 1;
+    }
 
+    std::unique_ptr<WebSocketServer> lobbyServer;
     try {
         // Create and start the WebSocket server
-        int port = (argc > 1) ? std::atoi(argv[1]) : 9002;
-        server = std::make_unique<WebSocketServer>(port);
+        ServerConfig config = ServerConfig::fromEnvironment();
+        if (argc > 1) {
+            config.port = std::atoi(argv[1]);
+        }
+        Logger::Options logOptions;
+        logOptions.level = config.logLevel;
+        logOptions.path = config.logFile;
+        Logger::instance().start(logOptions);
 
-        std::cout << "Starting Game Lobby Server..." << std::endl;
-        std::cout << "WebSocket server listening on port " << port << std::endl;
-        std::cout << "Press Ctrl+C to stop the server" << std::endl;
+        lobbyServer = std::make_unique<WebSocketServer>(config);
 
-        server->start();
+        LOG_INFO << "Starting Game Lobby Server...";
+        LOG_INFO << "WebSocket server listening on port " << config.port;
+        LOG_INFO << "Press Ctrl+C to stop the server";
 
-        // Keep the main thread alive
-        while (true) {
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-        }
+        lobbyServer->start();
+
+        int received = 0;
+        sigwait(&shutdownSignals, &received);
+        LOG_INFO << "Received " << (received == SIGINT ? "SIGINT" : "SIGTERM") << ", shutting down server gracefully...";
+
+        // Joins the workers, then drains pending writes and writes the final snapshot
+        lobbyServer->stop();
+        lobbyServer.reset();
 
     } catch (const std::exception& e) {
-        std::cerr << "Server error: " << e.what() << std::endl;
+        LOG_ERROR << "Server error: " << e.what();
+        if (lobbyServer) {
+            lobbyServer->stop();
+        }
+        Logger::instance().stop();
         return 1;
     }
 
+    Logger::instance().stop();
     return 0;
 }
@@ -0,0 +1,95 @@
+#include "matchmaking_index.hpp"
+
+MatchmakingIndex::GameBuckets* MatchmakingIndex::findGame(const std::string& gameType) const {
+    std::shared_lock<std::shared_mutex> lock(gamesMutex);
+    auto it = games.find(gameType);
+    return (it != games.end()) ? it->second.get() : nullptr;
+}
+
+MatchmakingIndex::GameBuckets& MatchmakingIndex::getOrCreateGame(const std::string& gameType) {
+    if (GameBuckets* game = findGame(gameType)) {
+        return *game;
+    }
+    std::unique_lock<std::shared_mutex> lock(gamesMutex);
+    auto& game = games[gameType];
+    if (!game) {
+        game = std::make_unique<GameBuckets>();
+    }
+    return *game;
+}
+
+void MatchmakingIndex::unlink(GameBuckets& game, const std::string& roomId) {
+    auto it = game.entries.find(roomId);
+    if (it != game.entries.end()) {
+        game.byFreeSlots[it->second.freeSlots].erase(it->second.position);
+        game.entries.erase(it);
+    }
+}
+
+void MatchmakingIndex::update(const Room& room) {
+    int freeSlots = room.freeSlots();
+    bool open = room.status == RoomStatus::WAITING && freeSlots > 0;
+
+    GameBuckets& game = getOrCreateGame(room.gameType);
+    std::lock_guard<std::mutex> lock(game.mutex);
+
+    auto it = game.entries.find(room.id);
+    if (it != game.entries.end() && open && it->second.freeSlots == freeSlots) {
+        return;
+    }
+    unlink(game, room.id);
+    if (!open) {
+        return;
+    }
+
+    if (game.byFreeSlots.size() <= static_cast<std::size_t>(freeSlots)) {
+        game.byFreeSlots.resize(freeSlots + 1);
+    }
+    auto& bucket = game.byFreeSlots[freeSlots];
+    bucket.push_back(room.id);
+    game.entries[room.id] = Entry{freeSlots, std::prev(bucket.end())};
+}
+
+void MatchmakingIndex::remove(const std::string& roomId, const std::string& gameType) {
+    GameBuckets* game = findGame(gameType);
+    if (!game) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(game->mutex);
+    unlink(*game, roomId);
+}
+
+std::vector<std::string> MatchmakingIndex::candidates(const std::string& gameType, std::size_t limit) const {
+    std::vector<std::string> result;
+    auto collect = [&result, limit](GameBuckets& game) {
+        std::lock_guard<std::mutex> lock(game.mutex);
+        for (std::size_t free = 1; free < game.byFreeSlots.size() && result.size() < limit; ++free) {
+            for (const auto& roomId : game.byFreeSlots[free]) {
+                if (result.size() >= limit) {
+                    break;
+                }
+                result.push_back(roomId);
+            }
+        }
+    };
+
+    if (!gameType.empty()) {
+        if (GameBuckets* game = findGame(gameType)) {
+            collect(*game);
+        }
+        return result;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(gamesMutex);
+    for (const auto& [type, game] : games) {
+        if (result.size() >= limit) {
+            break;
+        }
+        collect(*game);
+    }
+    return result;
+}
+
+std::vector<std::string> MatchmakingIndex::openRooms(const std::string& gameType) const {
+    return candidates(gameType, static_cast<std::size_t>(-1));
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <list>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "room.hpp"
+
+// Open rooms bucketed by game type and then by free slots. Updates are O(1)
+// (unlink from one bucket, append to another) and lookups walk the buckets
+// from the fewest free slots up, so quick-match prefers nearly full rooms and
+// costs O(maxPlayers) regardless of how many rooms exist. Within a bucket,
+// rooms are served oldest first.
+//
+// Each game type has its own lock; the type table is behind a shared lock that
+// is only taken exclusively the first time a game type appears.
+class MatchmakingIndex {
+private:
+    struct Entry {
+        int freeSlots;
+        std::list<std::string>::iterator position;
+    };
+
+    struct GameBuckets {
+        std::mutex mutex;
+        std::vector<std::list<std::string>> byFreeSlots;   // Index = free slots
+        std::unordered_map<std::string, Entry> entries;
+    };
+
+    mutable std::shared_mutex gamesMutex;
+    std::unordered_map<std::string, std::unique_ptr<GameBuckets>> games;
+
+    GameBuckets* findGame(const std::string& gameType) const;
+    GameBuckets& getOrCreateGame(const std::string& gameType);
+    static void unlink(GameBuckets& game, const std::string& roomId);
+
+public:
+    // Re-buckets the room from its current state; full or non-waiting rooms
+    // are dropped from the index
+    void update(const Room& room);
+    void remove(const std::string& roomId, const std::string& gameType);
+
+    // Up to limit open rooms of the game type, nearly full first. An empty
+    // gameType searches every game type.
+    std::vector<std::string> candidates(const std::string& gameType, std::size_t limit) const;
+    std::vector<std::string> openRooms(const std::string& gameType) const;
+};
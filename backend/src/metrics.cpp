@@ -0,0 +1,167 @@
+#include "metrics.hpp"
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+std::string formatNumber(double value) {
+    char buffer[32];
+    if (value == std::floor(value) && std::fabs(value) < 1e15) {
+        std::snprintf(buffer, sizeof(buffer), "%.0f", value);
+    } else {
+        std::snprintf(buffer, sizeof(buffer), "%.10g", value);
+    }
+    return buffer;
+}
+
+std::string labelSet(const std::string& labels, const std::string& extra = "") {
+    if (labels.empty() && extra.empty()) {
+        return std::string();
+    }
+    std::string joined = labels;
+    if (!labels.empty() && !extra.empty()) {
+        joined += ',';
+    }
+    joined += extra;
+    return "{" + joined + "}";
+}
+
+void writeSample(std::string& out, const std::string& name, const std::string& labels, double value) {
+    out += name;
+    out += labels;
+    out += ' ';
+    out += formatNumber(value);
+    out += '\n';
+}
+
+} // namespace
+
+std::uint64_t Counter::value() const {
+    std::uint64_t total = 0;
+    for (std::size_t i = 0; i < metrics::kStripes; ++i) {
+        total += stripes[i].value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot result;
+    for (std::size_t i = 0; i < metrics::kStripes; ++i) {
+        const Stripe& stripe = stripes[i];
+        for (std::size_t bucket = 0; bucket < kBuckets; ++bucket) {
+            result.counts[bucket] += stripe.counts[bucket].load(std::memory_order_relaxed);
+        }
+        result.sum += stripe.sum.load(std::memory_order_relaxed);
+    }
+    for (std::uint64_t count : result.counts) {
+        result.count += count;
+    }
+    return result;
+}
+
+std::uint64_t Histogram::bucketUpperBound(std::size_t bucket) {
+    if (bucket < kSubBuckets) {
+        return bucket;
+    }
+    unsigned magnitude = static_cast<unsigned>(bucket / kSubBuckets) + kSubBucketBits - 1;
+    std::uint64_t width = std::uint64_t{1} << (magnitude - kSubBucketBits);
+    return (kSubBuckets + bucket % kSubBuckets) * width + width - 1;
+}
+
+std::uint64_t Histogram::Snapshot::countBelowPowerOfTwo(unsigned bits) const {
+    if (bits > kMaxBits) {
+        return count;
+    }
+    // Bucket boundaries fall on every power of two
+    std::size_t end = bits < kSubBucketBits ? (std::size_t{1} << bits)
+                                            : (bits - kSubBucketBits + 1) * kSubBuckets;
+    std::uint64_t total = 0;
+    for (std::size_t bucket = 0; bucket < end; ++bucket) {
+        total += counts[bucket];
+    }
+    return total;
+}
+
+std::uint64_t Histogram::Snapshot::percentile(double q) const {
+    if (count == 0) {
+        return 0;
+    }
+    std::uint64_t rank = static_cast<std::uint64_t>(std::ceil(q * static_cast<double>(count)));
+    rank = rank == 0 ? 1 : rank;
+    std::uint64_t seen = 0;
+    for (std::size_t bucket = 0; bucket < kBuckets; ++bucket) {
+        seen += counts[bucket];
+        if (seen >= rank) {
+            return bucketUpperBound(bucket);
+        }
+    }
+    return bucketUpperBound(kBuckets - 1);
+}
+
+void MetricsRegistry::add(const std::string& name, const std::string& help, const char* type,
+                          const std::string& labels, Writer write) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& family : families) {
+        if (family.name == name) {
+            family.series.push_back(Series{labels, std::move(write)});
+            return;
+        }
+    }
+    families.push_back(Family{name, help, type, {Series{labels, std::move(write)}}});
+}
+
+void MetricsRegistry::addCounter(const std::string& name, const std::string& help, const Counter& counter,
+                                 const std::string& labels) {
+    add(name, help, "counter", labels, [&counter](std::string& out, const std::string& series,
+                                                  const std::string& seriesLabels) {
+        writeSample(out, series, labelSet(seriesLabels), static_cast<double>(counter.value()));
+    });
+}
+
+void MetricsRegistry::addCounter(const std::string& name, const std::string& help, std::function<double()> read,
+                                 const std::string& labels) {
+    add(name, help, "counter", labels, [read](std::string& out, const std::string& series,
+                                              const std::string& seriesLabels) {
+        writeSample(out, series, labelSet(seriesLabels), read());
+    });
+}
+
+void MetricsRegistry::addGauge(const std::string& name, const std::string& help, std::function<double()> read,
+                               const std::string& labels) {
+    add(name, help, "gauge", labels, [read](std::string& out, const std::string& series,
+                                            const std::string& seriesLabels) {
+        writeSample(out, series, labelSet(seriesLabels), read());
+    });
+}
+
+void MetricsRegistry::addHistogram(const std::string& name, const std::string& help, const Histogram& histogram,
+                                   double scale, unsigned minBits, unsigned maxBits, const std::string& labels) {
+    add(name, help, "histogram", labels, [&histogram, scale, minBits, maxBits](
+            std::string& out, const std::string& series, const std::string& seriesLabels) {
+        Histogram::Snapshot snapshot = histogram.snapshot();
+        for (unsigned bits = minBits; bits <= maxBits; ++bits) {
+            // Values are integers, so "below 2^bits" is "at most 2^bits - 1"
+            double bound = static_cast<double>((std::uint64_t{1} << bits) - 1) * scale;
+            writeSample(out, series + "_bucket", labelSet(seriesLabels, "le=\"" + formatNumber(bound) + "\""),
+                        static_cast<double>(snapshot.countBelowPowerOfTwo(bits)));
+        }
+        writeSample(out, series + "_bucket", labelSet(seriesLabels, "le=\"+Inf\""),
+                    static_cast<double>(snapshot.count));
+        writeSample(out, series + "_sum", labelSet(seriesLabels), static_cast<double>(snapshot.sum) * scale);
+        writeSample(out, series + "_count", labelSet(seriesLabels), static_cast<double>(snapshot.count));
+    });
+}
+
+std::string MetricsRegistry::render() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string out;
+    out.reserve(16384);
+    for (const auto& family : families) {
+        out += "# HELP " + family.name + " " + family.help + "\n";
+        out += "# TYPE " + family.name + " " + family.type + "\n";
+        for (const auto& series : family.series) {
+            series.write(out, family.name, series.labels);
+        }
+    }
+    return out;
+}
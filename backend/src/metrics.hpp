@@ -0,0 +1,156 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Instruments for hot paths. Each one is split into cache-line stripes and a
+// thread always records into the same stripe, so recording is an uncontended
+// relaxed add. Stripes are only summed when metrics are read.
+namespace metrics {
+
+constexpr std::size_t kStripes = 16;
+
+// Stripes are handed out round-robin as threads first record
+inline std::size_t threadStripe() {
+    static std::atomic<std::size_t> nextStripe{0};
+    thread_local std::size_t stripe = nextStripe.fetch_add(1, std::memory_order_relaxed) % kStripes;
+    return stripe;
+}
+
+} // namespace metrics
+
+class Counter {
+public:
+    Counter() : stripes(new Stripe[metrics::kStripes]) {}
+    Counter(const Counter&) = delete;
+    Counter& operator=(const Counter&) = delete;
+
+    void add(std::uint64_t amount = 1) {
+        stripes[metrics::threadStripe()].value.fetch_add(amount, std::memory_order_relaxed);
+    }
+    std::uint64_t value() const;
+
+private:
+    struct alignas(64) Stripe {
+        std::atomic<std::uint64_t> value{0};
+    };
+    std::unique_ptr<Stripe[]> stripes;
+};
+
+// Log-linear histogram in the style of HdrHistogram: each power of two is
+// split into 8 linear sub-buckets, so a recorded value is known to within
+// 12.5%. Values are unitless integers (nanoseconds, recipients, ...) up to
+// 2^40; larger ones land in the top bucket.
+class Histogram {
+public:
+    static constexpr unsigned kSubBucketBits = 3;
+    static constexpr std::size_t kSubBuckets = std::size_t{1} << kSubBucketBits;
+    static constexpr unsigned kMaxBits = 40;
+    static constexpr std::size_t kBuckets = (kMaxBits - kSubBucketBits + 1) * kSubBuckets;
+
+    struct Snapshot {
+        std::array<std::uint64_t, kBuckets> counts{};
+        std::uint64_t count = 0;
+        std::uint64_t sum = 0;
+
+        // Recorded values below 2^bits
+        std::uint64_t countBelowPowerOfTwo(unsigned bits) const;
+        // Upper bound of the bucket holding the q-th quantile (0 <= q <= 1)
+        std::uint64_t percentile(double q) const;
+    };
+
+    Histogram() : stripes(new Stripe[metrics::kStripes]) {}
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+
+    void record(std::uint64_t value) {
+        Stripe& stripe = stripes[metrics::threadStripe()];
+        stripe.counts[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+        stripe.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+    Snapshot snapshot() const;
+
+    static std::size_t bucketFor(std::uint64_t value) {
+        if (value < kSubBuckets) {
+            return static_cast<std::size_t>(value);
+        }
+        if (value >> kMaxBits) {
+            return kBuckets - 1;
+        }
+        unsigned magnitude = 63 - static_cast<unsigned>(__builtin_clzll(value));   // floor(log2(value))
+        std::size_t subBucket = (value >> (magnitude - kSubBucketBits)) & (kSubBuckets - 1);
+        return (magnitude - kSubBucketBits + 1) * kSubBuckets + subBucket;
+    }
+    // Largest value that falls in bucket
+    static std::uint64_t bucketUpperBound(std::size_t bucket);
+
+private:
+    struct alignas(64) Stripe {
+        std::array<std::atomic<std::uint64_t>, kBuckets> counts{};
+        std::atomic<std::uint64_t> sum{0};
+    };
+    std::unique_ptr<Stripe[]> stripes;
+};
+
+// Times a scope into a histogram in nanoseconds, including exits by exception
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram& target)
+        : histogram(target), started(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        histogram.record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - started).count()));
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Histogram& histogram;
+    std::chrono::steady_clock::time_point started;
+};
+
+// Named metrics rendered in the Prometheus text format (version 0.0.4).
+// Instruments are registered by reference and must outlive the registry;
+// values kept elsewhere (queue stats, pool stats, ...) are registered as
+// callbacks and read at scrape time.
+class MetricsRegistry {
+public:
+    // labels is a rendered label set without braces, e.g. type="auth"
+    void addCounter(const std::string& name, const std::string& help, const Counter& counter,
+                    const std::string& labels = "");
+    void addCounter(const std::string& name, const std::string& help, std::function<double()> read,
+                    const std::string& labels = "");
+    void addGauge(const std::string& name, const std::string& help, std::function<double()> read,
+                  const std::string& labels = "");
+    // Exported with one le bucket per power of two from 2^minBits to 2^maxBits,
+    // each value multiplied by scale (e.g. 1e-9 for nanoseconds to seconds)
+    void addHistogram(const std::string& name, const std::string& help, const Histogram& histogram,
+                      double scale, unsigned minBits, unsigned maxBits, const std::string& labels = "");
+
+    std::string render() const;
+
+private:
+    using Writer = std::function<void(std::string& out, const std::string& name, const std::string& labels)>;
+    struct Series {
+        std::string labels;
+        Writer write;
+    };
+    struct Family {
+        std::string name;
+        std::string help;
+        const char* type;
+        std::vector<Series> series;
+    };
+
+    mutable std::mutex mutex;
+    std::vector<Family> families;   // Exposition order is registration order
+
+    void add(const std::string& name, const std::string& help, const char* type,
+             const std::string& labels, Writer write);
+};
@@ -0,0 +1,50 @@
+#include "notification_scheduler.hpp"
+
+void NotificationScheduler::addRoomEvent(const RoomEvent& event) {
+    roomEvents.fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    RoomChanges& changes = dirtyRooms[event.roomId];
+    if (event.type == RoomEvent::Type::Deleted) {
+        // Nothing else about the room matters once it is gone
+        changes.deleted = true;
+        return;
+    }
+    if (changes.eventCount++ == 0) {
+        changes.first = event;
+    }
+}
+
+void NotificationScheduler::markUserDirty(const std::string& userId) {
+    userEvents.fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    dirtyUsers.insert(userId);
+}
+
+NotificationScheduler::Batch NotificationScheduler::take() {
+    Batch batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.rooms.swap(dirtyRooms);
+        batch.users.assign(dirtyUsers.begin(), dirtyUsers.end());
+        dirtyUsers.clear();
+    }
+
+    if (!batch.empty()) {
+        ticks.fetch_add(1, std::memory_order_relaxed);
+        roomsFlushed.fetch_add(batch.rooms.size(), std::memory_order_relaxed);
+        usersFlushed.fetch_add(batch.users.size(), std::memory_order_relaxed);
+    }
+    return batch;
+}
+
+NotificationStats NotificationScheduler::getStats() const {
+    NotificationStats stats;
+    stats.roomEvents = roomEvents.load(std::memory_order_relaxed);
+    stats.userEvents = userEvents.load(std::memory_order_relaxed);
+    stats.roomsFlushed = roomsFlushed.load(std::memory_order_relaxed);
+    stats.usersFlushed = usersFlushed.load(std::memory_order_relaxed);
+    stats.ticks = ticks.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "room_manager.hpp"
+
+struct NotificationStats {
+    std::uint64_t roomEvents = 0;      // Events received from RoomManager
+    std::uint64_t userEvents = 0;
+    std::uint64_t roomsFlushed = 0;    // Dirty rooms announced, at most one per room per tick
+    std::uint64_t usersFlushed = 0;
+    std::uint64_t ticks = 0;           // Non-empty batches taken
+};
+
+// Gathers room events and dirty user ids between ticks, so a burst of changes
+// to one entity turns into a single notification when the batch is taken.
+// The tick length trades latency for message count.
+class NotificationScheduler {
+public:
+    struct RoomChanges {
+        std::size_t eventCount = 0;
+        RoomEvent first;      // The whole story when it is the only event
+        bool deleted = false;
+    };
+
+    struct Batch {
+        std::unordered_map<std::string, RoomChanges> rooms;
+        std::vector<std::string> users;
+
+        bool empty() const { return rooms.empty() && users.empty(); }
+    };
+
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string, RoomChanges> dirtyRooms;
+    std::unordered_set<std::string> dirtyUsers;
+
+    std::atomic<std::uint64_t> roomEvents{0};
+    std::atomic<std::uint64_t> userEvents{0};
+    std::atomic<std::uint64_t> roomsFlushed{0};
+    std::atomic<std::uint64_t> usersFlushed{0};
+    std::atomic<std::uint64_t> ticks{0};
+
+public:
+    void addRoomEvent(const RoomEvent& event);
+    void markUserDirty(const std::string& userId);
+
+    // Everything gathered since the previous call
+    Batch take();
+
+    NotificationStats getStats() const;
+};
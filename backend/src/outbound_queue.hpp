@@ -0,0 +1,139 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+
+// Per-connection send queue in front of the socket's write buffer. Frames are
+// handed to the socket only while its buffered amount is below the high-water
+// mark; the rest wait here, bounded in bytes. A newer frame with the same
+// coalesce key drops the queued one and takes its place at the back, so stale
+// snapshots never pile up behind a slow reader and never overtake newer messages.
+template <typename Frame>
+class OutboundQueue {
+public:
+    struct Limits {
+        std::size_t highWaterBytes;           // Socket buffer level that holds frames back
+        std::size_t maxQueueBytes;            // Queue size that disconnects immediately
+        std::chrono::milliseconds grace;      // How long a backlog may go without draining
+    };
+
+    enum class Status {
+        Idle,        // Nothing waiting
+        Backlogged,  // Frames waiting for the socket buffer to drain
+        Overflow,    // Queue exceeded maxQueueBytes
+        Stalled      // Backlog has not drained within the grace period
+    };
+
+private:
+    struct Item {
+        Frame frame;
+        std::size_t bytes;
+        std::string coalesceKey;
+    };
+
+    mutable std::mutex mutex;
+    std::deque<Item> items;
+    std::size_t bytes = 0;
+    std::chrono::steady_clock::time_point lastProgress;
+
+    // Read without the lock by metrics
+    std::atomic<std::size_t> depth{0};
+    std::atomic<std::size_t> queuedBytes{0};
+    std::atomic<std::size_t> maxDepth{0};
+    std::atomic<std::uint64_t> coalesced{0};
+
+    // Sends queued frames while the socket has room. Caller holds the lock.
+    template <typename BufferedFn, typename SendFn>
+    Status drainLocked(const Limits& limits, BufferedFn&& buffered, SendFn&& send) {
+        auto now = std::chrono::steady_clock::now();
+        bool progressed = false;
+        while (!items.empty() && buffered() < limits.highWaterBytes) {
+            Item item = std::move(items.front());
+            items.pop_front();
+            bytes -= item.bytes;
+            send(item.frame);
+            progressed = true;
+        }
+        if (progressed) {
+            lastProgress = now;
+        }
+
+        depth.store(items.size(), std::memory_order_relaxed);
+        queuedBytes.store(bytes, std::memory_order_relaxed);
+        if (items.empty()) {
+            return Status::Idle;
+        }
+        if (bytes > limits.maxQueueBytes) {
+            return Status::Overflow;
+        }
+        if (now - lastProgress > limits.grace) {
+            return Status::Stalled;
+        }
+        return Status::Backlogged;
+    }
+
+public:
+    // Queues the frame behind anything already waiting (dropping a queued frame
+    // with the same non-empty key) and sends whatever the socket accepts.
+    template <typename BufferedFn, typename SendFn>
+    Status push(Frame frame, std::size_t frameBytes, const std::string& coalesceKey,
+                const Limits& limits, BufferedFn&& buffered, SendFn&& send) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // Fast path: nothing waiting and the socket has room
+        if (items.empty() && buffered() < limits.highWaterBytes) {
+            send(frame);
+            lastProgress = std::chrono::steady_clock::now();
+            return Status::Idle;
+        }
+
+        if (!coalesceKey.empty()) {
+            for (auto it = items.begin(); it != items.end(); ++it) {
+                if (it->coalesceKey == coalesceKey) {
+                    bytes -= it->bytes;
+                    items.erase(it);
+                    coalesced.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                }
+            }
+        }
+
+        if (items.empty()) {
+            // The grace period counts from when the backlog started
+            lastProgress = std::chrono::steady_clock::now();
+        }
+        items.push_back(Item{std::move(frame), frameBytes, coalesceKey});
+        bytes += frameBytes;
+
+        std::size_t previousMax = maxDepth.load(std::memory_order_relaxed);
+        while (items.size() > previousMax &&
+               !maxDepth.compare_exchange_weak(previousMax, items.size(), std::memory_order_relaxed)) {
+        }
+        return drainLocked(limits, buffered, send);
+    }
+
+    // Retries waiting frames; called periodically while the queue is backlogged
+    template <typename BufferedFn, typename SendFn>
+    Status drain(const Limits& limits, BufferedFn&& buffered, SendFn&& send) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return drainLocked(limits, buffered, send);
+    }
+
+    // Drops everything waiting, e.g. once the connection is being closed
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        items.clear();
+        bytes = 0;
+        depth.store(0, std::memory_order_relaxed);
+        queuedBytes.store(0, std::memory_order_relaxed);
+    }
+
+    std::size_t getDepth() const { return depth.load(std::memory_order_relaxed); }
+    std::size_t getQueuedBytes() const { return queuedBytes.load(std::memory_order_relaxed); }
+    std::size_t getMaxDepth() const { return maxDepth.load(std::memory_order_relaxed); }
+    std::uint64_t getCoalesced() const { return coalesced.load(std::memory_order_relaxed); }
+};
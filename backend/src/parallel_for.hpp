@@ -0,0 +1,29 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Runs fn(i) for every i in [0, count) on up to threads threads (the caller
+// included). Items are claimed one at a time, so uneven items balance out.
+// For startup and maintenance work, not request handling.
+template <typename Fn>
+void parallelFor(std::size_t count, std::size_t threads, Fn&& fn) {
+    std::atomic<std::size_t> next{0};
+    auto worker = [&]() {
+        for (std::size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+            fn(i);
+        }
+    };
+
+    std::size_t helpers = std::min(threads, count);
+    std::vector<std::thread> pool;
+    for (std::size_t t = 1; t < helpers; ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
@@ -0,0 +1,247 @@
+#include "persistence_queue.hpp"
+#include "database_manager.hpp"
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+PersistenceRecord PersistenceRecord::upsertUser(const User& user) {
+    PersistenceRecord record;
+    record.kind = Kind::User;
+    record.op = Op::Upsert;
+    record.id = user.id.str();
+    record.user = user;
+    return record;
+}
+
+PersistenceRecord PersistenceRecord::deleteUser(const std::string& userId) {
+    PersistenceRecord record;
+    record.kind = Kind::User;
+    record.op = Op::Delete;
+    record.id = userId;
+    return record;
+}
+
+PersistenceRecord PersistenceRecord::upsertRoom(const Room& room) {
+    PersistenceRecord record;
+    record.kind = Kind::Room;
+    record.op = Op::Upsert;
+    record.id = room.id;
+    record.room = room;
+    return record;
+}
+
+PersistenceRecord PersistenceRecord::deleteRoom(const std::string& roomId) {
+    PersistenceRecord record;
+    record.kind = Kind::Room;
+    record.op = Op::Delete;
+    record.id = roomId;
+    return record;
+}
+
+PersistenceRecord PersistenceRecord::insertChat(const ChatMessage& message) {
+    PersistenceRecord record;
+    record.kind = Kind::Chat;
+    record.op = Op::Insert;
+    record.id = message.roomId;
+    record.chat = message;
+    return record;
+}
+
+PersistenceQueue::PersistenceQueue(std::shared_ptr<DatabaseManager> db, const Options& opts)
+    : dbManager(std::move(db)), options(opts), queue(opts.capacity),
+      spilling(false), nextSequence(0), stopping(false), enqueued(0), coalesced(0), written(0), failed(0), batches(0),
+      producerStalls(0), spilled(0), dropped(0), maxQueueDepth(0) {
+    if (options.batchSize == 0) {
+        options.batchSize = 1;
+    }
+    writerThread = std::thread(&PersistenceQueue::writerLoop, this);
+}
+
+PersistenceQueue::~PersistenceQueue() {
+    stop();
+}
+
+std::string PersistenceQueue::entityKey(const PersistenceRecord& record) {
+    // Prefixed so user and room ids never collide
+    return (record.kind == PersistenceRecord::Kind::User ? "u:" : "r:") + record.id;
+}
+
+bool PersistenceQueue::enqueue(PersistenceRecord record) {
+    if (stopping.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    // Callers serialize an entity's records, so this orders them per entity
+    record.sequence = nextSequence.fetch_add(1, std::memory_order_relaxed);
+    bool isChat = record.kind == PersistenceRecord::Kind::Chat;
+    if (!isChat && spilling.load(std::memory_order_acquire)) {
+        spill(std::move(record));
+        return true;
+    }
+    if (!queue.tryPush(std::move(record))) {
+        // tryPush leaves the record alone when the queue is full
+        producerStalls.fetch_add(1, std::memory_order_relaxed);
+        wakeCondition.notify_one();
+        if (isChat) {
+            // The message is already in the room's history ring and delivered
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        spill(std::move(record));
+        return true;
+    }
+    enqueued.fetch_add(1, std::memory_order_relaxed);
+
+    std::size_t depth = queue.size();
+    std::size_t previousMax = maxQueueDepth.load(std::memory_order_relaxed);
+    while (depth > previousMax &&
+           !maxQueueDepth.compare_exchange_weak(previousMax, depth, std::memory_order_relaxed)) {
+    }
+
+    // Wake the writer early once a full batch is waiting
+    if (depth >= options.batchSize) {
+        wakeCondition.notify_one();
+    }
+    return true;
+}
+
+void PersistenceQueue::spill(PersistenceRecord record) {
+    std::string key = entityKey(record);
+    {
+        std::lock_guard<std::mutex> lock(overflowMutex);
+        auto [it, inserted] = overflow.try_emplace(std::move(key));
+        if (!inserted) {
+            coalesced.fetch_add(1, std::memory_order_relaxed);
+        }
+        it->second = std::move(record);
+        spilling.store(true, std::memory_order_release);
+    }
+    enqueued.fetch_add(1, std::memory_order_relaxed);
+    spilled.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PersistenceQueue::stop() {
+    bool expected = false;
+    if (!stopping.compare_exchange_strong(expected, true)) {
+        return;
+    }
+    wakeCondition.notify_one();
+    if (writerThread.joinable()) {
+        writerThread.join();
+    }
+}
+
+PersistenceStats PersistenceQueue::getStats() const {
+    PersistenceStats stats;
+    stats.enqueued = enqueued.load(std::memory_order_relaxed);
+    stats.coalesced = coalesced.load(std::memory_order_relaxed);
+    stats.written = written.load(std::memory_order_relaxed);
+    stats.failed = failed.load(std::memory_order_relaxed);
+    stats.batches = batches.load(std::memory_order_relaxed);
+    stats.producerStalls = producerStalls.load(std::memory_order_relaxed);
+    stats.spilled = spilled.load(std::memory_order_relaxed);
+    stats.dropped = dropped.load(std::memory_order_relaxed);
+    stats.queueDepth = queue.size();
+    stats.maxQueueDepth = maxQueueDepth.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void PersistenceQueue::writerLoop() {
+    // Latest record per entity, by entityKey
+    std::unordered_map<std::string, PersistenceRecord> pending;
+    std::unordered_map<std::string, PersistenceRecord> parked;
+    std::vector<PersistenceRecord> chats;   // Appends, kept in arrival order
+    std::vector<PersistenceRecord> batch;
+    auto lastFlush = std::chrono::steady_clock::now();
+
+    auto flush = [&]() {
+        if (pending.empty() && chats.empty()) {
+            return;
+        }
+        batch.clear();
+        batch.reserve(pending.size() + chats.size());
+        for (auto& [key, record] : pending) {
+            batch.push_back(std::move(record));
+        }
+        for (auto& record : chats) {
+            batch.push_back(std::move(record));
+        }
+        pending.clear();
+        chats.clear();
+
+        std::size_t ok = dbManager->bulkWrite(batch);
+        written.fetch_add(ok, std::memory_order_relaxed);
+        failed.fetch_add(batch.size() - ok, std::memory_order_relaxed);
+        batches.fetch_add(1, std::memory_order_relaxed);
+        lastFlush = std::chrono::steady_clock::now();
+    };
+
+    auto addPending = [&](std::string key, PersistenceRecord record) {
+        auto [it, inserted] = pending.try_emplace(std::move(key));
+        if (!inserted) {
+            coalesced.fetch_add(1, std::memory_order_relaxed);
+        }
+        it->second = std::move(record);
+    };
+
+    for (;;) {
+        // Read stopping before draining so nothing pushed earlier is missed
+        bool finalPass = stopping.load(std::memory_order_acquire);
+
+        // Take the parked records, then drain the queue. The queue can hold
+        // records older than a parked one (pushed before it spilled) and newer
+        // ones (pushed after the swap), so each entity keeps the higher sequence.
+        {
+            std::lock_guard<std::mutex> lock(overflowMutex);
+            parked.swap(overflow);
+            spilling.store(false, std::memory_order_release);
+        }
+
+        PersistenceRecord record;
+        while (queue.tryPop(record)) {
+            if (record.kind == PersistenceRecord::Kind::Chat) {
+                chats.push_back(std::move(record));
+            } else {
+                // Keyed before the record is moved; argument order is unspecified
+                std::string key = entityKey(record);
+                auto parkedIt = parked.empty() ? parked.end() : parked.find(key);
+                if (parkedIt != parked.end()) {
+                    coalesced.fetch_add(1, std::memory_order_relaxed);
+                    if (record.sequence < parkedIt->second.sequence) {
+                        continue;
+                    }
+                    parked.erase(parkedIt);
+                }
+                addPending(std::move(key), std::move(record));
+            }
+
+            if (pending.size() + chats.size() >= options.batchSize) {
+                flush();
+            }
+        }
+
+        // What is still parked is newer than anything drained for its entity
+        for (auto& [key, record] : parked) {
+            addPending(key, std::move(record));
+            if (pending.size() + chats.size() >= options.batchSize) {
+                flush();
+            }
+        }
+        parked.clear();
+
+        if (finalPass) {
+            flush();
+            return;
+        }
+
+        if (std::chrono::steady_clock::now() - lastFlush >= options.flushInterval) {
+            flush();
+        }
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wakeCondition.wait_for(lock, options.flushInterval, [this]() {
+            return stopping.load(std::memory_order_acquire) || queue.size() >= options.batchSize ||
+                   spilling.load(std::memory_order_acquire);
+        });
+    }
+}
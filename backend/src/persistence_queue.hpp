@@ -0,0 +1,124 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "bounded_queue.hpp"
+#include "chat_message.hpp"
+#include "room.hpp"
+#include "user.hpp"
+
+class DatabaseManager;
+
+// A single lobby mutation waiting to be written to MongoDB. Upserts carry the
+// full document state, so only the latest record per entity needs writing.
+// Chat inserts are append-only and never coalesced.
+struct PersistenceRecord {
+    enum class Kind { User, Room, Chat };
+    enum class Op { Upsert, Delete, Insert };
+
+    Kind kind;
+    Op op;
+    std::string id;
+    User user;          // Set for user upserts
+    Room room;          // Set for room upserts
+    ChatMessage chat;   // Set for chat inserts
+    std::uint64_t sequence = 0;   // Set by enqueue; orders one entity's records
+
+    PersistenceRecord() : kind(Kind::User), op(Op::Upsert) {}
+
+    static PersistenceRecord upsertUser(const User& user);
+    static PersistenceRecord deleteUser(const std::string& userId);
+    static PersistenceRecord upsertRoom(const Room& room);
+    static PersistenceRecord deleteRoom(const std::string& roomId);
+    static PersistenceRecord insertChat(const ChatMessage& message);
+};
+
+struct PersistenceStats {
+    std::uint64_t enqueued = 0;
+    std::uint64_t coalesced = 0;       // Records superseded before reaching Mongo
+    std::uint64_t written = 0;
+    std::uint64_t failed = 0;
+    std::uint64_t batches = 0;
+    std::uint64_t producerStalls = 0;  // Pushes that found the queue full
+    std::uint64_t spilled = 0;         // User/room records parked in the overflow map
+    std::uint64_t dropped = 0;         // Chat inserts shed while the queue was full
+    std::size_t queueDepth = 0;
+    std::size_t maxQueueDepth = 0;
+};
+
+// Write-behind pipeline between RoomManager and DatabaseManager. Producers push
+// records into a bounded lock-free queue; a single writer thread coalesces them
+// per entity and flushes with bulk writes when the batch fills or the flush
+// interval elapses. stop() drains everything still queued before returning.
+//
+// enqueue never waits, since callers hold shard locks. When the queue is full
+// (e.g. MongoDB is down), user and room records are parked in an overflow map
+// that keeps only the latest record per entity, so it is bounded by the number
+// of entities rather than the write rate. Chat inserts cannot be coalesced and
+// are dropped and counted instead.
+class PersistenceQueue {
+public:
+    struct Options {
+        std::size_t capacity = 65536;
+        std::size_t batchSize = 500;
+        std::chrono::milliseconds flushInterval{50};
+    };
+
+private:
+    std::shared_ptr<DatabaseManager> dbManager;
+    Options options;
+    BoundedQueue<PersistenceRecord> queue;
+
+    // Latest parked record per entity key. While spilling is set, every user
+    // and room record goes here. A parked record can still have older records
+    // for its entity queued ahead of it, so the writer keeps whichever of the
+    // two has the higher sequence.
+    std::mutex overflowMutex;
+    std::unordered_map<std::string, PersistenceRecord> overflow;
+    std::atomic<bool> spilling;
+    std::atomic<std::uint64_t> nextSequence;
+
+    std::thread writerThread;
+    std::atomic<bool> stopping;
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+
+    std::atomic<std::uint64_t> enqueued;
+    std::atomic<std::uint64_t> coalesced;
+    std::atomic<std::uint64_t> written;
+    std::atomic<std::uint64_t> failed;
+    std::atomic<std::uint64_t> batches;
+    std::atomic<std::uint64_t> producerStalls;
+    std::atomic<std::uint64_t> spilled;
+    std::atomic<std::uint64_t> dropped;
+    std::atomic<std::size_t> maxQueueDepth;
+
+public:
+    PersistenceQueue(std::shared_ptr<DatabaseManager> db, const Options& opts);
+    PersistenceQueue(std::shared_ptr<DatabaseManager> db) : PersistenceQueue(std::move(db), Options()) {}
+    ~PersistenceQueue();
+
+    PersistenceQueue(const PersistenceQueue&) = delete;
+    PersistenceQueue& operator=(const PersistenceQueue&) = delete;
+
+    // Never blocks; returns false once stopped. A chat insert that finds the
+    // queue full is dropped and counted in PersistenceStats::dropped.
+    bool enqueue(PersistenceRecord record);
+
+    // Flushes everything queued so far and joins the writer thread. Call once
+    // producers are quiesced; records pushed concurrently with stop() may be lost.
+    void stop();
+
+    PersistenceStats getStats() const;
+
+private:
+    static std::string entityKey(const PersistenceRecord& record);
+    void spill(PersistenceRecord record);
+    void writerLoop();
+};
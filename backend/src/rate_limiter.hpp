@@ -0,0 +1,79 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Client messages grouped by cost, each class with its own rate limit, so a
+// flood of cheap lookups does not use up the budget for chat and vice versa
+enum class RateClass : std::uint8_t {
+    Auth,
+    Chat,         // Fanned out to the room and persisted
+    RoomChange,   // create_room, join_room, leave_room, quick_match
+    Query,        // get_rooms, get_users, get_room
+    Other         // Unknown or unreadable message types
+};
+
+constexpr std::size_t kRateClasses = 5;
+
+inline const char* rateClassName(RateClass rateClass) {
+    switch (rateClass) {
+        case RateClass::Auth: return "auth";
+        case RateClass::Chat: return "chat";
+        case RateClass::RoomChange: return "room_change";
+        case RateClass::Query: return "query";
+        case RateClass::Other: return "other";
+    }
+    return "other";
+}
+
+struct RateLimit {
+    double perSecond = 0;   // 0 means unlimited
+    double burst = 1;       // Messages allowed back to back after a quiet spell
+};
+
+using RateLimits = std::array<RateLimit, kRateClasses>;
+
+// Token bucket that refills continuously at perSecond up to burst; each
+// message takes one token. Not thread-safe: the owner serializes access.
+class TokenBucket {
+public:
+    bool take(const RateLimit& limit, std::chrono::steady_clock::time_point now) {
+        if (limit.perSecond <= 0) {
+            return true;
+        }
+        refill(limit, now);
+        if (tokens < 1) {
+            return false;
+        }
+        tokens -= 1;
+        return true;
+    }
+
+    // True when the bucket would be full by now, so dropping it loses nothing
+    bool idle(const RateLimit& limit, std::chrono::steady_clock::time_point now) const {
+        return !started || limit.perSecond <= 0 ||
+               tokens + elapsedSeconds(now) * limit.perSecond >= limit.burst;
+    }
+
+private:
+    void refill(const RateLimit& limit, std::chrono::steady_clock::time_point now) {
+        if (!started) {
+            // A new bucket starts full
+            tokens = limit.burst;
+            started = true;
+        } else {
+            tokens = std::min(limit.burst, tokens + elapsedSeconds(now) * limit.perSecond);
+        }
+        refilledAt = now;
+    }
+
+    double elapsedSeconds(std::chrono::steady_clock::time_point now) const {
+        return now > refilledAt ? std::chrono::duration<double>(now - refilledAt).count() : 0.0;
+    }
+
+    double tokens = 0;
+    bool started = false;
+    std::chrono::steady_clock::time_point refilledAt;
+};
@@ -1,7 +1,11 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cstdint>
+#include "id_interner.hpp"
 
 enum class RoomStatus {
     WAITING,
@@ -9,25 +13,98 @@ enum class RoomStatus {
     FINISHED
 };
 
+// Room members stored inline as interned ids. Rooms are small, so the list is
+// a fixed array of 32-bit handles: copying a room never allocates, and a
+// membership test compares every slot (unused ones hold handle 0) in a loop
+// the compiler can vectorize. The capacity matches the client's largest room.
+class PlayerList {
+public:
+    static constexpr std::size_t kCapacity = 10;
+
+private:
+    std::array<InternedId, kCapacity> slots;
+    std::uint8_t count = 0;
+
+public:
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const InternedId* begin() const { return slots.data(); }
+    const InternedId* end() const { return slots.data() + count; }
+
+    bool contains(const std::string& userId) const {
+        IdInterner::Handle handle = IdInterner::instance().find(userId);
+        if (!handle) {
+            return false;
+        }
+        bool found = false;
+        for (const auto& slot : slots) {
+            found |= slot.get() == handle;
+        }
+        return found;
+    }
+
+    bool add(const std::string& userId) {
+        if (count == kCapacity) {
+            return false;
+        }
+        slots[count++] = InternedId(userId);
+        return true;
+    }
+
+    // Keeps the remaining players in join order
+    bool remove(const std::string& userId) {
+        IdInterner::Handle handle = IdInterner::instance().find(userId);
+        auto it = std::find_if(slots.begin(), slots.begin() + count,
+                               [handle](const InternedId& slot) { return handle && slot.get() == handle; });
+        if (it == slots.begin() + count) {
+            return false;
+        }
+        std::move(it + 1, slots.begin() + count, it);
+        slots[--count] = InternedId();
+        return true;
+    }
+
+    std::vector<std::string> ids() const {
+        std::vector<std::string> result;
+        result.reserve(count);
+        for (const auto& slot : *this) {
+            result.push_back(slot.str());
+        }
+        return result;
+    }
+};
+
 struct Room {
     std::string id;
     std::string name;
     std::string gameType;
-    std::vector<std::string> players;
-    std::string createdBy;
+    PlayerList players;
+    InternedId createdBy;
     int maxPlayers;
     RoomStatus status;
     std::chrono::system_clock::time_point createdAt;
+    std::uint64_t version;   // Bumped on every change; clients use it to detect missed deltas
 
-    Room() : maxPlayers(4), status(RoomStatus::WAITING) {}
-    Room(const std::string& roomId, const std::string& roomName, 
+    Room() : maxPlayers(4), status(RoomStatus::WAITING), version(0) {}
+    Room(const std::string& roomId, const std::string& roomName,
          const std::string& creator, const std::string& game = "Generic")
-        : id(roomId), name(roomName), createdBy(creator), gameType(game),
+        : id(roomId), name(roomName), gameType(game), createdBy(creator),
           maxPlayers(4), status(RoomStatus::WAITING),
-          createdAt(std::chrono::system_clock::now()) {}
+          createdAt(std::chrono::system_clock::now()), version(1) {}
 
-    bool isFull() const { return players.size() >= maxPlayers; }
+    // maxPlayers is kept within 1..PlayerList::kCapacity; every room built
+    // from stored or forwarded state goes through this
+    static int clampMaxPlayers(int requested) {
+        return std::max(1, std::min(requested, static_cast<int>(PlayerList::kCapacity)));
+    }
+
+    int freeSlots() const {
+        return maxPlayers - static_cast<int>(players.size());
+    }
+    bool isFull() const {
+        return freeSlots() <= 0;
+    }
     bool hasPlayer(const std::string& userId) const {
-        return std::find(players.begin(), players.end(), userId) != players.end();
+        return players.contains(userId);
     }
 };
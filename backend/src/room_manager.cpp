@@ -1,186 +1,694 @@
 #include "room_manager.hpp"
+#include "logger.hpp"
+#include "parallel_for.hpp"
+#include "state_snapshot.hpp"
 #include <algorithm>
-#include <random>
+#include <atomic>
 #include <sstream>
-#include <iostream>
 
-RoomManager::RoomManager(std::shared_ptr<DatabaseManager> db) : dbManager(db) {
-    // Load existing rooms and users from database
-    // This would be implemented with proper database queries
-}
+namespace {
 
-std::string RoomManager::createRoom(const std::string& name, const std::string& creatorId,
-                                   const std::string& gameType) {
-    std::lock_guard<std::mutex> lock(roomsMutex);
+// Documents stamped up to this long before the snapshot are read back too,
+// covering writes that were in flight while it was taken
+const std::int64_t kReconcileOverlapMs = 1000;
 
-    std::string roomId = generateRoomId();
-    Room room(roomId, name, creatorId, gameType);
-    room.players.push_back(creatorId);
+// Rooms per work item when rebuilding the indexes
+const std::size_t kIndexChunk = 4096;
 
-    rooms[roomId] = room;
+// Sampled ids per range when splitting an id space
+const std::size_t kSamplesPerRange = 32;
 
-    // Update user's current room
-    {
-        std::lock_guard<std::mutex> userLock(usersMutex);
-        if (users.find(creatorId) != users.end()) {
-            users[creatorId].currentRoom = roomId;
-            dbManager->updateUser(users[creatorId]);
+std::int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+long elapsedMs(std::chrono::steady_clock::time_point since) {
+    return static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - since).count());
+}
+
+// Up to count contiguous ranges covering every id, each holding a similar
+// share of ids. Boundaries come from a sorted sample, so this costs far less
+// than sorting all of them.
+std::vector<IdRange> partitionIds(const std::vector<std::string>& ids, std::size_t count) {
+    std::vector<IdRange> ranges;
+    if (ids.empty() || count <= 1) {
+        ranges.push_back(IdRange{});
+        return ranges;
+    }
+    std::size_t stride = std::max<std::size_t>(1, ids.size() / (count * kSamplesPerRange));
+    std::vector<std::string> sample;
+    for (std::size_t i = 0; i < ids.size(); i += stride) {
+        sample.push_back(ids[i]);
+    }
+    std::sort(sample.begin(), sample.end());
+
+    std::string from;
+    for (std::size_t r = 1; r < count; ++r) {
+        const std::string& bound = sample[r * sample.size() / count];
+        if (bound > from) {
+            ranges.push_back(IdRange{from, bound});
+            from = bound;
         }
     }
+    ranges.push_back(IdRange{from, ""});
+    return ranges;
+}
 
-    // Save to database
-    dbManager->insertRoom(room);
+// Moves each id into the bucket of the range holding it
+std::vector<std::vector<std::string>> bucketIds(std::vector<std::string>& ids, const std::vector<IdRange>& ranges) {
+    std::vector<std::vector<std::string>> buckets(ranges.size());
+    for (auto& id : ids) {
+        // The first range starts open, so the match is never before it
+        auto it = std::upper_bound(ranges.begin(), ranges.end(), id,
+                                   [](const std::string& value, const IdRange& range) { return value < range.from; });
+        buckets[static_cast<std::size_t>(it - ranges.begin()) - 1].push_back(std::move(id));
+    }
+    return buckets;
+}
 
-    notifyRoomUpdate(roomId);
-    return roomId;
+// Ids held locally that the database no longer has
+std::vector<std::string> missingFrom(std::vector<std::string>& stored, std::vector<std::string>& local) {
+    std::sort(stored.begin(), stored.end());
+    std::sort(local.begin(), local.end());
+    std::vector<std::string> missing;
+    std::set_difference(local.begin(), local.end(), stored.begin(), stored.end(), std::back_inserter(missing));
+    return missing;
 }
 
-bool RoomManager::joinRoom(const std::string& roomId, const std::string& userId) {
-    std::lock_guard<std::mutex> lock(roomsMutex);
+template <typename T>
+std::vector<std::string> keysOf(ShardedMap<T>& map) {
+    std::vector<std::string> keys;
+    map.forEachShard([&keys](const auto& items) {
+        for (const auto& entry : items) {
+            keys.push_back(entry.first);
+        }
+    });
+    return keys;
+}
 
-    auto roomIt = rooms.find(roomId);
-    if (roomIt == rooms.end()) {
-        return false;
+} // namespace
+
+RoomManager::RoomManager(std::shared_ptr<DatabaseManager> db,
+                         const PersistenceQueue::Options& persistenceOptions,
+                         const ChatHistory::Options& chatOptions,
+                         std::uint16_t nodeId)
+    : chatHistory(chatOptions), nodeId(nodeId), roomIds(nodeId), dbManager(db), persistence(std::make_unique<PersistenceQueue>(db, persistenceOptions)) {
+    // Existing rooms and users are loaded by restore()
+}
+
+RoomManager::~RoomManager() {
+    shutdown();
+}
+
+void RoomManager::shutdown() {
+    stopSnapshots();
+    persistence->stop();
+    if (shutDown) {
+        return;
+    }
+    shutDown = true;
+    // Every change the snapshot holds has now reached the database, so the
+    // next start need not look for deletions made after it
+    if (!snapshotPath.empty()) {
+        writeSnapshot(true);
     }
+}
 
-    Room& room = roomIt->second;
-    if (room.isFull() || room.hasPlayer(userId)) {
-        return false;
+RestoreStats RoomManager::restore(const std::string& path, std::size_t threads) {
+    RestoreStats stats;
+    auto started = std::chrono::steady_clock::now();
+
+    StateSnapshot::Contents snapshot;
+    stats.fromSnapshot = !path.empty() && StateSnapshot::read(path, snapshot, threads);
+    if (stats.fromSnapshot) {
+        rooms.insertAll(std::move(snapshot.rooms), [](const Room& room) { return room.id; }, threads);
+        users.insertAll(std::move(snapshot.users), [](const User& user) { return user.id.str(); }, threads);
+    }
+    stats.snapshotMs = elapsedMs(started);
+
+    if (dbManager->isDurable()) {
+        auto reconcileStarted = std::chrono::steady_clock::now();
+        // Without a snapshot the database is loaded whole
+        std::int64_t sinceMs = stats.fromSnapshot
+            ? std::max<std::int64_t>(0, snapshot.takenAtMs - kReconcileOverlapMs) : 0;
+        reconcile(sinceMs, stats.fromSnapshot && !snapshot.clean, threads, stats);
+        stats.reconcileMs = elapsedMs(reconcileStarted);
+    }
+    if (isLocalRoom) {
+        dropForeignState(stats);
     }
 
-    room.players.push_back(userId);
+    auto indexStarted = std::chrono::steady_clock::now();
+    rebuildIndexes(threads);
+    stats.indexMs = elapsedMs(indexStarted);
 
-    // Update user's current room
-    {
-        std::lock_guard<std::mutex> userLock(usersMutex);
-        if (users.find(userId) != users.end()) {
-            users[userId].currentRoom = roomId;
-            dbManager->updateUser(users[userId]);
+    stats.restoredUsers = keysOf(users);
+    stats.users = stats.restoredUsers.size();
+    stats.rooms = rooms.snapshot()->size();
+    stats.totalMs = elapsedMs(started);
+    return stats;
+}
+
+void RoomManager::reconcile(std::int64_t sinceMs, bool pruneDeleted, std::size_t threads, RestoreStats& stats) {
+    // Each collection is split into ranges read by parallel cursors; ranges
+    // are cut from the ids already loaded so they hold similar shares
+    std::vector<std::string> localRooms = keysOf(rooms);
+    std::vector<std::string> localUsers = keysOf(users);
+    std::vector<IdRange> roomRanges = partitionIds(localRooms, threads);
+    std::vector<IdRange> userRanges = partitionIds(localUsers, threads);
+    std::vector<std::vector<std::string>> roomBuckets = bucketIds(localRooms, roomRanges);
+    std::vector<std::vector<std::string>> userBuckets = bucketIds(localUsers, userRanges);
+
+    std::vector<std::vector<Room>> changedRooms(roomRanges.size());
+    std::vector<std::vector<User>> changedUsers(userRanges.size());
+    std::vector<std::vector<std::string>> staleRooms(roomRanges.size());
+    std::vector<std::vector<std::string>> staleUsers(userRanges.size());
+    std::atomic<bool> failed{false};
+
+    parallelFor(roomRanges.size() + userRanges.size(), threads, [&](std::size_t task) {
+        bool ok;
+        if (task < roomRanges.size()) {
+            ok = dbManager->loadRooms(roomRanges[task], sinceMs, changedRooms[task]);
+            if (ok && pruneDeleted) {
+                std::vector<std::string> stored;
+                ok = dbManager->scanIds(DatabaseManager::Collection::Rooms, roomRanges[task], stored);
+                staleRooms[task] = missingFrom(stored, roomBuckets[task]);
+            }
+        } else {
+            task -= roomRanges.size();
+            ok = dbManager->loadUsers(userRanges[task], sinceMs, changedUsers[task]);
+            if (ok && pruneDeleted) {
+                std::vector<std::string> stored;
+                ok = dbManager->scanIds(DatabaseManager::Collection::Users, userRanges[task], stored);
+                staleUsers[task] = missingFrom(stored, userBuckets[task]);
+            }
+        }
+        if (!ok) {
+            failed.store(true, std::memory_order_relaxed);
         }
+    });
+    stats.reconciled = !failed;
+    if (failed) {
+        // A partial id scan would look like mass deletion, so nothing is pruned
+        LOG_WARN << "Warm start could not read everything from the database; "
+                 << "some rooms or users may be out of date";
     }
 
-    // Update database
-    dbManager->updateRoom(room);
+    // A room changed after the snapshot may also be newer in the snapshot when
+    // its last writes never reached the database; the higher version wins
+    for (auto& changed : changedRooms) {
+        for (auto& room : changed) {
+            std::string roomId = room.id;
+            rooms.modify(roomId, [&](auto& items) {
+                auto it = items.find(roomId);
+                if (it == items.end() || it->second.version <= room.version) {
+                    items[roomId] = std::move(room);
+                    ++stats.updatedFromDatabase;
+                }
+            });
+        }
+    }
+    for (auto& changed : changedUsers) {
+        for (auto& user : changed) {
+            std::string userId = user.id.str();
+            users.modify(userId, [&](auto& items) { items[userId] = std::move(user); });
+            ++stats.updatedFromDatabase;
+        }
+    }
 
-    notifyRoomUpdate(roomId);
-    return true;
+    if (failed) {
+        return;
+    }
+    for (const auto& stale : staleRooms) {
+        for (const auto& roomId : stale) {
+            rooms.modify(roomId, [&](auto& items) { items.erase(roomId); });
+            ++stats.removedStale;
+        }
+    }
+    for (const auto& stale : staleUsers) {
+        for (const auto& userId : stale) {
+            users.modify(userId, [&](auto& items) { items.erase(userId); });
+            ++stats.removedStale;
+        }
+    }
 }
 
-bool RoomManager::leaveRoom(const std::string& roomId, const std::string& userId) {
-    std::lock_guard<std::mutex> lock(roomsMutex);
+void RoomManager::dropForeignState(RestoreStats& stats) {
+    // Other nodes serve and persist their own rooms, and expire their own
+    // users; adopting either would fight them over the shared documents.
+    // Users with no homeNode predate cluster mode and are left alone too.
+    std::vector<std::string> foreignRooms;
+    rooms.forEachShard([&](const auto& items) {
+        for (const auto& [roomId, room] : items) {
+            if (!isLocalRoom(roomId)) {
+                foreignRooms.push_back(roomId);
+            }
+        }
+    });
+    std::vector<std::string> foreignUsers;
+    users.forEachShard([&](const auto& items) {
+        for (const auto& [userId, user] : items) {
+            if (user.homeNode != nodeId) {
+                foreignUsers.push_back(userId);
+            }
+        }
+    });
+    for (const auto& roomId : foreignRooms) {
+        rooms.modify(roomId, [&](auto& items) { items.erase(roomId); });
+    }
+    for (const auto& userId : foreignUsers) {
+        users.modify(userId, [&](auto& items) { items.erase(userId); });
+    }
+    stats.skippedForeign = foreignRooms.size() + foreignUsers.size();
+}
 
-    auto roomIt = rooms.find(roomId);
-    if (roomIt == rooms.end()) {
-        return false;
+void RoomManager::rebuildIndexes(std::size_t threads) {
+    // Chat rings are not rebuilt; a restored room's history is read from the
+    // database the first time it is asked for
+    std::shared_ptr<const std::vector<Room>> all = rooms.snapshot();
+    std::size_t chunks = (all->size() + kIndexChunk - 1) / kIndexChunk;
+    parallelFor(chunks, threads, [&](std::size_t chunk) {
+        std::size_t end = std::min(all->size(), (chunk + 1) * kIndexChunk);
+        for (std::size_t i = chunk * kIndexChunk; i < end; ++i) {
+            const Room& room = (*all)[i];
+            matchmaking.update(room);
+            for (const auto& player : room.players) {
+                addMembership(player.str(), room.id);
+            }
+        }
+    });
+}
+
+void RoomManager::startSnapshots(const std::string& path, std::chrono::milliseconds interval) {
+    snapshotPath = path;
+    if (path.empty() || interval.count() <= 0 || snapshotThread.joinable()) {
+        return;
     }
+    snapshotThread = std::thread([this, interval]() {
+        std::unique_lock<std::mutex> lock(snapshotMutex);
+        while (!snapshotWake.wait_for(lock, interval, [this]() { return snapshotsStopping; })) {
+            lock.unlock();
+            writeSnapshot(false);
+            lock.lock();
+        }
+    });
+}
+
+void RoomManager::stopSnapshots() {
+    {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        snapshotsStopping = true;
+    }
+    snapshotWake.notify_all();
+    if (snapshotThread.joinable()) {
+        snapshotThread.join();
+    }
+}
 
-    Room& room = roomIt->second;
-    auto playerIt = std::find(room.players.begin(), room.players.end(), userId);
-    if (playerIt == room.players.end()) {
+bool RoomManager::writeSnapshot(bool clean) {
+    if (snapshotPath.empty()) {
         return false;
     }
+    // Stamped before the maps are read, so every change the snapshot misses
+    // reaches the database with a later updatedAt
+    std::int64_t takenAtMs = nowMs();
+    auto started = std::chrono::steady_clock::now();
+    std::shared_ptr<const std::vector<Room>> allRooms = rooms.snapshot();
+    std::shared_ptr<const std::vector<User>> allUsers = users.snapshot();
+    if (!StateSnapshot::write(snapshotPath, *allRooms, *allUsers, takenAtMs, clean)) {
+        return false;
+    }
+    if (clean) {
+        LOG_INFO << "Wrote snapshot of " << allRooms->size() << " rooms and " << allUsers->size()
+                 << " users to " << snapshotPath << " in " << elapsedMs(started) << "ms";
+    }
+    return true;
+}
+
+PersistenceStats RoomManager::getPersistenceStats() const {
+    return persistence->getStats();
+}
+
+ChatHistoryStats RoomManager::getChatHistoryStats() const {
+    return chatHistory.getStats();
+}
 
-    room.players.erase(playerIt);
+std::string RoomManager::createRoom(const std::string& name, const std::string& creatorId,
+                                   const std::string& gameType) {
+    std::string roomId = generateRoomId();
+    Room room(roomId, name, creatorId, gameType);
+    room.players.add(creatorId);
+
+    rooms.modify(roomId, [&](auto& items) {
+        items[roomId] = room;
+        // Under the shard lock, like removeRoom, so the ring exists before
+        // anyone can find the room and chat in it
+        chatHistory.addRoom(roomId);
+        addMembership(creatorId, roomId);
+        matchmaking.update(room);
+        // Save to database
+        persistence->enqueue(PersistenceRecord::upsertRoom(room));
+    });
 
     // Update user's current room
-    {
-        std::lock_guard<std::mutex> userLock(usersMutex);
-        if (users.find(userId) != users.end()) {
-            users[userId].currentRoom = "";
-            dbManager->updateUser(users[userId]);
+    setCurrentRoom(creatorId, roomId);
+
+    notifyRoomUpdate(RoomEvent{RoomEvent::Type::Created, roomId, creatorId, room});
+    return roomId;
+}
+
+bool RoomManager::joinRoom(const std::string& roomId, const std::string& userId) {
+    Room updated;
+    bool joined = rooms.modify(roomId, [&](auto& items) {
+        auto roomIt = items.find(roomId);
+        if (roomIt == items.end()) {
+            return false;
         }
+
+        Room& room = roomIt->second;
+        if (room.isFull() || room.hasPlayer(userId)) {
+            return false;
+        }
+
+        room.players.add(userId);
+        ++room.version;
+        addMembership(userId, roomId);
+        matchmaking.update(room);
+
+        // Update database
+        persistence->enqueue(PersistenceRecord::upsertRoom(room));
+        updated = room;
+        return true;
+    });
+    if (!joined) {
+        return false;
     }
 
-    // If room is empty, delete it
-    if (room.players.empty()) {
-        dbManager->deleteRoom(roomId);
-        rooms.erase(roomIt);
+    // Update user's current room
+    setCurrentRoom(userId, roomId);
+
+    notifyRoomUpdate(RoomEvent{RoomEvent::Type::PlayerJoined, roomId, userId, std::move(updated)});
+    return true;
+}
+
+bool RoomManager::leaveRoom(const std::string& roomId, const std::string& userId) {
+    bool roomDeleted = false;
+    Room updated;
+    bool left = rooms.modify(roomId, [&](auto& items) {
+        auto roomIt = items.find(roomId);
+        if (roomIt == items.end()) {
+            return false;
+        }
+
+        Room& room = roomIt->second;
+        if (!room.players.remove(userId)) {
+            return false;
+        }
+
+        ++room.version;
+        removeMembership(userId, roomId);
+
+        // If room is empty, delete it
+        if (room.players.empty()) {
+            persistence->enqueue(PersistenceRecord::deleteRoom(roomId));
+            matchmaking.remove(roomId, room.gameType);
+            chatHistory.removeRoom(roomId);
+            items.erase(roomIt);
+            roomDeleted = true;
+        } else {
+            // Update database
+            persistence->enqueue(PersistenceRecord::upsertRoom(room));
+            matchmaking.update(room);
+            updated = room;
+        }
         return true;
+    });
+    if (!left) {
+        return false;
     }
 
-    // Update database
-    dbManager->updateRoom(room);
+    // Update user's current room
+    setCurrentRoom(userId, "");
 
-    notifyRoomUpdate(roomId);
+    if (roomDeleted) {
+        notifyRoomUpdate(RoomEvent{RoomEvent::Type::Deleted, roomId, userId, Room()});
+    } else {
+        notifyRoomUpdate(RoomEvent{RoomEvent::Type::PlayerLeft, roomId, userId, std::move(updated)});
+    }
     return true;
 }
 
 bool RoomManager::addUser(const User& user) {
-    std::lock_guard<std::mutex> lock(usersMutex);
-    users[user.id] = user;
-    dbManager->insertUser(user);
-    notifyUserUpdate(user.id);
+    std::string userId = user.id.str();
+    users.modify(userId, [&](auto& items) {
+        User& stored = items[userId];
+        stored = user;
+        stored.homeNode = nodeId;
+        persistence->enqueue(PersistenceRecord::upsertUser(stored));
+    });
+    notifyUserUpdate(userId);
     return true;
 }
 
 bool RoomManager::removeUser(const std::string& userId) {
-    // First remove user from any rooms they're in
-    {
-        std::lock_guard<std::mutex> roomLock(roomsMutex);
-        for (auto& [roomId, room] : rooms) {
-            auto playerIt = std::find(room.players.begin(), room.players.end(), userId);
-            if (playerIt != room.players.end()) {
-                room.players.erase(playerIt);
+    leaveAllRooms(userId);
+
+    users.modify(userId, [&](auto& items) {
+        items.erase(userId);
+        persistence->enqueue(PersistenceRecord::deleteUser(userId));
+    });
+    notifyUserUpdate(userId);
+    return true;
+}
+
+void RoomManager::leaveAllRooms(const std::string& userId) {
+    std::vector<RoomEvent> events;
+
+    // The membership index names every room the user is in, so cleanup costs
+    // O(rooms joined) instead of a scan over all rooms. Loop in case a join
+    // landed while we were working.
+    for (std::vector<std::string> memberOf = takeMemberships(userId); !memberOf.empty();
+         memberOf = takeMemberships(userId)) {
+        for (const auto& roomId : memberOf) {
+            rooms.modify(roomId, [&](auto& items) {
+                auto roomIt = items.find(roomId);
+                if (roomIt == items.end()) {
+                    return;
+                }
+                Room& room = roomIt->second;
+                if (!room.players.remove(userId)) {
+                    return;
+                }
+
+                ++room.version;
                 if (room.players.empty()) {
-                    dbManager->deleteRoom(roomId);
-                    rooms.erase(roomId);
-                    break;
+                    persistence->enqueue(PersistenceRecord::deleteRoom(roomId));
+                    matchmaking.remove(roomId, room.gameType);
+                    chatHistory.removeRoom(roomId);
+                    items.erase(roomIt);
+                    events.push_back(RoomEvent{RoomEvent::Type::Deleted, roomId, userId, Room()});
                 } else {
-                    dbManager->updateRoom(room);
+                    persistence->enqueue(PersistenceRecord::upsertRoom(room));
+                    matchmaking.update(room);
+                    events.push_back(RoomEvent{RoomEvent::Type::PlayerLeft, roomId, userId, room});
                 }
-                notifyRoomUpdate(roomId);
-            }
+            });
         }
     }
 
-    std::lock_guard<std::mutex> lock(usersMutex);
-    users.erase(userId);
-    dbManager->deleteUser(userId);
-    return true;
+    for (const auto& event : events) {
+        notifyRoomUpdate(event);
+    }
 }
 
 bool RoomManager::sendChatMessage(const std::string& roomId, const std::string& userId,
                                  const std::string& message) {
-    std::lock_guard<std::mutex> userLock(usersMutex);
-    auto userIt = users.find(userId);
-    if (userIt == users.end()) {
+    std::string username = users.read(userId, [&](const auto& items) {
+        auto userIt = items.find(userId);
+        return (userIt != items.end()) ? userIt->second.username : std::string();
+    });
+    if (username.empty()) {
         return false;
     }
 
-    const User& user = userIt->second;
-    return dbManager->insertChatMessage(roomId, userId, user.username, message);
+    return recordChat(ChatMessage(roomId, userId, username, message));
 }
 
-std::vector<Room> RoomManager::getAllRooms() {
-    std::lock_guard<std::mutex> lock(roomsMutex);
+bool RoomManager::recordChat(const ChatMessage& message) {
+    chatHistory.append(message);
+    return persistence->enqueue(PersistenceRecord::insertChat(message));
+}
+
+std::vector<ChatHistory::Entry> RoomManager::getChatHistory(const std::string& roomId) {
+    std::vector<ChatHistory::Entry> history;
+    if (chatHistory.get(roomId, history)) {
+        return history;
+    }
+
+    // Only live rooms are cached; anything else has no history to send
+    if (rooms.get(roomId).id.empty()) {
+        return history;
+    }
+    std::vector<ChatMessage> stored = dbManager->getChatHistory(
+        roomId, static_cast<int>(chatHistory.getOptions().maxEntries));
+
+    // Warm under the room's shard lock so a room deleted meanwhile stays uncached
+    rooms.read(roomId, [&](const auto& items) {
+        if (items.count(roomId)) {
+            chatHistory.warm(roomId, stored);
+        }
+    });
+    chatHistory.get(roomId, history);
+    return history;
+}
+
+bool RoomManager::setRoomStatus(const std::string& roomId, RoomStatus status) {
+    Room updated;
+    bool changed = rooms.modify(roomId, [&](auto& items) {
+        auto roomIt = items.find(roomId);
+        if (roomIt == items.end() || roomIt->second.status == status) {
+            return false;
+        }
+
+        Room& room = roomIt->second;
+        room.status = status;
+        ++room.version;
+        matchmaking.update(room);
+        persistence->enqueue(PersistenceRecord::upsertRoom(room));
+        updated = room;
+        return true;
+    });
+    if (changed) {
+        notifyRoomUpdate(RoomEvent{RoomEvent::Type::StatusChanged, roomId, "", std::move(updated)});
+    }
+    return changed;
+}
+
+Room RoomManager::getRoomById(const std::string& roomId) {
+    return rooms.get(roomId);
+}
+
+User RoomManager::getUserById(const std::string& userId) {
+    return users.get(userId);
+}
+
+std::shared_ptr<const std::vector<Room>> RoomManager::getAllRooms() {
+    return rooms.snapshot();
+}
+
+std::shared_ptr<const std::vector<User>> RoomManager::getOnlineUsers() {
+    return users.snapshot();
+}
+
+std::vector<Room> RoomManager::findAvailableRooms(const std::string& gameType) {
     std::vector<Room> result;
-    for (const auto& [id, room] : rooms) {
-        result.push_back(room);
+    for (const auto& roomId : matchmaking.openRooms(gameType)) {
+        Room room = rooms.get(roomId);
+        if (!room.id.empty()) {
+            result.push_back(std::move(room));
+        }
     }
     return result;
 }
 
-std::vector<User> RoomManager::getOnlineUsers() {
-    std::lock_guard<std::mutex> lock(usersMutex);
-    std::vector<User> result;
-    for (const auto& [id, user] : users) {
-        if (user.isOnline) {
-            result.push_back(user);
+std::string RoomManager::findOrCreateRoom(const std::string& userId, const std::string& gameType) {
+    // Candidates can fill up between lookup and join, so try a few
+    constexpr std::size_t kCandidates = 4;
+    for (const auto& roomId : matchmaking.candidates(gameType, kCandidates)) {
+        if (joinRoom(roomId, userId)) {
+            return roomId;
         }
     }
-    return result;
+    return createRoom(gameType + " Match", userId, gameType);
+}
+
+std::vector<std::string> RoomManager::matchPlayers(const std::vector<std::string>& userIds,
+                                                   const std::string& gameType) {
+    // Each placement updates the index, so later players in the batch fill
+    // the rooms earlier ones joined or created
+    std::vector<std::string> assigned;
+    assigned.reserve(userIds.size());
+    for (const auto& userId : userIds) {
+        assigned.push_back(findOrCreateRoom(userId, gameType));
+    }
+    return assigned;
 }
 
 std::string RoomManager::generateRoomId() {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<> dis(100000, 999999);
-    return "room_" + std::to_string(dis(gen));
+    // "r_" plus 11 base62 digits stays within the small-string buffer, so
+    // room ids are never heap allocated when created, copied or looked up
+    // About one draw per node in the cluster; the cap only guards against a
+    // ring that gives this node nothing
+    constexpr int kMaxDraws = 1024;
+    std::string roomId;
+    for (int draw = 0; draw < kMaxDraws; ++draw) {
+        roomId = "r_";
+        SnowflakeIdGenerator::appendBase62(roomIds.next(), roomId);
+        if (!isLocalRoom || isLocalRoom(roomId)) {
+            break;
+        }
+    }
+    return roomId;
+}
+
+void RoomManager::setCurrentRoom(const std::string& userId, const std::string& roomId) {
+    // Players connected to another node have no user record here
+    bool found = users.modify(userId, [&](auto& items) {
+        auto userIt = items.find(userId);
+        if (userIt == items.end()) {
+            return false;
+        }
+        userIt->second.currentRoom = InternedId(roomId);
+        persistence->enqueue(PersistenceRecord::upsertUser(userIt->second));
+        return true;
+    });
+    if (found) {
+        notifyUserUpdate(userId);
+    }
+}
+
+void RoomManager::addMembership(const std::string& userId, const std::string& roomId) {
+    memberships.modify(userId, [&](auto& items) {
+        items[userId].emplace_back(roomId);
+    });
+}
+
+void RoomManager::removeMembership(const std::string& userId, const std::string& roomId) {
+    memberships.modify(userId, [&](auto& items) {
+        auto it = items.find(userId);
+        if (it == items.end()) {
+            return;
+        }
+        auto& joined = it->second;
+        IdInterner::Handle room = IdInterner::instance().find(roomId);
+        joined.erase(std::remove_if(joined.begin(), joined.end(),
+                                    [room](const InternedId& joinedRoom) { return joinedRoom.get() == room; }),
+                     joined.end());
+        if (joined.empty()) {
+            items.erase(it);
+        }
+    });
+}
+
+std::vector<std::string> RoomManager::takeMemberships(const std::string& userId) {
+    return memberships.modify(userId, [&](auto& items) {
+        std::vector<std::string> joined;
+        auto it = items.find(userId);
+        if (it != items.end()) {
+            for (const auto& roomId : it->second) {
+                joined.push_back(roomId.str());
+            }
+            items.erase(it);
+        }
+        return joined;
+    });
 }
 
-void RoomManager::notifyRoomUpdate(const std::string& roomId) {
+void RoomManager::notifyRoomUpdate(const RoomEvent& event) {
     if (onRoomUpdate) {
-        onRoomUpdate(roomId, "room_updated");
+        onRoomUpdate(event);
     }
 }
 
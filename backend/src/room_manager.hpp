@@ -1,27 +1,119 @@
 #pragma once
 #include <unordered_map>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <functional>
+#include <thread>
 #include "room.hpp"
 #include "user.hpp"
+#include "chat_history.hpp"
 #include "database_manager.hpp"
+#include "matchmaking_index.hpp"
+#include "persistence_queue.hpp"
+#include "sharded_map.hpp"
+#include "snowflake_id.hpp"
+
+// One change to a room. room is the state right after the change (empty for
+// room_deleted), so listeners need not read it back.
+struct RoomEvent {
+    enum class Type { Created, PlayerJoined, PlayerLeft, StatusChanged, Deleted };
+
+    Type type;
+    std::string roomId;
+    std::string userId;   // Player that joined or left (creator for Created)
+    Room room;
+};
+
+// What a warm start recovered and how long each phase took
+struct RestoreStats {
+    bool fromSnapshot = false;          // A usable snapshot file was found
+    bool reconciled = false;            // The database was consulted for later changes
+    std::size_t rooms = 0;
+    std::size_t users = 0;
+    std::size_t updatedFromDatabase = 0;
+    std::size_t removedStale = 0;       // In the snapshot but since deleted from the database
+    std::size_t skippedForeign = 0;     // Rooms owned or users homed on other nodes (cluster mode)
+    long snapshotMs = 0;
+    long reconcileMs = 0;
+    long indexMs = 0;
+    long totalMs = 0;
+    // Users restored without a connection; they must reconnect or be expired
+    std::vector<std::string> restoredUsers;
+};
 
 class RoomManager {
 private:
-    std::unordered_map<std::string, Room> rooms;
-    std::unordered_map<std::string, User> users;
+    // Lock ordering: a room shard lock may be held while taking a memberships
+    // shard, matchmaking or chat history lock, never the reverse. Users shards are never nested with
+    // anything. No lock is held while onRoomUpdate/onUserUpdate run, so
+    // callbacks may call back into the manager. The id table (IdInterner) locks
+    // are innermost and may be taken under any of these.
+    ShardedMap<Room> rooms;
+    ShardedMap<User> users;   // Only online users are kept
+
+    // Authoritative user -> rooms index, updated under the room's shard lock
+    // together with Room::players so disconnect cleanup never scans rooms.
+    ShardedMap<std::vector<InternedId>> memberships;
+
+    // Open rooms by game type and free slots, updated with every room change
+    MatchmakingIndex matchmaking;
+
+    // Recent chat per live room; a room's ring lives exactly as long as the room
+    ChatHistory chatHistory;
+
+    // Room ids are unique across instances as long as their node ids differ
+    std::uint16_t nodeId;
+    SnowflakeIdGenerator roomIds;
     std::shared_ptr<DatabaseManager> dbManager;
-    mutable std::mutex roomsMutex;
-    mutable std::mutex usersMutex;
+
+    // Mutations are persisted write-behind. Records are enqueued while the
+    // owning shard lock is held so the queue sees each entity's changes in order;
+    // enqueue never waits, so a stalled database cannot block a shard.
+    std::unique_ptr<PersistenceQueue> persistence;
+
+    // Periodic state snapshots for warm restarts, plus a clean one at shutdown
+    std::string snapshotPath;
+    std::thread snapshotThread;
+    std::mutex snapshotMutex;
+    std::condition_variable snapshotWake;
+    bool snapshotsStopping = false;
+    bool shutDown = false;
 
 public:
+    // Events for one room may reach onRoomUpdate out of order when changes race
+    // on different threads; RoomEvent::room.version orders them.
+    using RoomEventCallback = std::function<void(const RoomEvent&)>;
     using MessageCallback = std::function<void(const std::string&, const std::string&)>;
-    MessageCallback onRoomUpdate;
+    RoomEventCallback onRoomUpdate;
     MessageCallback onUserUpdate;
+    // In cluster mode, true for room ids this node owns. New room ids are
+    // drawn until one passes, so rooms are always created on the creator's node.
+    std::function<bool(const std::string&)> isLocalRoom;
+
+    RoomManager(std::shared_ptr<DatabaseManager> db,
+                const PersistenceQueue::Options& persistenceOptions = PersistenceQueue::Options(),
+                const ChatHistory::Options& chatOptions = ChatHistory::Options(),
+                std::uint16_t nodeId = 0);
+    ~RoomManager();
+
+    // Drains pending writes to the database, then writes a clean snapshot when
+    // snapshots are enabled; call after request handling has stopped
+    void shutdown();
 
-    RoomManager(std::shared_ptr<DatabaseManager> db);
+    // Warm start: loads the snapshot at path (if any), then applies whatever the
+    // database received after it was taken using up to threads threads. Call
+    // once, before any request is handled. Nothing is persisted or announced.
+    // In cluster mode (isLocalRoom set) only rooms this node owns and users
+    // homed on it are kept; the rest belong to the other nodes sharing the database.
+    RestoreStats restore(const std::string& path, std::size_t threads);
+    // Writes a snapshot to path every interval (0 only writes the one at shutdown)
+    void startSnapshots(const std::string& path, std::chrono::milliseconds interval);
+    bool writeSnapshot(bool clean);
+    PersistenceStats getPersistenceStats() const;
+    ChatHistoryStats getChatHistoryStats() const;
 
     // Room operations
     std::string createRoom(const std::string& name, const std::string& creatorId, 
@@ -29,28 +121,50 @@ public:
     bool joinRoom(const std::string& roomId, const std::string& userId);
     bool leaveRoom(const std::string& roomId, const std::string& userId);
     bool deleteRoom(const std::string& roomId);
+    bool setRoomStatus(const std::string& roomId, RoomStatus status);
     Room getRoomById(const std::string& roomId);
-    std::vector<Room> getAllRooms();
+    // Immutable snapshot shared by concurrent readers until the next change
+    std::shared_ptr<const std::vector<Room>> getAllRooms();
 
     // User operations
+    // Stamps the user's homeNode with this node
     bool addUser(const User& user);
     bool removeUser(const std::string& userId);
-    bool updateUserActivity(const std::string& userId);
     User getUserById(const std::string& userId);
-    std::vector<User> getOnlineUsers();
+    std::shared_ptr<const std::vector<User>> getOnlineUsers();
+    // Also used when the user's room is held by another node
+    void setCurrentRoom(const std::string& userId, const std::string& roomId);
+    // Removes a user from every room here without touching the user record,
+    // for players whose connection lives on another node
+    void leaveAllRooms(const std::string& userId);
 
-    // Chat operations
+    // Chat operations. Messages go to the room's history ring and are persisted
+    // write-behind; history is served from the ring, falling back to the
+    // database only for a live room whose ring is missing.
     bool sendChatMessage(const std::string& roomId, const std::string& userId, 
                         const std::string& message);
-    std::vector<std::string> getChatHistory(const std::string& roomId);
+    std::vector<ChatHistory::Entry> getChatHistory(const std::string& roomId);
+    // Stores an already validated message, e.g. one forwarded by another node
+    bool recordChat(const ChatMessage& message);
 
     // Matchmaking
     std::vector<Room> findAvailableRooms(const std::string& gameType = "");
     std::string findOrCreateRoom(const std::string& userId, const std::string& gameType = "Generic");
+    // Places players that queued in the same tick; returns the room per player
+    std::vector<std::string> matchPlayers(const std::vector<std::string>& userIds,
+                                          const std::string& gameType = "Generic");
 
 private:
     std::string generateRoomId();
-    void notifyRoomUpdate(const std::string& roomId);
+    void addMembership(const std::string& userId, const std::string& roomId);
+    void removeMembership(const std::string& userId, const std::string& roomId);
+    std::vector<std::string> takeMemberships(const std::string& userId);
+    void notifyRoomUpdate(const RoomEvent& event);
     void notifyUserUpdate(const std::string& userId);
-    void cleanupInactiveUsers();
+    void stopSnapshots();
+    // Database changes since sinceMs and, for an unclean snapshot, deletions
+    void reconcile(std::int64_t sinceMs, bool pruneDeleted, std::size_t threads, RestoreStats& stats);
+    void rebuildIndexes(std::size_t threads);
+    // Cluster mode: drops restored rooms and users that belong to other nodes
+    void dropForeignState(RestoreStats& stats);
 };
@@ -0,0 +1,194 @@
+#include "server_config.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <thread>
+#include <unistd.h>
+#include "snowflake_id.hpp"
+
+namespace {
+
+long readEnvLong(const char* name, long fallback) {
+    const char* value = std::getenv(name);
+    if (!value || !*value) {
+        return fallback;
+    }
+    char* end = nullptr;
+    long parsed = std::strtol(value, &end, 10);
+    return (end && *end == '\0') ? parsed : fallback;
+}
+
+// Comma-separated node ids; invalid entries are skipped
+std::vector<std::uint16_t> readEnvNodeList(const char* name) {
+    std::vector<std::uint16_t> nodes;
+    const char* value = std::getenv(name);
+    if (!value) {
+        return nodes;
+    }
+    std::string list = value;
+    std::size_t start = 0;
+    while (start <= list.size()) {
+        std::size_t end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string item = list.substr(start, end - start);
+        char* parsedEnd = nullptr;
+        long node = std::strtol(item.c_str(), &parsedEnd, 10);
+        if (!item.empty() && parsedEnd && *parsedEnd == '\0' && node >= 0 && node <= SnowflakeIdGenerator::kMaxNodeId &&
+            std::find(nodes.begin(), nodes.end(), static_cast<std::uint16_t>(node)) == nodes.end()) {
+            nodes.push_back(static_cast<std::uint16_t>(node));
+        }
+        start = end + 1;
+    }
+    return nodes;
+}
+
+std::uint16_t hostnameNodeId() {
+    char hostname[256] = {};
+    if (gethostname(hostname, sizeof(hostname) - 1) != 0) {
+        return 0;
+    }
+    return static_cast<std::uint16_t>(std::hash<std::string>{}(hostname) % (SnowflakeIdGenerator::kMaxNodeId + 1));
+}
+
+} // namespace
+
+std::size_t ServerConfig::effectiveWorkerThreads() const {
+    if (workerThreads > 0) {
+        return workerThreads;
+    }
+    unsigned int hardware = std::thread::hardware_concurrency();
+    return hardware > 0 ? hardware : 1;
+}
+
+RateLimits ServerConfig::connectionRateLimits() const {
+    RateLimits limits;
+    for (std::size_t i = 0; i < kRateClasses; ++i) {
+        limits[i].perSecond = static_cast<double>(messageRatePerSecond[i]);
+        limits[i].burst = std::max(1.0, limits[i].perSecond * static_cast<double>(rateLimitBurstSeconds));
+    }
+    return limits;
+}
+
+RateLimits ServerConfig::addressRateLimits() const {
+    RateLimits limits = connectionRateLimits();
+    for (RateLimit& limit : limits) {
+        limit.perSecond *= static_cast<double>(rateLimitAddressFactor);
+        limit.burst *= static_cast<double>(std::max(1L, rateLimitAddressFactor));
+    }
+    return limits;
+}
+
+CompressionOptions ServerConfig::compressionOptions() const {
+    CompressionOptions options;
+    options.enabled = compressionEnabled;
+    options.minBytes = compressMinBytes;
+    options.level = compressLevel;
+    options.serverWindowBits = compressServerWindowBits;
+    options.clientWindowBits = compressClientWindowBits;
+    options.serverContextTakeover = compressServerContextTakeover;
+    options.clientContextTakeover = compressClientContextTakeover;
+    return options;
+}
+
+ServerConfig ServerConfig::fromEnvironment() {
+    ServerConfig config;
+    config.port = static_cast<int>(readEnvLong("WEBSOCKET_PORT", config.port));
+
+    long workers = readEnvLong("WORKER_THREADS", 0);
+    config.workerThreads = workers > 0 ? static_cast<std::size_t>(workers) : 0;
+
+    long nodeId = readEnvLong("NODE_ID", -1);
+    config.nodeId = (nodeId >= 0 && nodeId <= SnowflakeIdGenerator::kMaxNodeId)
+        ? static_cast<std::uint16_t>(nodeId) : hostnameNodeId();
+
+    const char* mongoUri = std::getenv("MONGODB_URI");
+    if (mongoUri && *mongoUri) {
+        config.mongoUri = mongoUri;
+    }
+    long poolSize = readEnvLong("DB_POOL_SIZE", static_cast<long>(config.dbPoolSize));
+    config.dbPoolSize = poolSize > 0 ? static_cast<std::size_t>(poolSize) : config.dbPoolSize;
+
+    long capacity = readEnvLong("PERSIST_QUEUE_CAPACITY", static_cast<long>(config.persistQueueCapacity));
+    config.persistQueueCapacity = capacity > 0 ? static_cast<std::size_t>(capacity) : config.persistQueueCapacity;
+    long batchSize = readEnvLong("PERSIST_BATCH_SIZE", static_cast<long>(config.persistBatchSize));
+    config.persistBatchSize = batchSize > 0 ? static_cast<std::size_t>(batchSize) : config.persistBatchSize;
+    config.persistFlushIntervalMs = std::max(1L, readEnvLong("PERSIST_FLUSH_MS", config.persistFlushIntervalMs));
+    config.lobbyDeltaIntervalMs = std::max(1L, readEnvLong("LOBBY_DELTA_MS", config.lobbyDeltaIntervalMs));
+    config.matchmakingIntervalMs = std::max(1L, readEnvLong("MATCHMAKING_TICK_MS", config.matchmakingIntervalMs));
+    config.notifyTickMs = std::max(0L, readEnvLong("NOTIFY_TICK_MS", config.notifyTickMs));
+
+    long historyEntries = readEnvLong("CHAT_HISTORY_SIZE", static_cast<long>(config.chatHistoryEntries));
+    config.chatHistoryEntries = historyEntries > 0 ? static_cast<std::size_t>(historyEntries) : config.chatHistoryEntries;
+    long historyBytes = readEnvLong("CHAT_HISTORY_BYTES", static_cast<long>(config.chatHistoryBytes));
+    config.chatHistoryBytes = historyBytes > 0 ? static_cast<std::size_t>(historyBytes) : config.chatHistoryBytes;
+
+    long highWater = readEnvLong("SEND_HIGH_WATER_BYTES", static_cast<long>(config.sendHighWaterBytes));
+    config.sendHighWaterBytes = highWater > 0 ? static_cast<std::size_t>(highWater) : config.sendHighWaterBytes;
+    long queueMax = readEnvLong("SEND_QUEUE_MAX_BYTES", static_cast<long>(config.sendQueueMaxBytes));
+    config.sendQueueMaxBytes = queueMax > 0 ? static_cast<std::size_t>(queueMax) : config.sendQueueMaxBytes;
+    config.slowConsumerGraceMs = std::max(1L, readEnvLong("SLOW_CONSUMER_GRACE_MS", config.slowConsumerGraceMs));
+    config.sendPumpIntervalMs = std::max(1L, readEnvLong("SEND_PUMP_MS", config.sendPumpIntervalMs));
+
+    config.idleTimeoutMs = std::max(0L, readEnvLong("IDLE_TIMEOUT_MS", config.idleTimeoutMs));
+    config.pingIntervalMs = std::max(0L, readEnvLong("PING_INTERVAL_MS", config.pingIntervalMs));
+    config.pongTimeoutMs = std::max(1L, readEnvLong("PONG_TIMEOUT_MS", config.pongTimeoutMs));
+
+    config.maxConnections = static_cast<std::size_t>(
+        std::max(0L, readEnvLong("MAX_CONNECTIONS", static_cast<long>(config.maxConnections))));
+    config.maxConnectionsPerAddress = static_cast<std::size_t>(
+        std::max(0L, readEnvLong("MAX_CONNECTIONS_PER_IP", static_cast<long>(config.maxConnectionsPerAddress))));
+    config.connectRatePerAddress = std::max(0L, readEnvLong("CONNECT_RATE_PER_IP", config.connectRatePerAddress));
+    if (const char* trustedProxies = std::getenv("TRUSTED_PROXIES")) {
+        config.trustedProxies = trustedProxies;
+    }
+    static const char* const rateVariables[kRateClasses] = {
+        "RATE_LIMIT_AUTH", "RATE_LIMIT_CHAT", "RATE_LIMIT_ROOM", "RATE_LIMIT_QUERY", "RATE_LIMIT_OTHER"};
+    for (std::size_t i = 0; i < kRateClasses; ++i) {
+        config.messageRatePerSecond[i] = std::max(0L, readEnvLong(rateVariables[i], config.messageRatePerSecond[i]));
+    }
+    config.rateLimitBurstSeconds = std::max(1L, readEnvLong("RATE_LIMIT_BURST_SECONDS", config.rateLimitBurstSeconds));
+    config.rateLimitAddressFactor = std::max(0L, readEnvLong("RATE_LIMIT_IP_FACTOR", config.rateLimitAddressFactor));
+    config.rateLimitDisconnectAfter = std::max(0L, readEnvLong("RATE_LIMIT_DISCONNECT_AFTER",
+                                                               config.rateLimitDisconnectAfter));
+
+    config.compressionEnabled = readEnvLong("COMPRESSION", config.compressionEnabled ? 1 : 0) != 0;
+    long minBytes = readEnvLong("COMPRESS_MIN_BYTES", static_cast<long>(config.compressMinBytes));
+    config.compressMinBytes = static_cast<std::size_t>(std::max(0L, minBytes));
+    config.compressLevel = static_cast<int>(std::min(9L, std::max(1L, readEnvLong("COMPRESS_LEVEL", config.compressLevel))));
+    // zlib cannot deflate with an 8-bit window, so 9 is the floor
+    config.compressServerWindowBits = static_cast<int>(
+        std::min(15L, std::max(9L, readEnvLong("COMPRESS_SERVER_WINDOW_BITS", config.compressServerWindowBits))));
+    config.compressClientWindowBits = static_cast<int>(
+        std::min(15L, std::max(8L, readEnvLong("COMPRESS_CLIENT_WINDOW_BITS", config.compressClientWindowBits))));
+    config.compressServerContextTakeover =
+        readEnvLong("COMPRESS_SERVER_CONTEXT_TAKEOVER", config.compressServerContextTakeover ? 1 : 0) != 0;
+    config.compressClientContextTakeover =
+        readEnvLong("COMPRESS_CLIENT_CONTEXT_TAKEOVER", config.compressClientContextTakeover ? 1 : 0) != 0;
+
+    // Set but empty turns snapshots off
+    if (const char* snapshotPath = std::getenv("SNAPSHOT_PATH")) {
+        config.snapshotPath = snapshotPath;
+    }
+    config.snapshotIntervalMs = std::max(0L, readEnvLong("SNAPSHOT_INTERVAL_MS", config.snapshotIntervalMs));
+    config.restoreGraceMs = std::max(0L, readEnvLong("RESTORE_GRACE_MS", config.restoreGraceMs));
+
+    config.clusterNodes = readEnvNodeList("CLUSTER_NODES");
+    const char* clusterBus = std::getenv("CLUSTER_BUS");
+    if (clusterBus && *clusterBus) {
+        config.clusterBus = clusterBus;
+    }
+    config.clusterRequestTimeoutMs = std::max(1L, readEnvLong("CLUSTER_REQUEST_TIMEOUT_MS", config.clusterRequestTimeoutMs));
+    config.clusterSyncIntervalMs = std::max(1L, readEnvLong("CLUSTER_SYNC_MS", config.clusterSyncIntervalMs));
+
+    const char* logLevel = std::getenv("LOG_LEVEL");
+    if (logLevel && *logLevel && !Logger::parseLevel(logLevel, config.logLevel)) {
+        LOG_WARN << "Unknown LOG_LEVEL " << logLevel << "; using " << Logger::levelName(config.logLevel);
+    }
+    if (const char* logFile = std::getenv("LOG_FILE")) {
+        config.logFile = logFile;
+    }
+    config.logSamplePerSecond = std::max(0L, readEnvLong("LOG_SAMPLE_PER_SECOND", config.logSamplePerSecond));
+    return config;
+}
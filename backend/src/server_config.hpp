@@ -0,0 +1,153 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "compression.hpp"
+#include "logger.hpp"
+#include "rate_limiter.hpp"
+
+// Runtime settings for the lobby server. Defaults are suitable for local
+// development; fromEnvironment() applies the overrides used by docker-compose.
+struct ServerConfig {
+    int port;
+    std::size_t workerThreads;   // Threads calling run() on the shared io_context
+
+    // Embedded in generated ids (0-1023); instances sharing a database need
+    // distinct values. Without NODE_ID it is derived from the hostname.
+    std::uint16_t nodeId;
+
+    // MongoDB
+    std::string mongoUri;
+    std::size_t dbPoolSize;      // Clients in the mongocxx pool
+
+    // Write-behind persistence
+    std::size_t persistQueueCapacity;
+    std::size_t persistBatchSize;
+    long persistFlushIntervalMs;
+
+    // Lobby listing changes are sent to watchers as one delta per interval
+    long lobbyDeltaIntervalMs;
+
+    // Quick-match requests are batched and placed once per tick
+    long matchmakingIntervalMs;
+
+    // Room and user changes are coalesced per entity and announced once per
+    // tick; 0 sends every change as it happens
+    long notifyTickMs;
+
+    // Per-room chat history ring, capped by entries and by payload bytes
+    std::size_t chatHistoryEntries;
+    std::size_t chatHistoryBytes;
+
+    // Outbound backpressure: frames wait in a per-connection queue while the
+    // socket buffers more than sendHighWaterBytes. A queue above
+    // sendQueueMaxBytes, or one that makes no progress for
+    // slowConsumerGraceMs, disconnects the client.
+    std::size_t sendHighWaterBytes;
+    std::size_t sendQueueMaxBytes;
+    long slowConsumerGraceMs;
+    long sendPumpIntervalMs;
+
+    // Connections that send no lobby message for idleTimeoutMs are closed.
+    // A connection that has been silent for pingIntervalMs is pinged, and
+    // closed as a dead peer if nothing arrives within pongTimeoutMs.
+    // 0 disables the idle timeout or the keepalive.
+    long idleTimeoutMs;
+    long pingIntervalMs;
+    long pongTimeoutMs;
+
+    // Admission control: handshakes are refused beyond maxConnections open
+    // connections, maxConnectionsPerAddress from one client address, or
+    // connectRatePerAddress a second from one address. 0 disables each.
+    std::size_t maxConnections;
+    std::size_t maxConnectionsPerAddress;
+    long connectRatePerAddress;
+
+    // Comma-separated proxy addresses and CIDR blocks. Connections from them
+    // are limited by the client address in X-Forwarded-For (or X-Real-IP)
+    // rather than by the proxy's own. Empty trusts no forwarding headers.
+    std::string trustedProxies;
+
+    // Message rate limits per connection, by RateClass, in messages a second
+    // (0 is unlimited). Buckets hold rateLimitBurstSeconds worth of messages.
+    // Each client address shares buckets rateLimitAddressFactor times larger
+    // (0 turns them off); loopback clients skip all per-address limits. A
+    // connection refused rateLimitDisconnectAfter messages in a row is closed.
+    std::array<long, kRateClasses> messageRatePerSecond;
+    long rateLimitBurstSeconds;
+    long rateLimitAddressFactor;
+    long rateLimitDisconnectAfter;
+
+    // permessage-deflate for clients that offer it. Messages under
+    // compressMinBytes go uncompressed; compressLevel applies to frames a
+    // fan-out compresses once. Window bits (9-15) and context takeover are
+    // what the server proposes; clients may narrow the windows further.
+    // Server context takeover compresses better but rules out sharing
+    // compressed fan-out frames, so each recipient's copy is compressed alone.
+    bool compressionEnabled;
+    std::size_t compressMinBytes;
+    int compressLevel;
+    int compressServerWindowBits;
+    int compressClientWindowBits;
+    bool compressServerContextTakeover;
+    bool compressClientContextTakeover;
+
+    // Warm restarts: rooms and users are snapshotted to snapshotPath every
+    // snapshotIntervalMs and at shutdown, and restored from it at startup.
+    // Restored users that do not reconnect within restoreGraceMs are removed.
+    // An empty path disables snapshots; an interval of 0 writes only at shutdown.
+    std::string snapshotPath;
+    long snapshotIntervalMs;
+    long restoreGraceMs;
+
+    // Cluster mode: with clusterNodes listing more than one node id (this
+    // node's included), rooms are spread over the nodes by a hash of their id
+    // and the nodes talk over the bus at clusterBus. Forwarded requests fail
+    // after clusterRequestTimeoutMs; every clusterSyncIntervalMs each node
+    // resends its full room summary.
+    std::vector<std::uint16_t> clusterNodes;
+    std::string clusterBus;
+    long clusterRequestTimeoutMs;
+    long clusterSyncIntervalMs;
+
+    // Logging: lines below logLevel are skipped, and lines go to logFile or,
+    // without one, to stdout and stderr. High-frequency events such as
+    // connection opens are logged at most logSamplePerSecond times a second
+    // each (0 logs every one).
+    LogLevel logLevel;
+    std::string logFile;
+    long logSamplePerSecond;
+
+    ServerConfig()
+        : port(9002), workerThreads(0), nodeId(0),
+          mongoUri("mongodb://localhost:27017"), dbPoolSize(16),
+          persistQueueCapacity(65536), persistBatchSize(500), persistFlushIntervalMs(50),
+          lobbyDeltaIntervalMs(100), matchmakingIntervalMs(20), notifyTickMs(25),
+          chatHistoryEntries(50), chatHistoryBytes(32 * 1024),
+          sendHighWaterBytes(64 * 1024), sendQueueMaxBytes(1024 * 1024),
+          slowConsumerGraceMs(10000), sendPumpIntervalMs(10),
+          idleTimeoutMs(30 * 60 * 1000), pingIntervalMs(30000), pongTimeoutMs(10000),
+          maxConnections(10000), maxConnectionsPerAddress(100), connectRatePerAddress(20),
+          messageRatePerSecond{2, 10, 5, 10, 5}, rateLimitBurstSeconds(2), rateLimitAddressFactor(10),
+          rateLimitDisconnectAfter(200),
+          compressionEnabled(true), compressMinBytes(256), compressLevel(6), compressServerWindowBits(15),
+          compressClientWindowBits(15), compressServerContextTakeover(false), compressClientContextTakeover(true),
+          snapshotPath("lobby-state.snapshot"), snapshotIntervalMs(60000), restoreGraceMs(60000),
+          clusterBus("unix:///tmp/lobby-cluster"), clusterRequestTimeoutMs(2000), clusterSyncIntervalMs(10000),
+          logLevel(LogLevel::Info), logSamplePerSecond(10) {}
+
+    bool clusterEnabled() const { return clusterNodes.size() > 1; }
+
+    // Worker count to actually spawn (0 means one per hardware thread)
+    std::size_t effectiveWorkerThreads() const;
+
+    // Bucket sizes for one connection, and for all connections from one address
+    RateLimits connectionRateLimits() const;
+    RateLimits addressRateLimits() const;
+
+    CompressionOptions compressionOptions() const;
+
+    static ServerConfig fromEnvironment();
+};
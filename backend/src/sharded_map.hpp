@@ -0,0 +1,130 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "parallel_for.hpp"
+
+// String-keyed map split into independently locked, hash-selected shards so
+// operations on different keys rarely contend. Bulk reads go through an
+// immutable snapshot that is rebuilt at most once per change and shared by all
+// readers until the next change (read-copy-update), instead of copying the
+// whole map under a lock on every call.
+template <typename T, std::size_t ShardCount = 64>
+class ShardedMap {
+public:
+    using Map = std::unordered_map<std::string, T>;
+    using Snapshot = std::vector<T>;
+
+private:
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        Map items;
+    };
+
+    struct CachedSnapshot {
+        std::uint64_t version;
+        std::shared_ptr<const Snapshot> items;
+    };
+
+    std::array<Shard, ShardCount> shards;
+    std::atomic<std::uint64_t> version{0};
+    std::shared_ptr<const CachedSnapshot> cached;  // Accessed with std::atomic_load/store
+    std::mutex rebuildMutex;
+
+    Shard& shardFor(const std::string& key) {
+        return shards[std::hash<std::string>{}(key) % ShardCount];
+    }
+
+public:
+    // Runs fn(map) with the key's shard locked, without invalidating snapshots
+    template <typename Fn>
+    auto read(const std::string& key, Fn&& fn) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return fn(static_cast<const Map&>(shard.items));
+    }
+
+    // Runs fn(map) with the key's shard locked and invalidates snapshots
+    template <typename Fn>
+    auto modify(const std::string& key, Fn&& fn) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        struct VersionBump {
+            std::atomic<std::uint64_t>& version;
+            ~VersionBump() { version.fetch_add(1, std::memory_order_release); }
+        } bump{version};
+        return fn(shard.items);
+    }
+
+    // Copy of one value, or a default-constructed T when absent
+    T get(const std::string& key) {
+        return read(key, [&key](const Map& items) {
+            auto it = items.find(key);
+            return (it != items.end()) ? it->second : T{};
+        });
+    }
+
+    // Stores many values at once, replacing any with the same key. Values are
+    // grouped by shard first so each shard is locked once, on up to threads
+    // threads, and snapshots are invalidated once. For bulk loads, not requests.
+    template <typename KeyOf>
+    void insertAll(std::vector<T>&& values, KeyOf&& keyOf, std::size_t threads = 1) {
+        std::array<std::vector<std::size_t>, ShardCount> byShard;
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            byShard[std::hash<std::string>{}(keyOf(values[i])) % ShardCount].push_back(i);
+        }
+        parallelFor(ShardCount, threads, [&](std::size_t index) {
+            Shard& shard = shards[index];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.items.reserve(shard.items.size() + byShard[index].size());
+            for (std::size_t i : byShard[index]) {
+                std::string key = keyOf(values[i]);
+                shard.items[std::move(key)] = std::move(values[i]);
+            }
+        });
+        version.fetch_add(1, std::memory_order_release);
+    }
+
+    // Visits every shard in turn; only one shard lock is held at a time
+    template <typename Fn>
+    void forEachShard(Fn&& fn) {
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            fn(static_cast<const Map&>(shard.items));
+        }
+    }
+
+    std::shared_ptr<const Snapshot> snapshot() {
+        std::uint64_t current = version.load(std::memory_order_acquire);
+        auto snap = std::atomic_load(&cached);
+        if (snap && snap->version == current) {
+            return snap->items;
+        }
+
+        // One reader rebuilds while the others wait and reuse its result
+        std::lock_guard<std::mutex> rebuildLock(rebuildMutex);
+        current = version.load(std::memory_order_acquire);
+        snap = std::atomic_load(&cached);
+        if (snap && snap->version == current) {
+            return snap->items;
+        }
+
+        auto items = std::make_shared<Snapshot>();
+        forEachShard([&items](const Map& shardItems) {
+            for (const auto& [key, value] : shardItems) {
+                items->push_back(value);
+            }
+        });
+
+        std::shared_ptr<const Snapshot> result = items;
+        std::atomic_store(&cached, std::make_shared<const CachedSnapshot>(CachedSnapshot{current, result}));
+        return result;
+    }
+};
@@ -0,0 +1,34 @@
+#include "snowflake_id.hpp"
+#include <algorithm>
+#include <chrono>
+
+SnowflakeIdGenerator::SnowflakeIdGenerator(std::uint16_t nodeId)
+    : nodeBits(static_cast<std::uint64_t>(std::min(nodeId, kMaxNodeId)) << kSequenceBits) {}
+
+std::uint64_t SnowflakeIdGenerator::next() {
+    auto sinceEpoch = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    std::uint64_t now = static_cast<std::uint64_t>(sinceEpoch) - kEpochMs;
+    std::uint64_t floor = now << kSequenceBits;
+
+    std::uint64_t previous = last.load(std::memory_order_relaxed);
+    std::uint64_t issued;
+    do {
+        // A sequence overflow carries into the timestamp, borrowing the next millisecond
+        issued = std::max(floor, previous + 1);
+    } while (!last.compare_exchange_weak(previous, issued, std::memory_order_relaxed));
+
+    std::uint64_t timestamp = issued >> kSequenceBits;
+    std::uint64_t sequence = issued & ((std::uint64_t{1} << kSequenceBits) - 1);
+    return (timestamp << (kNodeBits + kSequenceBits)) | nodeBits | sequence;
+}
+
+void SnowflakeIdGenerator::appendBase62(std::uint64_t id, std::string& out) {
+    static const char kDigits[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    std::size_t start = out.size();
+    out.resize(start + kEncodedLength);
+    for (std::size_t i = kEncodedLength; i > 0; --i) {
+        out[start + i - 1] = kDigits[id % 62];
+        id /= 62;
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Snowflake-style 64-bit ids: milliseconds since kEpochMs (41 bits), node id
+// (10 bits), per-millisecond sequence (12 bits). Ids from one generator are
+// strictly increasing and ids from generators with different node ids never
+// collide, so backend instances only need distinct NODE_IDs.
+//
+// Issuing an id is a single CAS on the last (timestamp, sequence) pair, so
+// concurrent callers never block each other. When a millisecond's 4096
+// sequence numbers run out, or the clock steps backwards, ids keep counting
+// from the last one issued and catch up with the clock later.
+class SnowflakeIdGenerator {
+public:
+    static constexpr std::uint64_t kEpochMs = 1704067200000;   // 2024-01-01T00:00:00Z
+    static constexpr unsigned kNodeBits = 10;
+    static constexpr unsigned kSequenceBits = 12;
+    static constexpr std::uint16_t kMaxNodeId = (1u << kNodeBits) - 1;
+
+    // Fixed-width base62 keeps string ids sortable by creation time
+    static constexpr std::size_t kEncodedLength = 11;
+
+private:
+    std::uint64_t nodeBits;
+    std::atomic<std::uint64_t> last{0};   // (ms since epoch << kSequenceBits) | sequence
+
+public:
+    explicit SnowflakeIdGenerator(std::uint16_t nodeId);
+
+    std::uint64_t next();
+
+    // Appends the kEncodedLength-character base62 form of id to out
+    static void appendBase62(std::uint64_t id, std::string& out);
+};
@@ -0,0 +1,334 @@
+#include "state_snapshot.hpp"
+#include "logger.hpp"
+#include "parallel_for.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char kMagic[8] = {'L', 'O', 'B', 'B', 'Y', 'S', 'N', 'P'};
+const std::uint32_t kFormatVersion = 3;
+const std::uint32_t kCleanFlag = 1;
+const std::uint32_t kOnlineFlag = 1;
+
+// Records decoded per parallel work item
+const std::size_t kDecodeChunk = 16384;
+
+struct Header {
+    char magic[8];
+    std::uint32_t formatVersion;
+    std::uint32_t flags;
+    std::int64_t takenAtMs;
+    std::uint64_t roomCount;
+    std::uint64_t userCount;
+    std::uint64_t stringBytes;
+    std::uint64_t checksum;      // Over everything after the header
+    std::uint64_t reserved;
+};
+
+struct StringRef {
+    std::uint32_t offset;
+    std::uint32_t length;
+};
+
+struct RoomRecord {
+    StringRef id;
+    StringRef name;
+    StringRef gameType;
+    StringRef createdBy;
+    std::int64_t createdAtMs;
+    std::uint64_t version;
+    std::int32_t maxPlayers;
+    std::uint8_t status;
+    std::uint8_t playerCount;
+    std::uint16_t reserved;
+    StringRef players[PlayerList::kCapacity];
+};
+
+struct UserRecord {
+    StringRef id;
+    StringRef username;
+    StringRef currentRoom;
+    std::uint32_t flags;
+    std::int32_t homeNode;
+    std::int64_t lastActivityMs;
+};
+
+static_assert(sizeof(Header) == 64, "snapshot header layout");
+static_assert(sizeof(RoomRecord) == 136, "snapshot room record layout");
+static_assert(sizeof(UserRecord) == 40, "snapshot user record layout");
+
+// Word-at-a-time mixing hash; detects torn or damaged files, not tampering.
+// Every part fed to it but the last must be a multiple of 8 bytes long, so
+// the file's sections can be hashed one after another.
+class Checksum {
+public:
+    void update(const void* data, std::size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        std::size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            std::uint64_t word;
+            std::memcpy(&word, bytes + i, 8);
+            hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+            hash ^= hash >> 32;
+        }
+        for (; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+        }
+    }
+    std::uint64_t value() const { return hash; }
+
+private:
+    std::uint64_t hash = 0x9E3779B97F4A7C15ull;
+};
+
+std::int64_t toMillis(std::chrono::system_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+}
+
+std::chrono::system_clock::time_point fromMillis(std::int64_t ms) {
+    return std::chrono::system_clock::time_point(std::chrono::milliseconds(ms));
+}
+
+class StringTable {
+public:
+    std::string bytes;
+
+    StringRef add(const std::string& value) {
+        StringRef ref{static_cast<std::uint32_t>(bytes.size()), static_cast<std::uint32_t>(value.size())};
+        bytes += value;
+        return ref;
+    }
+};
+
+bool writeAll(int fd, const void* data, std::size_t size) {
+    const char* cursor = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = ::write(fd, cursor, size);
+        if (written < 0) {
+            return false;
+        }
+        cursor += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+// Read-only mapping of a whole file, unmapped on destruction
+class MappedFile {
+public:
+    const unsigned char* data = nullptr;
+    std::size_t size = 0;
+
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* mapping = ::mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                data = static_cast<const unsigned char*>(mapping);
+                size = static_cast<std::size_t>(info.st_size);
+                ::madvise(mapping, size, MADV_WILLNEED);
+            }
+        }
+        ::close(fd);
+    }
+    ~MappedFile() {
+        if (data) {
+            ::munmap(const_cast<unsigned char*>(data), size);
+        }
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+};
+
+} // namespace
+
+bool StateSnapshot::write(const std::string& path, const std::vector<Room>& rooms, const std::vector<User>& users,
+                          std::int64_t takenAtMs, bool clean) {
+    StringTable strings;
+    std::vector<RoomRecord> roomRecords(rooms.size());
+    for (std::size_t i = 0; i < rooms.size(); ++i) {
+        const Room& room = rooms[i];
+        RoomRecord& record = roomRecords[i];
+        std::memset(&record, 0, sizeof(record));
+        record.id = strings.add(room.id);
+        record.name = strings.add(room.name);
+        record.gameType = strings.add(room.gameType);
+        record.createdBy = strings.add(room.createdBy.str());
+        record.createdAtMs = toMillis(room.createdAt);
+        record.version = room.version;
+        record.maxPlayers = room.maxPlayers;
+        record.status = static_cast<std::uint8_t>(room.status);
+        for (const auto& player : room.players) {
+            record.players[record.playerCount++] = strings.add(player.str());
+        }
+    }
+
+    std::vector<UserRecord> userRecords(users.size());
+    for (std::size_t i = 0; i < users.size(); ++i) {
+        const User& user = users[i];
+        UserRecord& record = userRecords[i];
+        std::memset(&record, 0, sizeof(record));
+        record.id = strings.add(user.id.str());
+        record.username = strings.add(user.username);
+        record.currentRoom = strings.add(user.currentRoom.str());
+        record.flags = user.isOnline ? kOnlineFlag : 0;
+        record.homeNode = user.homeNode;
+        record.lastActivityMs = toMillis(user.lastActivity);
+    }
+
+    if (strings.bytes.size() > UINT32_MAX) {
+        LOG_ERROR << "Snapshot string table too large (" << strings.bytes.size() << " bytes)";
+        return false;
+    }
+
+    std::size_t roomBytes = roomRecords.size() * sizeof(RoomRecord);
+    std::size_t userBytes = userRecords.size() * sizeof(UserRecord);
+    Checksum sum;
+    sum.update(roomRecords.data(), roomBytes);
+    sum.update(userRecords.data(), userBytes);
+    sum.update(strings.bytes.data(), strings.bytes.size());
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.formatVersion = kFormatVersion;
+    header.flags = clean ? kCleanFlag : 0;
+    header.takenAtMs = takenAtMs;
+    header.roomCount = roomRecords.size();
+    header.userCount = userRecords.size();
+    header.stringBytes = strings.bytes.size();
+    header.checksum = sum.value();
+
+    std::string temporary = path + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        LOG_ERROR << "Cannot write snapshot " << temporary;
+        return false;
+    }
+    bool ok = writeAll(fd, &header, sizeof(header)) && writeAll(fd, roomRecords.data(), roomBytes) &&
+              writeAll(fd, userRecords.data(), userBytes) &&
+              writeAll(fd, strings.bytes.data(), strings.bytes.size()) && ::fsync(fd) == 0;
+    ok = (::close(fd) == 0) && ok;
+    if (!ok || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        LOG_ERROR << "Error writing snapshot " << path;
+        ::unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool StateSnapshot::read(const std::string& path, Contents& out, std::size_t threads) {
+    MappedFile file(path);
+    if (!file.data) {
+        return false;
+    }
+
+    Header header;
+    if (file.size < sizeof(header)) {
+        LOG_WARN << "Ignoring truncated snapshot " << path;
+        return false;
+    }
+    std::memcpy(&header, file.data, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.formatVersion != kFormatVersion) {
+        LOG_WARN << "Ignoring snapshot " << path << " from an incompatible format";
+        return false;
+    }
+
+    // Sizes are checked before they are multiplied so a damaged header cannot overflow
+    std::size_t bodySize = file.size - sizeof(header);
+    if (header.roomCount > bodySize / sizeof(RoomRecord) || header.userCount > bodySize / sizeof(UserRecord) ||
+        header.roomCount * sizeof(RoomRecord) + header.userCount * sizeof(UserRecord) + header.stringBytes != bodySize) {
+        LOG_WARN << "Ignoring truncated snapshot " << path;
+        return false;
+    }
+    const unsigned char* body = file.data + sizeof(header);
+    Checksum sum;
+    sum.update(body, bodySize);
+    if (sum.value() != header.checksum) {
+        LOG_WARN << "Ignoring corrupt snapshot " << path;
+        return false;
+    }
+
+    const RoomRecord* roomRecords = reinterpret_cast<const RoomRecord*>(body);
+    const UserRecord* userRecords = reinterpret_cast<const UserRecord*>(
+        body + header.roomCount * sizeof(RoomRecord));
+    const char* strings = reinterpret_cast<const char*>(
+        body + header.roomCount * sizeof(RoomRecord) + header.userCount * sizeof(UserRecord));
+    std::uint64_t stringBytes = header.stringBytes;
+    std::atomic<bool> valid{true};
+    auto text = [&](const StringRef& ref) {
+        if (static_cast<std::uint64_t>(ref.offset) + ref.length > stringBytes) {
+            valid.store(false, std::memory_order_relaxed);
+            return std::string();
+        }
+        return std::string(strings + ref.offset, ref.length);
+    };
+
+    std::size_t roomCount = static_cast<std::size_t>(header.roomCount);
+    std::size_t userCount = static_cast<std::size_t>(header.userCount);
+    std::size_t roomChunks = (roomCount + kDecodeChunk - 1) / kDecodeChunk;
+    std::size_t userChunks = (userCount + kDecodeChunk - 1) / kDecodeChunk;
+    out.rooms.assign(roomCount, Room());
+    out.users.assign(userCount, User());
+
+    parallelFor(roomChunks + userChunks, threads, [&](std::size_t chunk) {
+        if (chunk < roomChunks) {
+            std::size_t end = std::min(roomCount, (chunk + 1) * kDecodeChunk);
+            for (std::size_t i = chunk * kDecodeChunk; i < end; ++i) {
+                const RoomRecord& record = roomRecords[i];
+                Room& room = out.rooms[i];
+                room.id = text(record.id);
+                room.name = text(record.name);
+                room.gameType = text(record.gameType);
+                room.createdBy = InternedId(text(record.createdBy));
+                room.createdAt = fromMillis(record.createdAtMs);
+                room.version = record.version;
+                room.maxPlayers = record.maxPlayers;
+                room.status = static_cast<RoomStatus>(record.status);
+                // Rooms are written already clamped, so anything else is damage
+                if (room.maxPlayers != Room::clampMaxPlayers(record.maxPlayers) ||
+                    record.playerCount > PlayerList::kCapacity) {
+                    valid.store(false, std::memory_order_relaxed);
+                    continue;
+                }
+                for (std::size_t p = 0; p < record.playerCount; ++p) {
+                    room.players.add(text(record.players[p]));
+                }
+            }
+        } else {
+            chunk -= roomChunks;
+            std::size_t end = std::min(userCount, (chunk + 1) * kDecodeChunk);
+            for (std::size_t i = chunk * kDecodeChunk; i < end; ++i) {
+                const UserRecord& record = userRecords[i];
+                User& user = out.users[i];
+                user.id = InternedId(text(record.id));
+                user.username = text(record.username);
+                user.currentRoom = InternedId(text(record.currentRoom));
+                user.isOnline = (record.flags & kOnlineFlag) != 0;
+                user.lastActivity = fromMillis(record.lastActivityMs);
+                user.homeNode = record.homeNode;
+            }
+        }
+    });
+
+    if (!valid) {
+        LOG_WARN << "Ignoring corrupt snapshot " << path;
+        out.rooms.clear();
+        out.users.clear();
+        return false;
+    }
+    out.takenAtMs = header.takenAtMs;
+    out.clean = (header.flags & kCleanFlag) != 0;
+    return true;
+}
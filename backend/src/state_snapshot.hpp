@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "room.hpp"
+#include "user.hpp"
+
+// Binary image of the live rooms and users for warm restarts. The file is a
+// fixed header, fixed-size room and user records, then one string table the
+// records point into. Reading maps the file and decodes the records in
+// parallel straight from the mapping, with no per-document parsing.
+//
+// Records are written in native byte order and layout; the header's format
+// version guards against files from an incompatible build. Files are written
+// to a temporary name and renamed, so a crash never leaves a torn snapshot.
+class StateSnapshot {
+public:
+    struct Contents {
+        std::int64_t takenAtMs = 0;   // Wall clock when the state was captured
+        // Written at shutdown after every pending database write was drained,
+        // so the database held nothing newer at that point
+        bool clean = false;
+        std::vector<Room> rooms;
+        std::vector<User> users;
+    };
+
+    static bool write(const std::string& path, const std::vector<Room>& rooms, const std::vector<User>& users,
+                      std::int64_t takenAtMs, bool clean);
+
+    // False when the file is missing, truncated, corrupt or from another format version
+    static bool read(const std::string& path, Contents& out, std::size_t threads);
+};
@@ -0,0 +1,156 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+// Hierarchical timing wheel (as in the Linux kernel's timer wheel). Level 0
+// has 256 one-tick slots; each of the three levels above has 64 slots, each
+// 64 times wider than the level below, so deadlines up to 2^26 ticks ahead
+// are placed in O(1). Moving a key to a new deadline is an O(1) splice.
+// Advancing expires only what is due, plus an occasional cascade that
+// re-places one coarse slot into finer ones.
+//
+// Not synchronized; the owner serializes access.
+template <typename Key, typename Hash = std::hash<Key>>
+class TimingWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    static constexpr unsigned kRootBits = 8;
+    static constexpr unsigned kLevelBits = 6;
+    static constexpr std::size_t kLevels = 4;
+    static constexpr std::uint64_t kRootSize = std::uint64_t{1} << kRootBits;
+    static constexpr std::uint64_t kLevelSize = std::uint64_t{1} << kLevelBits;
+
+    using Slot = std::list<Key>;
+
+    struct Entry {
+        std::uint64_t expiry;   // Absolute tick
+        Slot* slot;
+        typename Slot::iterator position;
+    };
+
+    Clock::duration tick;
+    Clock::time_point origin;
+    std::uint64_t currentTick = 0;   // Every tick up to and including this one has been processed
+
+    std::array<std::vector<Slot>, kLevels> levels;
+    std::unordered_map<Key, Entry, Hash> entries;
+
+    static unsigned levelShift(std::size_t level) {
+        return level == 0 ? 0 : kRootBits + kLevelBits * static_cast<unsigned>(level - 1);
+    }
+
+    std::uint64_t tickFor(Clock::time_point deadline) const {
+        if (deadline <= origin) {
+            return 0;
+        }
+        // Round up so nothing fires before its deadline
+        return static_cast<std::uint64_t>((deadline - origin + tick - Clock::duration(1)) / tick);
+    }
+
+    Slot& slotFor(std::uint64_t expiry) {
+        std::uint64_t delta = expiry - currentTick;
+        if (delta < kRootSize) {
+            return levels[0][expiry & (kRootSize - 1)];
+        }
+        for (std::size_t level = 1; level < kLevels; ++level) {
+            if (delta < (kRootSize << (kLevelBits * level)) || level == kLevels - 1) {
+                if (delta >= (kRootSize << (kLevelBits * level))) {
+                    // Beyond the wheel's range: park in the farthest slot and
+                    // re-place when it cascades
+                    expiry = currentTick + (kRootSize << (kLevelBits * level)) - 1;
+                }
+                return levels[level][(expiry >> levelShift(level)) & (kLevelSize - 1)];
+            }
+        }
+        return levels[0][expiry & (kRootSize - 1)];   // Unreachable
+    }
+
+    void place(const Key& key, Entry& entry, Slot* from) {
+        Slot& to = slotFor(entry.expiry);
+        if (from) {
+            to.splice(to.end(), *from, entry.position);
+        } else {
+            entry.position = to.insert(to.end(), key);
+        }
+        entry.slot = &to;
+    }
+
+    // Moves every key in one coarse slot down to the slot it now belongs in
+    void cascade(std::size_t level) {
+        Slot& slot = levels[level][(currentTick >> levelShift(level)) & (kLevelSize - 1)];
+        while (!slot.empty()) {
+            Entry& entry = entries.find(slot.front())->second;
+            place(slot.front(), entry, &slot);
+        }
+    }
+
+public:
+    explicit TimingWheel(Clock::duration tickLength, Clock::time_point start = Clock::now())
+        : tick(tickLength), origin(start) {
+        levels[0].resize(kRootSize);
+        for (std::size_t level = 1; level < kLevels; ++level) {
+            levels[level].resize(kLevelSize);
+        }
+    }
+
+    // Sets (or moves) key's deadline
+    void schedule(const Key& key, Clock::time_point deadline) {
+        std::uint64_t expiry = std::max(tickFor(deadline), currentTick + 1);
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            Entry& entry = entries.emplace(key, Entry{expiry, nullptr, {}}).first->second;
+            place(key, entry, nullptr);
+        } else {
+            it->second.expiry = expiry;
+            place(key, it->second, it->second.slot);
+        }
+    }
+
+    void cancel(const Key& key) {
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            it->second.slot->erase(it->second.position);
+            entries.erase(it);
+        }
+    }
+
+    // Processes every tick up to now and appends the keys that came due to
+    // expired; they are no longer scheduled
+    void advance(Clock::time_point now, std::vector<Key>& expired) {
+        std::uint64_t target = tickFor(now);
+        while (currentTick < target) {
+            ++currentTick;
+            if ((currentTick & (kRootSize - 1)) == 0) {
+                for (std::size_t level = 1; level < kLevels; ++level) {
+                    cascade(level);
+                    if (((currentTick >> levelShift(level)) & (kLevelSize - 1)) != 0) {
+                        break;
+                    }
+                }
+            }
+
+            Slot& due = levels[0][currentTick & (kRootSize - 1)];
+            while (!due.empty()) {
+                auto it = entries.find(due.front());
+                if (it->second.expiry > currentTick) {
+                    // Parked past the wheel's range; not due yet
+                    place(due.front(), it->second, &due);
+                    continue;
+                }
+                expired.push_back(std::move(due.front()));
+                due.pop_front();
+                entries.erase(it);
+            }
+        }
+    }
+
+    std::size_t size() const { return entries.size(); }
+};
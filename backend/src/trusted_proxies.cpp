@@ -0,0 +1,149 @@
+#include "trusted_proxies.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+namespace {
+
+std::string trim(const std::string& text) {
+    std::size_t begin = 0;
+    std::size_t end = text.size();
+    while (begin < end && std::isspace(static_cast<unsigned char>(text[begin]))) {
+        ++begin;
+    }
+    while (end > begin && std::isspace(static_cast<unsigned char>(text[end - 1]))) {
+        --end;
+    }
+    return text.substr(begin, end - begin);
+}
+
+std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::size_t start = 0;
+    while (start <= list.size()) {
+        std::size_t end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string item = trim(list.substr(start, end - start));
+        if (!item.empty()) {
+            items.push_back(std::move(item));
+        }
+        start = end + 1;
+    }
+    return items;
+}
+
+std::array<std::uint8_t, 16> bytesOf(const boost::asio::ip::address& address) {
+    std::array<std::uint8_t, 16> bytes{};
+    if (address.is_v4()) {
+        auto v4 = address.to_v4().to_bytes();
+        std::copy(v4.begin(), v4.end(), bytes.begin());
+    } else {
+        auto v6 = address.to_v6().to_bytes();
+        std::copy(v6.begin(), v6.end(), bytes.begin());
+    }
+    return bytes;
+}
+
+} // namespace
+
+bool TrustedProxies::parse(const std::string& list, TrustedProxies& out, std::string& error) {
+    out.networks.clear();
+    for (const auto& item : splitList(list)) {
+        std::size_t slash = item.find('/');
+        boost::system::error_code ec;
+        Address address = normalize(boost::asio::ip::make_address(item.substr(0, slash), ec));
+        if (ec) {
+            error = item;
+            return false;
+        }
+        unsigned maxPrefix = address.is_v4() ? 32 : 128;
+        unsigned prefix = maxPrefix;
+        if (slash != std::string::npos) {
+            std::string bits = item.substr(slash + 1);
+            char* end = nullptr;
+            long parsed = std::strtol(bits.c_str(), &end, 10);
+            if (bits.empty() || !end || *end != '\0' || parsed < 0 || parsed > static_cast<long>(maxPrefix)) {
+                error = item;
+                return false;
+            }
+            prefix = static_cast<unsigned>(parsed);
+        }
+        out.networks.push_back(Network{address.is_v6(), bytesOf(address), prefix});
+    }
+    return true;
+}
+
+TrustedProxies::Address TrustedProxies::normalize(const Address& address) {
+    if (address.is_v6() && address.to_v6().is_v4_mapped()) {
+        return boost::asio::ip::make_address_v4(boost::asio::ip::v4_mapped, address.to_v6());
+    }
+    return address;
+}
+
+bool TrustedProxies::contains(const Address& address) const {
+    Address normalized = normalize(address);
+    std::array<std::uint8_t, 16> bytes = bytesOf(normalized);
+    for (const auto& network : networks) {
+        if (network.v6 != normalized.is_v6()) {
+            continue;
+        }
+        unsigned full = network.prefix / 8;
+        unsigned rest = network.prefix % 8;
+        if (!std::equal(bytes.begin(), bytes.begin() + full, network.bytes.begin())) {
+            continue;
+        }
+        std::uint8_t mask = static_cast<std::uint8_t>(0xff << (8 - rest));
+        if (rest == 0 || (bytes[full] & mask) == (network.bytes[full] & mask)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TrustedProxies::parseEntry(const std::string& entry, Address& out) {
+    std::string host = trim(entry);
+    if (!host.empty() && host.front() == '[') {
+        std::size_t close = host.find(']');
+        if (close == std::string::npos) {
+            return false;
+        }
+        host = host.substr(1, close - 1);
+    } else if (std::count(host.begin(), host.end(), ':') == 1) {
+        host = host.substr(0, host.find(':'));   // IPv4 with a port
+    }
+    boost::system::error_code ec;
+    out = normalize(boost::asio::ip::make_address(host, ec));
+    return !ec;
+}
+
+TrustedProxies::Address TrustedProxies::clientAddress(const Address& peer, const std::string& forwardedFor,
+                                                      const std::string& realIp) const {
+    if (!contains(peer)) {
+        return peer;
+    }
+    if (!forwardedFor.empty()) {
+        // Each proxy appends the address it was connected from, so the list
+        // is read from the right; entries left of the first untrusted hop
+        // are whatever the client chose to send
+        std::vector<std::string> hops = splitList(forwardedFor);
+        Address client = peer;
+        for (auto it = hops.rbegin(); it != hops.rend(); ++it) {
+            Address hop;
+            if (!parseEntry(*it, hop)) {
+                return client;
+            }
+            client = hop;
+            if (!contains(hop)) {
+                return hop;
+            }
+        }
+        return client;
+    }
+    Address real;
+    if (!realIp.empty() && parseEntry(realIp, real)) {
+        return real;
+    }
+    return peer;
+}
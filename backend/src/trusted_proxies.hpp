@@ -0,0 +1,42 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <boost/asio/ip/address.hpp>
+
+// Reverse proxies whose X-Forwarded-For and X-Real-IP headers are believed.
+// Behind a proxy every connection comes from the proxy's address, so the
+// per-address limits must key on the client the proxy reports instead.
+// Headers from any other peer are ignored; anyone could send them.
+class TrustedProxies {
+public:
+    using Address = boost::asio::ip::address;
+
+    // Comma-separated addresses and CIDR blocks, e.g. "172.16.0.0/12,::1".
+    // False, with the offending entry in error, if one does not parse.
+    static bool parse(const std::string& list, TrustedProxies& out, std::string& error);
+
+    bool empty() const { return networks.empty(); }
+    bool contains(const Address& address) const;
+
+    // The client a trusted peer connected on behalf of: the rightmost
+    // X-Forwarded-For entry that is not itself a trusted proxy, else X-Real-IP.
+    // The peer itself when it is not trusted or the headers are missing or
+    // malformed.
+    Address clientAddress(const Address& peer, const std::string& forwardedFor, const std::string& realIp) const;
+
+    // IPv4-mapped IPv6 addresses become plain IPv4
+    static Address normalize(const Address& address);
+
+private:
+    struct Network {
+        bool v6;
+        std::array<std::uint8_t, 16> bytes;
+        unsigned prefix;
+    };
+    std::vector<Network> networks;
+
+    // One header entry: an address, optionally bracketed ("[::1]") or with a port
+    static bool parseEntry(const std::string& entry, Address& out);
+};
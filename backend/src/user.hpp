@@ -1,16 +1,18 @@
 #pragma once
 #include <string>
 #include <chrono>
+#include "id_interner.hpp"
 
 struct User {
-    std::string id;
+    InternedId id;            // Id strings are shared with rooms and other holders
     std::string username;
-    std::string currentRoom;
+    InternedId currentRoom;
     bool isOnline;
     std::chrono::system_clock::time_point lastActivity;
+    int homeNode;             // Node holding the user's connection, -1 if unknown
 
-    User() : isOnline(false) {}
-    User(const std::string& userId, const std::string& name) 
-        : id(userId), username(name), isOnline(true), 
-          lastActivity(std::chrono::system_clock::now()) {}
+    User() : isOnline(false), homeNode(-1) {}
+    User(const std::string& userId, const std::string& name)
+        : id(userId), username(name), isOnline(true),
+          lastActivity(std::chrono::system_clock::now()), homeNode(-1) {}
 };
@@ -0,0 +1,32 @@
+#pragma once
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#include "compression.hpp"
+
+// websocketpp's permessage-deflate extension, negotiating with the server's
+// CompressionOptions. websocketpp builds one per connection with no way to
+// pass arguments, so the options are set once, before the endpoint accepts
+// connections.
+template <typename config>
+class WebSocketDeflate : public websocketpp::extensions::permessage_deflate::enabled<config> {
+public:
+    WebSocketDeflate() {
+        using websocketpp::extensions::permessage_deflate::mode::smallest;
+        const CompressionOptions& current = options();
+        if (!current.serverContextTakeover) {
+            this->enable_server_no_context_takeover();
+        }
+        if (!current.clientContextTakeover) {
+            this->enable_client_no_context_takeover();
+        }
+        this->set_server_max_window_bits(static_cast<std::uint8_t>(current.serverWindowBits), smallest);
+        this->set_client_max_window_bits(static_cast<std::uint8_t>(current.clientWindowBits), smallest);
+    }
+
+    // Hides the base version: when false, websocketpp declines every offer
+    bool is_implemented() const { return options().enabled; }
+
+    static CompressionOptions& options() {
+        static CompressionOptions current;
+        return current;
+    }
+};
@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <websocketpp/logger/levels.hpp>
+#include "logger.hpp"
+
+// websocketpp logger policy that hands the library's access and error log
+// lines to Logger, instead of writing them to a stream on the I/O thread.
+// Access channels log at debug level; error channels at the level they name.
+// A channel whose level Logger skips fails dynamic_test, so websocketpp does
+// not format lines nobody will see.
+template <typename Concurrency, typename Names>
+class WebSocketLog {
+public:
+    using level = websocketpp::log::level;
+    using channel_type_hint = websocketpp::log::channel_type_hint;
+
+    explicit WebSocketLog(channel_type_hint::value hint = channel_type_hint::access)
+        : WebSocketLog(0, hint) {}
+    WebSocketLog(level channels, channel_type_hint::value hint = channel_type_hint::access)
+        : errorLog(hint == channel_type_hint::error), staticChannels(channels) {}
+
+    void set_channels(level channels) { dynamicChannels.fetch_or(channels, std::memory_order_relaxed); }
+    void clear_channels(level channels) { dynamicChannels.fetch_and(~channels, std::memory_order_relaxed); }
+
+    void write(level channel, const std::string& message) { write(channel, message.c_str()); }
+    void write(level channel, const char* message) {
+        if (dynamic_test(channel)) {
+            LogLine(levelFor(channel)) << Names::channel_name(channel) << ": " << message;
+        }
+    }
+
+    bool static_test(level channel) const { return (channel & staticChannels) != 0; }
+    bool dynamic_test(level channel) {
+        return (channel & dynamicChannels.load(std::memory_order_relaxed)) != 0 &&
+               Logger::instance().enabled(levelFor(channel));
+    }
+
+private:
+    LogLevel levelFor(level channel) const {
+        using websocketpp::log::elevel;
+        if (!errorLog) {
+            return LogLevel::Debug;
+        }
+        if (channel & (elevel::rerror | elevel::fatal)) {
+            return LogLevel::Error;
+        }
+        if (channel & elevel::warn) {
+            return LogLevel::Warn;
+        }
+        return (channel & elevel::info) ? LogLevel::Info : LogLevel::Debug;
+    }
+
+    bool errorLog;
+    level staticChannels;
+    std::atomic<level> dynamicChannels{0};
+};
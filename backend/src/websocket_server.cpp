@@ -1,9 +1,120 @@
 #include "websocket_server.hpp"
-#include <iostream>
+#include "in_memory_database.hpp"
+#include "json_codec.hpp"
+#include "local_bus.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cctype>
 #include <json/json.h>
 
-WebSocketServer::WebSocketServer(int port) : isRunning(false) {
-    // Initialize WebSocket++ server
+namespace {
+
+Json::Value roomToJson(const Room& room) {
+    Json::Value roomData;
+    roomData["id"] = room.id;
+    roomData["name"] = room.name;
+    roomData["gameType"] = room.gameType;
+    roomData["players"] = Json::Value(Json::arrayValue);
+    for (const auto& playerId : room.players) {
+        roomData["players"].append(playerId.str());
+    }
+    roomData["maxPlayers"] = room.maxPlayers;
+    roomData["status"] = static_cast<int>(room.status);
+    roomData["version"] = static_cast<Json::UInt64>(room.version);
+    return roomData;
+}
+
+// Full room state for one client: sent on subscribe (create/join) and on resync
+Json::Value roomSnapshot(const Room& room) {
+    Json::Value message;
+    message["type"] = "room_update";
+    message["room"] = roomToJson(room);
+    return message;
+}
+
+const char* const kJsonSubprotocol = "lobby.json.v1";
+
+// Resolution of idle and keepalive deadlines
+const long kTimeoutTickMs = 100;
+
+// Restored users checked per tick once the reconnect grace period is over
+const std::size_t kRestoreExpiryChunk = 1000;
+
+std::int64_t steadyNow() {
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+std::chrono::steady_clock::time_point steadyAt(std::int64_t ticks) {
+    return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(ticks));
+}
+
+// The listener is dual-stack, so IPv4 peers arrive as v4-mapped IPv6
+// addresses; those are unmapped. Unspecified if the peer is already gone.
+websocketpp::lib::asio::ip::address peerAddress(const server::connection_ptr& con) {
+    websocketpp::lib::asio::error_code ec;
+    auto address = con->get_raw_socket().remote_endpoint(ec).address();
+    if (ec) {
+        return websocketpp::lib::asio::ip::address();
+    }
+    if (address.is_v6() && address.to_v6().is_v4_mapped()) {
+        return websocketpp::lib::asio::ip::make_address_v4(websocketpp::lib::asio::ip::v4_mapped, address.to_v6());
+    }
+    return address;
+}
+
+bool isLoopbackPeer(const server::connection_ptr& con) {
+    return peerAddress(con).is_loopback();
+}
+
+AdmissionControl::Limits admissionLimits(const ServerConfig& config) {
+    AdmissionControl::Limits limits;
+    limits.maxConnections = config.maxConnections;
+    limits.maxConnectionsPerAddress = config.maxConnectionsPerAddress;
+    limits.connectRate.perSecond = static_cast<double>(config.connectRatePerAddress);
+    limits.connectRate.burst = std::max(1.0, limits.connectRate.perSecond * config.rateLimitBurstSeconds);
+    limits.messageRates = config.addressRateLimits();
+    return limits;
+}
+
+const char* admissionDecisionName(AdmissionControl::Decision decision) {
+    switch (decision) {
+        case AdmissionControl::Decision::Admitted: return "admitted";
+        case AdmissionControl::Decision::ServerFull: return "server_full";
+        case AdmissionControl::Decision::AddressFull: return "address_full";
+        case AdmissionControl::Decision::ConnectRate: return "connect_rate";
+    }
+    return "unknown";
+}
+
+} // namespace
+
+WebSocketServer::WebSocketServer(const ServerConfig& serverConfig)
+    : config(serverConfig), frameEncoder(config.compressionOptions()), slowConsumersEvicted(0),
+      timeouts(std::chrono::milliseconds(kTimeoutTickMs)), pingsSent(0), deadPeersClosed(0), idleClosed(0),
+      restoreExpiryCursor(0), restoredExpired(0), warmStartMs(0),
+      admission(admissionLimits(config)), connectionRates(config.connectionRateLimits()),
+      openLog(static_cast<std::uint32_t>(config.logSamplePerSecond)),
+      closeLog(static_cast<std::uint32_t>(config.logSamplePerSecond)),
+      messageErrorLog(static_cast<std::uint32_t>(config.logSamplePerSecond)),
+      sendErrorLog(static_cast<std::uint32_t>(config.logSamplePerSecond)),
+      slowConsumerLog(static_cast<std::uint32_t>(config.logSamplePerSecond)),
+      admissionLog(static_cast<std::uint32_t>(config.logSamplePerSecond)),
+      rateLimitLog(static_cast<std::uint32_t>(config.logSamplePerSecond)),
+      isRunning(false) {
+    sendLimits.highWaterBytes = config.sendHighWaterBytes;
+    sendLimits.maxQueueBytes = config.sendQueueMaxBytes;
+    sendLimits.grace = std::chrono::milliseconds(config.slowConsumerGraceMs);
+
+    std::string badProxy;
+    if (!TrustedProxies::parse(config.trustedProxies, trustedProxies, badProxy)) {
+        throw std::runtime_error("Invalid TRUSTED_PROXIES entry: " + badProxy);
+    }
+
+    // Every connection's permessage-deflate negotiation reads these
+    LobbyServerConfig::permessage_deflate_type::options() = config.compressionOptions();
+
+    // Initialize WebSocket++ server. Its logs go through Logger, which drops
+    // the access channels (debug level) unless LOG_LEVEL is debug.
     wsServer.set_access_channels(websocketpp::log::alevel::all);
     wsServer.clear_access_channels(websocketpp::log::alevel::frame_payload);
     wsServer.init_asio();
@@ -13,35 +124,81 @@ WebSocketServer::WebSocketServer(int port) : isRunning(false) {
     wsServer.set_open_handler(std::bind(&WebSocketServer::onOpen, this, std::placeholders::_1));
     wsServer.set_close_handler(std::bind(&WebSocketServer::onClose, this, std::placeholders::_1));
     wsServer.set_message_handler(std::bind(&WebSocketServer::onMessage, this, std::placeholders::_1, std::placeholders::_2));
+    wsServer.set_ping_handler(std::bind(&WebSocketServer::onPing, this, std::placeholders::_1, std::placeholders::_2));
+    wsServer.set_pong_handler(std::bind(&WebSocketServer::onPong, this, std::placeholders::_1, std::placeholders::_2));
+    wsServer.set_http_handler(std::bind(&WebSocketServer::onHttp, this, std::placeholders::_1));
 
     // Initialize managers
-    dbManager = std::make_shared<DatabaseManager>();
-    roomManager = std::make_shared<RoomManager>(dbManager);
+    if (InMemoryDatabase::handles(config.mongoUri)) {
+        dbManager = std::make_shared<InMemoryDatabase>(config.mongoUri);
+    } else {
+        dbManager = std::make_shared<DatabaseManager>(config.mongoUri, config.dbPoolSize);
+    }
+    // Before the warm start, whose reads filter on indexed fields
+    if (!dbManager->ensureIndexes()) {
+        LOG_WARN << "Some database indexes are missing; affected queries will scan whole collections";
+    }
+    PersistenceQueue::Options persistenceOptions;
+    persistenceOptions.capacity = config.persistQueueCapacity;
+    persistenceOptions.batchSize = config.persistBatchSize;
+    persistenceOptions.flushInterval = std::chrono::milliseconds(config.persistFlushIntervalMs);
+    ChatHistory::Options chatOptions;
+    chatOptions.maxEntries = config.chatHistoryEntries;
+    chatOptions.maxBytes = config.chatHistoryBytes;
+    roomManager = std::make_shared<RoomManager>(dbManager, persistenceOptions, chatOptions, config.nodeId);
 
-    // Set up room manager callbacks
-    roomManager->onRoomUpdate = [this](const std::string& roomId, const std::string& type) {
-        Room room = roomManager->getRoomById(roomId);
-        Json::Value roomData;
-        roomData["type"] = "room_update";
-        roomData["room"]["id"] = room.id;
-        roomData["room"]["name"] = room.name;
-        roomData["room"]["gameType"] = room.gameType;
-        roomData["room"]["players"] = Json::Value(Json::arrayValue);
-        for (const auto& playerId : room.players) {
-            roomData["room"]["players"].append(playerId);
-        }
-        roomData["room"]["maxPlayers"] = room.maxPlayers;
-        roomData["room"]["status"] = static_cast<int>(room.status);
+    // Before the warm start, which keeps only the rooms this node owns
+    if (config.clusterEnabled()) {
+        const auto& nodes = config.clusterNodes;
+        if (std::find(nodes.begin(), nodes.end(), config.nodeId) == nodes.end()) {
+            throw std::runtime_error("NODE_ID " + std::to_string(config.nodeId) + " is not listed in CLUSTER_NODES");
+        }
+        if (!LocalBus::handles(config.clusterBus)) {
+            throw std::runtime_error("Unsupported CLUSTER_BUS: " + config.clusterBus);
+        }
+        ClusterNode::Options clusterOptions;
+        clusterOptions.self = config.nodeId;
+        clusterOptions.nodes = nodes;
+        clusterOptions.requestTimeout = std::chrono::milliseconds(config.clusterRequestTimeoutMs);
+        cluster = std::make_unique<ClusterNode>(clusterOptions, std::make_unique<LocalBus>(config.clusterBus, config.nodeId));
+        roomManager->isLocalRoom = [this](const std::string& roomId) { return cluster->owns(roomId); };
+    }
 
-        Json::StreamWriterBuilder builder;
-        std::string message = Json::writeString(builder, roomData);
-        broadcastToAll(message);
+    // Warm start before accepting connections; no client sees a partial lobby
+    RestoreStats restored = roomManager->restore(config.snapshotPath, config.effectiveWorkerThreads());
+    restoredUsers = std::move(restored.restoredUsers);
+    warmStartMs = restored.totalMs;
+    LOG_INFO << "Warm start: " << restored.rooms << " rooms and " << restored.users << " users ready in "
+             << restored.totalMs << "ms (snapshot " << (restored.fromSnapshot ? "" : "not found, ")
+             << restored.snapshotMs << "ms, database " << restored.reconcileMs << "ms with "
+             << restored.updatedFromDatabase << " updated and " << restored.removedStale << " removed, indexes "
+             << restored.indexMs << "ms)";
+    if (restored.skippedForeign > 0) {
+        LOG_INFO << "Warm start left " << restored.skippedForeign << " rooms and users to the other cluster nodes";
+    }
+
+    // Set up room manager callbacks
+    roomManager->onRoomUpdate = [this](const RoomEvent& event) {
+        if (cluster) {
+            cluster->forwardRoomEvent(event);
+        }
+        queueRoomEvent(event);
+    };
+    roomManager->onUserUpdate = [this](const std::string& userId, const std::string&) {
+        if (config.notifyTickMs > 0) {
+            notifications.markUserDirty(userId);
+        } else {
+            publishUserChanges({userId});
+        }
     };
 
-    wsServer.listen(port);
+    registerMetrics();
+
+    wsServer.set_reuse_addr(true);
+    wsServer.listen(config.port);
     wsServer.start_accept();
 
-    std::cout << "WebSocket server initialized on port " << port << std::endl;
+    LOG_INFO << "WebSocket server initialized on port " << config.port << " (node " << config.nodeId << ")";
 }
 
 WebSocketServer::~WebSocketServer() {
@@ -49,105 +206,404 @@ WebSocketServer::~WebSocketServer() {
 }
 
 void WebSocketServer::start() {
-    if (!isRunning) {
-        isRunning = true;
-        serverThread = std::thread([this]() {
+    bool expected = false;
+    if (!isRunning.compare_exchange_strong(expected, true)) {
+        return;
+    }
+
+    scheduleLobbyFlush();
+    scheduleMatchmaking();
+    scheduleSendPump();
+    if (config.notifyTickMs > 0) {
+        scheduleNotifications();
+    }
+    if (config.idleTimeoutMs > 0 || config.pingIntervalMs > 0) {
+        scheduleTimeoutSweep();
+    }
+    if (!restoredUsers.empty()) {
+        scheduleRestoreExpiry(config.restoreGraceMs);
+    }
+    roomManager->startSnapshots(config.snapshotPath, std::chrono::milliseconds(config.snapshotIntervalMs));
+    if (cluster) {
+        if (!cluster->start([this](std::uint16_t from, const Json::Value& message) {
+                handleClusterMessage(from, message);
+            })) {
+            throw std::runtime_error("Cannot start cluster bus at " + config.clusterBus);
+        }
+        // Peers answer with their full room summaries, and ours goes out on
+        // the first sync tick, so listings span the cluster right away
+        Json::Value hello;
+        hello["type"] = "hello";
+        cluster->broadcast(hello);
+        nextFullClusterSync = std::chrono::steady_clock::now();
+        scheduleClusterSync();
+    }
+
+    // All workers share the io_context; websocketpp wraps each connection's
+    // handlers in a strand, so per-connection message order is preserved.
+    std::size_t workerCount = config.effectiveWorkerThreads();
+    workerThreads.reserve(workerCount);
+    for (std::size_t i = 0; i < workerCount; ++i) {
+        workerThreads.emplace_back([this]() {
             try {
                 wsServer.run();
             } catch (const std::exception& e) {
-                std::cerr << "WebSocket server error: " << e.what() << std::endl;
+                LOG_ERROR << "WebSocket server error: " << e.what();
             }
         });
-        std::cout << "WebSocket server started" << std::endl;
     }
+    LOG_INFO << "WebSocket server started with " << workerCount << " worker threads";
 }
 
 void WebSocketServer::stop() {
-    if (isRunning) {
-        isRunning = false;
-        wsServer.stop();
-        if (serverThread.joinable()) {
-            serverThread.join();
+    bool expected = true;
+    if (!isRunning.compare_exchange_strong(expected, false)) {
+        return;
+    }
+
+    wsServer.stop();
+    for (auto& worker : workerThreads) {
+        if (worker.joinable()) {
+            worker.join();
         }
-        std::cout << "WebSocket server stopped" << std::endl;
     }
+    workerThreads.clear();
+
+    if (cluster) {
+        cluster->stop();
+        ClusterStats clusterStats = cluster->getStats();
+        LOG_INFO << "Cluster: " << clusterStats.bus.sent << " messages sent, " << clusterStats.bus.received
+                 << " received, " << clusterStats.bus.dropped << " dropped, " << clusterStats.requestsFailed
+                 << " forwarded requests failed";
+    }
+
+    // No handlers are running any more, so every queued mutation can be drained
+    roomManager->shutdown();
+    PersistenceStats stats = roomManager->getPersistenceStats();
+    LOG_INFO << "Persisted " << stats.written << " records in " << stats.batches
+             << " batches (" << stats.coalesced << " coalesced, " << stats.failed << " failed, "
+             << stats.spilled << " spilled, " << stats.dropped << " chat messages dropped)";
+    ChatHistoryStats chatStats = roomManager->getChatHistoryStats();
+    LOG_INFO << "Chat history: " << chatStats.hits << " hits, " << chatStats.misses << " misses, "
+             << chatStats.appended << " appended, " << chatStats.evicted << " evicted";
+    NotificationStats notifyStats = notifications.getStats();
+    LOG_INFO << "Notifications: " << notifyStats.roomEvents << " room and " << notifyStats.userEvents
+             << " user events sent as " << notifyStats.roomsFlushed << " room and " << notifyStats.usersFlushed
+             << " user updates over " << notifyStats.ticks << " ticks";
+    std::uint64_t deflatedIn = deflatedBytesIn.value();
+    if (deflatedIn > 0) {
+        LOG_INFO << "Compression: " << deflateLatency.snapshot().count << " shared fan-out frames, " << deflatedIn
+                 << " bytes compressed to " << deflatedBytesOut.value();
+    }
+    OutboundStats outbound = getOutboundStats();
+    std::uint64_t handshakesTotal = 0;
+    for (const Counter& counter : handshakes) {
+        handshakesTotal += counter.value();
+    }
+    std::uint64_t admitted = handshakes[static_cast<std::size_t>(AdmissionControl::Decision::Admitted)].value();
+    std::uint64_t rateLimited = 0;
+    for (std::size_t i = 0; i < kRateClasses; ++i) {
+        rateLimited += refusedByConnection[i].value() + refusedByAddress[i].value();
+    }
+    LOG_INFO << "Admission: " << admitted << " handshakes admitted, " << handshakesTotal - admitted << " refused; "
+             << rateLimited << " messages rate limited, " << rateLimitDisconnects.value() << " clients disconnected";
+    LOG_INFO << "Keepalive: " << pingsSent.load() << " pings, " << deadPeersClosed.load() << " dead peers and "
+             << idleClosed.load() << " idle connections closed";
+    LOG_INFO << "Outbound queues: max depth " << outbound.maxDepth << ", " << outbound.coalesced
+             << " coalesced, " << outbound.evicted << " slow consumers disconnected";
+    for (const auto& [type, route] : messageHandlers()) {
+        Histogram::Snapshot latency = messageLatency[route.index]->snapshot();
+        if (latency.count > 0) {
+            LOG_INFO << "Message " << type << ": " << latency.count << " handled, p50 "
+                     << latency.percentile(0.5) / 1000 << "us, p99 " << latency.percentile(0.99) / 1000
+                     << "us";
+        }
+    }
+    DatabaseStats dbStats = dbManager->getStats();
+    if (dbStats.operations > 0) {
+        LOG_INFO << "MongoDB: " << dbStats.operations << " operations over " << dbStats.poolSize
+                 << " pooled clients, avg " << dbStats.totalLatencyUs / dbStats.operations << "us (max "
+                 << dbStats.maxLatencyUs << "us, avg wait " << dbStats.totalAcquireUs / dbStats.operations
+                 << "us), " << dbStats.failures << " failed";
+    }
+    LOG_INFO << "WebSocket server stopped";
 }
 
 void WebSocketServer::onOpen(connection_hdl hdl) {
-    std::lock_guard<std::mutex> lock(connectionsMutex);
-    connections[hdl] = ""; // User ID will be set during authentication
-    std::cout << "New WebSocket connection opened" << std::endl;
+    server::connection_ptr con = wsServer.get_con_from_hdl(hdl);
+    WireProtocol protocol = (con->get_subprotocol() == BinaryCodec::kSubprotocol)
+        ? WireProtocol::Binary : WireProtocol::Json;
+
+    auto state = std::make_shared<ConnectionState>(hdl, protocol);
+    if (con->admission) {
+        state->address = con->admission->address();
+    }
+    // Shared compressed frames hold no back-references into earlier messages,
+    // which only holds on our side when each message is compressed alone
+    DeflateNegotiation deflate =
+        DeflateNegotiation::fromResponse(con->get_response_header("Sec-WebSocket-Extensions"));
+    if (deflate.enabled) {
+        state->compression = (!deflate.serverContextTakeover &&
+                              deflate.serverWindowBits >= frameEncoder.deflateWindowBits())
+            ? FrameCompression::Shared : FrameCompression::PerConnection;
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(connectionsMutex);
+        // User ID will be set during authentication
+        connections[hdl] = state;
+    }
+    connectionsOpened.add();
+
+    if (std::optional<std::chrono::steady_clock::time_point> deadline =
+            checkTimeouts(state, std::chrono::steady_clock::now())) {
+        std::lock_guard<std::mutex> lock(timeoutsMutex);
+        timeouts.schedule(state, *deadline);
+    }
+    std::uint64_t skipped = 0;
+    if (openLog.sample(LogLevel::Info, skipped)) {
+        LOG_INFO << "New WebSocket connection opened" << LogSuppressed{skipped};
+    }
 }
 
 void WebSocketServer::onClose(connection_hdl hdl) {
     cleanupConnection(hdl);
-    std::cout << "WebSocket connection closed" << std::endl;
+    // Free the connection's slots now rather than whenever the last
+    // reference to the connection goes
+    websocketpp::lib::error_code ec;
+    if (server::connection_ptr con = wsServer.get_con_from_hdl(hdl, ec)) {
+        con->admission.reset();
+    }
+    std::uint64_t skipped = 0;
+    if (closeLog.sample(LogLevel::Info, skipped)) {
+        LOG_INFO << "WebSocket connection closed" << LogSuppressed{skipped};
+    }
 }
 
 void WebSocketServer::onMessage(connection_hdl hdl, message_ptr msg) {
+    std::shared_ptr<ConnectionState> state = stateFor(hdl);
+    std::int64_t now = steadyNow();
+    if (state) {
+        state->lastReceived.store(now, std::memory_order_relaxed);
+        state->lastMessage.store(now, std::memory_order_relaxed);
+    }
+
+    // Rate limits apply before the frame is decoded, to the type read
+    // straight from its bytes
+    const std::string& payload = msg->get_payload();
+    bool binary = msg->get_opcode() == websocketpp::frame::opcode::binary;
+    RateClass rateClass = rateClassOf(binary ? BinaryCodec::peekClientMessageType(payload.data(), payload.size())
+                                             : JsonCodec::peekMessageType(payload));
+    if (state && !admitMessage(state, rateClass, now)) {
+        return;
+    }
+
     try {
-        std::string payload = msg->get_payload();
-        processMessage(hdl, payload);
+        if (binary) {
+            dispatchMessage(hdl, BinaryCodec::decodeClientMessage(payload.data(), payload.size()), rateClass);
+        } else {
+            processMessage(hdl, payload, rateClass);
+        }
     } catch (const std::exception& e) {
-        std::cerr << "Error processing message: " << e.what() << std::endl;
+        messageErrors.add();
+        std::uint64_t skipped = 0;
+        if (messageErrorLog.sample(LogLevel::Warn, skipped)) {
+            LOG_WARN << "Error processing message: " << e.what() << LogSuppressed{skipped};
+        }
+
+        try {
+            sendMessage(hdl, createResponse("error", "", false, e.what()));
+        } catch (const std::exception& sendError) {
+            LOG_ERROR << "Error sending error response: " << sendError.what();
+        }
+    }
+}
+
+bool WebSocketServer::onPing(connection_hdl hdl, std::string) {
+    if (std::shared_ptr<ConnectionState> state = stateFor(hdl)) {
+        state->lastReceived.store(steadyNow(), std::memory_order_relaxed);
+    }
+    return true;   // Let websocketpp answer with a pong
+}
 
-        std::string errorResponse = createJsonResponse("error", "", false, e.what());
-        wsServer.send(hdl, errorResponse, websocketpp::frame::opcode::text);
+void WebSocketServer::onPong(connection_hdl hdl, std::string) {
+    if (std::shared_ptr<ConnectionState> state = stateFor(hdl)) {
+        state->lastReceived.store(steadyNow(), std::memory_order_relaxed);
     }
 }
 
 bool WebSocketServer::onValidate(connection_hdl hdl) {
-    return true; // Accept all connections for now
-}
-
-void WebSocketServer::processMessage(connection_hdl hdl, const std::string& message) {
-    Json::Value root;
-    Json::CharReaderBuilder builder;
-    Json::CharReader* reader = builder.newCharReader();
-    std::string errors;
-
-    if (!reader->parse(message.c_str(), message.c_str() + message.length(), &root, &errors)) {
-        delete reader;
-        throw std::runtime_error("Invalid JSON format");
-    }
-    delete reader;
-
-    std::string type = root.get("type", "").asString();
-    std::string data = root.get("data", "").asString();
-
-    if (type == "auth") {
-        handleUserAuth(hdl, data);
-    } else if (type == "create_room") {
-        handleCreateRoom(hdl, data);
-    } else if (type == "join_room") {
-        handleJoinRoom(hdl, data);
-    } else if (type == "leave_room") {
-        handleLeaveRoom(hdl, data);
-    } else if (type == "chat_message") {
-        handleChatMessage(hdl, data);
-    } else if (type == "get_rooms") {
-        handleGetRooms(hdl);
-    } else if (type == "get_users") {
-        handleGetUsers(hdl);
+    server::connection_ptr con = wsServer.get_con_from_hdl(hdl);
+
+    // Admission first, so a refused handshake costs as little as possible.
+    // Connections through a trusted proxy count against the client it names.
+    // Loopback clients (health checks, local tools) skip the per-address limits.
+    auto address = peerAddress(con);
+    if (!trustedProxies.empty()) {
+        address = trustedProxies.clientAddress(address, con->get_request_header("X-Forwarded-For"),
+                                               con->get_request_header("X-Real-IP"));
+    }
+    AdmissionControl::Decision decision =
+        admission.admit(address.is_loopback() ? std::string() : address.to_string(), con->admission);
+    handshakes[static_cast<std::size_t>(decision)].add();
+    if (decision != AdmissionControl::Decision::Admitted) {
+        con->set_status(decision == AdmissionControl::Decision::ServerFull
+            ? websocketpp::http::status_code::service_unavailable
+            : websocketpp::http::status_code::too_many_requests);
+        std::uint64_t skipped = 0;
+        if (admissionLog.sample(LogLevel::Warn, skipped)) {
+            LOG_WARN << "Refused connection from " << address.to_string() << ": "
+                     << admissionDecisionName(decision) << LogSuppressed{skipped};
+        }
+        return false;
+    }
+
+    // Pick the first lobby subprotocol the client offers (browsers list them
+    // in preference order). Clients that offer none get JSON text frames.
+    for (const auto& protocol : con->get_requested_subprotocols()) {
+        if (protocol == BinaryCodec::kSubprotocol || protocol == kJsonSubprotocol) {
+            con->select_subprotocol(protocol);
+            break;
+        }
+    }
+    return true;
+}
+
+void WebSocketServer::onHttp(connection_hdl hdl) {
+    // Plain HTTP requests on the WebSocket port: metrics scrapes and health checks
+    server::connection_ptr con = wsServer.get_con_from_hdl(hdl);
+    const std::string& resource = con->get_resource();
+    std::string path = resource.substr(0, resource.find('?'));
+
+    if (path == "/metrics") {
+        con->set_status(websocketpp::http::status_code::ok);
+        con->append_header("Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+        con->set_body(metricsRegistry.render());
+    } else if (path == "/health") {
+        bool healthy = isRunning.load();
+        con->set_status(healthy ? websocketpp::http::status_code::ok
+                                : websocketpp::http::status_code::service_unavailable);
+        con->append_header("Content-Type", "text/plain");
+        con->set_body(healthy ? "OK" : "Stopping");
+    } else if (path == "/log-level") {
+        // Anyone may read the level, as with /metrics; only the host itself may change it
+        const std::string& method = con->get_request().get_method();
+        con->append_header("Content-Type", "text/plain");
+        if (method == "PUT" || method == "POST") {
+            std::string requested = con->get_request_body();
+            requested.erase(std::remove_if(requested.begin(), requested.end(),
+                                           [](unsigned char c) { return std::isspace(c); }), requested.end());
+            LogLevel level;
+            if (!isLoopbackPeer(con)) {
+                con->set_status(websocketpp::http::status_code::forbidden);
+                con->set_body("Forbidden");
+            } else if (!Logger::parseLevel(requested, level)) {
+                con->set_status(websocketpp::http::status_code::bad_request);
+                con->set_body("Unknown level; use debug, info, warn, error or off");
+            } else {
+                LogLevel previous = Logger::instance().getLevel();
+                Logger::instance().setLevel(level);
+                LOG_WARN << "Log level changed from " << Logger::levelName(previous) << " to "
+                         << Logger::levelName(level);
+                con->set_status(websocketpp::http::status_code::ok);
+                con->set_body(Logger::levelName(level));
+            }
+        } else {
+            con->set_status(websocketpp::http::status_code::ok);
+            con->set_body(Logger::levelName(Logger::instance().getLevel()));
+        }
     } else {
-        throw std::runtime_error("Unknown message type: " + type);
+        con->set_status(websocketpp::http::status_code::not_found);
+        con->set_body("Not found");
     }
 }
 
-void WebSocketServer::handleUserAuth(connection_hdl hdl, const std::string& data) {
-    Json::Value authData;
-    Json::CharReaderBuilder builder;
-    Json::CharReader* reader = builder.newCharReader();
-    std::string errors;
+const std::unordered_map<std::string_view, WebSocketServer::MessageRoute>& WebSocketServer::messageHandlers() {
+    static const std::unordered_map<std::string_view, MessageRoute> handlers = {
+        {"auth", {&WebSocketServer::handleUserAuth, 0, RateClass::Auth}},
+        {"create_room", {&WebSocketServer::handleCreateRoom, 1, RateClass::RoomChange}},
+        {"join_room", {&WebSocketServer::handleJoinRoom, 2, RateClass::RoomChange}},
+        {"leave_room", {&WebSocketServer::handleLeaveRoom, 3, RateClass::RoomChange}},
+        {"chat_message", {&WebSocketServer::handleChatMessage, 4, RateClass::Chat}},
+        {"get_rooms", {&WebSocketServer::handleGetRooms, 5, RateClass::Query}},
+        {"get_users", {&WebSocketServer::handleGetUsers, 6, RateClass::Query}},
+        {"quick_match", {&WebSocketServer::handleQuickMatch, 7, RateClass::RoomChange}},
+        {"get_room", {&WebSocketServer::handleGetRoom, 8, RateClass::Query}},
+    };
+    return handlers;
+}
 
-    if (!reader->parse(data.c_str(), data.c_str() + data.length(), &authData, &errors)) {
-        delete reader;
-        throw std::runtime_error("Invalid auth data");
+RateClass WebSocketServer::rateClassOf(std::string_view type) {
+    const auto& handlers = messageHandlers();
+    auto route = handlers.find(type);
+    return route != handlers.end() ? route->second.rateClass : RateClass::Other;
+}
+
+bool WebSocketServer::admitMessage(const std::shared_ptr<ConnectionState>& state, RateClass rateClass,
+                                   std::int64_t now) {
+    std::size_t index = static_cast<std::size_t>(rateClass);
+    const char* scope = nullptr;
+    if (!state->rateBuckets[index].take(connectionRates[index], steadyAt(now))) {
+        refusedByConnection[index].add();
+        scope = "connection";
+    } else if (state->address && !state->address->take(rateClass, steadyAt(now))) {
+        refusedByAddress[index].add();
+        scope = "address";
+    } else {
+        state->refusedInRow = 0;
+        return true;
+    }
+
+    // One error per run of refused messages; the rest are dropped silently
+    std::uint32_t refused = ++state->refusedInRow;
+    if (refused == 1) {
+        try {
+            sendMessage(state->hdl, createResponse("error", "", false, "Rate limit exceeded"));
+        } catch (const std::exception& e) {
+            LOG_ERROR << "Error sending error response: " << e.what();
+        }
+    }
+    if (config.rateLimitDisconnectAfter > 0 && refused == static_cast<std::uint32_t>(config.rateLimitDisconnectAfter)) {
+        rateLimitDisconnects.add();
+        websocketpp::lib::error_code ec;
+        wsServer.close(state->hdl, websocketpp::close::status::policy_violation, "Rate limit exceeded", ec);
+        std::uint64_t skipped = 0;
+        if (rateLimitLog.sample(LogLevel::Warn, skipped)) {
+            LOG_WARN << "Disconnected client over the " << scope << " rate limit for "
+                     << rateClassName(rateClass) << " messages" << LogSuppressed{skipped};
+        }
     }
-    delete reader;
+    return false;
+}
 
-    std::string userId = authData.get("userId", "").asString();
-    std::string username = authData.get("username", "").asString();
+void WebSocketServer::processMessage(connection_hdl hdl, const std::string& message, RateClass charged) {
+    // The envelope and payload are parsed in one pass into a single DOM
+    dispatchMessage(hdl, JsonCodec::parse(message.data(), message.data() + message.size(), "Invalid JSON format"), charged);
+}
+
+void WebSocketServer::dispatchMessage(connection_hdl hdl, const Json::Value& root, RateClass charged) {
+    std::string_view type = JsonCodec::messageType(root);
+    const auto& handlers = messageHandlers();
+    auto route = handlers.find(type);
+    if (route == handlers.end()) {
+        throw std::runtime_error("Unknown message type: " + std::string(type));
+    }
+    // A JSON frame whose type the pre-decode skim misread (an escaped or
+    // repeated key) is charged again for the type it really has
+    if (route->second.rateClass != charged) {
+        std::shared_ptr<ConnectionState> state = stateFor(hdl);
+        if (state && !admitMessage(state, route->second.rateClass, steadyNow())) {
+            return;
+        }
+    }
+    ScopedTimer timer(*messageLatency[route->second.index]);
+
+    Json::Value legacyData;
+    (this->*(route->second.handler))(hdl, JsonCodec::messageData(root, legacyData));
+}
+
+void WebSocketServer::handleUserAuth(connection_hdl hdl, const Json::Value& data) {
+    std::string userId = data.get("userId", "").asString();
+    std::string username = data.get("username", "").asString();
 
     if (userId.empty() || username.empty()) {
         throw std::runtime_error("Missing user credentials");
@@ -159,9 +615,13 @@ void WebSocketServer::handleUserAuth(connection_hdl hdl, const std::string& data
 
     // Associate connection with user
     {
-        std::lock_guard<std::mutex> lock(connectionsMutex);
-        connections[hdl] = userId;
-        userConnections[userId] = hdl;
+        std::unique_lock<std::shared_mutex> lock(connectionsMutex);
+        auto connIt = connections.find(hdl);
+        if (connIt == connections.end()) {
+            throw std::runtime_error("Connection closed");
+        }
+        connIt->second->userId = userId;
+        userConnections[userId] = connIt->second;
     }
 
     Json::Value response;
@@ -169,77 +629,1204 @@ void WebSocketServer::handleUserAuth(connection_hdl hdl, const std::string& data
     response["user"]["id"] = userId;
     response["user"]["username"] = username;
 
-    Json::StreamWriterBuilder writerBuilder;
-    std::string responseStr = Json::writeString(writerBuilder, response);
-    wsServer.send(hdl, responseStr, websocketpp::frame::opcode::text);
+    sendMessage(hdl, response);
 }
 
-void WebSocketServer::handleCreateRoom(connection_hdl hdl, const std::string& data) {
+void WebSocketServer::handleCreateRoom(connection_hdl hdl, const Json::Value& data) {
     std::string userId = getUserId(hdl);
     if (userId.empty()) {
         throw std::runtime_error("User not authenticated");
     }
 
-    Json::Value roomData;
-    Json::CharReaderBuilder builder;
-    Json::CharReader* reader = builder.newCharReader();
-    std::string errors;
+    std::string roomName = data.get("name", "").asString();
+    std::string gameType = data.get("gameType", "Generic").asString();
+
+    std::string roomId = roomManager->createRoom(roomName, userId, gameType);
+
+    Json::Value response;
+    response["type"] = "room_created";
+    response["roomId"] = roomId;
+
+    sendMessage(hdl, response);
+}
 
-    if (!reader->parse(data.c_str(), data.c_str() + data.length(), &roomData, &errors)) {
-        delete reader;
-        throw std::runtime_error("Invalid room data");
+void WebSocketServer::handleJoinRoom(connection_hdl hdl, const Json::Value& data) {
+    std::string userId = getUserId(hdl);
+    if (userId.empty()) {
+        throw std::runtime_error("User not authenticated");
     }
-    delete reader;
 
-    std::string roomName = roomData.get("name", "").asString();
-    std::string gameType = roomData.get("gameType", "Generic").asString();
+    std::string roomId = data.get("roomId", "").asString();
+    if (cluster && !cluster->owns(roomId)) {
+        forwardJoin(hdl, userId, roomId);
+        return;
+    }
 
-    std::string roomId = roomManager->createRoom(roomName, userId, gameType);
+    if (!roomManager->joinRoom(roomId, userId)) {
+        throw std::runtime_error("Unable to join room: " + roomId);
+    }
 
     Json::Value response;
-    response["type"] = "room_created";
+    response["type"] = "room_joined";
+    response["roomId"] = roomId;
+
+    sendMessage(hdl, response);
+    sendChatHistory(hdl, roomId);
+}
+
+void WebSocketServer::handleLeaveRoom(connection_hdl hdl, const Json::Value& data) {
+    std::string userId = getUserId(hdl);
+    if (userId.empty()) {
+        throw std::runtime_error("User not authenticated");
+    }
+
+    std::string roomId = data.get("roomId", "").asString();
+    if (cluster && !cluster->owns(roomId)) {
+        forwardLeave(hdl, userId, roomId);
+        return;
+    }
+
+    if (!roomManager->leaveRoom(roomId, userId)) {
+        throw std::runtime_error("Not in room: " + roomId);
+    }
+
+    Json::Value response;
+    response["type"] = "room_left";
     response["roomId"] = roomId;
 
-    Json::StreamWriterBuilder writerBuilder;
-    std::string responseStr = Json::writeString(writerBuilder, response);
-    wsServer.send(hdl, responseStr, websocketpp::frame::opcode::text);
+    sendMessage(hdl, response);
+}
+
+void WebSocketServer::handleChatMessage(connection_hdl hdl, const Json::Value& data) {
+    std::string userId = getUserId(hdl);
+    if (userId.empty()) {
+        throw std::runtime_error("User not authenticated");
+    }
+
+    std::string roomId = data.get("roomId", "").asString();
+    std::string text = data.get("message", "").asString();
+
+    if (text.empty()) {
+        throw std::runtime_error("Empty chat message");
+    }
+    if (!findRoom(roomId).hasPlayer(userId)) {
+        throw std::runtime_error("Not in room: " + roomId);
+    }
+    if (cluster && !cluster->owns(roomId)) {
+        // The owner stores it and sends it to every member, including ours
+        Json::Value request;
+        request["type"] = "chat";
+        request["roomId"] = roomId;
+        request["userId"] = userId;
+        request["username"] = roomManager->getUserById(userId).username;
+        request["message"] = text;
+        cluster->send(cluster->ownerOf(roomId), request);
+        return;
+    }
+    if (!roomManager->sendChatMessage(roomId, userId, text)) {
+        throw std::runtime_error("Failed to send chat message");
+    }
+
+    Json::Value message;
+    message["type"] = "chat_message";
+    message["roomId"] = roomId;
+    message["userId"] = userId;
+    message["username"] = roomManager->getUserById(userId).username;
+    message["message"] = text;
+
+    publishChat(roomId, message);
+}
+
+void WebSocketServer::handleGetRooms(connection_hdl hdl, const Json::Value&) {
+    Json::Value response;
+    response["type"] = "room_update";
+    response["rooms"] = Json::Value(Json::arrayValue);
+    for (const auto& room : *roomManager->getAllRooms()) {
+        response["rooms"].append(roomToJson(room));
+    }
+    if (cluster) {
+        for (const auto& room : cluster->remoteRooms().all()) {
+            response["rooms"].append(roomToJson(room));
+        }
+    }
+
+    // Requesting the listing subscribes the user to its deltas
+    std::string userId = getUserId(hdl);
+    if (!userId.empty()) {
+        interest.addLobbyWatcher(userId);
+    }
+
+    sendMessage(hdl, response, "room_listing");
+}
+
+void WebSocketServer::handleGetUsers(connection_hdl hdl, const Json::Value&) {
+    Json::Value response;
+    response["type"] = "user_update";
+    response["users"] = Json::Value(Json::arrayValue);
+    for (const auto& user : *roomManager->getOnlineUsers()) {
+        Json::Value userData;
+        userData["id"] = user.id.str();
+        userData["username"] = user.username;
+        userData["currentRoom"] = user.currentRoom.str();
+        response["users"].append(userData);
+    }
+
+    sendMessage(hdl, response, "user_listing");
+}
+
+void WebSocketServer::handleQuickMatch(connection_hdl hdl, const Json::Value& data) {
+    std::string userId = getUserId(hdl);
+    if (userId.empty()) {
+        throw std::runtime_error("User not authenticated");
+    }
+
+    // Matched on the next tick together with everyone else queued for the game
+    std::string gameType = data.get("gameType", "Generic").asString();
+    std::lock_guard<std::mutex> lock(matchQueueMutex);
+    matchQueue[gameType].push_back(PendingMatch{hdl, userId});
+}
+
+void WebSocketServer::handleGetRoom(connection_hdl hdl, const Json::Value& data) {
+    // Clients ask for a snapshot when they detect a gap in a room's versions
+    std::string roomId = data.get("roomId", "").asString();
+    Room room = findRoom(roomId);
+    if (room.id.empty()) {
+        throw std::runtime_error("Room not found: " + roomId);
+    }
+
+    sendMessage(hdl, roomSnapshot(room), "room_update:" + roomId);
+}
+
+void WebSocketServer::queueRoomEvent(const RoomEvent& event) {
+    if (config.notifyTickMs > 0) {
+        notifications.addRoomEvent(event);
+    } else {
+        onRoomEvent(event);
+    }
+}
+
+Room WebSocketServer::findRoom(const std::string& roomId) {
+    if (cluster && !cluster->owns(roomId)) {
+        return cluster->remoteRooms().get(roomId);
+    }
+    return roomManager->getRoomById(roomId);
+}
+
+void WebSocketServer::onRoomEvent(const RoomEvent& event) {
+    const std::string& roomId = event.roomId;
+    if (event.type == RoomEvent::Type::Deleted) {
+        interest.removeRoom(roomId);
+        interest.markRoomRemoved(roomId);
+        return;
+    }
+
+    // Membership follows the current state, which may be newer than the event
+    Room current = findRoom(roomId);
+    if (current.id.empty()) {
+        // Deleted again before this event was handled
+        return;
+    }
+
+    // Members get the change right away; the lobby listing is batched
+    interest.setRoomMembers(roomId, current.players.ids());
+    interest.markRoomChanged(roomId);
+
+    // A new member subscribes with a full snapshot; everyone already in the
+    // room gets a delta carrying the version it produces
+    const Room& room = event.room;
+    Json::Value delta;
+    delta["roomId"] = roomId;
+    delta["version"] = static_cast<Json::UInt64>(room.version);
+    std::vector<std::string> recipients;
+
+    switch (event.type) {
+        case RoomEvent::Type::Created:
+            sendToUsers({event.userId}, roomSnapshot(room), "room_update:" + roomId);
+            return;
+        case RoomEvent::Type::PlayerJoined:
+            sendToUsers({event.userId}, roomSnapshot(room), "room_update:" + roomId);
+            delta["type"] = "player_joined";
+            delta["userId"] = event.userId;
+            for (const auto& playerId : room.players) {
+                std::string id = playerId.str();
+                if (id != event.userId) {
+                    recipients.push_back(std::move(id));
+                }
+            }
+            break;
+        case RoomEvent::Type::PlayerLeft:
+            delta["type"] = "player_left";
+            delta["userId"] = event.userId;
+            recipients = room.players.ids();
+            break;
+        case RoomEvent::Type::StatusChanged:
+            delta["type"] = "status_changed";
+            delta["status"] = static_cast<int>(room.status);
+            recipients = room.players.ids();
+            break;
+        case RoomEvent::Type::Deleted:
+            return;
+    }
+
+    sendToUsers(recipients, delta);
+}
+
+void WebSocketServer::publishUserChanges(const std::vector<std::string>& userIds) {
+    if (userIds.empty() || !interest.hasLobbyWatchers()) {
+        return;
+    }
+
+    Json::Value message;
+    message["type"] = "user_delta";
+    message["updated"] = Json::Value(Json::arrayValue);
+    message["removed"] = Json::Value(Json::arrayValue);
+    for (const auto& userId : userIds) {
+        User user = roomManager->getUserById(userId);
+        if (user.id.empty()) {
+            message["removed"].append(userId);
+            continue;
+        }
+        Json::Value userData;
+        userData["id"] = user.id.str();
+        userData["username"] = user.username;
+        userData["currentRoom"] = user.currentRoom.str();
+        message["updated"].append(userData);
+    }
+
+    sendToUsers(interest.getLobbyWatchers(), message);
 }
 
-void WebSocketServer::broadcastToAll(const std::string& message) {
-    std::lock_guard<std::mutex> lock(connectionsMutex);
-    for (const auto& [hdl, userId] : connections) {
+void WebSocketServer::scheduleNotifications() {
+    wsServer.set_timer(config.notifyTickMs, [this](const websocketpp::lib::error_code& ec) {
+        if (ec || !isRunning) {
+            return;
+        }
+        flushNotifications();
+        scheduleNotifications();
+    });
+}
+
+void WebSocketServer::flushNotifications() {
+    NotificationScheduler::Batch batch = notifications.take();
+
+    for (const auto& [roomId, changes] : batch.rooms) {
+        if (changes.deleted) {
+            onRoomEvent(RoomEvent{RoomEvent::Type::Deleted, roomId, "", Room()});
+            if (changes.eventCount == 0) {
+                continue;
+            }
+            // The id was reused within the tick; the snapshot below covers the new room
+        } else if (changes.eventCount == 1) {
+            // A lone change still goes out as its delta
+            onRoomEvent(changes.first);
+            continue;
+        }
+
+        // Several changes in one tick: members get the current state once
+        Room current = findRoom(roomId);
+        if (current.id.empty()) {
+            // Deleted after the batch was taken; the next tick reports it
+            continue;
+        }
+        std::vector<std::string> members = current.players.ids();
+        interest.setRoomMembers(roomId, members);
+        interest.markRoomChanged(roomId);
+        sendToUsers(members, roomSnapshot(current), "room_update:" + roomId);
+    }
+
+    // Lobby watchers see each changed user once, in its current state
+    publishUserChanges(batch.users);
+}
+
+void WebSocketServer::scheduleLobbyFlush() {
+    wsServer.set_timer(config.lobbyDeltaIntervalMs, [this](const websocketpp::lib::error_code& ec) {
+        if (ec || !isRunning) {
+            return;
+        }
+        flushLobbyDelta();
+        scheduleLobbyFlush();
+    });
+}
+
+void WebSocketServer::flushLobbyDelta() {
+    InterestIndex::LobbyDelta delta = interest.takeLobbyDelta();
+    if (delta.empty() || !interest.hasLobbyWatchers()) {
+        return;
+    }
+
+    Json::Value message;
+    message["type"] = "lobby_delta";
+    message["updated"] = Json::Value(Json::arrayValue);
+    message["removed"] = Json::Value(Json::arrayValue);
+    for (const auto& roomId : delta.changedRooms) {
+        Room room = findRoom(roomId);
+        if (room.id.empty()) {
+            message["removed"].append(roomId);
+        } else {
+            message["updated"].append(roomToJson(room));
+        }
+    }
+    for (const auto& roomId : delta.removedRooms) {
+        message["removed"].append(roomId);
+    }
+
+    sendToUsers(interest.getLobbyWatchers(), message);
+}
+
+void WebSocketServer::scheduleMatchmaking() {
+    wsServer.set_timer(config.matchmakingIntervalMs, [this](const websocketpp::lib::error_code& ec) {
+        if (ec || !isRunning) {
+            return;
+        }
+        flushMatchQueue();
+        scheduleMatchmaking();
+    });
+}
+
+void WebSocketServer::flushMatchQueue() {
+    std::unordered_map<std::string, std::vector<PendingMatch>> queued;
+    {
+        std::lock_guard<std::mutex> lock(matchQueueMutex);
+        queued.swap(matchQueue);
+    }
+
+    for (const auto& [gameType, pending] : queued) {
+        std::vector<std::string> userIds;
+        userIds.reserve(pending.size());
+        for (const auto& match : pending) {
+            userIds.push_back(match.userId);
+        }
+
+        std::vector<std::string> roomIds = roomManager->matchPlayers(userIds, gameType);
+        for (std::size_t i = 0; i < pending.size(); ++i) {
+            Json::Value response;
+            response["type"] = "room_joined";
+            response["roomId"] = roomIds[i];
+            try {
+                sendMessage(pending[i].hdl, response);
+                sendChatHistory(pending[i].hdl, roomIds[i]);
+            } catch (const std::exception& e) {
+                LOG_ERROR << "Error sending match result: " << e.what();
+            }
+        }
+    }
+}
+
+void WebSocketServer::scheduleSendPump() {
+    wsServer.set_timer(config.sendPumpIntervalMs, [this](const websocketpp::lib::error_code& ec) {
+        if (ec || !isRunning) {
+            return;
+        }
+        pumpBacklog();
+        scheduleSendPump();
+    });
+}
+
+void WebSocketServer::scheduleTimeoutSweep() {
+    wsServer.set_timer(kTimeoutTickMs, [this](const websocketpp::lib::error_code& ec) {
+        if (ec || !isRunning) {
+            return;
+        }
+        sweepTimeouts();
+        scheduleTimeoutSweep();
+    });
+}
+
+void WebSocketServer::scheduleRestoreExpiry(long delayMs) {
+    wsServer.set_timer(delayMs, [this](const websocketpp::lib::error_code& ec) {
+        if (ec || !isRunning) {
+            return;
+        }
+        if (expireRestoredUsers()) {
+            scheduleRestoreExpiry(1);
+        }
+    });
+}
+
+bool WebSocketServer::expireRestoredUsers() {
+    // Chunked so a large restore does not hold a worker for long
+    std::size_t end = std::min(restoredUsers.size(), restoreExpiryCursor + kRestoreExpiryChunk);
+    std::vector<std::string> expired;
+    {
+        std::shared_lock<std::shared_mutex> lock(connectionsMutex);
+        for (std::size_t i = restoreExpiryCursor; i < end; ++i) {
+            if (!userConnections.count(restoredUsers[i])) {
+                expired.push_back(restoredUsers[i]);
+            }
+        }
+    }
+    restoreExpiryCursor = end;
+    for (const auto& userId : expired) {
+        roomManager->removeUser(userId);
+    }
+    restoredExpired += expired.size();
+
+    if (restoreExpiryCursor < restoredUsers.size()) {
+        return true;
+    }
+    LOG_INFO << "Removed " << restoredExpired << " of " << restoredUsers.size()
+             << " restored users that did not reconnect";
+    std::vector<std::string>().swap(restoredUsers);
+    return false;
+}
+
+void WebSocketServer::sweepTimeouts() {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::shared_ptr<ConnectionState>> due;
+    {
+        std::lock_guard<std::mutex> lock(timeoutsMutex);
+        timeouts.advance(now, due);
+    }
+    if (due.empty()) {
+        return;
+    }
+
+    std::vector<std::pair<std::shared_ptr<ConnectionState>, std::chrono::steady_clock::time_point>> rearm;
+    rearm.reserve(due.size());
+    for (const auto& state : due) {
+        if (state->closed.load()) {
+            continue;
+        }
+        if (std::optional<std::chrono::steady_clock::time_point> deadline = checkTimeouts(state, now)) {
+            rearm.emplace_back(state, *deadline);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(timeoutsMutex);
+    for (const auto& [state, deadline] : rearm) {
+        // Cleanup sets closed before cancelling, so this never re-adds a closed connection
+        if (!state->closed.load()) {
+            timeouts.schedule(state, deadline);
+        }
+    }
+}
+
+std::optional<std::chrono::steady_clock::time_point> WebSocketServer::checkTimeouts(
+    const std::shared_ptr<ConnectionState>& state, std::chrono::steady_clock::time_point now) {
+    auto lastMessage = steadyAt(state->lastMessage.load(std::memory_order_relaxed));
+    auto lastReceived = steadyAt(state->lastReceived.load(std::memory_order_relaxed));
+    auto idleTimeout = std::chrono::milliseconds(config.idleTimeoutMs);
+    auto pingInterval = std::chrono::milliseconds(config.pingIntervalMs);
+    auto pongTimeout = std::chrono::milliseconds(config.pongTimeoutMs);
+    websocketpp::lib::error_code ec;
+
+    if (config.idleTimeoutMs > 0 && now - lastMessage >= idleTimeout) {
+        idleClosed.fetch_add(1, std::memory_order_relaxed);
+        wsServer.close(state->hdl, websocketpp::close::status::going_away, "Idle timeout", ec);
+        return std::nullopt;
+    }
+
+    auto next = std::chrono::steady_clock::time_point::max();
+    if (config.idleTimeoutMs > 0) {
+        next = lastMessage + idleTimeout;
+    }
+    if (config.pingIntervalMs > 0) {
+        if (state->pingSent != 0 && lastReceived < steadyAt(state->pingSent)) {
+            // Nothing has arrived since the ping. A half-open peer never answers
+            // the close either; websocketpp drops the TCP connection once the
+            // close handshake times out, which releases the user's rooms.
+            auto pongDeadline = steadyAt(state->pingSent) + pongTimeout;
+            if (now >= pongDeadline) {
+                deadPeersClosed.fetch_add(1, std::memory_order_relaxed);
+                wsServer.close(state->hdl, websocketpp::close::status::going_away, "Keepalive timeout", ec);
+                return std::nullopt;
+            }
+            next = std::min(next, pongDeadline);
+        } else if (now - lastReceived >= pingInterval) {
+            wsServer.ping(state->hdl, "", ec);
+            pingsSent.fetch_add(1, std::memory_order_relaxed);
+            state->pingSent = now.time_since_epoch().count();
+            next = std::min(next, now + pongTimeout);
+        } else {
+            state->pingSent = 0;
+            next = std::min(next, lastReceived + pingInterval);
+        }
+    }
+    if (next == std::chrono::steady_clock::time_point::max()) {
+        return std::nullopt;
+    }
+    return next;
+}
+
+void WebSocketServer::pumpBacklog() {
+    // websocketpp has no write-completion hook, so backlogged outboxes are
+    // retried on a short timer instead
+    std::vector<std::shared_ptr<ConnectionState>> pending;
+    {
+        std::lock_guard<std::mutex> lock(backlogMutex);
+        pending.assign(backlogged.begin(), backlogged.end());
+    }
+
+    for (const auto& state : pending) {
+        websocketpp::lib::error_code ec;
+        server::connection_ptr con = wsServer.get_con_from_hdl(state->hdl, ec);
+        Outbox::Status status = Outbox::Status::Idle;
+        if (ec) {
+            state->outbox.clear();
+        } else {
+            status = state->outbox.drain(sendLimits,
+                [&con]() { return con->get_buffered_amount(); },
+                [&con](const message_ptr& frame) { con->send(frame); });
+        }
+
+        if (status == Outbox::Status::Idle) {
+            // A push may have refilled the outbox since the drain
+            std::lock_guard<std::mutex> lock(backlogMutex);
+            if (state->outbox.getDepth() == 0) {
+                backlogged.erase(state);
+            }
+        } else {
+            onOutboxStatus(state, status);
+        }
+    }
+}
+
+void WebSocketServer::broadcastToRoom(const std::string& roomId, const Json::Value& message) {
+    sendToUsers(interest.getRoomMembers(roomId), message);
+}
+
+void WebSocketServer::sendToUser(const std::string& userId, const Json::Value& message) {
+    std::shared_ptr<ConnectionState> state;
+    {
+        std::shared_lock<std::shared_mutex> lock(connectionsMutex);
+        auto it = userConnections.find(userId);
+        if (it == userConnections.end()) {
+            return;
+        }
+        state = it->second;
+    }
+
+    deliver(state, frameEncoder.wrap(encodeMessage(message, state->protocol),
+        state->protocol == WireProtocol::Binary ? websocketpp::frame::opcode::binary
+                                                : websocketpp::frame::opcode::text));
+}
+
+void WebSocketServer::sendToUsers(const std::vector<std::string>& userIds, const Json::Value& message,
+                                  const std::string& coalesceKey) {
+    if (userIds.empty()) {
+        return;
+    }
+    ScopedTimer timer(fanoutLatency);
+    FanoutFrames frames(message);
+    std::size_t recipients = 0;
+
+    std::shared_lock<std::shared_mutex> lock(connectionsMutex);
+    for (const auto& userId : userIds) {
+        auto it = userConnections.find(userId);
+        if (it == userConnections.end()) {
+            continue;
+        }
+        message_ptr frame = frameFor(frames, *it->second);
+        if (frame) {
+            deliver(it->second, frame, coalesceKey);
+            ++recipients;
+        }
+    }
+    fanoutRecipients.record(recipients);
+}
+
+void WebSocketServer::broadcastToAll(const Json::Value& message) {
+    ScopedTimer timer(fanoutLatency);
+    FanoutFrames frames(message);
+    std::size_t recipients = 0;
+
+    std::shared_lock<std::shared_mutex> lock(connectionsMutex);
+    for (const auto& [hdl, state] : connections) {
+        message_ptr frame = frameFor(frames, *state);
+        if (frame) {
+            deliver(state, frame);
+            ++recipients;
+        }
+    }
+    fanoutRecipients.record(recipients);
+}
+
+message_ptr WebSocketServer::frameFor(FanoutFrames& frames, const ConnectionState& state) {
+    bool binary = state.protocol == WireProtocol::Binary;
+    FanoutFrames::Encoding& encoding = binary ? frames.binary : frames.json;
+    websocketpp::frame::opcode::value opcode = binary ? websocketpp::frame::opcode::binary
+                                                      : websocketpp::frame::opcode::text;
+    if (!encoding.encoded) {
+        encoding.payload = encodeMessage(frames.message, state.protocol);
+        encoding.encoded = true;
+    }
+
+    if (state.compression == FrameCompression::PerConnection && frameEncoder.shouldCompress(encoding.payload.size())) {
+        // Framed and compressed on send by the connection's own deflate context
+        return frameEncoder.wrap(encoding.payload, opcode);
+    }
+    if (state.compression == FrameCompression::Shared && !encoding.deflateTried) {
+        encoding.deflateTried = true;
+        if (frameEncoder.shouldCompress(encoding.payload.size())) {
+            ScopedTimer timer(deflateLatency);
+            encoding.deflated = frameEncoder.encodeDeflated(encoding.payload, opcode);
+            deflatedBytesIn.add(encoding.payload.size());
+            deflatedBytesOut.add(encoding.deflated ? encoding.deflated->get_payload().size() : encoding.payload.size());
+        }
+    }
+    if (state.compression == FrameCompression::Shared && encoding.deflated) {
+        return encoding.deflated;
+    }
+
+    if (!encoding.plain) {
+        encoding.plain = frameEncoder.encode(encoding.payload, opcode);
+        if (!encoding.plain) {
+            LOG_ERROR << "Error preparing broadcast frame";
+        }
+    }
+    return encoding.plain;
+}
+
+void WebSocketServer::deliver(const std::shared_ptr<ConnectionState>& state, const message_ptr& frame,
+                              const std::string& coalesceKey) {
+    if (!frame || state->evicted.load(std::memory_order_relaxed)) {
+        return;
+    }
+    websocketpp::lib::error_code ec;
+    server::connection_ptr con = wsServer.get_con_from_hdl(state->hdl, ec);
+    if (ec) {
+        return;
+    }
+
+    std::size_t frameBytes = frame->get_header().size() + frame->get_payload().size();
+    Outbox::Status status = state->outbox.push(frame, frameBytes, coalesceKey, sendLimits,
+        [&con]() { return con->get_buffered_amount(); },
+        [this, &con](const message_ptr& next) {
+            websocketpp::lib::error_code sendError = con->send(next);
+            std::uint64_t skipped = 0;
+            if (sendError && sendErrorLog.sample(LogLevel::Error, skipped)) {
+                LOG_ERROR << "Error sending message: " << sendError.message() << LogSuppressed{skipped};
+            }
+        });
+    onOutboxStatus(state, status);
+}
+
+void WebSocketServer::onOutboxStatus(const std::shared_ptr<ConnectionState>& state, Outbox::Status status) {
+    switch (status) {
+        case Outbox::Status::Idle:
+            break;
+        case Outbox::Status::Backlogged: {
+            std::lock_guard<std::mutex> lock(backlogMutex);
+            backlogged.insert(state);
+            break;
+        }
+        case Outbox::Status::Overflow:
+            evictSlowConsumer(state, "send queue limit exceeded");
+            break;
+        case Outbox::Status::Stalled:
+            evictSlowConsumer(state, "send queue not draining");
+            break;
+    }
+}
+
+void WebSocketServer::evictSlowConsumer(const std::shared_ptr<ConnectionState>& state, const char* reason) {
+    if (state->evicted.exchange(true)) {
+        return;
+    }
+    state->outbox.clear();
+    {
+        std::lock_guard<std::mutex> lock(backlogMutex);
+        backlogged.erase(state);
+    }
+    slowConsumersEvicted.fetch_add(1, std::memory_order_relaxed);
+
+    // The close frame queues behind data already in the socket buffer; the
+    // close handshake timeout bounds how long that can take
+    websocketpp::lib::error_code ec;
+    wsServer.close(state->hdl, websocketpp::close::status::try_again_later, "Slow consumer", ec);
+    std::uint64_t skipped = 0;
+    if (slowConsumerLog.sample(LogLevel::Warn, skipped)) {
+        LOG_WARN << "Disconnected slow consumer: " << reason << LogSuppressed{skipped};
+    }
+}
+
+std::vector<WebSocketServer::ConnectionQueueStats> WebSocketServer::getConnectionQueueStats() const {
+    std::vector<ConnectionQueueStats> result;
+    std::shared_lock<std::shared_mutex> lock(connectionsMutex);
+    result.reserve(connections.size());
+    for (const auto& [hdl, state] : connections) {
+        result.push_back(ConnectionQueueStats{state->userId, state->outbox.getDepth(),
+            state->outbox.getQueuedBytes(), state->outbox.getMaxDepth(), state->outbox.getCoalesced()});
+    }
+    return result;
+}
+
+WebSocketServer::OutboundStats WebSocketServer::getOutboundStats() const {
+    OutboundStats stats;
+    for (const auto& connection : getConnectionQueueStats()) {
+        ++stats.connections;
+        if (connection.depth > 0) {
+            ++stats.backlogged;
+        }
+        stats.queuedFrames += connection.depth;
+        stats.queuedBytes += connection.queuedBytes;
+        stats.maxDepth = std::max(stats.maxDepth, connection.maxDepth);
+        stats.coalesced += connection.coalesced;
+    }
+    stats.evicted = slowConsumersEvicted.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void WebSocketServer::handleClusterMessage(std::uint16_t from, const Json::Value& message) {
+    const std::string type = message["type"].asString();
+    const std::string roomId = message["roomId"].asString();
+    const std::string userId = message["userId"].asString();
+
+    if (type == "room_event") {
+        // A room this node does not own changed and some of its players are connected here
+        RoomEvent event = ClusterNode::decodeEvent(message["event"]);
+        if (event.type == RoomEvent::Type::Deleted) {
+            cluster->remoteRooms().remove(event.roomId);
+        } else {
+            cluster->remoteRooms().update(event.room, from);
+        }
+        queueRoomEvent(event);
+    } else if (type == "chat_event") {
+        broadcastToRoom(roomId, message["message"]);
+    } else if (type == "join") {
+        // Room events for the player go to its home from now on
+        cluster->setMemberHome(userId, from);
+        Json::Value response;
+        bool joined = roomManager->joinRoom(roomId, userId);
+        response["joined"] = joined;
+        response["history"] = Json::Value(Json::arrayValue);
+        if (joined) {
+            for (const auto& entry : roomManager->getChatHistory(roomId)) {
+                response["history"].append(*entry);
+            }
+        }
+        cluster->reply(from, message, response);
+    } else if (type == "leave") {
+        Json::Value response;
+        response["left"] = roomManager->leaveRoom(roomId, userId);
+        cluster->reply(from, message, response);
+    } else if (type == "chat") {
+        // The sender's node checked membership against a copy that may be stale
+        if (!roomManager->getRoomById(roomId).hasPlayer(userId)) {
+            return;
+        }
+        std::string username = message["username"].asString();
+        std::string text = message["message"].asString();
+        if (!roomManager->recordChat(ChatMessage(roomId, userId, username, text))) {
+            return;
+        }
+        Json::Value chat;
+        chat["type"] = "chat_message";
+        chat["roomId"] = roomId;
+        chat["userId"] = userId;
+        chat["username"] = username;
+        chat["message"] = text;
+        publishChat(roomId, chat);
+    } else if (type == "user_gone") {
+        roomManager->leaveAllRooms(userId);
+        cluster->forgetMember(userId);
+    } else if (type == "summary") {
+        applyClusterSummary(from, message);
+    } else if (type == "hello") {
+        // A node (re)started and knows none of our rooms
+        cluster->publishSummary(*roomManager->getAllRooms(), {}, true, from);
+    }
+}
+
+void WebSocketServer::applyClusterSummary(std::uint16_t from, const Json::Value& message) {
+    RemoteRooms& remote = cluster->remoteRooms();
+    bool full = message["full"].asBool();
+    if (full && message["first"].asBool()) {
+        remote.beginSync(from);
+    }
+    // Lobby watchers here see the owner's changes in the next delta
+    for (const auto& value : message["rooms"]) {
+        Room room = ClusterNode::decodeRoom(value);
+        if (remote.update(room, from)) {
+            interest.markRoomChanged(room.id);
+        }
+    }
+    for (const auto& value : message["removed"]) {
+        std::string roomId = value.asString();
+        if (remote.remove(roomId)) {
+            interest.markRoomRemoved(roomId);
+        }
+    }
+    if (full && message["last"].asBool()) {
+        for (const auto& roomId : remote.endSync(from)) {
+            interest.markRoomRemoved(roomId);
+        }
+    }
+}
+
+void WebSocketServer::forwardJoin(connection_hdl hdl, const std::string& userId, const std::string& roomId) {
+    std::uint16_t owner = cluster->ownerOf(roomId);
+    // Noted before asking, so the owner hears about a disconnect even if the reply is lost
+    cluster->noteOwnerContacted(userId, owner);
+
+    Json::Value request;
+    request["type"] = "join";
+    request["roomId"] = roomId;
+    request["userId"] = userId;
+    cluster->request(owner, request, [this, hdl, userId, roomId](bool ok, const Json::Value& reply) {
+        if (!ok || !reply["joined"].asBool()) {
+            sendError(hdl, "Unable to join room: " + roomId);
+            return;
+        }
+        roomManager->setCurrentRoom(userId, roomId);
+
+        Json::Value response;
+        response["type"] = "room_joined";
+        response["roomId"] = roomId;
+        std::vector<ChatHistory::Entry> history;
+        for (const auto& entry : reply["history"]) {
+            history.push_back(std::make_shared<const std::string>(entry.asString()));
+        }
         try {
-            wsServer.send(hdl, message, websocketpp::frame::opcode::text);
+            sendMessage(hdl, response);
+            sendChatEntries(hdl, roomId, history);
         } catch (const std::exception& e) {
-            std::cerr << "Error broadcasting message: " << e.what() << std::endl;
+            LOG_ERROR << "Error sending forwarded join result: " << e.what();
+        }
+    });
+}
+
+void WebSocketServer::forwardLeave(connection_hdl hdl, const std::string& userId, const std::string& roomId) {
+    Json::Value request;
+    request["type"] = "leave";
+    request["roomId"] = roomId;
+    request["userId"] = userId;
+    cluster->request(cluster->ownerOf(roomId), request, [this, hdl, userId, roomId](bool ok, const Json::Value& reply) {
+        if (!ok || !reply["left"].asBool()) {
+            sendError(hdl, "Not in room: " + roomId);
+            return;
+        }
+        roomManager->setCurrentRoom(userId, "");
+
+        Json::Value response;
+        response["type"] = "room_left";
+        response["roomId"] = roomId;
+        try {
+            sendMessage(hdl, response);
+        } catch (const std::exception& e) {
+            LOG_ERROR << "Error sending forwarded leave result: " << e.what();
+        }
+    });
+}
+
+void WebSocketServer::publishChat(const std::string& roomId, const Json::Value& message) {
+    broadcastToRoom(roomId, message);
+    if (!cluster) {
+        return;
+    }
+    std::vector<std::uint16_t> homes = cluster->homesOf(roomManager->getRoomById(roomId), "");
+    if (homes.empty()) {
+        return;
+    }
+    Json::Value event;
+    event["type"] = "chat_event";
+    event["roomId"] = roomId;
+    event["message"] = message;
+    for (std::uint16_t node : homes) {
+        cluster->send(node, event);
+    }
+}
+
+void WebSocketServer::scheduleClusterSync() {
+    wsServer.set_timer(config.lobbyDeltaIntervalMs, [this](const websocketpp::lib::error_code& ec) {
+        if (ec || !isRunning) {
+            return;
+        }
+        syncCluster();
+        scheduleClusterSync();
+    });
+}
+
+void WebSocketServer::syncCluster() {
+    cluster->expireRequests();
+
+    std::vector<Room> changed;
+    std::vector<std::string> removed;
+    for (const auto& roomId : cluster->takeChanged()) {
+        Room room = roomManager->getRoomById(roomId);
+        if (room.id.empty()) {
+            removed.push_back(roomId);
+        } else {
+            changed.push_back(std::move(room));
         }
     }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now >= nextFullClusterSync) {
+        cluster->publishSummary(*roomManager->getAllRooms(), removed, true);
+        nextFullClusterSync = now + std::chrono::milliseconds(config.clusterSyncIntervalMs);
+    } else if (!changed.empty() || !removed.empty()) {
+        cluster->publishSummary(changed, removed, false);
+    }
+}
+
+void WebSocketServer::registerMetrics() {
+    const auto& handlers = messageHandlers();
+    messageLatency.resize(handlers.size());
+    for (const auto& [type, route] : handlers) {
+        messageLatency[route.index] = std::make_unique<Histogram>();
+    }
+    for (const auto& [type, route] : handlers) {
+        metricsRegistry.addHistogram("lobby_message_duration_seconds", "Time spent handling a client message",
+            *messageLatency[route.index], 1e-9, 10, 34, "type=\"" + std::string(type) + "\"");
+    }
+    metricsRegistry.addCounter("lobby_message_errors_total", "Client messages rejected or failed", messageErrors);
+    metricsRegistry.addHistogram("lobby_fanout_recipients", "Connections reached by one fan-out",
+        fanoutRecipients, 1, 0, 16);
+    metricsRegistry.addHistogram("lobby_fanout_duration_seconds", "Time to encode and queue one fan-out",
+        fanoutLatency, 1e-9, 10, 34);
+    metricsRegistry.addCounter("lobby_deflate_bytes_total", "Fan-out payload bytes before and after shared compression",
+        deflatedBytesIn, "stage=\"in\"");
+    metricsRegistry.addCounter("lobby_deflate_bytes_total", "Fan-out payload bytes before and after shared compression",
+        deflatedBytesOut, "stage=\"out\"");
+    metricsRegistry.addHistogram("lobby_deflate_duration_seconds", "Time to compress one shared fan-out frame",
+        deflateLatency, 1e-9, 10, 34);
+
+    metricsRegistry.addGauge("lobby_warm_start_seconds", "Time to restore state before accepting connections",
+        [this]() { return static_cast<double>(warmStartMs) / 1000.0; });
+
+    if (cluster) {
+        metricsRegistry.addCounter("lobby_cluster_messages_sent_total", "Messages sent to other nodes",
+            [this]() { return static_cast<double>(cluster->getStats().bus.sent); });
+        metricsRegistry.addCounter("lobby_cluster_messages_received_total", "Messages received from other nodes",
+            [this]() { return static_cast<double>(cluster->getStats().bus.received); });
+        metricsRegistry.addCounter("lobby_cluster_messages_dropped_total", "Messages the bus could not send",
+            [this]() { return static_cast<double>(cluster->getStats().bus.dropped); });
+        metricsRegistry.addCounter("lobby_cluster_requests_failed_total", "Forwarded requests that timed out",
+            [this]() { return static_cast<double>(cluster->getStats().requestsFailed); });
+        metricsRegistry.addGauge("lobby_cluster_remote_rooms", "Rooms owned by other nodes known here",
+            [this]() { return static_cast<double>(cluster->getStats().remoteRooms); });
+    }
+
+    metricsRegistry.addGauge("lobby_connections", "Open WebSocket connections", [this]() {
+        std::shared_lock<std::shared_mutex> lock(connectionsMutex);
+        return static_cast<double>(connections.size());
+    });
+    metricsRegistry.addGauge("lobby_users", "Authenticated users", [this]() {
+        std::shared_lock<std::shared_mutex> lock(connectionsMutex);
+        return static_cast<double>(userConnections.size());
+    });
+    metricsRegistry.addCounter("lobby_connections_opened_total", "WebSocket connections opened", connectionsOpened);
+    metricsRegistry.addCounter("lobby_connections_closed_total", "WebSocket connections closed", connectionsClosed);
+    for (std::size_t i = 0; i < AdmissionControl::kDecisions; ++i) {
+        metricsRegistry.addCounter("lobby_handshakes_total", "WebSocket handshakes by admission decision", handshakes[i],
+            std::string("result=\"") + admissionDecisionName(static_cast<AdmissionControl::Decision>(i)) + "\"");
+    }
+    metricsRegistry.addGauge("lobby_admission_addresses", "Client addresses with admission or rate limit state",
+        [this]() { return static_cast<double>(admission.trackedAddresses()); });
+    for (std::size_t i = 0; i < kRateClasses; ++i) {
+        std::string rateClass = rateClassName(static_cast<RateClass>(i));
+        metricsRegistry.addCounter("lobby_rate_limited_total", "Client messages dropped by a rate limit",
+            refusedByConnection[i], "scope=\"connection\",class=\"" + rateClass + "\"");
+        metricsRegistry.addCounter("lobby_rate_limited_total", "Client messages dropped by a rate limit",
+            refusedByAddress[i], "scope=\"address\",class=\"" + rateClass + "\"");
+    }
+    metricsRegistry.addCounter("lobby_rate_limit_disconnects_total", "Connections closed for exceeding a rate limit",
+        rateLimitDisconnects);
+
+    metricsRegistry.addGauge("lobby_send_queue_frames", "Frames waiting in outbound queues",
+        [this]() { return static_cast<double>(getOutboundStats().queuedFrames); });
+    metricsRegistry.addGauge("lobby_send_queue_bytes", "Bytes waiting in outbound queues",
+        [this]() { return static_cast<double>(getOutboundStats().queuedBytes); });
+    metricsRegistry.addGauge("lobby_send_queue_backlogged", "Connections with a non-empty outbound queue",
+        [this]() { return static_cast<double>(getOutboundStats().backlogged); });
+    metricsRegistry.addGauge("lobby_send_queue_max_depth", "Deepest outbound queue seen on an open connection",
+        [this]() { return static_cast<double>(getOutboundStats().maxDepth); });
+    metricsRegistry.addCounter("lobby_slow_consumers_evicted_total", "Connections closed for not keeping up",
+        [this]() { return static_cast<double>(slowConsumersEvicted.load(std::memory_order_relaxed)); });
+
+    metricsRegistry.addCounter("lobby_pings_sent_total", "Keepalive pings sent",
+        [this]() { return static_cast<double>(pingsSent.load(std::memory_order_relaxed)); });
+    metricsRegistry.addCounter("lobby_timeouts_total", "Connections closed by the timeout sweep",
+        [this]() { return static_cast<double>(deadPeersClosed.load(std::memory_order_relaxed)); },
+        "reason=\"dead_peer\"");
+    metricsRegistry.addCounter("lobby_timeouts_total", "Connections closed by the timeout sweep",
+        [this]() { return static_cast<double>(idleClosed.load(std::memory_order_relaxed)); }, "reason=\"idle\"");
+
+    metricsRegistry.addGauge("lobby_persistence_queue_depth", "Records waiting for the write-behind flush",
+        [this]() { return static_cast<double>(roomManager->getPersistenceStats().queueDepth); });
+    metricsRegistry.addCounter("lobby_persistence_written_total", "Records written by the write-behind flush",
+        [this]() { return static_cast<double>(roomManager->getPersistenceStats().written); });
+    metricsRegistry.addCounter("lobby_persistence_failed_total", "Records the write-behind flush failed to write",
+        [this]() { return static_cast<double>(roomManager->getPersistenceStats().failed); });
+    metricsRegistry.addCounter("lobby_persistence_spilled_total",
+        "User and room records parked in the overflow map because the queue was full",
+        [this]() { return static_cast<double>(roomManager->getPersistenceStats().spilled); });
+    metricsRegistry.addCounter("lobby_persistence_dropped_total",
+        "Chat inserts not persisted because the queue was full",
+        [this]() { return static_cast<double>(roomManager->getPersistenceStats().dropped); });
+    metricsRegistry.addCounter("lobby_chat_history_requests_total", "Chat history requests",
+        [this]() { return static_cast<double>(roomManager->getChatHistoryStats().hits); }, "result=\"hit\"");
+    metricsRegistry.addCounter("lobby_chat_history_requests_total", "Chat history requests",
+        [this]() { return static_cast<double>(roomManager->getChatHistoryStats().misses); }, "result=\"miss\"");
+    metricsRegistry.addCounter("lobby_notifications_flushed_total", "Coalesced notifications sent",
+        [this]() { return static_cast<double>(notifications.getStats().roomsFlushed); }, "kind=\"room\"");
+    metricsRegistry.addCounter("lobby_notifications_flushed_total", "Coalesced notifications sent",
+        [this]() { return static_cast<double>(notifications.getStats().usersFlushed); }, "kind=\"user\"");
+    metricsRegistry.addCounter("lobby_log_lines_total", "Log lines by outcome",
+        []() { return static_cast<double>(Logger::instance().getStats().written); }, "result=\"written\"");
+    metricsRegistry.addCounter("lobby_log_lines_total", "Log lines by outcome",
+        []() { return static_cast<double>(Logger::instance().getStats().dropped); }, "result=\"dropped\"");
+    metricsRegistry.addGauge("lobby_interned_ids", "Distinct user and room ids held in the id table",
+        []() { return static_cast<double>(IdInterner::instance().size()); });
+
+    for (std::size_t i = 0; i < static_cast<std::size_t>(DatabaseManager::Operation::Count); ++i) {
+        auto operation = static_cast<DatabaseManager::Operation>(i);
+        metricsRegistry.addHistogram("lobby_db_operation_duration_seconds", "MongoDB call latency, including pool wait",
+            dbManager->getLatency(operation), 1e-9, 10, 36,
+            "operation=\"" + std::string(DatabaseManager::operationName(operation)) + "\"");
+    }
+    metricsRegistry.addCounter("lobby_db_failures_total", "MongoDB calls that failed",
+        [this]() { return static_cast<double>(dbManager->getStats().failures); });
+}
+
+std::string WebSocketServer::encodeMessage(const Json::Value& message, WireProtocol protocol) {
+    if (protocol == WireProtocol::Binary) {
+        return BinaryCodec::encodeServerMessage(message);
+    }
+
+    static const Json::StreamWriterBuilder compactWriter = []() {
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        return builder;
+    }();
+    return Json::writeString(compactWriter, message);
+}
+
+std::shared_ptr<ConnectionState> WebSocketServer::stateFor(connection_hdl hdl) {
+    std::shared_lock<std::shared_mutex> lock(connectionsMutex);
+    auto it = connections.find(hdl);
+    return (it != connections.end()) ? it->second : nullptr;
+}
+
+void WebSocketServer::sendError(connection_hdl hdl, const std::string& error) {
+    messageErrors.add();
+    try {
+        sendMessage(hdl, createResponse("error", "", false, error));
+    } catch (const std::exception& e) {
+        LOG_ERROR << "Error sending error response: " << e.what();
+    }
+}
+
+void WebSocketServer::sendMessage(connection_hdl hdl, const Json::Value& message, const std::string& coalesceKey) {
+    std::shared_ptr<ConnectionState> state = stateFor(hdl);
+    if (!state) {
+        // Not opened yet or already closed; nothing to queue behind
+        websocketpp::lib::error_code ec;
+        wsServer.send(hdl, encodeMessage(message, WireProtocol::Json), websocketpp::frame::opcode::text, ec);
+        return;
+    }
+
+    deliver(state, frameEncoder.wrap(encodeMessage(message, state->protocol),
+        state->protocol == WireProtocol::Binary ? websocketpp::frame::opcode::binary
+                                                : websocketpp::frame::opcode::text), coalesceKey);
+}
+
+void WebSocketServer::sendChatHistory(connection_hdl hdl, const std::string& roomId) {
+    sendChatEntries(hdl, roomId, roomManager->getChatHistory(roomId));
+}
+
+void WebSocketServer::sendChatEntries(connection_hdl hdl, const std::string& roomId,
+                                      const std::vector<ChatHistory::Entry>& entries) {
+    std::shared_ptr<ConnectionState> state = stateFor(hdl);
+    if (!state || entries.empty()) {
+        return;
+    }
+
+    if (state->protocol == WireProtocol::Binary) {
+        Json::Value message;
+        message["type"] = "chat_history";
+        message["roomId"] = roomId;
+        message["messages"] = Json::Value(Json::arrayValue);
+        for (const auto& entry : entries) {
+            message["messages"].append(JsonCodec::parse(entry->data(), entry->data() + entry->size(),
+                                                        "Invalid chat history entry"));
+        }
+        sendMessage(hdl, message);
+        return;
+    }
+
+    // Entries are stored as JSON objects, so the frame is spliced together
+    // instead of being rebuilt and re-encoded
+    std::string quotedRoomId = Json::valueToQuotedString(roomId.c_str());
+    std::size_t size = quotedRoomId.size() + 48;
+    for (const auto& entry : entries) {
+        size += entry->size() + 1;
+    }
+
+    std::string payload;
+    payload.reserve(size);
+    payload += "{\"type\":\"chat_history\",\"roomId\":";
+    payload += quotedRoomId;
+    payload += ",\"messages\":[";
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        if (i > 0) {
+            payload += ',';
+        }
+        payload += *entries[i];
+    }
+    payload += "]}";
+
+    deliver(state, frameEncoder.wrap(payload, websocketpp::frame::opcode::text));
 }
 
 std::string WebSocketServer::getUserId(connection_hdl hdl) {
-    std::lock_guard<std::mutex> lock(connectionsMutex);
+    std::shared_lock<std::shared_mutex> lock(connectionsMutex);
     auto it = connections.find(hdl);
-    return (it != connections.end()) ? it->second : "";
+    return (it != connections.end()) ? it->second->userId : "";
 }
 
 void WebSocketServer::cleanupConnection(connection_hdl hdl) {
-    std::string userId = getUserId(hdl);
+    std::string userId;
+    bool ownsUser = false;
 
     {
-        std::lock_guard<std::mutex> lock(connectionsMutex);
-        connections.erase(hdl);
-        if (!userId.empty()) {
-            userConnections.erase(userId);
+        std::unique_lock<std::shared_mutex> lock(connectionsMutex);
+        auto connIt = connections.find(hdl);
+        if (connIt == connections.end()) {
+            return;
+        }
+        std::shared_ptr<ConnectionState> state = connIt->second;
+        userId = state->userId;
+        connections.erase(connIt);
+        connectionsClosed.add();
+
+        state->closed.store(true);
+        {
+            std::lock_guard<std::mutex> timeoutsLock(timeoutsMutex);
+            timeouts.cancel(state);
+        }
+
+        // Frames still waiting can never be sent
+        state->outbox.clear();
+        std::lock_guard<std::mutex> backlogLock(backlogMutex);
+        backlogged.erase(state);
+
+        // A reconnect may already have re-bound this user to a newer connection
+        auto userIt = userConnections.find(userId);
+        if (userIt != userConnections.end() && userIt->second == state) {
+            userConnections.erase(userIt);
+            ownsUser = true;
         }
     }
 
-    if (!userId.empty()) {
+    if (ownsUser) {
+        interest.removeLobbyWatcher(userId);
         roomManager->removeUser(userId);
+        if (cluster) {
+            // Owners of rooms the user joined elsewhere remove it there
+            Json::Value gone;
+            gone["type"] = "user_gone";
+            gone["userId"] = userId;
+            for (std::uint16_t owner : cluster->takeContactedOwners(userId)) {
+                cluster->send(owner, gone);
+            }
+        }
     }
 }
 
-std::string WebSocketServer::createJsonResponse(const std::string& type, const std::string& data,
-                                               bool success, const std::string& error) {
+Json::Value WebSocketServer::createResponse(const std::string& type, const std::string& data,
+                                           bool success, const std::string& error) {
     Json::Value response;
     response["type"] = type;
     response["success"] = success;
@@ -249,7 +1836,5 @@ std::string WebSocketServer::createJsonResponse(const std::string& type, const s
     if (!error.empty()) {
         response["error"] = error;
     }
-
-    Json::StreamWriterBuilder builder;
-    return Json::writeString(builder, response);
+    return response;
 }
@@ -2,14 +2,62 @@
 #include <websocketpp/config/asio_no_tls.hpp>
 #include <websocketpp/server.hpp>
 #include <websocketpp/common/thread.hpp>
+#include <array>
+#include <atomic>
+#include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+#include <json/json.h>
+#include "admission_control.hpp"
+#include "binary_codec.hpp"
+#include "cluster_node.hpp"
+#include "connection_state.hpp"
+#include "frame_encoder.hpp"
+#include "interest_index.hpp"
+#include "metrics.hpp"
+#include "notification_scheduler.hpp"
+#include "rate_limiter.hpp"
 #include "room_manager.hpp"
 #include "database_manager.hpp"
+#include "server_config.hpp"
+#include "timing_wheel.hpp"
+#include "trusted_proxies.hpp"
+#include "websocket_deflate.hpp"
+#include "websocket_log.hpp"
 
-typedef websocketpp::server<websocketpp::config::asio> server;
+// websocketpp's asio config with the access and error logs routed to Logger,
+// admission state on each connection and permessage-deflate
+struct LobbyServerConfig : public websocketpp::config::asio {
+    typedef websocketpp::config::asio base;
+
+    // Extra state websocketpp keeps on every connection: the admission ticket
+    // taken in onValidate, released on close or when the connection is destroyed
+    struct connection_base {
+        std::unique_ptr<AdmissionControl::Ticket> admission;
+    };
+
+    // permessage-deflate, negotiated per connection with CompressionOptions
+    struct permessage_deflate_config {};
+    typedef WebSocketDeflate<permessage_deflate_config> permessage_deflate_type;
+
+    typedef WebSocketLog<base::concurrency_type, websocketpp::log::alevel> alog_type;
+    typedef WebSocketLog<base::concurrency_type, websocketpp::log::elevel> elog_type;
+
+    struct transport_config : public base::transport_config {
+        typedef LobbyServerConfig::alog_type alog_type;
+        typedef LobbyServerConfig::elog_type elog_type;
+    };
+    typedef websocketpp::transport::asio::endpoint<transport_config> transport_type;
+};
+
+typedef websocketpp::server<LobbyServerConfig> server;
 typedef server::message_ptr message_ptr;
 using websocketpp::connection_hdl;
 
@@ -19,45 +67,246 @@ private:
     std::shared_ptr<RoomManager> roomManager;
     std::shared_ptr<DatabaseManager> dbManager;
 
-    std::unordered_map<connection_hdl, std::string, std::owner_less<connection_hdl>> connections;
-    std::unordered_map<std::string, connection_hdl> userConnections;
+    ServerConfig config;
+
+    // Set in cluster mode. Requests for rooms another node owns are forwarded
+    // to it, and its room events and chat arrive from it for local players.
+    std::unique_ptr<ClusterNode> cluster;
+    std::chrono::steady_clock::time_point nextFullClusterSync;   // Only the sync timer touches this
+
+    std::map<connection_hdl, std::shared_ptr<ConnectionState>, std::owner_less<connection_hdl>> connections;
+    std::unordered_map<std::string, std::shared_ptr<ConnectionState>> userConnections;
+
+    // Room members and lobby watchers, so updates only reach interested users
+    InterestIndex interest;
+
+    // Room and user changes waiting for the next notification tick
+    NotificationScheduler notifications;
+
+    // Quick-match requests queued since the last matchmaking tick, by game type
+    struct PendingMatch {
+        connection_hdl hdl;
+        std::string userId;
+    };
+    std::mutex matchQueueMutex;
+    std::unordered_map<std::string, std::vector<PendingMatch>> matchQueue;
+
+    // Fan-out payloads are framed, and compressed, once and shared by every
+    // recipient that can take them
+    FrameEncoder<LobbyServerConfig> frameEncoder;
+    Counter deflatedBytesIn;
+    Counter deflatedBytesOut;
+    Histogram deflateLatency;                                 // Nanoseconds
+
+    // Connections with frames waiting in their outbox, retried by the send pump
+    using Outbox = OutboundQueue<message_ptr>;
+    Outbox::Limits sendLimits;
+    std::mutex backlogMutex;
+    std::unordered_set<std::shared_ptr<ConnectionState>> backlogged;
+    std::atomic<std::uint64_t> slowConsumersEvicted;
+
+    // Next idle/keepalive check per connection. Handlers only stamp times on
+    // the connection; a due check re-arms itself from those stamps, so each
+    // connection costs at most one wheel operation per interval.
+    std::mutex timeoutsMutex;
+    TimingWheel<std::shared_ptr<ConnectionState>> timeouts;
+    std::atomic<std::uint64_t> pingsSent;
+    std::atomic<std::uint64_t> deadPeersClosed;
+    std::atomic<std::uint64_t> idleClosed;
+
+    // Users restored by the warm start. Once restoreGraceMs has passed, those
+    // that have not reconnected are removed a chunk per tick; only that timer
+    // chain touches these.
+    std::vector<std::string> restoredUsers;
+    std::size_t restoreExpiryCursor;
+    std::size_t restoredExpired;
+    long warmStartMs;
 
-    mutable std::mutex connectionsMutex;
-    std::thread serverThread;
-    bool isRunning;
+    // Served as /metrics on the WebSocket port. Hot paths record into striped
+    // instruments; everything else is read from its owner at scrape time.
+    MetricsRegistry metricsRegistry;
+    std::vector<std::unique_ptr<Histogram>> messageLatency;   // Nanoseconds, by MessageRoute::index
+    Counter messageErrors;
+    Histogram fanoutRecipients;
+    Histogram fanoutLatency;                                  // Nanoseconds
+    Counter connectionsOpened;
+    Counter connectionsClosed;
+
+    // Handshakes are admitted in onValidate; messages are charged to the
+    // connection's and its address's buckets before they are decoded
+    AdmissionControl admission;
+    TrustedProxies trustedProxies;
+    RateLimits connectionRates;
+    std::array<Counter, AdmissionControl::kDecisions> handshakes;   // By AdmissionControl::Decision
+    std::array<Counter, kRateClasses> refusedByConnection;
+    std::array<Counter, kRateClasses> refusedByAddress;
+    Counter rateLimitDisconnects;
+
+    // Per-event log lines that a connect storm or a misbehaving client could
+    // repeat thousands of times a second
+    LogSampler openLog;
+    LogSampler closeLog;
+    LogSampler messageErrorLog;
+    LogSampler sendErrorLog;
+    LogSampler slowConsumerLog;
+    LogSampler admissionLog;
+    LogSampler rateLimitLog;
+
+    // Handlers run on any worker thread; websocketpp serializes each
+    // connection's handlers on its own strand, so only shared maps need locking.
+    // Lookups and broadcasts take a shared lock, open/auth/close take it exclusively.
+    mutable std::shared_mutex connectionsMutex;
+    std::vector<std::thread> workerThreads;
+    std::atomic<bool> isRunning;
 
 public:
-    WebSocketServer(int port = 9002);
+    explicit WebSocketServer(const ServerConfig& serverConfig = ServerConfig());
     ~WebSocketServer();
 
     void start();
     void stop();
 
     // Message broadcasting
-    void broadcastToRoom(const std::string& roomId, const std::string& message);
-    void sendToUser(const std::string& userId, const std::string& message);
-    void broadcastToAll(const std::string& message);
+    // Messages are encoded per recipient protocol; fan-out encodes each
+    // protocol at most once
+    void broadcastToRoom(const std::string& roomId, const Json::Value& message);
+    void sendToUser(const std::string& userId, const Json::Value& message);
+    void broadcastToAll(const Json::Value& message);
+    // coalesceKey marks a message that supersedes any queued one with the same
+    // key, e.g. successive room_update snapshots of one room
+    void sendToUsers(const std::vector<std::string>& userIds, const Json::Value& message,
+                     const std::string& coalesceKey = "");
+
+    // Outbound queue metrics
+    struct ConnectionQueueStats {
+        std::string userId;
+        std::size_t depth;
+        std::size_t queuedBytes;
+        std::size_t maxDepth;
+        std::uint64_t coalesced;
+    };
+    struct OutboundStats {
+        std::size_t connections = 0;
+        std::size_t backlogged = 0;
+        std::size_t queuedFrames = 0;
+        std::size_t queuedBytes = 0;
+        std::size_t maxDepth = 0;
+        std::uint64_t coalesced = 0;
+        std::uint64_t evicted = 0;
+    };
+    std::vector<ConnectionQueueStats> getConnectionQueueStats() const;
+    OutboundStats getOutboundStats() const;
 
 private:
     // WebSocket event handlers
     void onOpen(connection_hdl hdl);
     void onClose(connection_hdl hdl);
     void onMessage(connection_hdl hdl, message_ptr msg);
+    bool onPing(connection_hdl hdl, std::string payload);
+    void onPong(connection_hdl hdl, std::string payload);
     bool onValidate(connection_hdl hdl);
+    void onHttp(connection_hdl hdl);
 
     // Message processing
-    void processMessage(connection_hdl hdl, const std::string& message);
-    void handleUserAuth(connection_hdl hdl, const std::string& data);
-    void handleCreateRoom(connection_hdl hdl, const std::string& data);
-    void handleJoinRoom(connection_hdl hdl, const std::string& data);
-    void handleLeaveRoom(connection_hdl hdl, const std::string& data);
-    void handleChatMessage(connection_hdl hdl, const std::string& data);
-    void handleGetRooms(connection_hdl hdl);
-    void handleGetUsers(connection_hdl hdl);
+    // charged is the rate class the message was admitted under
+    void processMessage(connection_hdl hdl, const std::string& message, RateClass charged);
+    void dispatchMessage(connection_hdl hdl, const Json::Value& root, RateClass charged);
+    void handleUserAuth(connection_hdl hdl, const Json::Value& data);
+    void handleCreateRoom(connection_hdl hdl, const Json::Value& data);
+    void handleJoinRoom(connection_hdl hdl, const Json::Value& data);
+    void handleLeaveRoom(connection_hdl hdl, const Json::Value& data);
+    void handleChatMessage(connection_hdl hdl, const Json::Value& data);
+    void handleGetRooms(connection_hdl hdl, const Json::Value& data);
+    void handleGetUsers(connection_hdl hdl, const Json::Value& data);
+    void handleQuickMatch(connection_hdl hdl, const Json::Value& data);
+    void handleGetRoom(connection_hdl hdl, const Json::Value& data);
+
+    // Message type -> handler and its latency histogram, built once
+    using MessageHandler = void (WebSocketServer::*)(connection_hdl, const Json::Value&);
+    struct MessageRoute {
+        MessageHandler handler;
+        std::size_t index;
+        RateClass rateClass;
+    };
+    static const std::unordered_map<std::string_view, MessageRoute>& messageHandlers();
+    static RateClass rateClassOf(std::string_view type);
+
+    // Charges a message to the rate limits; false when it must be dropped
+    bool admitMessage(const std::shared_ptr<ConnectionState>& state, RateClass rateClass, std::int64_t now);
+
+    // Room events and the throttled lobby listing
+    void onRoomEvent(const RoomEvent& event);
+    void publishUserChanges(const std::vector<std::string>& userIds);
+    void scheduleNotifications();
+    void flushNotifications();
+    void scheduleLobbyFlush();
+    void flushLobbyDelta();
+    void scheduleMatchmaking();
+    void flushMatchQueue();
+    void scheduleSendPump();
+    void pumpBacklog();
+    void scheduleTimeoutSweep();
+    void sweepTimeouts();
+    void scheduleRestoreExpiry(long delayMs);
+    // True while restored users remain to be checked
+    bool expireRestoredUsers();
+    // Next time the connection needs checking, or nothing once it is being closed
+    std::optional<std::chrono::steady_clock::time_point> checkTimeouts(
+        const std::shared_ptr<ConnectionState>& state, std::chrono::steady_clock::time_point now);
+
+    void registerMetrics();
+
+    // Cluster mode
+    void handleClusterMessage(std::uint16_t from, const Json::Value& message);
+    void applyClusterSummary(std::uint16_t from, const Json::Value& message);
+    void forwardJoin(connection_hdl hdl, const std::string& userId, const std::string& roomId);
+    void forwardLeave(connection_hdl hdl, const std::string& userId, const std::string& roomId);
+    void scheduleClusterSync();
+    void syncCluster();
+    // The room from this node, or the latest copy reported by its owner
+    Room findRoom(const std::string& roomId);
+    // Local room events, and remote ones for rooms with local players
+    void queueRoomEvent(const RoomEvent& event);
+    // Sends a room's chat to its local members and, on the owner, to the other nodes hosting members
+    void publishChat(const std::string& roomId, const Json::Value& message);
 
     // Utility functions
     std::string getUserId(connection_hdl hdl);
     void cleanupConnection(connection_hdl hdl);
-    std::string createJsonResponse(const std::string& type, const std::string& data, 
-                                   bool success = true, const std::string& error = "");
+    Json::Value createResponse(const std::string& type, const std::string& data,
+                               bool success = true, const std::string& error = "");
+
+    // Wire encoding
+    static std::string encodeMessage(const Json::Value& message, WireProtocol protocol);
+    std::shared_ptr<ConnectionState> stateFor(connection_hdl hdl);
+    void sendMessage(connection_hdl hdl, const Json::Value& message, const std::string& coalesceKey = "");
+    void sendChatHistory(connection_hdl hdl, const std::string& roomId);
+    void sendChatEntries(connection_hdl hdl, const std::string& roomId,
+                         const std::vector<ChatHistory::Entry>& entries);
+    // Error response outside a message handler, e.g. for a failed forwarded request
+    void sendError(connection_hdl hdl, const std::string& error);
+
+    // Every frame goes through the recipient's outbox
+    void deliver(const std::shared_ptr<ConnectionState>& state, const message_ptr& frame,
+                 const std::string& coalesceKey = "");
+    void onOutboxStatus(const std::shared_ptr<ConnectionState>& state, Outbox::Status status);
+    void evictSlowConsumer(const std::shared_ptr<ConnectionState>& state, const char* reason);
+
+    // Lazily encoded and framed copies of one fan-out message, per wire protocol
+    struct FanoutFrames {
+        struct Encoding {
+            std::string payload;
+            bool encoded = false;
+            message_ptr plain;
+            message_ptr deflated;
+            bool deflateTried = false;
+        };
+
+        const Json::Value& message;
+        Encoding json;
+        Encoding binary;
+
+        explicit FanoutFrames(const Json::Value& msg) : message(msg) {}
+    };
+    message_ptr frameFor(FanoutFrames& frames, const ConnectionState& state);
 };
@@ -0,0 +1,341 @@
+// Admission control and message rate limits: token buckets, connection caps,
+// address buckets shared by an address's connections, trusted proxies, the
+// type peek that runs before parsing, and a chat flood that must not slow
+// down everyone else.
+//
+// The flood is replayed in simulated time on one thread: frames arrive on a
+// fixed schedule and a single worker handles them in order, each taking as
+// long as its real handling took here. A client's latency is its wait behind
+// earlier frames plus its own handling, without scheduler noise from a flood
+// thread competing for the same cores.
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "admission_control.hpp"
+#include "in_memory_database.hpp"
+#include "json_codec.hpp"
+#include "logger.hpp"
+#include "rate_limiter.hpp"
+#include "room_manager.hpp"
+#include "server_config.hpp"
+#include "test_support.hpp"
+#include "trusted_proxies.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+void tokenBucketRefills() {
+    RateLimit limit{2, 4};
+    TokenBucket bucket;
+    Clock::time_point start = Clock::now();
+    CHECK(bucket.idle(limit, start));
+    for (int i = 0; i < 4; ++i) {
+        CHECK(bucket.take(limit, start));
+    }
+    CHECK(!bucket.take(limit, start));
+    CHECK(!bucket.idle(limit, start));
+
+    // Half a second buys one token at 2/s
+    CHECK(bucket.take(limit, start + milliseconds(500)));
+    CHECK(!bucket.take(limit, start + milliseconds(500)));
+
+    // A long quiet spell refills to burst and no further
+    Clock::time_point later = start + std::chrono::seconds(10);
+    CHECK(bucket.idle(limit, later));
+    for (int i = 0; i < 4; ++i) {
+        CHECK(bucket.take(limit, later));
+    }
+    CHECK(!bucket.take(limit, later));
+
+    RateLimit unlimited;
+    TokenBucket open;
+    for (int i = 0; i < 1000; ++i) {
+        CHECK(open.take(unlimited, start));
+    }
+}
+
+void admissionCaps() {
+    AdmissionControl::Limits limits;
+    limits.maxConnections = 3;
+    limits.maxConnectionsPerAddress = 2;
+    AdmissionControl admission(limits);
+
+    std::unique_ptr<AdmissionControl::Ticket> a1, a2, a3, b, c;
+    CHECK(admission.admit("198.51.100.1", a1) == AdmissionControl::Decision::Admitted);
+    CHECK(admission.admit("198.51.100.1", a2) == AdmissionControl::Decision::Admitted);
+    CHECK(admission.admit("198.51.100.1", a3) == AdmissionControl::Decision::AddressFull);
+    CHECK(!a3);
+    CHECK(admission.admit("198.51.100.2", b) == AdmissionControl::Decision::Admitted);
+    CHECK(admission.admit("198.51.100.3", c) == AdmissionControl::Decision::ServerFull);
+    CHECK(admission.openConnections() == 3);
+
+    // A closed connection frees its slots, both overall and for its address
+    a1.reset();
+    CHECK(admission.openConnections() == 2);
+    CHECK(admission.admit("198.51.100.1", a3) == AdmissionControl::Decision::Admitted);
+    a2.reset();
+    CHECK(admission.admit("198.51.100.3", c) == AdmissionControl::Decision::Admitted);
+
+    // Exempt peers skip the per-address limits but not the overall cap
+    std::unique_ptr<AdmissionControl::Ticket> local;
+    CHECK(admission.admit("", local) == AdmissionControl::Decision::ServerFull);
+    c.reset();
+    CHECK(admission.admit("", local) == AdmissionControl::Decision::Admitted);
+    CHECK(local && !local->address());
+}
+
+void connectRateLimitsHandshakes() {
+    AdmissionControl::Limits limits;
+    limits.connectRate = RateLimit{1, 2};
+    AdmissionControl admission(limits);
+
+    std::unique_ptr<AdmissionControl::Ticket> first, second, third;
+    CHECK(admission.admit("203.0.113.9", first) == AdmissionControl::Decision::Admitted);
+    CHECK(admission.admit("203.0.113.9", second) == AdmissionControl::Decision::Admitted);
+    CHECK(admission.admit("203.0.113.9", third) == AdmissionControl::Decision::ConnectRate);
+    // Closing connections does not give handshakes back
+    first.reset();
+    second.reset();
+    CHECK(admission.admit("203.0.113.9", third) == AdmissionControl::Decision::ConnectRate);
+    CHECK(admission.admit("203.0.113.10", third) == AdmissionControl::Decision::Admitted);
+}
+
+void addressBucketsAreShared() {
+    AdmissionControl::Limits limits;
+    limits.messageRates[static_cast<std::size_t>(RateClass::Chat)] = RateLimit{1, 3};
+    AdmissionControl admission(limits);
+
+    std::unique_ptr<AdmissionControl::Ticket> one, two, other;
+    admission.admit("198.51.100.1", one);
+    admission.admit("198.51.100.1", two);
+    admission.admit("198.51.100.2", other);
+    CHECK(one->address() == two->address());
+
+    Clock::time_point now = Clock::now();
+    CHECK(one->address()->take(RateClass::Chat, now));
+    CHECK(one->address()->take(RateClass::Chat, now));
+    CHECK(two->address()->take(RateClass::Chat, now));
+    CHECK(!two->address()->take(RateClass::Chat, now));
+    // Other classes and other addresses have budgets of their own
+    CHECK(two->address()->take(RateClass::Query, now));
+    CHECK(other->address()->take(RateClass::Chat, now));
+}
+
+void trustedProxiesNameTheClient() {
+    using Address = TrustedProxies::Address;
+    TrustedProxies proxies;
+    std::string error;
+    CHECK(!TrustedProxies::parse("10.0.0.0/8,10.0.0.0/33", proxies, error));
+    CHECK(error == "10.0.0.0/33");
+    CHECK(TrustedProxies::parse("10.0.0.0/8, ::1", proxies, error));
+
+    Address proxy = boost::asio::ip::make_address("10.1.2.3");
+    Address stranger = boost::asio::ip::make_address("203.0.113.5");
+    CHECK(proxies.contains(boost::asio::ip::make_address("::ffff:10.1.2.3")));
+    CHECK(!proxies.contains(stranger));
+
+    // The rightmost entry that is not one of our proxies is the client
+    CHECK(proxies.clientAddress(proxy, "192.0.2.1, 198.51.100.7, 10.9.9.9", "").to_string() == "198.51.100.7");
+    CHECK(proxies.clientAddress(proxy, "", "198.51.100.9").to_string() == "198.51.100.9");
+    CHECK(proxies.clientAddress(proxy, "", "") == proxy);
+    // Anyone else's headers are ignored
+    CHECK(proxies.clientAddress(stranger, "198.51.100.7", "198.51.100.9") == stranger);
+}
+
+void peekFindsTopLevelType() {
+    CHECK(JsonCodec::peekMessageType(R"({"type":"chat_message","data":{}})") == "chat_message");
+    CHECK(JsonCodec::peekMessageType(R"(  { "count" : 12 , "type" : "get_rooms" })") == "get_rooms");
+    // Nested "type" members and brackets inside strings are skipped
+    CHECK(JsonCodec::peekMessageType(R"({"data":{"type":"auth","x":[1,{"y":"}]\""}]},"type":"join_room"})") ==
+          "join_room");
+    CHECK(JsonCodec::peekMessageType(R"({"type":"chat_message")") == "chat_message");
+
+    CHECK(JsonCodec::peekMessageType(R"({"type":"a\"b"})").empty());
+    CHECK(JsonCodec::peekMessageType(R"({"type":5})").empty());
+    CHECK(JsonCodec::peekMessageType(R"(["type","auth"])").empty());
+    CHECK(JsonCodec::peekMessageType(R"({"data":"x")").empty());
+    CHECK(JsonCodec::peekMessageType(R"({"data":1 "type":"auth"})").empty());
+    CHECK(JsonCodec::peekMessageType("").empty());
+}
+
+// One client connection as onMessage sees it
+struct Connection {
+    std::string userId;
+    std::string roomId;
+    std::unique_ptr<AdmissionControl::Ticket> ticket;
+    std::array<TokenBucket, kRateClasses> buckets;
+    bool legit;
+};
+
+struct Frame {
+    microseconds arrival;
+    std::size_t connection;
+};
+
+struct FloodResult {
+    std::vector<double> legitLatencyUs;
+    std::size_t floodFrames = 0;
+    std::size_t floodAdmitted = 0;
+    std::size_t legitRefused = 0;
+};
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<std::size_t>(p * static_cast<double>(values.size())))];
+}
+
+// Legitimate users chat within their limits from addresses of their own while
+// bots on one address send chat_message as fast as they can
+FloodResult replayFlood(bool withFlood, bool limited, microseconds runFor) {
+    const std::size_t kLegit = 100;
+    const microseconds kLegitInterval(200000);   // 5 messages a second each
+    const std::size_t kBots = 4;
+    const microseconds kBotInterval(5);          // 200k frames a second between them
+
+    ServerConfig config;
+    RateLimits connectionRates = config.connectionRateLimits();
+    AdmissionControl::Limits limits;
+    limits.messageRates = config.addressRateLimits();
+    if (!limited) {
+        connectionRates = RateLimits{};
+        limits.messageRates = RateLimits{};
+    }
+    AdmissionControl admission(limits);
+    RoomManager manager(std::make_shared<InMemoryDatabase>("memory://"));
+
+    std::vector<Connection> connections;
+    auto connect = [&](const std::string& userId, const std::string& address, bool legit) {
+        Connection connection;
+        connection.userId = userId;
+        connection.legit = legit;
+        manager.addUser(User(userId, "Player"));
+        connection.roomId = manager.createRoom("Room " + userId, userId);
+        admission.admit(address, connection.ticket);
+        connections.push_back(std::move(connection));
+    };
+    for (std::size_t i = 0; i < kLegit; ++i) {
+        connect("legit_" + std::to_string(i), "198.51.100." + std::to_string(i + 1), true);
+    }
+    for (std::size_t i = 0; withFlood && i < kBots; ++i) {
+        connect("bot_" + std::to_string(i), "203.0.113.7", false);
+    }
+    std::vector<std::string> texts;
+    for (const auto& connection : connections) {
+        texts.push_back(R"({"type":"chat_message","data":{"roomId":")" + connection.roomId +
+                        R"(","message":"hello there"}})");
+    }
+
+    // Legitimate users spread over the interval, bots take turns
+    std::vector<Frame> frames;
+    for (microseconds at(0); at < runFor; at += kLegitInterval) {
+        for (std::size_t i = 0; i < kLegit; ++i) {
+            frames.push_back(Frame{at + kLegitInterval * i / kLegit, i});
+        }
+    }
+    std::size_t bot = 0;
+    for (microseconds at(0); withFlood && at < runFor; at += kBotInterval) {
+        frames.push_back(Frame{at, kLegit + bot});
+        bot = (bot + 1) % kBots;
+    }
+    std::stable_sort(frames.begin(), frames.end(),
+                     [](const Frame& a, const Frame& b) { return a.arrival < b.arrival; });
+
+    FloodResult result;
+    Clock::time_point epoch = Clock::now();
+    std::chrono::nanoseconds workerFree(0);
+    for (const Frame& frame : frames) {
+        Connection& connection = connections[frame.connection];
+        const std::string& payload = texts[frame.connection];
+        std::chrono::nanoseconds started = std::max<std::chrono::nanoseconds>(frame.arrival, workerFree);
+        Clock::time_point now = epoch + started;
+
+        auto handlingStarted = Clock::now();
+        // What onMessage does: peek, charge the connection and its address, then decode
+        RateClass rateClass = JsonCodec::peekMessageType(payload) == "chat_message" ? RateClass::Chat
+                                                                                   : RateClass::Other;
+        std::size_t index = static_cast<std::size_t>(rateClass);
+        bool admitted = connection.buckets[index].take(connectionRates[index], now) &&
+                        connection.ticket->address()->take(rateClass, now);
+        if (admitted) {
+            Json::Value root = JsonCodec::parse(payload.data(), payload.data() + payload.size(), "Invalid JSON");
+            Json::Value legacyData;
+            const Json::Value& data = JsonCodec::messageData(root, legacyData);
+            manager.sendChatMessage(data["roomId"].asString(), connection.userId, data["message"].asString());
+        }
+        workerFree = started + (Clock::now() - handlingStarted);
+
+        if (connection.legit) {
+            result.legitLatencyUs.push_back(
+                std::chrono::duration<double, std::micro>(workerFree - frame.arrival).count());
+            result.legitRefused += admitted ? 0 : 1;
+        } else {
+            ++result.floodFrames;
+            result.floodAdmitted += admitted ? 1 : 0;
+        }
+    }
+    manager.shutdown();
+    return result;
+}
+
+void floodLeavesLegitLatencyFlat() {
+    const microseconds kRunFor(500000);
+    FloodResult quiet = replayFlood(false, true, kRunFor);
+    FloodResult limited = replayFlood(true, true, kRunFor);
+    FloodResult unlimited = replayFlood(true, false, kRunFor);
+
+    auto report = [](const char* label, const FloodResult& result) {
+        std::cout << std::left << std::setw(20) << label << std::right << std::fixed << std::setprecision(1)
+                  << "legit p50 " << std::setw(9) << percentile(result.legitLatencyUs, 0.5) << " us, p99 "
+                  << std::setw(9) << percentile(result.legitLatencyUs, 0.99) << " us; flood admitted "
+                  << result.floodAdmitted << "/" << result.floodFrames << std::endl;
+    };
+    report("no flood", quiet);
+    report("flood, limited", limited);
+    report("flood, no limits", unlimited);
+
+    // Legitimate users stay inside their limits
+    CHECK(quiet.legitRefused == 0);
+    CHECK(limited.legitRefused == 0);
+
+    // The bots get at most their connections' budgets, capped by their shared address
+    ServerConfig config;
+    RateLimit perConnection = config.connectionRateLimits()[static_cast<std::size_t>(RateClass::Chat)];
+    RateLimit perAddress = config.addressRateLimits()[static_cast<std::size_t>(RateClass::Chat)];
+    double seconds = std::chrono::duration<double>(kRunFor).count();
+    double budget = std::min(4 * (perConnection.burst + perConnection.perSecond * seconds),
+                             perAddress.burst + perAddress.perSecond * seconds);
+    CHECK(static_cast<double>(limited.floodAdmitted) <= budget + 1);
+    CHECK(limited.floodFrames == 100000);
+
+    // Refusing a frame costs a peek and two bucket checks, so the flood hardly
+    // delays anyone; without limits it queues up behind the bots' chat. The
+    // median is compared, being immune to a preemption stretching one frame.
+    double quietMedian = percentile(quiet.legitLatencyUs, 0.5);
+    double limitedMedian = percentile(limited.legitLatencyUs, 0.5);
+    CHECK(limitedMedian < quietMedian + 100.0);
+    CHECK(percentile(unlimited.legitLatencyUs, 0.5) > 10 * limitedMedian);
+}
+
+} // namespace
+
+int main() {
+    Logger::instance().setLevel(LogLevel::Warn);
+    tokenBucketRefills();
+    admissionCaps();
+    connectRateLimitsHandshakes();
+    addressBucketsAreShared();
+    trustedProxiesNameTheClient();
+    peekFindsTopLevelType();
+    floodLeavesLegitLatencyFlat();
+    return lobbytest::result();
+}
@@ -0,0 +1,333 @@
+// Two cluster nodes in two processes over the Unix socket LocalBus. Node 2
+// runs in a forked child and owns rooms; node 1, in this process, is home to
+// visitors that join them through forwarded requests. Each node answers bus
+// messages the way WebSocketServer::handleClusterMessage does, minus clients.
+// A warm start from the database they share must keep only the restarting
+// node's own rooms and users.
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cluster_node.hpp"
+#include "hash_ring.hpp"
+#include "in_memory_database.hpp"
+#include "local_bus.hpp"
+#include "logger.hpp"
+#include "room_manager.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+const std::uint16_t kHome = 1;
+const std::uint16_t kOwner = 2;
+const std::size_t kOwnerRooms = 50;
+const std::size_t kHomeRooms = 20;
+const std::size_t kVisitors = 10;
+
+// The in-memory store, treated as if it outlived the processes so restore
+// reconciles against it
+class DurableMemoryDatabase : public InMemoryDatabase {
+public:
+    using InMemoryDatabase::InMemoryDatabase;
+    bool isDurable() const override { return true; }
+};
+
+bool waitFor(const std::function<bool()>& condition, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+Json::Value joinRequest(const std::string& roomId, const std::string& userId) {
+    Json::Value request;
+    request["type"] = "join";
+    request["roomId"] = roomId;
+    request["userId"] = userId;
+    return request;
+}
+
+// Sends a request to the owner and waits for its reply; false when none came
+bool ask(ClusterNode& cluster, const Json::Value& request, Json::Value& reply) {
+    struct Outcome {
+        std::mutex mutex;
+        bool done = false;
+        bool ok = false;
+        Json::Value reply;
+    };
+    // Shared with the callback, which may outlive this call if the reply is late
+    auto outcome = std::make_shared<Outcome>();
+    cluster.request(kOwner, request, [outcome](bool ok, const Json::Value& response) {
+        std::lock_guard<std::mutex> lock(outcome->mutex);
+        outcome->done = true;
+        outcome->ok = ok;
+        outcome->reply = response;
+    });
+    bool answered = waitFor([&]() {
+        std::lock_guard<std::mutex> lock(outcome->mutex);
+        return outcome->done;
+    }, std::chrono::seconds(5));
+    std::lock_guard<std::mutex> lock(outcome->mutex);
+    reply = outcome->reply;
+    return answered && outcome->ok;
+}
+
+// A RoomManager and its ClusterNode, wired like a server in cluster mode
+class TestNode {
+public:
+    TestNode(std::uint16_t self, const std::string& busUri)
+        : manager(std::make_shared<InMemoryDatabase>("memory://"), PersistenceQueue::Options(),
+                  ChatHistory::Options(), self),
+          cluster(clusterOptions(self), std::make_unique<LocalBus>(busUri, self)) {
+        manager.isLocalRoom = [this](const std::string& roomId) { return cluster.owns(roomId); };
+        manager.onRoomUpdate = [this](const RoomEvent& event) { cluster.forwardRoomEvent(event); };
+    }
+
+    ~TestNode() {
+        cluster.stop();
+        manager.shutdown();
+    }
+
+    bool start() {
+        return cluster.start([this](std::uint16_t from, const Json::Value& message) { handle(from, message); });
+    }
+
+    std::vector<std::string> createRooms(std::size_t count, const std::string& hostPrefix) {
+        std::vector<std::string> roomIds;
+        for (std::size_t i = 0; i < count; ++i) {
+            std::string hostId = hostPrefix + std::to_string(i);
+            manager.addUser(User(hostId, "Host"));
+            roomIds.push_back(manager.createRoom("Room " + std::to_string(i), hostId));
+        }
+        return roomIds;
+    }
+
+    RoomManager manager;
+    ClusterNode cluster;
+    std::atomic<bool> quit{false};
+    std::atomic<std::size_t> roomEvents{0};
+
+private:
+    static ClusterNode::Options clusterOptions(std::uint16_t self) {
+        ClusterNode::Options options;
+        options.self = self;
+        options.nodes = {kHome, kOwner};
+        options.requestTimeout = std::chrono::milliseconds(300);
+        return options;
+    }
+
+    void handle(std::uint16_t from, const Json::Value& message) {
+        const std::string type = message["type"].asString();
+        const std::string roomId = message["roomId"].asString();
+        const std::string userId = message["userId"].asString();
+        RemoteRooms& remote = cluster.remoteRooms();
+
+        if (type == "room_event") {
+            RoomEvent event = ClusterNode::decodeEvent(message["event"]);
+            if (event.type == RoomEvent::Type::Deleted) {
+                remote.remove(event.roomId);
+            } else {
+                remote.update(event.room, from);
+            }
+            ++roomEvents;
+        } else if (type == "join") {
+            cluster.setMemberHome(userId, from);
+            Json::Value response;
+            response["joined"] = manager.joinRoom(roomId, userId);
+            cluster.reply(from, message, response);
+        } else if (type == "user_gone") {
+            manager.leaveAllRooms(userId);
+            cluster.forgetMember(userId);
+        } else if (type == "summary") {
+            bool full = message["full"].asBool();
+            if (full && message["first"].asBool()) {
+                remote.beginSync(from);
+            }
+            for (const auto& value : message["rooms"]) {
+                remote.update(ClusterNode::decodeRoom(value), from);
+            }
+            for (const auto& value : message["removed"]) {
+                remote.remove(value.asString());
+            }
+            if (full && message["last"].asBool()) {
+                remote.endSync(from);
+            }
+        } else if (type == "hello") {
+            cluster.publishSummary(*manager.getAllRooms(), {}, true, from);
+        } else if (type == "quit") {
+            quit = true;
+        }
+    }
+};
+
+// Node 2: owns its rooms and serves forwarded joins until told to quit.
+// Its exit code reports whether node 1's rooms reached it.
+int runOwner(const std::string& busUri) {
+    TestNode node(kOwner, busUri);
+    node.createRooms(kOwnerRooms, "owner_host_");
+    if (!node.start()) {
+        return 2;
+    }
+    if (!waitFor([&]() { return node.quit.load(); }, std::chrono::seconds(30))) {
+        return 3;
+    }
+    CHECK(node.cluster.remoteRooms().size() == kHomeRooms);
+    return lobbytest::result();
+}
+
+// Node 1: home of the visitors
+void runHome(const std::string& busUri, pid_t owner) {
+    TestNode node(kHome, busUri);
+    std::vector<std::string> homeRooms = node.createRooms(kHomeRooms, "home_host_");
+    CHECK(node.start());
+    for (const auto& roomId : homeRooms) {
+        CHECK(node.cluster.owns(roomId));
+    }
+
+    // The owner may not have bound its socket yet; hello is repeated until its summary arrives
+    RemoteRooms& remote = node.cluster.remoteRooms();
+    bool synced = waitFor([&]() {
+        Json::Value hello;
+        hello["type"] = "hello";
+        node.cluster.send(kOwner, hello);
+        return remote.size() == kOwnerRooms;
+    }, std::chrono::seconds(10));
+    CHECK(synced);
+    std::vector<Room> ownerRooms = remote.all();
+    for (const Room& room : ownerRooms) {
+        // Both processes place every room on the same node
+        CHECK(node.cluster.ownerOf(room.id) == kOwner);
+        CHECK(room.players.size() == 1);
+    }
+    node.cluster.publishSummary(*node.manager.getAllRooms(), {}, true);
+
+    // Forwarded joins, one at a time as clients make them: the kernel queues
+    // only net.unix.max_dgram_qlen datagrams per socket (10 by default) and
+    // the bus drops sends beyond that. The owner sends each room's events to
+    // the visitor's home.
+    for (std::size_t i = 0; i < kVisitors && i < ownerRooms.size(); ++i) {
+        std::string visitorId = "visitor_" + std::to_string(i);
+        node.manager.addUser(User(visitorId, "Visitor"));
+        node.cluster.noteOwnerContacted(visitorId, kOwner);
+        Json::Value reply;
+        CHECK(ask(node.cluster, joinRequest(ownerRooms[i].id, visitorId), reply));
+        CHECK(reply["joined"].asBool());
+        CHECK(waitFor([&]() { return remote.get(ownerRooms[i].id).hasPlayer(visitorId); },
+                      std::chrono::seconds(5)));
+    }
+    Json::Value refused;
+    CHECK(ask(node.cluster, joinRequest("no_such_room", "visitor_0"), refused));
+    CHECK(!refused["joined"].asBool());
+
+    // Disconnecting visitors are dropped from the owner's rooms, and the events say so
+    for (std::size_t i = 0; i < kVisitors; ++i) {
+        std::string visitorId = "visitor_" + std::to_string(i);
+        Json::Value gone;
+        gone["type"] = "user_gone";
+        gone["userId"] = visitorId;
+        for (std::uint16_t ownerNode : node.cluster.takeContactedOwners(visitorId)) {
+            node.cluster.send(ownerNode, gone);
+        }
+        node.manager.removeUser(visitorId);
+        CHECK(waitFor([&]() { return !remote.get(ownerRooms[i].id).hasPlayer(visitorId); },
+                      std::chrono::seconds(5)));
+    }
+    CHECK(node.roomEvents.load() == 2 * kVisitors);
+
+    // Node 2 checks what it learned from us, then goes away
+    Json::Value quit;
+    quit["type"] = "quit";
+    node.cluster.send(kOwner, quit);
+    int status = 0;
+    CHECK(::waitpid(owner, &status, 0) == owner);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // With the owner down a forwarded request fails once it times out
+    std::atomic<int> outcome{0};   // 1 ok, -1 failed
+    node.cluster.request(kOwner, joinRequest(ownerRooms[0].id, "late"), [&](bool ok, const Json::Value&) { outcome = ok ? 1 : -1; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    node.cluster.expireRequests();
+    CHECK(outcome.load() == -1);
+    ClusterStats stats = node.cluster.getStats();
+    CHECK(stats.requestsFailed == 1);
+    CHECK(stats.bus.dropped >= 1);
+}
+
+// Both nodes write their users and rooms to one database; node 1 then restarts
+// from it and must find its users by homeNode and its rooms by the ring
+void restoreKeepsOwnState() {
+    auto db = std::make_shared<DurableMemoryDatabase>("memory://");
+    std::vector<std::string> roomIds;
+    for (std::uint16_t self : {kHome, kOwner}) {
+        RoomManager writer(db, PersistenceQueue::Options(), ChatHistory::Options(), self);
+        std::string prefix = "node" + std::to_string(self) + "_";
+        for (std::size_t i = 0; i < kHomeRooms; ++i) {
+            std::string hostId = prefix + std::to_string(i);
+            writer.addUser(User(hostId, "Host"));
+            roomIds.push_back(writer.createRoom("Room " + std::to_string(i), hostId));
+        }
+        writer.shutdown();
+    }
+
+    HashRing ring({kHome, kOwner});
+    RoomManager restarted(db, PersistenceQueue::Options(), ChatHistory::Options(), kHome);
+    restarted.isLocalRoom = [&](const std::string& roomId) { return ring.ownerOf(roomId) == kHome; };
+    RestoreStats stats = restarted.restore("", 1);
+    CHECK(stats.reconciled);
+
+    std::size_t ownRooms = 0;
+    for (const auto& roomId : roomIds) {
+        bool own = ring.ownerOf(roomId) == kHome;
+        ownRooms += own ? 1 : 0;
+        CHECK(restarted.getRoomById(roomId).id.empty() != own);
+    }
+    CHECK(stats.rooms == ownRooms);
+    CHECK(stats.users == kHomeRooms);
+    CHECK(stats.skippedForeign == (roomIds.size() - ownRooms) + kHomeRooms);
+    for (std::size_t i = 0; i < kHomeRooms; ++i) {
+        User home = restarted.getUserById("node1_" + std::to_string(i));
+        CHECK(home.homeNode == kHome);
+        CHECK(restarted.getUserById("node2_" + std::to_string(i)).id.empty());
+    }
+    restarted.shutdown();
+}
+
+} // namespace
+
+int main() {
+    Logger::instance().setLevel(LogLevel::Warn);
+    std::string directory = (std::filesystem::temp_directory_path() / "lobby_cluster_XXXXXX").string();
+    if (!::mkdtemp(directory.data())) {
+        std::cerr << "Cannot create a directory for the bus sockets" << std::endl;
+        return 1;
+    }
+    std::string busUri = "unix://" + directory;
+
+    // Forked before any thread exists in this process
+    pid_t owner = ::fork();
+    if (owner < 0) {
+        std::cerr << "fork failed" << std::endl;
+        return 1;
+    }
+    if (owner == 0) {
+        std::_Exit(runOwner(busUri));
+    }
+    runHome(busUri, owner);
+    std::filesystem::remove_all(directory);
+
+    restoreKeepsOwnState();
+    return lobbytest::result();
+}
@@ -0,0 +1,224 @@
+// NotificationScheduler coalescing, and convergence under churn: a client
+// model that applies each flushed batch the way WebSocketServer does must end
+// up with exactly the RoomManager's rooms, versions and users.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "in_memory_database.hpp"
+#include "logger.hpp"
+#include "notification_scheduler.hpp"
+#include "room_manager.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+RoomEvent eventFor(RoomEvent::Type type, const std::string& roomId, std::uint64_t version) {
+    Room room;
+    room.id = roomId;
+    room.version = version;
+    return RoomEvent{type, roomId, "user", room};
+}
+
+void coalescesPerTick() {
+    NotificationScheduler scheduler;
+    scheduler.addRoomEvent(eventFor(RoomEvent::Type::Created, "a", 1));
+    scheduler.addRoomEvent(eventFor(RoomEvent::Type::PlayerJoined, "a", 2));
+    scheduler.addRoomEvent(eventFor(RoomEvent::Type::PlayerJoined, "b", 7));
+    scheduler.addRoomEvent(eventFor(RoomEvent::Type::StatusChanged, "c", 3));
+    scheduler.addRoomEvent(eventFor(RoomEvent::Type::Deleted, "c", 0));
+    scheduler.markUserDirty("alice");
+    scheduler.markUserDirty("alice");
+    scheduler.markUserDirty("bob");
+
+    NotificationScheduler::Batch batch = scheduler.take();
+    CHECK(batch.rooms.size() == 3);
+    CHECK(batch.rooms["a"].eventCount == 2);
+    CHECK(batch.rooms["a"].first.room.version == 1);
+    CHECK(!batch.rooms["a"].deleted);
+    CHECK(batch.rooms["b"].eventCount == 1);
+    CHECK(batch.rooms["b"].first.type == RoomEvent::Type::PlayerJoined);
+    CHECK(batch.rooms["c"].deleted);
+    CHECK(batch.users.size() == 2);
+
+    CHECK(scheduler.take().empty());
+    NotificationStats stats = scheduler.getStats();
+    CHECK(stats.roomEvents == 5);
+    CHECK(stats.userEvents == 3);
+    CHECK(stats.roomsFlushed == 3);
+    CHECK(stats.usersFlushed == 2);
+    CHECK(stats.ticks == 1);
+}
+
+// What clients end up knowing, updated from batches as flushNotifications sends them
+class ClientModel {
+public:
+    explicit ClientModel(RoomManager& roomManager) : manager(roomManager) {}
+
+    void apply(NotificationScheduler::Batch& batch) {
+        for (auto& [roomId, changes] : batch.rooms) {
+            if (changes.deleted) {
+                rooms.erase(roomId);
+                gone.insert(roomId);
+                if (changes.eventCount == 0) {
+                    continue;
+                }
+            } else if (changes.eventCount == 1) {
+                // A delta; clients drop deltas for deleted rooms and older versions
+                const Room& room = changes.first.room;
+                auto known = rooms.find(roomId);
+                if (!gone.count(roomId) && (known == rooms.end() || known->second.version < room.version)) {
+                    rooms[roomId] = room;
+                }
+                continue;
+            }
+            Room current = manager.getRoomById(roomId);
+            if (!current.id.empty()) {
+                rooms[roomId] = current;
+            }
+        }
+        for (const auto& userId : batch.users) {
+            User user = manager.getUserById(userId);
+            if (user.id.empty()) {
+                users.erase(userId);
+            } else {
+                users[userId] = user.currentRoom.str();
+            }
+        }
+    }
+
+    std::map<std::string, Room> rooms;
+    std::map<std::string, std::string> users;   // Id -> current room
+
+private:
+    RoomManager& manager;
+    std::set<std::string> gone;
+};
+
+void convergesUnderChurn() {
+    const std::size_t kThreads = 8;
+    const std::size_t kUsersPerThread = 40;
+    const auto kRunFor = std::chrono::milliseconds(1500);
+    const auto kTick = std::chrono::milliseconds(2);
+
+    RoomManager manager(std::make_shared<InMemoryDatabase>("memory://"));
+    NotificationScheduler scheduler;
+    manager.onRoomUpdate = [&](const RoomEvent& event) { scheduler.addRoomEvent(event); };
+    manager.onUserUpdate = [&](const std::string& userId, const std::string&) { scheduler.markUserDirty(userId); };
+
+    ClientModel model(manager);
+    std::atomic<bool> stop{false};
+    std::thread ticker([&]() {
+        while (!stop.load()) {
+            NotificationScheduler::Batch batch = scheduler.take();
+            model.apply(batch);
+            std::this_thread::sleep_for(kTick);
+        }
+    });
+
+    // Rooms any thread may join; stale ids only make joins fail
+    std::mutex knownMutex;
+    std::vector<std::string> knownRooms;
+
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            std::mt19937 rng(static_cast<unsigned>(t) + 1);
+            std::vector<std::string> userIds;
+            for (std::size_t i = 0; i < kUsersPerThread; ++i) {
+                userIds.push_back("t" + std::to_string(t) + "_u" + std::to_string(i));
+                manager.addUser(User(userIds.back(), "Player"));
+            }
+            auto deadline = std::chrono::steady_clock::now() + kRunFor;
+            while (std::chrono::steady_clock::now() < deadline) {
+                const std::string& userId = userIds[rng() % userIds.size()];
+                std::string roomId;
+                {
+                    std::lock_guard<std::mutex> lock(knownMutex);
+                    if (!knownRooms.empty()) {
+                        roomId = knownRooms[rng() % knownRooms.size()];
+                    }
+                }
+                switch (rng() % 6) {
+                    case 0: {
+                        std::string created = manager.createRoom("Room", userId);
+                        std::lock_guard<std::mutex> lock(knownMutex);
+                        knownRooms.push_back(created);
+                        break;
+                    }
+                    case 1:
+                    case 2:
+                        manager.joinRoom(roomId, userId);
+                        break;
+                    case 3:
+                        manager.setRoomStatus(roomId, rng() % 2 ? RoomStatus::IN_PROGRESS : RoomStatus::WAITING);
+                        break;
+                    case 4:
+                        manager.leaveRoom(roomId, userId);
+                        break;
+                    case 5:
+                        // Disconnect and come straight back
+                        manager.removeUser(userId);
+                        manager.addUser(User(userId, "Player"));
+                        break;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    stop = true;
+    ticker.join();
+    // Everything still pending goes out in the next tick
+    NotificationScheduler::Batch last = scheduler.take();
+    model.apply(last);
+
+    auto rooms = manager.getAllRooms();
+    CHECK(model.rooms.size() == rooms->size());
+    std::size_t roomsMatching = 0;
+    for (const Room& room : *rooms) {
+        auto known = model.rooms.find(room.id);
+        if (known != model.rooms.end() && known->second.version == room.version &&
+            known->second.status == room.status && known->second.players.ids() == room.players.ids()) {
+            ++roomsMatching;
+        }
+    }
+    CHECK(roomsMatching == rooms->size());
+
+    auto users = manager.getOnlineUsers();
+    CHECK(model.users.size() == users->size());
+    std::size_t usersMatching = 0;
+    for (const User& user : *users) {
+        auto known = model.users.find(user.id.str());
+        if (known != model.users.end() && known->second == user.currentRoom.str()) {
+            ++usersMatching;
+        }
+    }
+    CHECK(usersMatching == users->size());
+
+    // Coalescing must actually have happened
+    NotificationStats stats = scheduler.getStats();
+    CHECK(stats.roomsFlushed + stats.usersFlushed < stats.roomEvents + stats.userEvents);
+    std::cout << "Churn: " << rooms->size() << " rooms and " << users->size() << " users; "
+              << stats.roomsFlushed + stats.usersFlushed << " notifications for "
+              << stats.roomEvents + stats.userEvents << " events in " << stats.ticks << " ticks" << std::endl;
+    manager.shutdown();
+}
+
+} // namespace
+
+int main() {
+    Logger::instance().setLevel(LogLevel::Warn);
+    coalescesPerTick();
+    convergesUnderChurn();
+    return lobbytest::result();
+}
@@ -0,0 +1,99 @@
+// PersistenceQueue coalescing: every entity pushed must reach the database,
+// and only its latest record, however many were queued for it.
+#include <memory>
+#include <string>
+#include <vector>
+#include "in_memory_database.hpp"
+#include "logger.hpp"
+#include "persistence_queue.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+// Nothing is flushed until stop(), so every record meets the others in one batch
+PersistenceQueue::Options holdUntilStop() {
+    PersistenceQueue::Options options;
+    options.batchSize = 100000;
+    options.flushInterval = std::chrono::milliseconds(60000);
+    return options;
+}
+
+std::size_t stored(InMemoryDatabase& db, DatabaseManager::Collection collection) {
+    std::vector<std::string> ids;
+    db.scanIds(collection, IdRange{}, ids);
+    return ids.size();
+}
+
+void writesEveryEntity() {
+    auto db = std::make_shared<InMemoryDatabase>("memory://");
+    PersistenceQueue queue(db, holdUntilStop());
+    for (int i = 0; i < 1000; ++i) {
+        CHECK(queue.enqueue(PersistenceRecord::upsertUser(User("user_" + std::to_string(i), "Player"))));
+    }
+    for (int i = 0; i < 100; ++i) {
+        Room room;
+        room.id = "room_" + std::to_string(i);
+        CHECK(queue.enqueue(PersistenceRecord::upsertRoom(room)));
+    }
+    queue.stop();
+
+    CHECK(stored(*db, DatabaseManager::Collection::Users) == 1000);
+    CHECK(stored(*db, DatabaseManager::Collection::Rooms) == 100);
+    PersistenceStats stats = queue.getStats();
+    CHECK(stats.written == 1100);
+    CHECK(stats.coalesced == 0);
+}
+
+void keepsLatestPerEntity() {
+    auto db = std::make_shared<InMemoryDatabase>("memory://");
+    PersistenceQueue queue(db, holdUntilStop());
+    for (int i = 0; i < 10; ++i) {
+        queue.enqueue(PersistenceRecord::upsertUser(User("alice", "Alice " + std::to_string(i))));
+    }
+    queue.enqueue(PersistenceRecord::upsertUser(User("bob", "Bob")));
+    queue.enqueue(PersistenceRecord::deleteUser("bob"));
+    // A user and a room may share an id without replacing each other
+    Room room;
+    room.id = "alice";
+    queue.enqueue(PersistenceRecord::upsertRoom(room));
+    queue.stop();
+
+    CHECK(db->getUserById("alice").username == "Alice 9");
+    CHECK(db->getUserById("bob").id.empty());
+    CHECK(stored(*db, DatabaseManager::Collection::Rooms) == 1);
+    PersistenceStats stats = queue.getStats();
+    CHECK(stats.coalesced == 10);
+    CHECK(stats.written == 3);
+}
+
+// A record parked while the queue is full must win over the older record for
+// its entity that is still queued
+void spilledUpdateWins() {
+    auto db = std::make_shared<InMemoryDatabase>("memory://");
+    PersistenceQueue::Options options = holdUntilStop();
+    options.capacity = 4;
+    PersistenceQueue queue(db, options);
+    CHECK(queue.enqueue(PersistenceRecord::upsertUser(User("alice", "Alice 0"))));
+    for (int i = 0; i < 3; ++i) {
+        CHECK(queue.enqueue(PersistenceRecord::upsertUser(User("user_" + std::to_string(i), "Player"))));
+    }
+    CHECK(queue.enqueue(PersistenceRecord::upsertUser(User("alice", "Alice 1"))));
+    queue.stop();
+
+    CHECK(db->getUserById("alice").username == "Alice 1");
+    CHECK(stored(*db, DatabaseManager::Collection::Users) == 4);
+    PersistenceStats stats = queue.getStats();
+    CHECK(stats.spilled == 1);
+    CHECK(stats.coalesced == 1);
+    CHECK(stats.written == 4);
+}
+
+} // namespace
+
+int main() {
+    Logger::instance().setLevel(LogLevel::Warn);
+    writesEveryEntity();
+    keepsLatestPerEntity();
+    spilledUpdateWins();
+    return lobbytest::result();
+}
@@ -0,0 +1,191 @@
+// Disconnect cleanup through the membership index: removeUser and
+// leaveAllRooms must reach every room the user is in, and nothing else.
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "in_memory_database.hpp"
+#include "logger.hpp"
+#include "room_manager.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+std::shared_ptr<InMemoryDatabase> memoryDatabase() {
+    return std::make_shared<InMemoryDatabase>("memory://");
+}
+
+void addUsers(RoomManager& manager, const std::vector<std::string>& userIds) {
+    for (const auto& userId : userIds) {
+        manager.addUser(User(userId, "Player " + userId));
+    }
+}
+
+bool inAnyRoom(RoomManager& manager, const std::string& userId) {
+    auto rooms = manager.getAllRooms();
+    return std::any_of(rooms->begin(), rooms->end(), [&](const Room& room) { return room.hasPlayer(userId); });
+}
+
+void removeUserLeavesEveryRoom() {
+    RoomManager manager(memoryDatabase());
+    addUsers(manager, {"alice", "bob", "carol"});
+    std::string first = manager.createRoom("First", "alice");
+    std::string second = manager.createRoom("Second", "bob");
+    std::string third = manager.createRoom("Third", "carol");
+    CHECK(manager.joinRoom(second, "alice"));
+    CHECK(manager.joinRoom(third, "alice"));
+
+    std::vector<RoomEvent> events;
+    manager.onRoomUpdate = [&](const RoomEvent& event) { events.push_back(event); };
+    CHECK(manager.removeUser("alice"));
+
+    // alice was alone in the first room, so it goes; the others lose her only
+    CHECK(manager.getRoomById(first).id.empty());
+    CHECK(manager.getRoomById(second).players.size() == 1);
+    CHECK(manager.getRoomById(third).players.size() == 1);
+    CHECK(!inAnyRoom(manager, "alice"));
+    CHECK(manager.getUserById("alice").id.empty());
+    CHECK(events.size() == 3);
+    CHECK(std::count_if(events.begin(), events.end(), [](const RoomEvent& event) {
+              return event.type == RoomEvent::Type::Deleted;
+          }) == 1);
+    manager.shutdown();
+}
+
+void removeUserContinuesPastDeletedRoom() {
+    // The old scan stopped at the first room it deleted
+    RoomManager manager(memoryDatabase());
+    addUsers(manager, {"alice", "bob"});
+    std::vector<std::string> alone;
+    for (int i = 0; i < 5; ++i) {
+        alone.push_back(manager.createRoom("Alone " + std::to_string(i), "alice"));
+    }
+    std::string shared = manager.createRoom("Shared", "bob");
+    CHECK(manager.joinRoom(shared, "alice"));
+
+    manager.removeUser("alice");
+    for (const auto& roomId : alone) {
+        CHECK(manager.getRoomById(roomId).id.empty());
+    }
+    CHECK(manager.getRoomById(shared).players.size() == 1);
+    CHECK(manager.getAllRooms()->size() == 1);
+    manager.shutdown();
+}
+
+void leaveAllRoomsKeepsUser() {
+    RoomManager manager(memoryDatabase());
+    addUsers(manager, {"alice", "bob"});
+    std::string room = manager.createRoom("Room", "bob");
+    CHECK(manager.joinRoom(room, "alice"));
+
+    manager.leaveAllRooms("alice");
+    CHECK(!manager.getRoomById(room).hasPlayer("alice"));
+    CHECK(manager.getUserById("alice").id.str() == "alice");
+
+    // The index was cleared with the rooms, so she can come back
+    CHECK(manager.joinRoom(room, "alice"));
+    manager.removeUser("alice");
+    CHECK(!manager.getRoomById(room).hasPlayer("alice"));
+    manager.shutdown();
+}
+
+void removeUnknownUserIsHarmless() {
+    RoomManager manager(memoryDatabase());
+    addUsers(manager, {"bob"});
+    std::string room = manager.createRoom("Room", "bob");
+    CHECK(manager.removeUser("nobody"));
+    manager.leaveAllRooms("nobody");
+    CHECK(manager.getRoomById(room).players.size() == 1);
+    manager.shutdown();
+}
+
+void massDisconnectEmptiesLobby() {
+    // Users fill rooms of four and then all drop at once from several threads
+    const std::size_t kUsers = 8000;
+    const std::size_t kThreads = 4;
+    RoomManager manager(memoryDatabase());
+    std::vector<std::string> userIds;
+    for (std::size_t i = 0; i < kUsers; ++i) {
+        userIds.push_back("user_" + std::to_string(i));
+    }
+    addUsers(manager, userIds);
+
+    std::vector<std::string> roomIds;
+    for (std::size_t i = 0; i < kUsers; i += 4) {
+        std::string roomId = manager.createRoom("Room " + std::to_string(i), userIds[i]);
+        roomIds.push_back(roomId);
+        for (std::size_t j = i + 1; j < std::min(i + 4, kUsers); ++j) {
+            CHECK(manager.joinRoom(roomId, userIds[j]));
+        }
+    }
+    CHECK(manager.getAllRooms()->size() == roomIds.size());
+
+    std::atomic<std::size_t> roomsDeleted{0};
+    manager.onRoomUpdate = [&](const RoomEvent& event) {
+        if (event.type == RoomEvent::Type::Deleted) {
+            ++roomsDeleted;
+        }
+    };
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (std::size_t i = t; i < kUsers; i += kThreads) {
+                manager.removeUser(userIds[i]);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    CHECK(manager.getAllRooms()->empty());
+    CHECK(roomsDeleted.load() == roomIds.size());
+    CHECK(manager.getOnlineUsers()->empty());
+    manager.shutdown();
+}
+
+void removeRacesWithJoins() {
+    // Joins race removeUser; whatever the interleaving, a removeUser after
+    // the last join leaves the user in no room and the index agrees
+    RoomManager manager(memoryDatabase());
+    addUsers(manager, {"host", "racer"});
+    std::vector<std::string> roomIds;
+    for (int i = 0; i < 64; ++i) {
+        roomIds.push_back(manager.createRoom("Room " + std::to_string(i), "host"));
+    }
+
+    std::atomic<bool> stop{false};
+    std::thread joiner([&]() {
+        std::mt19937 rng(7);
+        while (!stop.load()) {
+            manager.joinRoom(roomIds[rng() % roomIds.size()], "racer");
+        }
+    });
+    for (int i = 0; i < 200; ++i) {
+        manager.removeUser("racer");
+    }
+    stop = true;
+    joiner.join();
+
+    manager.removeUser("racer");
+    CHECK(!inAnyRoom(manager, "racer"));
+    CHECK(manager.getAllRooms()->size() == roomIds.size());
+    CHECK(manager.joinRoom(roomIds[0], "racer"));
+    manager.shutdown();
+}
+
+} // namespace
+
+int main() {
+    Logger::instance().setLevel(LogLevel::Warn);
+    removeUserLeavesEveryRoom();
+    removeUserContinuesPastDeletedRoom();
+    leaveAllRoomsKeepsUser();
+    removeUnknownUserIsHarmless();
+    massDisconnectEmptiesLobby();
+    removeRacesWithJoins();
+    return lobbytest::result();
+}
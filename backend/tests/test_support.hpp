@@ -0,0 +1,31 @@
+#pragma once
+#include <iostream>
+
+// Minimal checks for the backend tests. Each test is a plain executable run
+// by CTest; a failed CHECK is reported and the process exits non-zero.
+namespace lobbytest {
+
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+inline void check(bool ok, const char* expression, const char* file, int line) {
+    if (!ok) {
+        std::cerr << file << ":" << line << ": CHECK failed: " << expression << std::endl;
+        ++failures();
+    }
+}
+
+// Exit code for main
+inline int result() {
+    if (failures() > 0) {
+        std::cerr << failures() << " check(s) failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace lobbytest
+
+#define CHECK(condition) lobbytest::check(static_cast<bool>(condition), #condition, __FILE__, __LINE__)
@@ -0,0 +1,90 @@
+#!/bin/bash
+# Requests/sec against the number of cluster nodes. For each node count,
+# starts that many servers on one host as a cluster over the Unix socket bus,
+# each with an in-memory store and its own port, then runs one
+# LobbyLoadGenerator per node at the same time and sums their rates. Load
+# grows with the cluster (USERS per node), and listings span every node, so
+# clients join rooms owned elsewhere through forwarded requests.
+#
+#   tools/cluster_scaling.sh build/GameLobbyServer build/LobbyLoadGenerator
+#
+# NODES, USERS, DURATION, MIX, WORKERS (threads per node) and PORT (first
+# node's port) override the defaults below. Every node and generator needs
+# cores of its own for the curve to mean anything.
+set -euo pipefail
+
+SERVER=${1:?usage: cluster_scaling.sh SERVER LOAD_GENERATOR}
+GENERATOR=${2:?usage: cluster_scaling.sh SERVER LOAD_GENERATOR}
+NODES=${NODES:-"1 2 4"}
+USERS=${USERS:-2000}
+DURATION=${DURATION:-30}
+MIX=${MIX:-"chat=70,join=10,leave=10,create=5,rooms=5"}
+WORKERS=${WORKERS:-1}
+PORT=${PORT:-9202}
+OUT=$(mktemp -d)
+servers=()
+cleanup() {
+    for pid in "${servers[@]}"; do
+        kill -TERM "$pid" 2>/dev/null || true
+    done
+    rm -rf "$OUT"
+}
+trap cleanup EXIT
+
+# The bus drops datagrams once a node's socket queue holds this many
+qlen=$(cat /proc/sys/net/unix/max_dgram_qlen 2>/dev/null || echo 0)
+if [ "$qlen" -lt 512 ]; then
+    echo "net.unix.max_dgram_qlen is $qlen; raise it (sysctl -w net.unix.max_dgram_qlen=512)" \
+         "or bursts of cluster messages will be dropped" >&2
+fi
+
+waitForPort() {
+    for _ in $(seq 1 100); do
+        if (exec 3<>"/dev/tcp/127.0.0.1/$1") 2>/dev/null; then
+            return 0
+        fi
+        sleep 0.1
+    done
+    echo "Server did not open port $1" >&2
+    return 1
+}
+
+printf "%-6s %14s %14s %18s %11s\n" nodes requests/s per_node messages_recv/s efficiency
+single=""
+for count in $NODES; do
+    members=$(seq -s, 1 "$count")
+    servers=()
+    for node in $(seq 1 "$count"); do
+        MONGODB_URI=memory:// SNAPSHOT_PATH= WORKER_THREADS=$WORKERS WEBSOCKET_PORT=$((PORT + node - 1)) \
+            NODE_ID=$node CLUSTER_NODES=$members CLUSTER_BUS="unix://$OUT/bus-$count" \
+            LOG_LEVEL=warn "$SERVER" >"$OUT/server-$count-$node.log" 2>&1 &
+        servers+=($!)
+    done
+    for node in $(seq 1 "$count"); do
+        waitForPort $((PORT + node - 1))
+    done
+
+    generators=()
+    for node in $(seq 1 "$count"); do
+        "$GENERATOR" --url "ws://127.0.0.1:$((PORT + node - 1))" --users "$USERS" --duration "$DURATION" \
+            --mix "$MIX" --label "nodes=$count,node=$node" >"$OUT/generator-$count-$node.log" &
+        generators+=($!)
+    done
+    for pid in "${generators[@]}"; do
+        wait "$pid"
+    done
+
+    for pid in "${servers[@]}"; do
+        kill -TERM "$pid"
+        wait "$pid" || true
+    done
+    servers=()
+
+    requests=$(cat "$OUT"/generator-$count-*.log | awk '/^Requests\/sec:/ { sub(",", "", $2); sum += $2 } END { print sum }')
+    received=$(cat "$OUT"/generator-$count-*.log | awk '/^Messages received\/sec:/ { sum += $3 } END { print sum }')
+    perNode=$(awk -v total="$requests" -v n="$count" 'BEGIN { print total / n }')
+    # Per-node rate relative to the first node count run
+    single=${single:-$perNode}
+    efficiency=$(awk -v node="$perNode" -v base="$single" 'BEGIN { print (base > 0 ? node / base : 0) }')
+    printf "%-6s %14.0f %14.0f %18.0f %11.2f\n" "$count" "$requests" "$perNode" "$received" "$efficiency"
+done
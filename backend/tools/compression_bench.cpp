@@ -0,0 +1,344 @@
+// permessage-deflate CPU against bandwidth. Builds the lobby's outbound
+// messages from a real RoomManager (a room_update, the lobby listing in JSON
+// and in the binary codec, a chat message and the user list) and compresses
+// each the way fan-out frames are, on its own through MessageDeflater, by zlib
+// level and by window bits. Then a stream of small room_updates, compressed
+// one by one against one zlib stream with context takeover, and a listing
+// fanned out compressed once against compressed per recipient.
+//
+//   LobbyCompressionBench --rooms 50 --users 200 --levels 1,6,9 --recipients 1000
+#include <zlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <json/json.h>
+#include "binary_codec.hpp"
+#include "compression.hpp"
+#include "in_memory_database.hpp"
+#include "logger.hpp"
+#include "room_manager.hpp"
+
+namespace {
+
+struct Options {
+    std::size_t rooms = 50;            // In the lobby listing
+    std::size_t users = 200;           // In the user list
+    std::vector<int> levels = {1, 6, 9};
+    std::vector<int> windowBits = {9, 12, 15};
+    std::size_t updates = 200;         // room_updates in the context takeover stream
+    std::size_t recipients = 1000;     // Fan-out of the listing
+    std::size_t iterations = 200;      // Compressions per measurement; the mean is reported
+};
+
+void printUsage() {
+    std::cout << "Usage: LobbyCompressionBench [options]\n"
+              << "  --rooms N            Rooms in the lobby listing (default 50)\n"
+              << "  --users N            Users in the user list (default 200)\n"
+              << "  --levels LIST        zlib levels (default 1,6,9)\n"
+              << "  --window-bits LIST   Window bits, 9-15 (default 9,12,15)\n"
+              << "  --updates N          room_updates in the context takeover stream (default 200)\n"
+              << "  --recipients N       Fan-out of the lobby listing (default 1000)\n"
+              << "  --iterations N       Compressions per measurement (default 200)\n";
+}
+
+std::vector<int> parseList(const std::string& list) {
+    std::vector<int> values;
+    std::size_t start = 0;
+    while (start < list.size()) {
+        std::size_t end = list.find(',', start);
+        values.push_back(std::stoi(list.substr(start, end == std::string::npos ? std::string::npos : end - start)));
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+    return values;
+}
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--help" || flag == "-h") {
+            printUsage();
+            std::exit(0);
+        }
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for " + flag);
+        }
+        std::string value = argv[++i];
+        if (flag == "--rooms") {
+            options.rooms = std::max(1UL, std::stoul(value));
+        } else if (flag == "--users") {
+            options.users = std::max(1UL, std::stoul(value));
+        } else if (flag == "--levels") {
+            options.levels = parseList(value);
+        } else if (flag == "--window-bits") {
+            options.windowBits = parseList(value);
+        } else if (flag == "--updates") {
+            options.updates = std::max(1UL, std::stoul(value));
+        } else if (flag == "--recipients") {
+            options.recipients = std::max(1UL, std::stoul(value));
+        } else if (flag == "--iterations") {
+            options.iterations = std::max(1UL, std::stoul(value));
+        } else {
+            throw std::runtime_error("Unknown option: " + flag);
+        }
+    }
+    if (options.levels.empty() || options.windowBits.empty()) {
+        throw std::runtime_error("--levels and --window-bits need at least one value");
+    }
+    return options;
+}
+
+// The shapes WebSocketServer sends
+Json::Value roomToJson(const Room& room) {
+    Json::Value roomData;
+    roomData["id"] = room.id;
+    roomData["name"] = room.name;
+    roomData["gameType"] = room.gameType;
+    roomData["players"] = Json::Value(Json::arrayValue);
+    for (const auto& playerId : room.players) {
+        roomData["players"].append(playerId.str());
+    }
+    roomData["maxPlayers"] = room.maxPlayers;
+    roomData["status"] = static_cast<int>(room.status);
+    roomData["version"] = static_cast<Json::UInt64>(room.version);
+    return roomData;
+}
+
+std::string toText(const Json::Value& message) {
+    static const Json::StreamWriterBuilder compactWriter = []() {
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        return builder;
+    }();
+    return Json::writeString(compactWriter, message);
+}
+
+struct Payload {
+    std::string label;
+    std::string text;
+};
+
+// A lobby of users in rooms of up to four, and the messages it produces
+std::vector<Payload> buildPayloads(RoomManager& manager, const Options& options,
+                                   std::vector<std::string>& roomUpdates) {
+    const char* const gameTypes[] = {"Chess", "Poker", "Racing", "Shooter"};
+    std::size_t users = std::max(options.users, options.rooms);
+    std::vector<std::string> roomIds;
+    for (std::size_t i = 0; i < users; ++i) {
+        std::string userId = "user_" + std::to_string(i);
+        manager.addUser(User(userId, "Player" + std::to_string(i)));
+        if (i % 4 == 0 && roomIds.size() < options.rooms) {
+            roomIds.push_back(manager.createRoom("Room " + std::to_string(roomIds.size()), userId,
+                                                 gameTypes[roomIds.size() % 4]));
+        } else if (!roomIds.empty() && i % 4 != 0) {
+            manager.joinRoom(roomIds.back(), userId);
+        }
+    }
+
+    Json::Value listing;
+    listing["type"] = "room_update";
+    listing["rooms"] = Json::Value(Json::arrayValue);
+    auto rooms = manager.getAllRooms();
+    for (const auto& room : *rooms) {
+        listing["rooms"].append(roomToJson(room));
+        Json::Value update;
+        update["type"] = "room_update";
+        update["room"] = roomToJson(room);
+        roomUpdates.push_back(toText(update));
+    }
+    // The stream cycles through the rooms, as updates for a busy lobby would
+    std::vector<std::string> stream;
+    for (std::size_t i = 0; i < options.updates; ++i) {
+        stream.push_back(roomUpdates[i % roomUpdates.size()]);
+    }
+    roomUpdates.swap(stream);
+
+    Json::Value chat;
+    chat["type"] = "chat_message";
+    chat["roomId"] = rooms->front().id;
+    chat["userId"] = "user_1";
+    chat["username"] = "Player1";
+    chat["message"] = "gg, rematch in five? I'll host this time";
+
+    Json::Value userList;
+    userList["type"] = "user_update";
+    userList["users"] = Json::Value(Json::arrayValue);
+    auto online = manager.getOnlineUsers();
+    for (std::size_t i = 0; i < online->size() && i < options.users; ++i) {
+        const User& user = (*online)[i];
+        Json::Value userData;
+        userData["id"] = user.id.str();
+        userData["username"] = user.username;
+        userData["currentRoom"] = user.currentRoom.str();
+        userList["users"].append(userData);
+    }
+
+    std::vector<Payload> payloads;
+    payloads.push_back({"room_update json", roomUpdates.front()});
+    payloads.push_back({"lobby " + std::to_string(rooms->size()) + " rooms", toText(listing)});
+    payloads.push_back({"  (binary codec)", BinaryCodec::encodeServerMessage(listing)});
+    payloads.push_back({"chat_message json", toText(chat)});
+    payloads.push_back({"user_list " + std::to_string(userList["users"].size()), toText(userList)});
+    return payloads;
+}
+
+double microsecondsSince(std::chrono::steady_clock::time_point started) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count();
+}
+
+struct Measurement {
+    std::size_t bytes = 0;   // Compressed size
+    double us = 0;           // Per message
+};
+
+// A standalone frame, as every fan-out frame is compressed
+Measurement measure(const std::string& payload, int level, int windowBits, std::size_t iterations) {
+    CompressionOptions compression;
+    compression.level = level;
+    compression.serverWindowBits = windowBits;
+    MessageDeflater deflater(compression);
+    std::string out;
+    if (!deflater.deflate(payload, out)) {
+        throw std::runtime_error("deflate failed");
+    }
+    auto started = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i) {
+        deflater.deflate(payload, out);
+    }
+    return {out.size(), microsecondsSince(started) / static_cast<double>(iterations)};
+}
+
+// One connection's compressor with server context takeover: every message
+// may refer back to the ones before it on the same stream
+Measurement measureTakeover(const std::vector<std::string>& messages, int level, int windowBits) {
+    z_stream stream{};
+    if (deflateInit2(&stream, level, Z_DEFLATED, -windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("deflateInit2 failed");
+    }
+    Measurement result;
+    std::string out;
+    auto started = std::chrono::steady_clock::now();
+    for (const auto& message : messages) {
+        out.resize(deflateBound(&stream, static_cast<uLong>(message.size())) + 16);
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(message.data()));
+        stream.avail_in = static_cast<uInt>(message.size());
+        stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+        stream.avail_out = static_cast<uInt>(out.size());
+        if (deflate(&stream, Z_SYNC_FLUSH) != Z_OK) {
+            deflateEnd(&stream);
+            throw std::runtime_error("deflate failed");
+        }
+        // Less the 00 00 ff ff tail, as on the wire
+        result.bytes += out.size() - stream.avail_out - 4;
+    }
+    result.us = microsecondsSince(started) / static_cast<double>(messages.size());
+    deflateEnd(&stream);
+    return result;
+}
+
+std::string percentOf(std::size_t part, std::size_t whole) {
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(0) << 100.0 * static_cast<double>(part) / static_cast<double>(whole) << "%";
+    return text.str();
+}
+
+std::string sizeOf(std::size_t bytes) {
+    std::ostringstream text;
+    if (bytes >= 1024) {
+        text << std::fixed << std::setprecision(1) << static_cast<double>(bytes) / 1024.0 << " KB";
+    } else {
+        text << bytes << " B";
+    }
+    return text.str();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        Options options = parseOptions(argc, argv);
+        Logger::instance().setLevel(LogLevel::Warn);
+        RoomManager manager(std::make_shared<InMemoryDatabase>("memory://"));
+        std::vector<std::string> roomUpdates;
+        std::vector<Payload> payloads = buildPayloads(manager, options, roomUpdates);
+        CompressionOptions defaults;
+
+        std::cout << "Standalone frames, window " << options.windowBits.back()
+                  << " (size after compression, time per message; * is under the "
+                  << defaults.minBytes << " B threshold and goes uncompressed)\n"
+                  << std::left << std::setw(20) << "payload" << std::right << std::setw(10) << "raw";
+        for (int level : options.levels) {
+            std::cout << std::setw(18) << ("level " + std::to_string(level));
+        }
+        std::cout << std::endl;
+        for (const auto& payload : payloads) {
+            std::cout << std::left << std::setw(20) << payload.label << std::right << std::setw(9)
+                      << sizeOf(payload.text.size()) << (payload.text.size() < defaults.minBytes ? "*" : " ");
+            for (int level : options.levels) {
+                Measurement result = measure(payload.text, level, options.windowBits.back(), options.iterations);
+                std::cout << std::setw(8) << percentOf(result.bytes, payload.text.size()) << std::setw(7)
+                          << std::fixed << std::setprecision(1) << result.us << " us";
+            }
+            std::cout << std::endl;
+        }
+
+        const Payload& listing = payloads[1];
+        std::cout << "\nWindow bits, " << listing.label << " at level " << defaults.level << "\n";
+        for (int bits : options.windowBits) {
+            Measurement result = measure(listing.text, defaults.level, bits, options.iterations);
+            std::cout << std::setw(4) << bits << " bits" << std::setw(10) << sizeOf(result.bytes) << std::setw(8)
+                      << percentOf(result.bytes, listing.text.size()) << std::setw(8) << std::setprecision(1)
+                      << result.us << " us" << std::endl;
+        }
+
+        std::size_t raw = 0;
+        for (const auto& update : roomUpdates) {
+            raw += update.size();
+        }
+        std::cout << "\n" << roomUpdates.size() << " room_updates, " << sizeOf(raw) << " raw, level "
+                  << defaults.level << ", window " << options.windowBits.back() << "\n";
+        CompressionOptions streamOptions;
+        streamOptions.serverWindowBits = options.windowBits.back();
+        MessageDeflater deflater(streamOptions);
+        std::string out;
+        Measurement alone;
+        auto started = std::chrono::steady_clock::now();
+        for (const auto& update : roomUpdates) {
+            deflater.deflate(update, out);
+            alone.bytes += out.size();
+        }
+        alone.us = microsecondsSince(started) / static_cast<double>(roomUpdates.size());
+        Measurement takeover = measureTakeover(roomUpdates, defaults.level, options.windowBits.back());
+        std::cout << "  each on its own        " << std::setw(6) << percentOf(alone.bytes, raw) << std::setw(8)
+                  << alone.us << " us per message, once per fan-out\n"
+                  << "  context takeover       " << std::setw(6) << percentOf(takeover.bytes, raw) << std::setw(8)
+                  << takeover.us << " us per message per recipient" << std::endl;
+
+        // Per recipient is what a compressor per connection costs: one
+        // deflate of the same listing for every socket
+        double onceMs = measure(listing.text, defaults.level, options.windowBits.back(), options.iterations).us / 1000.0;
+        started = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < options.recipients; ++i) {
+            deflater.deflate(listing.text, out);
+        }
+        double perRecipientMs = microsecondsSince(started) / 1000.0;
+        std::cout << "\n" << listing.label << " to " << options.recipients << " recipients: "
+                  << std::setprecision(2) << onceMs << " ms compressed once, " << perRecipientMs
+                  << " ms compressed per recipient" << std::endl;
+
+        manager.shutdown();
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Compression benchmark error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,210 @@
+// RoomManager throughput under concurrent access. Each thread runs a mix of
+// joins and leaves (moving its own users in and out of random rooms, each of
+// which keeps its host), listings and single-room reads against the in-memory
+// database. Every thread count is run twice: directly against the sharded
+// manager, and with all calls serialised behind one mutex, which is how the
+// manager behaved before it was sharded.
+//
+//   LobbyContentionBench --threads 1,2,4,8 --rooms 10000 --users 20000 --seconds 3
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "in_memory_database.hpp"
+#include "logger.hpp"
+#include "room_manager.hpp"
+
+namespace {
+
+struct Options {
+    std::vector<std::size_t> threads = {1, 2, 4, 8};
+    std::size_t rooms = 10000;
+    std::size_t users = 20000;
+    double seconds = 3;
+    unsigned listingPercent = 1;   // getAllRooms calls
+    unsigned readPercent = 15;     // getRoomById calls
+};
+
+void printUsage() {
+    std::cout << "Usage: LobbyContentionBench [options]\n"
+              << "  --threads LIST       Thread counts to run (default 1,2,4,8)\n"
+              << "  --rooms N            Rooms created up front (default 10000)\n"
+              << "  --users N            Users, split evenly between threads (default 20000)\n"
+              << "  --seconds S          Measured time per run (default 3)\n"
+              << "  --listings PCT       Share of getAllRooms calls (default 1)\n"
+              << "  --reads PCT          Share of getRoomById calls (default 15)\n";
+}
+
+std::vector<std::size_t> parseList(const std::string& list) {
+    std::vector<std::size_t> values;
+    std::size_t start = 0;
+    while (start < list.size()) {
+        std::size_t end = list.find(',', start);
+        values.push_back(std::max(1UL, std::stoul(list.substr(start, end == std::string::npos ? std::string::npos
+                                                                                                  : end - start))));
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+    return values;
+}
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--help" || flag == "-h") {
+            printUsage();
+            std::exit(0);
+        }
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for " + flag);
+        }
+        std::string value = argv[++i];
+        if (flag == "--threads") {
+            options.threads = parseList(value);
+        } else if (flag == "--rooms") {
+            options.rooms = std::max(1UL, std::stoul(value));
+        } else if (flag == "--users") {
+            options.users = std::max(1UL, std::stoul(value));
+        } else if (flag == "--seconds") {
+            options.seconds = std::max(0.1, std::stod(value));
+        } else if (flag == "--listings") {
+            options.listingPercent = static_cast<unsigned>(std::min(100UL, std::stoul(value)));
+        } else if (flag == "--reads") {
+            options.readPercent = static_cast<unsigned>(std::min(100UL, std::stoul(value)));
+        } else {
+            throw std::runtime_error("Unknown option: " + flag);
+        }
+    }
+    if (options.listingPercent + options.readPercent > 100) {
+        throw std::runtime_error("--listings and --reads add up to more than 100");
+    }
+    return options;
+}
+
+// Calls the manager directly, or through one lock when serialised
+class Driver {
+public:
+    Driver(RoomManager& roomManager, bool serialised) : manager(roomManager), global(serialised) {}
+
+    template <typename Fn>
+    auto call(Fn&& fn) {
+        if (!global) {
+            return fn(manager);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        return fn(manager);
+    }
+
+private:
+    RoomManager& manager;
+    bool global;
+    std::mutex mutex;
+};
+
+double run(const Options& options, std::size_t threadCount, bool serialised) {
+    RoomManager manager(std::make_shared<InMemoryDatabase>("memory://"));
+    std::vector<std::string> roomIds;
+    roomIds.reserve(options.rooms);
+    // Each room keeps its host, so rooms are never emptied and deleted
+    for (std::size_t i = 0; i < options.rooms; ++i) {
+        std::string hostId = "host_" + std::to_string(i);
+        manager.addUser(User(hostId, "Host" + std::to_string(i)));
+        roomIds.push_back(manager.createRoom("Room " + std::to_string(i), hostId));
+    }
+    for (std::size_t i = 0; i < options.users; ++i) {
+        manager.addUser(User("user_" + std::to_string(i), "Player" + std::to_string(i)));
+    }
+
+    Driver driver(manager, serialised);
+    std::atomic<bool> go{false};
+    std::atomic<bool> stop{false};
+    std::vector<std::uint64_t> completed(threadCount, 0);
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&, t]() {
+            std::mt19937_64 rng(t + 1);
+            std::size_t firstUser = options.users * t / threadCount;
+            std::size_t userCount = std::max<std::size_t>(1, options.users * (t + 1) / threadCount - firstUser);
+            // The room each of this thread's users is in, empty when none
+            std::vector<std::string> joined(userCount);
+            std::uint64_t ops = 0;
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            while (!stop.load(std::memory_order_relaxed)) {
+                unsigned roll = static_cast<unsigned>(rng() % 100);
+                const std::string& roomId = roomIds[rng() % roomIds.size()];
+                if (roll < options.listingPercent) {
+                    driver.call([](RoomManager& m) { return m.getAllRooms()->size(); });
+                } else if (roll < options.listingPercent + options.readPercent) {
+                    driver.call([&](RoomManager& m) { return m.getRoomById(roomId).players.size(); });
+                } else {
+                    std::size_t slot = rng() % userCount;
+                    std::string userId = "user_" + std::to_string(firstUser + slot);
+                    if (joined[slot].empty()) {
+                        if (driver.call([&](RoomManager& m) { return m.joinRoom(roomId, userId); })) {
+                            joined[slot] = roomId;
+                        }
+                    } else {
+                        driver.call([&](RoomManager& m) { return m.leaveRoom(joined[slot], userId); });
+                        joined[slot].clear();
+                    }
+                }
+                ++ops;
+            }
+            completed[t] = ops;
+        });
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.seconds));
+    stop.store(true);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    manager.shutdown();
+
+    std::uint64_t total = 0;
+    for (std::uint64_t ops : completed) {
+        total += ops;
+    }
+    return static_cast<double>(total) / elapsed;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        Options options = parseOptions(argc, argv);
+        Logger::instance().setLevel(LogLevel::Warn);
+        std::cout << options.rooms << " rooms, " << options.users << " users, " << options.listingPercent
+                  << "% listings, " << options.readPercent << "% reads, the rest joins/leaves; "
+                  << std::thread::hardware_concurrency() << " hardware threads\n";
+        std::cout << std::left << std::setw(9) << "threads" << std::right << std::setw(16) << "sharded ops/s"
+                  << std::setw(18) << "serialised ops/s" << std::setw(10) << "ratio" << std::endl;
+        for (std::size_t threadCount : options.threads) {
+            double sharded = run(options, threadCount, false);
+            double serialised = run(options, threadCount, true);
+            std::cout << std::left << std::setw(9) << threadCount << std::right << std::fixed << std::setprecision(0)
+                      << std::setw(16) << sharded << std::setw(18) << serialised << std::setprecision(2)
+                      << std::setw(10) << sharded / serialised << std::endl;
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Contention benchmark error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,329 @@
+// Client message decoding: the per-message reader and double parse the server
+// used to do, against JsonCodec's single pass. Runs a corpus of client frames
+// through each path and reports time and heap allocations per message.
+//
+//   LobbyDecodeBench --messages 200000
+//   LobbyDecodeBench --corpus frames.jsonl    (one client frame per line)
+//
+// Without --corpus, frames are generated in the frontend's format with the
+// load generator's default mix (chat 70, join 10, leave 10, create 5, rooms 5).
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <json/json.h>
+#include "json_codec.hpp"
+
+namespace {
+
+std::atomic<std::uint64_t> allocations{0};
+std::atomic<long> decodeSink{0};
+
+const std::size_t kDefaultAlignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+// Every replaced operator new below allocates here and every operator delete
+// frees with std::free, so the array, sized, aligned and nothrow forms all
+// pair with each other and are all counted
+void* allocate(std::size_t size, std::size_t alignment) noexcept {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    size = size ? size : 1;
+    return alignment <= kDefaultAlignment
+        ? std::malloc(size)
+        : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+void* allocateOrThrow(std::size_t size, std::size_t alignment) {
+    if (void* block = allocate(size, alignment)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+// Out of line: inlined into a delete expression, GCC pairs the free() with
+// the new expression and reports -Wmismatched-new-delete
+[[gnu::noinline]] void release(void* block) noexcept {
+    std::free(block);
+}
+
+} // namespace
+
+void* operator new(std::size_t size) { return allocateOrThrow(size, kDefaultAlignment); }
+void* operator new[](std::size_t size) { return allocateOrThrow(size, kDefaultAlignment); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return allocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return allocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate(size, kDefaultAlignment); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocate(size, kDefaultAlignment); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* block) noexcept { release(block); }
+void operator delete[](void* block) noexcept { release(block); }
+void operator delete(void* block, std::size_t) noexcept { release(block); }
+void operator delete[](void* block, std::size_t) noexcept { release(block); }
+void operator delete(void* block, std::align_val_t) noexcept { release(block); }
+void operator delete[](void* block, std::align_val_t) noexcept { release(block); }
+void operator delete(void* block, std::size_t, std::align_val_t) noexcept { release(block); }
+void operator delete[](void* block, std::size_t, std::align_val_t) noexcept { release(block); }
+void operator delete(void* block, const std::nothrow_t&) noexcept { release(block); }
+void operator delete[](void* block, const std::nothrow_t&) noexcept { release(block); }
+void operator delete(void* block, std::align_val_t, const std::nothrow_t&) noexcept { release(block); }
+void operator delete[](void* block, std::align_val_t, const std::nothrow_t&) noexcept { release(block); }
+
+namespace {
+
+struct Options {
+    std::string corpus;
+    std::size_t messages = 200000;   // Generated frames, when no corpus is given
+    std::size_t rounds = 5;          // Passes over the corpus; the fastest is reported
+};
+
+void printUsage() {
+    std::cout << "Usage: LobbyDecodeBench [options]\n"
+              << "  --corpus FILE        Client frames, one JSON text per line\n"
+              << "  --messages N         Frames to generate without a corpus (default 200000)\n"
+              << "  --rounds N           Passes per path; the fastest is reported (default 5)\n";
+}
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--help" || flag == "-h") {
+            printUsage();
+            std::exit(0);
+        }
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for " + flag);
+        }
+        std::string value = argv[++i];
+        if (flag == "--corpus") {
+            options.corpus = value;
+        } else if (flag == "--messages") {
+            options.messages = std::max(1UL, std::stoul(value));
+        } else if (flag == "--rounds") {
+            options.rounds = std::max(1UL, std::stoul(value));
+        } else {
+            throw std::runtime_error("Unknown option: " + flag);
+        }
+    }
+    return options;
+}
+
+std::string toText(const Json::Value& value) {
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString(builder, value);
+}
+
+std::vector<Json::Value> generateCorpus(std::size_t count) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> pick(0, 99);
+    std::uniform_int_distribution<int> chatLength(5, 120);
+    std::vector<Json::Value> corpus;
+    corpus.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        Json::Value message;
+        std::string roomId = std::to_string(7312648839118209024ULL + rng() % 5000);
+        int roll = i % 1000 == 0 ? -1 : pick(rng);
+        if (roll < 0) {
+            message["type"] = "auth";
+            message["data"]["userId"] = "user_" + std::to_string(rng() % 100000);
+            message["data"]["username"] = "Player" + std::to_string(rng() % 100000);
+        } else if (roll < 70) {
+            message["type"] = "chat_message";
+            message["data"]["roomId"] = roomId;
+            message["data"]["message"] = std::string(static_cast<std::size_t>(chatLength(rng)), 'x');
+        } else if (roll < 80) {
+            message["type"] = "join_room";
+            message["data"]["roomId"] = roomId;
+        } else if (roll < 90) {
+            message["type"] = "leave_room";
+            message["data"]["roomId"] = roomId;
+        } else if (roll < 95) {
+            message["type"] = "create_room";
+            message["data"]["name"] = "Room " + std::to_string(i);
+            message["data"]["gameType"] = "Generic";
+        } else {
+            message["type"] = "get_rooms";
+        }
+        corpus.push_back(std::move(message));
+    }
+    return corpus;
+}
+
+std::vector<Json::Value> readCorpus(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot read " + path);
+    }
+    std::vector<Json::Value> corpus;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty()) {
+            corpus.push_back(JsonCodec::parse(line.data(), line.data() + line.size(), "Invalid frame in corpus"));
+        }
+    }
+    if (corpus.empty()) {
+        throw std::runtime_error("Empty corpus " + path);
+    }
+    return corpus;
+}
+
+// The same frames with data as an object (current clients) or as a
+// JSON-encoded string (older clients)
+std::vector<std::string> encodeFrames(const std::vector<Json::Value>& corpus, bool dataAsString) {
+    std::vector<std::string> frames;
+    frames.reserve(corpus.size());
+    for (Json::Value message : corpus) {
+        if (message.isMember("data")) {
+            if (dataAsString && message["data"].isObject()) {
+                message["data"] = toText(message["data"]);
+            } else if (!dataAsString && message["data"].isString()) {
+                const char* begin = nullptr;
+                const char* end = nullptr;
+                message["data"].getString(&begin, &end);
+                message["data"] = JsonCodec::parse(begin, end, "Invalid message data");
+            }
+        }
+        frames.push_back(toText(message));
+    }
+    return frames;
+}
+
+const std::unordered_map<std::string_view, int>& handlerTable() {
+    static const std::unordered_map<std::string_view, int> table = {
+        {"auth", 0}, {"create_room", 1}, {"join_room", 2}, {"leave_room", 3}, {"chat_message", 4},
+        {"get_rooms", 5}, {"get_users", 6}, {"quick_match", 7}, {"get_room", 8}};
+    return table;
+}
+
+// What processMessage did before: a builder and reader per parse, the type and
+// data copied out as strings, data parsed again and the type matched in a chain
+int decodeOld(const std::string& frame) {
+    Json::Value root;
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    std::string errors;
+    if (!reader->parse(frame.c_str(), frame.c_str() + frame.length(), &root, &errors)) {
+        throw std::runtime_error("Invalid JSON format");
+    }
+    std::string type = root.get("type", "").asString();
+    std::string data = root.get("data", "").asString();
+
+    Json::Value payload;
+    if (type != "get_rooms" && type != "get_users") {
+        Json::CharReaderBuilder dataBuilder;
+        std::unique_ptr<Json::CharReader> dataReader(dataBuilder.newCharReader());
+        if (!dataReader->parse(data.c_str(), data.c_str() + data.length(), &payload, &errors)) {
+            throw std::runtime_error("Invalid message data");
+        }
+    }
+
+    int handler = -1;
+    if (type == "auth") {
+        handler = 0;
+    } else if (type == "create_room") {
+        handler = 1;
+    } else if (type == "join_room") {
+        handler = 2;
+    } else if (type == "leave_room") {
+        handler = 3;
+    } else if (type == "chat_message") {
+        handler = 4;
+    } else if (type == "get_rooms") {
+        handler = 5;
+    } else if (type == "get_users") {
+        handler = 6;
+    }
+    return handler + static_cast<int>(payload.size());
+}
+
+// The server's path: one parse, the type read in place and a table lookup
+int decodeNew(const std::string& frame) {
+    Json::Value root = JsonCodec::parse(frame.data(), frame.data() + frame.size(), "Invalid JSON format");
+    const auto& table = handlerTable();
+    auto route = table.find(JsonCodec::messageType(root));
+    if (route == table.end()) {
+        throw std::runtime_error("Unknown message type");
+    }
+    Json::Value legacyData;
+    return route->second + static_cast<int>(JsonCodec::messageData(root, legacyData).size());
+}
+
+struct Result {
+    double nsPerMessage = 0;
+    double allocationsPerMessage = 0;
+};
+
+template <typename Decode>
+Result run(const std::vector<std::string>& frames, std::size_t rounds, Decode decode) {
+    Result best;
+    long checksum = 0;
+    for (std::size_t round = 0; round < rounds; ++round) {
+        std::uint64_t allocated = allocations.load(std::memory_order_relaxed);
+        auto started = std::chrono::steady_clock::now();
+        for (const auto& frame : frames) {
+            checksum += decode(frame);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+        double perMessage = ns / static_cast<double>(frames.size());
+        if (round == 0 || perMessage < best.nsPerMessage) {
+            best.nsPerMessage = perMessage;
+        }
+        best.allocationsPerMessage = static_cast<double>(allocations.load(std::memory_order_relaxed) - allocated) /
+                                     static_cast<double>(frames.size());
+    }
+    decodeSink.store(checksum, std::memory_order_relaxed);   // Keeps the decodes from being optimised away
+    return best;
+}
+
+void printRow(const char* name, const Result& result) {
+    std::cout << std::left << std::setw(30) << name << std::right << std::fixed << std::setprecision(0)
+              << std::setw(10) << result.nsPerMessage << std::setw(14) << 1e9 / result.nsPerMessage
+              << std::setprecision(1) << std::setw(10) << result.allocationsPerMessage << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        Options options = parseOptions(argc, argv);
+        std::vector<Json::Value> corpus =
+            options.corpus.empty() ? generateCorpus(options.messages) : readCorpus(options.corpus);
+        std::vector<std::string> objectFrames = encodeFrames(corpus, false);
+        std::vector<std::string> stringFrames = encodeFrames(corpus, true);
+
+        std::size_t bytes = 0;
+        for (const auto& frame : objectFrames) {
+            bytes += frame.size();
+        }
+        std::cout << corpus.size() << " frames, " << bytes / corpus.size() << " B average\n";
+        std::cout << std::left << std::setw(30) << "path" << std::right << std::setw(10) << "ns/msg"
+                  << std::setw(14) << "msgs/s" << std::setw(10) << "allocs" << std::endl;
+        printRow("reader per parse, string data", run(stringFrames, options.rounds, decodeOld));
+        printRow("JsonCodec, object data", run(objectFrames, options.rounds, decodeNew));
+        printRow("JsonCodec, string data", run(stringFrames, options.rounds, decodeNew));
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Decode benchmark error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,114 @@
+// Mass disconnect: fills rooms with users on the in-memory database, then
+// removes every user and reports how long the cleanup took. removeUser finds
+// a user's rooms through the membership index, so the cost should track the
+// number of users, not users x rooms.
+//
+//   LobbyDisconnectBench --users 50000 --room-size 4 --threads 1
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "in_memory_database.hpp"
+#include "logger.hpp"
+#include "room_manager.hpp"
+
+namespace {
+
+struct Options {
+    std::size_t users = 50000;
+    std::size_t roomSize = 4;    // Players per room; the first creates it
+    std::size_t threads = 1;     // Threads removing users
+};
+
+void printUsage() {
+    std::cout << "Usage: LobbyDisconnectBench [options]\n"
+              << "  --users N            Users to connect and drop (default 50000)\n"
+              << "  --room-size N        Players per room, at most 4 (default 4)\n"
+              << "  --threads N          Threads removing users (default 1)\n";
+}
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--help" || flag == "-h") {
+            printUsage();
+            std::exit(0);
+        }
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for " + flag);
+        }
+        std::string value = argv[++i];
+        if (flag == "--users") {
+            options.users = std::max(1UL, std::stoul(value));
+        } else if (flag == "--room-size") {
+            options.roomSize = std::min(4UL, std::max(1UL, std::stoul(value)));
+        } else if (flag == "--threads") {
+            options.threads = std::max(1UL, std::stoul(value));
+        } else {
+            throw std::runtime_error("Unknown option: " + flag);
+        }
+    }
+    return options;
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point started) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        Options options = parseOptions(argc, argv);
+        Logger::instance().setLevel(LogLevel::Warn);
+        RoomManager manager(std::make_shared<InMemoryDatabase>("memory://"));
+
+        auto started = std::chrono::steady_clock::now();
+        std::vector<std::string> userIds;
+        userIds.reserve(options.users);
+        std::string roomId;
+        for (std::size_t i = 0; i < options.users; ++i) {
+            userIds.push_back("user_" + std::to_string(i));
+            manager.addUser(User(userIds.back(), "Player" + std::to_string(i)));
+            if (i % options.roomSize == 0) {
+                roomId = manager.createRoom("Room " + std::to_string(i), userIds.back());
+            } else {
+                manager.joinRoom(roomId, userIds.back());
+            }
+        }
+        std::size_t rooms = manager.getAllRooms()->size();
+        std::cout << "Connected " << options.users << " users in " << rooms << " rooms in " << std::fixed
+                  << std::setprecision(0) << millisecondsSince(started) << " ms" << std::endl;
+
+        started = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (std::size_t t = 0; t < options.threads; ++t) {
+            threads.emplace_back([&, t]() {
+                for (std::size_t i = t; i < userIds.size(); i += options.threads) {
+                    manager.removeUser(userIds[i]);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        double dropMs = millisecondsSince(started);
+
+        std::size_t roomsLeft = manager.getAllRooms()->size();
+        std::cout << "Dropped every user in " << std::setprecision(1) << dropMs << " ms ("
+                  << std::setprecision(2) << dropMs * 1000.0 / static_cast<double>(options.users)
+                  << " us per user) with " << options.threads << " thread(s); rooms left: " << roomsLeft
+                  << std::endl;
+        manager.shutdown();
+        return roomsLeft == 0 ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Disconnect benchmark error: " << e.what() << std::endl;
+        return 1;
+    }
+}
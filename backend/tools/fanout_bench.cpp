@@ -0,0 +1,175 @@
+// Broadcast framing cost: one payload sent to N recipients, framed per
+// recipient (what connection::send(string) does) against framed once by
+// FrameEncoder and shared. Reports time per fan-out and the frame bytes held
+// by the recipients' queues.
+//
+//   LobbyFanoutBench --recipients 1000,10000,50000 --payload-bytes 200 --rounds 20
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/server.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "frame_encoder.hpp"
+
+namespace {
+
+typedef websocketpp::config::asio config;
+typedef config::message_type::ptr message_ptr;
+
+struct Options {
+    std::vector<std::size_t> recipients = {1000, 10000, 50000};
+    std::size_t payloadBytes = 200;   // About one room_update
+    std::size_t rounds = 20;
+};
+
+void printUsage() {
+    std::cout << "Usage: LobbyFanoutBench [options]\n"
+              << "  --recipients LIST    Fan-out sizes (default 1000,10000,50000)\n"
+              << "  --payload-bytes N    Message size (default 200)\n"
+              << "  --rounds N           Fan-outs per size; the median is reported (default 20)\n";
+}
+
+std::vector<std::size_t> parseList(const std::string& list) {
+    std::vector<std::size_t> values;
+    std::size_t start = 0;
+    while (start < list.size()) {
+        std::size_t end = list.find(',', start);
+        values.push_back(std::stoul(list.substr(start, end == std::string::npos ? std::string::npos : end - start)));
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+    return values;
+}
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--help" || flag == "-h") {
+            printUsage();
+            std::exit(0);
+        }
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for " + flag);
+        }
+        std::string value = argv[++i];
+        if (flag == "--recipients") {
+            options.recipients = parseList(value);
+        } else if (flag == "--payload-bytes") {
+            options.payloadBytes = std::max(1UL, std::stoul(value));
+        } else if (flag == "--rounds") {
+            options.rounds = std::max(1UL, std::stoul(value));
+        } else {
+            throw std::runtime_error("Unknown option: " + flag);
+        }
+    }
+    return options;
+}
+
+// A JSON text of the requested size, shaped like a room update
+std::string makePayload(std::size_t bytes) {
+    std::string payload = "{\"type\":\"room_update\",\"room\":{\"id\":\"7312648839118209024\",\"players\":[\"";
+    while (payload.size() + 4 < bytes) {
+        payload += static_cast<char>('a' + payload.size() % 26);
+    }
+    payload += "\"]}}";
+    return payload;
+}
+
+std::size_t frameBytes(const message_ptr& frame) {
+    return frame->get_header().size() + frame->get_payload().size();
+}
+
+struct Result {
+    double medianMs = 0;
+    std::size_t heldBytes = 0;   // Frame bytes referenced by all queues, each buffer counted once
+};
+
+double medianOf(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+// Each recipient gets its own message: payload copy, header build and frame
+Result perRecipient(const std::string& payload, std::size_t recipients, std::size_t rounds) {
+    auto manager = std::make_shared<config::con_msg_manager_type>();
+    config::rng_type rng;
+    websocketpp::processor::hybi13<config> processor(false, true, manager, rng);
+    std::vector<std::vector<message_ptr>> queues(recipients);
+    std::vector<double> samples;
+    Result result;
+    for (std::size_t round = 0; round < rounds; ++round) {
+        auto started = std::chrono::steady_clock::now();
+        for (auto& queue : queues) {
+            message_ptr in = manager->get_message(websocketpp::frame::opcode::text, payload.size());
+            message_ptr out = manager->get_message(websocketpp::frame::opcode::text, payload.size());
+            in->set_payload(payload);
+            processor.prepare_data_frame(in, out);
+            queue.push_back(out);
+        }
+        samples.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count());
+        result.heldBytes = 0;
+        for (auto& queue : queues) {
+            result.heldBytes += frameBytes(queue.back());
+            queue.clear();
+        }
+    }
+    result.medianMs = medianOf(samples);
+    return result;
+}
+
+// One frame built by FrameEncoder, shared by every recipient
+Result shared(const std::string& payload, std::size_t recipients, std::size_t rounds) {
+    CompressionOptions compression;
+    compression.enabled = false;
+    FrameEncoder<config> encoder(compression);
+    std::vector<std::vector<message_ptr>> queues(recipients);
+    std::vector<double> samples;
+    Result result;
+    for (std::size_t round = 0; round < rounds; ++round) {
+        auto started = std::chrono::steady_clock::now();
+        message_ptr frame = encoder.encode(payload);
+        for (auto& queue : queues) {
+            queue.push_back(frame);
+        }
+        samples.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count());
+        result.heldBytes = frameBytes(frame);
+        for (auto& queue : queues) {
+            queue.clear();
+        }
+    }
+    result.medianMs = medianOf(samples);
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        Options options = parseOptions(argc, argv);
+        std::string payload = makePayload(options.payloadBytes);
+        std::cout << "Payload " << payload.size() << " B, median of " << options.rounds << " fan-outs\n";
+        std::cout << std::left << std::setw(12) << "recipients" << std::right << std::setw(16) << "per-recip ms"
+                  << std::setw(12) << "shared ms" << std::setw(10) << "speedup" << std::setw(16) << "per-recip KB"
+                  << std::setw(12) << "shared KB" << std::endl;
+        for (std::size_t recipients : options.recipients) {
+            Result before = perRecipient(payload, recipients, options.rounds);
+            Result after = shared(payload, recipients, options.rounds);
+            std::cout << std::left << std::setw(12) << recipients << std::right << std::fixed << std::setprecision(3)
+                      << std::setw(16) << before.medianMs << std::setw(12) << after.medianMs << std::setprecision(1)
+                      << std::setw(9) << (after.medianMs > 0 ? before.medianMs / after.medianMs : 0) << "x"
+                      << std::setw(16) << before.heldBytes / 1024.0 << std::setw(12) << after.heldBytes / 1024.0
+                      << std::endl;
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Fan-out benchmark error: " << e.what() << std::endl;
+        return 1;
+    }
+}
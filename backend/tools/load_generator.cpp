@@ -0,0 +1,633 @@
+// Load generator for the lobby server. Opens many concurrent WebSocket
+// connections, each running a scripted user session (auth, then a weighted
+// mix of create/join/leave/chat/listing requests with one request in flight),
+// and reports per-request latency percentiles and message rates.
+//
+//   LobbyLoadGenerator --url ws://localhost:9002 --users 2000 --duration 60
+//       --mix chat=70,join=10,leave=10,create=5,rooms=5 --output results.json
+//
+// Start the server with MONGODB_URI=memory:// to keep MongoDB out of the
+// measurement, or point it at a local mongod to include it.
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/client.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <json/json.h>
+#include "metrics.hpp"
+
+typedef websocketpp::client<websocketpp::config::asio_client> client;
+using websocketpp::connection_hdl;
+
+namespace {
+
+enum class Action { Auth, CreateRoom, JoinRoom, LeaveRoom, Chat, GetRooms, Count };
+
+const std::array<const char*, static_cast<std::size_t>(Action::Count)> kActionNames = {
+    "auth", "create", "join", "leave", "chat", "rooms"};
+
+std::size_t indexOf(Action action) {
+    return static_cast<std::size_t>(action);
+}
+
+struct Options {
+    std::string url = "ws://localhost:9002";
+    std::size_t users = 1000;
+    std::size_t threads = 0;        // 0 means one per hardware thread
+    long connectRate = 500;         // New connections per second
+    long warmupSeconds = 5;         // Excluded from the results
+    long durationSeconds = 30;
+    long thinkMs = 100;             // Pause between a response and the next request
+    long requestTimeoutMs = 5000;
+    std::array<unsigned, static_cast<std::size_t>(Action::Count)> mix = {0, 5, 10, 10, 70, 5};
+    std::string output;             // JSON results file
+    std::string label;              // Copied into the results, e.g. a commit hash
+};
+
+void printUsage() {
+    std::cout << "Usage: LobbyLoadGenerator [options]\n"
+              << "  --url URL            Server to load (default ws://localhost:9002)\n"
+              << "  --users N            Concurrent simulated users (default 1000)\n"
+              << "  --threads N          Client I/O threads (default: hardware threads)\n"
+              << "  --connect-rate N     Connections opened per second (default 500)\n"
+              << "  --warmup S           Seconds before measuring (default 5)\n"
+              << "  --duration S         Seconds measured (default 30)\n"
+              << "  --think-ms MS        Pause between requests per user (default 100)\n"
+              << "  --timeout-ms MS      Request timeout (default 5000)\n"
+              << "  --mix SPEC           Weights, e.g. chat=70,join=10,leave=10,create=5,rooms=5\n"
+              << "  --output FILE        Write results as JSON\n"
+              << "  --label TEXT         Label stored in the results\n";
+}
+
+void parseMix(const std::string& spec, Options& options) {
+    options.mix.fill(0);
+    std::size_t start = 0;
+    while (start < spec.size()) {
+        std::size_t end = spec.find(',', start);
+        std::string item = spec.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        std::size_t equals = item.find('=');
+        std::string name = item.substr(0, equals);
+        auto found = std::find(kActionNames.begin(), kActionNames.end(), name);
+        if (equals == std::string::npos || found == kActionNames.end() || name == "auth") {
+            throw std::runtime_error("Invalid mix entry: " + item);
+        }
+        options.mix[static_cast<std::size_t>(found - kActionNames.begin())] =
+            static_cast<unsigned>(std::stoul(item.substr(equals + 1)));
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+}
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--help" || flag == "-h") {
+            printUsage();
+            std::exit(0);
+        }
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for " + flag);
+        }
+        std::string value = argv[++i];
+        if (flag == "--url") {
+            options.url = value;
+        } else if (flag == "--users") {
+            options.users = std::stoul(value);
+        } else if (flag == "--threads") {
+            options.threads = std::stoul(value);
+        } else if (flag == "--connect-rate") {
+            options.connectRate = std::max(1L, std::stol(value));
+        } else if (flag == "--warmup") {
+            options.warmupSeconds = std::max(0L, std::stol(value));
+        } else if (flag == "--duration") {
+            options.durationSeconds = std::max(1L, std::stol(value));
+        } else if (flag == "--think-ms") {
+            options.thinkMs = std::max(0L, std::stol(value));
+        } else if (flag == "--timeout-ms") {
+            options.requestTimeoutMs = std::max(1L, std::stol(value));
+        } else if (flag == "--mix") {
+            parseMix(value, options);
+        } else if (flag == "--output") {
+            options.output = value;
+        } else if (flag == "--label") {
+            options.label = value;
+        } else {
+            throw std::runtime_error("Unknown option: " + flag);
+        }
+    }
+    return options;
+}
+
+// One simulated user. Timer and message callbacks for the same user can run
+// on different I/O threads, so its state is guarded by its own mutex.
+struct SimUser {
+    std::mutex mutex;
+    std::string userId;
+    connection_hdl hdl;
+    bool open = false;
+    bool authenticated = false;
+    std::string roomId;             // Room the user is in; empty in the lobby
+    std::string requestedRoom;      // Target of an outstanding join
+    bool waiting = false;
+    Action pending = Action::Auth;
+    std::uint64_t sequence = 0;     // Identifies the outstanding request for its timeout
+    std::chrono::steady_clock::time_point sentAt;
+    std::mt19937 rng;
+
+    SimUser(std::string id, unsigned seed) : userId(std::move(id)), rng(seed) {}
+};
+
+struct ActionStats {
+    Histogram latency;              // Nanoseconds, request to matching response
+    Counter completed;
+    Counter failed;                 // Answered with an error
+    Counter timedOut;
+};
+
+class LoadGenerator {
+public:
+    explicit LoadGenerator(const Options& opts) : options(opts) {
+        endpoint.clear_access_channels(websocketpp::log::alevel::all);
+        endpoint.clear_error_channels(websocketpp::log::elevel::all);
+        endpoint.init_asio();
+
+        std::string runId = std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+        std::random_device seeds;
+        users.reserve(options.users);
+        for (std::size_t i = 0; i < options.users; ++i) {
+            users.push_back(std::make_unique<SimUser>("load_" + runId + "_" + std::to_string(i), seeds()));
+        }
+
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        writer.reset(builder.newStreamWriter());
+    }
+
+    int run();
+
+private:
+    Options options;
+    client endpoint;
+    std::vector<std::unique_ptr<SimUser>> users;
+    std::vector<std::thread> threads;
+    std::atomic<bool> running{true};
+    std::atomic<bool> measuring{false};
+
+    std::mutex writerMutex;
+    std::unique_ptr<Json::StreamWriter> writer;
+
+    // Rooms that users may try to join, refreshed from room listings
+    std::mutex roomsMutex;
+    std::vector<std::string> knownRooms;
+
+    std::array<ActionStats, static_cast<std::size_t>(Action::Count)> stats;
+    Counter messagesReceived;       // Every frame, including fan-out from other users
+    Counter bytesReceived;
+    std::atomic<std::size_t> connected{0};
+    std::atomic<std::size_t> nextToConnect{0};
+    Counter connectFailures;
+    Counter disconnects;
+
+    void scheduleConnects();
+    void connectUser(SimUser& user);
+    void onOpen(SimUser& user, connection_hdl hdl);
+    void onFail(SimUser& user);
+    void onClose(SimUser& user);
+    void onMessage(SimUser& user, client::message_ptr msg);
+
+    void scheduleNext(SimUser& user);
+    void nextRequest(SimUser& user);
+    // Caller holds user.mutex
+    void send(SimUser& user, Action action, const Json::Value& data);
+    void complete(SimUser& user, bool failed);
+    Action chooseAction(SimUser& user);
+    bool pickRoom(SimUser& user, std::string& roomId);
+    void forgetRoom(const std::string& roomId);
+    void refreshRooms(const Json::Value& rooms);
+
+    Json::Value report(double seconds);
+};
+
+void LoadGenerator::scheduleConnects() {
+    // Opens connections in 10ms batches to hold the configured rate
+    std::size_t batch = std::max<std::size_t>(1, static_cast<std::size_t>(options.connectRate / 100));
+    for (std::size_t i = 0; i < batch && running; ++i) {
+        std::size_t index = nextToConnect.fetch_add(1);
+        if (index >= users.size()) {
+            return;
+        }
+        connectUser(*users[index]);
+    }
+    endpoint.set_timer(10, [this](const websocketpp::lib::error_code& ec) {
+        if (!ec && running) {
+            scheduleConnects();
+        }
+    });
+}
+
+void LoadGenerator::connectUser(SimUser& user) {
+    websocketpp::lib::error_code ec;
+    client::connection_ptr con = endpoint.get_connection(options.url, ec);
+    if (ec) {
+        connectFailures.add();
+        return;
+    }
+    con->add_subprotocol("lobby.json.v1");
+    con->set_open_handler([this, &user](connection_hdl hdl) { onOpen(user, hdl); });
+    con->set_fail_handler([this, &user](connection_hdl) { onFail(user); });
+    con->set_close_handler([this, &user](connection_hdl) { onClose(user); });
+    con->set_message_handler([this, &user](connection_hdl, client::message_ptr msg) { onMessage(user, msg); });
+    endpoint.connect(con);
+}
+
+void LoadGenerator::onOpen(SimUser& user, connection_hdl hdl) {
+    connected.fetch_add(1);
+    std::lock_guard<std::mutex> lock(user.mutex);
+    user.hdl = hdl;
+    user.open = true;
+
+    Json::Value data;
+    data["userId"] = user.userId;
+    data["username"] = user.userId;
+    send(user, Action::Auth, data);
+}
+
+void LoadGenerator::onFail(SimUser&) {
+    connectFailures.add();
+}
+
+void LoadGenerator::onClose(SimUser& user) {
+    std::lock_guard<std::mutex> lock(user.mutex);
+    if (user.open) {
+        connected.fetch_sub(1);
+        if (running) {
+            disconnects.add();
+        }
+    }
+    user.open = false;
+    user.waiting = false;
+}
+
+void LoadGenerator::onMessage(SimUser& user, client::message_ptr msg) {
+    const std::string& payload = msg->get_payload();
+    messagesReceived.add();
+    bytesReceived.add(payload.size());
+
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    Json::Value message;
+    if (!reader->parse(payload.data(), payload.data() + payload.size(), &message, nullptr)) {
+        return;
+    }
+    std::string type = message.get("type", "").asString();
+
+    if (type == "room_update" && message.isMember("rooms")) {
+        refreshRooms(message["rooms"]);
+    }
+
+    std::lock_guard<std::mutex> lock(user.mutex);
+    if (!user.waiting) {
+        return;
+    }
+
+    // Match the outstanding request's answer among fan-out from other users
+    switch (user.pending) {
+        case Action::Auth:
+            if (type != "auth_success") break;
+            user.authenticated = true;
+            complete(user, false);
+            return;
+        case Action::CreateRoom:
+            if (type != "room_created") break;
+            user.roomId = message.get("roomId", "").asString();
+            {
+                std::lock_guard<std::mutex> roomsLock(roomsMutex);
+                knownRooms.push_back(user.roomId);
+            }
+            complete(user, false);
+            return;
+        case Action::JoinRoom:
+            if (type != "room_joined" || message.get("roomId", "").asString() != user.requestedRoom) break;
+            user.roomId = user.requestedRoom;
+            complete(user, false);
+            return;
+        case Action::LeaveRoom:
+            if (type != "room_left") break;
+            user.roomId.clear();
+            complete(user, false);
+            return;
+        case Action::Chat:
+            if (type != "chat_message" || message.get("userId", "").asString() != user.userId) break;
+            complete(user, false);
+            return;
+        case Action::GetRooms:
+            if (type != "room_update" || !message.isMember("rooms")) break;
+            complete(user, false);
+            return;
+        case Action::Count:
+            break;
+    }
+
+    if (type == "error") {
+        if (user.pending == Action::JoinRoom) {
+            // Full or already gone; stop offering it
+            forgetRoom(user.requestedRoom);
+        } else if (user.pending == Action::Chat || user.pending == Action::LeaveRoom) {
+            user.roomId.clear();   // The room went away underneath us
+        }
+        complete(user, true);
+    }
+}
+
+void LoadGenerator::complete(SimUser& user, bool failed) {
+    ActionStats& actionStats = stats[indexOf(user.pending)];
+    if (measuring) {
+        if (failed) {
+            actionStats.failed.add();
+        } else {
+            actionStats.latency.record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - user.sentAt).count()));
+            actionStats.completed.add();
+        }
+    }
+    user.waiting = false;
+    if (user.authenticated) {
+        scheduleNext(user);
+    }
+}
+
+void LoadGenerator::scheduleNext(SimUser& user) {
+    endpoint.set_timer(options.thinkMs, [this, &user](const websocketpp::lib::error_code& ec) {
+        if (!ec && running) {
+            nextRequest(user);
+        }
+    });
+}
+
+void LoadGenerator::nextRequest(SimUser& user) {
+    std::lock_guard<std::mutex> lock(user.mutex);
+    if (!user.open || user.waiting) {
+        return;
+    }
+
+    Action action = chooseAction(user);
+    Json::Value data(Json::objectValue);
+    switch (action) {
+        case Action::CreateRoom:
+            data["name"] = "Load " + user.userId;
+            data["gameType"] = "Generic";
+            break;
+        case Action::JoinRoom:
+            data["roomId"] = user.requestedRoom;
+            break;
+        case Action::LeaveRoom:
+            data["roomId"] = user.roomId;
+            break;
+        case Action::Chat:
+            data["roomId"] = user.roomId;
+            data["message"] = "load test message " + std::to_string(user.sequence);
+            break;
+        default:
+            break;
+    }
+    send(user, action, data);
+}
+
+Action LoadGenerator::chooseAction(SimUser& user) {
+    unsigned total = 0;
+    for (unsigned weight : options.mix) {
+        total += weight;
+    }
+    Action action = Action::GetRooms;
+    if (total > 0) {
+        unsigned roll = std::uniform_int_distribution<unsigned>(0, total - 1)(user.rng);
+        for (std::size_t i = 0; i < options.mix.size(); ++i) {
+            if (roll < options.mix[i]) {
+                action = static_cast<Action>(i);
+                break;
+            }
+            roll -= options.mix[i];
+        }
+    }
+
+    // Steer the pick toward something valid in the user's current state
+    bool inRoom = !user.roomId.empty();
+    if (inRoom && (action == Action::CreateRoom || action == Action::JoinRoom)) {
+        return Action::LeaveRoom;
+    }
+    if (!inRoom && (action == Action::Chat || action == Action::LeaveRoom || action == Action::JoinRoom)) {
+        return pickRoom(user, user.requestedRoom) ? Action::JoinRoom : Action::CreateRoom;
+    }
+    return action;
+}
+
+bool LoadGenerator::pickRoom(SimUser& user, std::string& roomId) {
+    std::lock_guard<std::mutex> lock(roomsMutex);
+    if (knownRooms.empty()) {
+        return false;
+    }
+    roomId = knownRooms[std::uniform_int_distribution<std::size_t>(0, knownRooms.size() - 1)(user.rng)];
+    return true;
+}
+
+void LoadGenerator::forgetRoom(const std::string& roomId) {
+    std::lock_guard<std::mutex> lock(roomsMutex);
+    auto it = std::find(knownRooms.begin(), knownRooms.end(), roomId);
+    if (it != knownRooms.end()) {
+        *it = std::move(knownRooms.back());
+        knownRooms.pop_back();
+    }
+}
+
+void LoadGenerator::refreshRooms(const Json::Value& rooms) {
+    std::vector<std::string> open;
+    for (const auto& room : rooms) {
+        if (room["players"].size() < room.get("maxPlayers", 0).asUInt()) {
+            open.push_back(room["id"].asString());
+        }
+    }
+    std::lock_guard<std::mutex> lock(roomsMutex);
+    knownRooms.swap(open);
+}
+
+void LoadGenerator::send(SimUser& user, Action action, const Json::Value& data) {
+    Json::Value request;
+    request["type"] = action == Action::CreateRoom ? "create_room"
+                    : action == Action::JoinRoom ? "join_room"
+                    : action == Action::LeaveRoom ? "leave_room"
+                    : action == Action::Chat ? "chat_message"
+                    : action == Action::GetRooms ? "get_rooms" : "auth";
+    request["data"] = data;
+
+    std::string payload;
+    {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        std::ostringstream out;
+        writer->write(request, &out);
+        payload = out.str();
+    }
+
+    user.pending = action;
+    user.waiting = true;
+    user.sentAt = std::chrono::steady_clock::now();
+    std::uint64_t sequence = ++user.sequence;
+
+    websocketpp::lib::error_code ec;
+    endpoint.send(user.hdl, payload, websocketpp::frame::opcode::text, ec);
+    if (ec) {
+        user.waiting = false;
+        return;
+    }
+
+    endpoint.set_timer(options.requestTimeoutMs, [this, &user, sequence](const websocketpp::lib::error_code& timerEc) {
+        if (timerEc) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(user.mutex);
+        if (!user.waiting || user.sequence != sequence) {
+            return;
+        }
+        if (measuring) {
+            stats[indexOf(user.pending)].timedOut.add();
+        }
+        user.waiting = false;
+        if (user.open && user.authenticated && running) {
+            scheduleNext(user);
+        }
+    });
+}
+
+Json::Value LoadGenerator::report(double seconds) {
+    Json::Value results;
+    results["label"] = options.label;
+    results["url"] = options.url;
+    results["users"] = static_cast<Json::UInt64>(options.users);
+    results["connected"] = static_cast<Json::UInt64>(connected.load());
+    results["connectFailures"] = static_cast<Json::UInt64>(connectFailures.value());
+    results["disconnects"] = static_cast<Json::UInt64>(disconnects.value());
+    results["durationSeconds"] = seconds;
+    results["thinkMs"] = static_cast<Json::Int64>(options.thinkMs);
+
+    std::uint64_t totalCompleted = 0;
+    std::cout << std::left << std::setw(8) << "action" << std::right << std::setw(10) << "ok"
+              << std::setw(8) << "failed" << std::setw(9) << "timeout" << std::setw(10) << "p50 ms"
+              << std::setw(10) << "p99 ms" << std::setw(10) << "p999 ms" << std::setw(10) << "mean ms" << std::endl;
+    for (std::size_t i = 0; i < stats.size(); ++i) {
+        Histogram::Snapshot latency = stats[i].latency.snapshot();
+        double mean = latency.count > 0 ? static_cast<double>(latency.sum) / static_cast<double>(latency.count) : 0;
+        Json::Value action;
+        action["completed"] = static_cast<Json::UInt64>(stats[i].completed.value());
+        action["failed"] = static_cast<Json::UInt64>(stats[i].failed.value());
+        action["timedOut"] = static_cast<Json::UInt64>(stats[i].timedOut.value());
+        action["p50Us"] = static_cast<double>(latency.percentile(0.5)) / 1e3;
+        action["p99Us"] = static_cast<double>(latency.percentile(0.99)) / 1e3;
+        action["p999Us"] = static_cast<double>(latency.percentile(0.999)) / 1e3;
+        action["meanUs"] = mean / 1e3;
+        results["actions"][kActionNames[i]] = action;
+        totalCompleted += stats[i].completed.value();
+
+        std::cout << std::left << std::setw(8) << kActionNames[i] << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << stats[i].completed.value() << std::setw(8) << stats[i].failed.value()
+                  << std::setw(9) << stats[i].timedOut.value()
+                  << std::setw(10) << static_cast<double>(latency.percentile(0.5)) / 1e6
+                  << std::setw(10) << static_cast<double>(latency.percentile(0.99)) / 1e6
+                  << std::setw(10) << static_cast<double>(latency.percentile(0.999)) / 1e6
+                  << std::setw(10) << mean / 1e6 << std::endl;
+    }
+
+    // Received counts include the warmup; rates use the measured window only
+    results["requestsPerSecond"] = static_cast<double>(totalCompleted) / seconds;
+    results["messagesReceived"] = static_cast<Json::UInt64>(messagesReceived.value());
+    results["bytesReceived"] = static_cast<Json::UInt64>(bytesReceived.value());
+    std::cout << "Requests/sec: " << static_cast<double>(totalCompleted) / seconds
+              << ", connected " << connected.load() << "/" << options.users
+              << " (" << connectFailures.value() << " failed, " << disconnects.value() << " dropped)" << std::endl;
+    return results;
+}
+
+int LoadGenerator::run() {
+    endpoint.start_perpetual();
+    std::size_t threadCount = options.threads > 0 ? options.threads
+                                                  : std::max(1u, std::thread::hardware_concurrency());
+    for (std::size_t i = 0; i < threadCount; ++i) {
+        threads.emplace_back([this]() { endpoint.run(); });
+    }
+    endpoint.set_timer(0, [this](const websocketpp::lib::error_code& ec) {
+        if (!ec) {
+            scheduleConnects();
+        }
+    });
+
+    std::cout << "Connecting " << options.users << " users to " << options.url << " with "
+              << threadCount << " threads" << std::endl;
+    std::this_thread::sleep_for(std::chrono::seconds(options.warmupSeconds));
+
+    std::uint64_t receivedBefore = messagesReceived.value();
+    measuring = true;
+    auto started = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(options.durationSeconds));
+    measuring = false;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::uint64_t receivedDuring = messagesReceived.value() - receivedBefore;
+
+    Json::Value results = report(seconds);
+    results["messagesReceivedPerSecond"] = static_cast<double>(receivedDuring) / seconds;
+    std::cout << "Messages received/sec: " << static_cast<double>(receivedDuring) / seconds << std::endl;
+
+    running = false;
+    for (auto& user : users) {
+        std::lock_guard<std::mutex> lock(user->mutex);
+        if (user->open) {
+            websocketpp::lib::error_code ec;
+            endpoint.close(user->hdl, websocketpp::close::status::going_away, "Load test finished", ec);
+        }
+    }
+    endpoint.stop_perpetual();
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    endpoint.stop();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (!options.output.empty()) {
+        std::ofstream file(options.output);
+        if (!file) {
+            std::cerr << "Cannot write " << options.output << std::endl;
+            return 1;
+        }
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "  ";
+        file << Json::writeString(builder, results) << std::endl;
+        std::cout << "Results written to " << options.output << std::endl;
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        Options options = parseOptions(argc, argv);
+        LoadGenerator generator(options);
+        return generator.run();
+    } catch (const std::exception& e) {
+        std::cerr << "Load generator error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,138 @@
+// Quick-match placement against a large lobby. Creates open rooms (each with
+// its host) spread over a few game types on the in-memory database, then
+// places players through RoomManager::matchPlayers in per-tick batches, the
+// way the server's matchmaking tick does, and times a findAvailableRooms
+// listing.
+//
+//   LobbyMatchmakingBench --rooms 100000 --players 20000 --batch 100 --game-types 4
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "in_memory_database.hpp"
+#include "logger.hpp"
+#include "room_manager.hpp"
+
+namespace {
+
+struct Options {
+    std::size_t rooms = 100000;
+    std::size_t players = 20000;
+    std::size_t batch = 100;       // Players queued in one matchmaking tick
+    std::size_t gameTypes = 4;
+};
+
+void printUsage() {
+    std::cout << "Usage: LobbyMatchmakingBench [options]\n"
+              << "  --rooms N            Open rooms created up front (default 100000)\n"
+              << "  --players N          Players to place (default 20000)\n"
+              << "  --batch N            Players placed per matchPlayers call (default 100)\n"
+              << "  --game-types N       Game types the rooms and players are spread over (default 4)\n";
+}
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--help" || flag == "-h") {
+            printUsage();
+            std::exit(0);
+        }
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for " + flag);
+        }
+        std::string value = argv[++i];
+        if (flag == "--rooms") {
+            options.rooms = std::stoul(value);
+        } else if (flag == "--players") {
+            options.players = std::max(1UL, std::stoul(value));
+        } else if (flag == "--batch") {
+            options.batch = std::max(1UL, std::stoul(value));
+        } else if (flag == "--game-types") {
+            options.gameTypes = std::max(1UL, std::stoul(value));
+        } else {
+            throw std::runtime_error("Unknown option: " + flag);
+        }
+    }
+    return options;
+}
+
+std::string gameType(std::size_t i, std::size_t gameTypes) {
+    return "Game" + std::to_string(i % gameTypes);
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point started) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        Options options = parseOptions(argc, argv);
+        Logger::instance().setLevel(LogLevel::Warn);
+        RoomManager manager(std::make_shared<InMemoryDatabase>("memory://"));
+
+        auto started = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < options.rooms; ++i) {
+            std::string hostId = "host_" + std::to_string(i);
+            manager.addUser(User(hostId, "Host" + std::to_string(i)));
+            manager.createRoom("Room " + std::to_string(i), hostId, gameType(i, options.gameTypes));
+        }
+        std::vector<std::string> playerIds;
+        playerIds.reserve(options.players);
+        for (std::size_t i = 0; i < options.players; ++i) {
+            playerIds.push_back("player_" + std::to_string(i));
+            manager.addUser(User(playerIds.back(), "Player" + std::to_string(i)));
+        }
+        std::cout << options.rooms << " open rooms over " << options.gameTypes << " game types set up in "
+                  << std::fixed << std::setprecision(0) << millisecondsSince(started) << " ms" << std::endl;
+
+        started = std::chrono::steady_clock::now();
+        std::vector<double> batchMs;
+        std::unordered_set<std::string> roomsUsed;
+        std::size_t placed = 0;
+        std::size_t perTick = options.batch * options.gameTypes;
+        for (std::size_t first = 0; first < playerIds.size(); first += perTick) {
+            // One tick: a batch of queued players per game type
+            std::size_t end = std::min(playerIds.size(), first + perTick);
+            for (std::size_t type = 0; type < options.gameTypes; ++type) {
+                std::vector<std::string> queued;
+                for (std::size_t i = first + type; i < end; i += options.gameTypes) {
+                    queued.push_back(playerIds[i]);
+                }
+                if (queued.empty()) {
+                    continue;
+                }
+                auto batchStarted = std::chrono::steady_clock::now();
+                for (const auto& roomId : manager.matchPlayers(queued, gameType(type, options.gameTypes))) {
+                    placed += roomId.empty() ? 0 : 1;
+                    roomsUsed.insert(roomId);
+                }
+                batchMs.push_back(millisecondsSince(batchStarted));
+            }
+        }
+        double totalMs = millisecondsSince(started);
+        std::sort(batchMs.begin(), batchMs.end());
+        std::cout << "Placed " << placed << "/" << options.players << " players into " << roomsUsed.size()
+                  << " rooms in " << std::setprecision(1) << totalMs << " ms (" << std::setprecision(2)
+                  << totalMs * 1000.0 / static_cast<double>(options.players) << " us each); batch of "
+                  << options.batch << " p50 " << batchMs[batchMs.size() / 2] << " ms, max " << batchMs.back()
+                  << " ms" << std::endl;
+
+        started = std::chrono::steady_clock::now();
+        std::size_t listed = manager.findAvailableRooms(gameType(0, options.gameTypes)).size();
+        std::cout << "findAvailableRooms listed " << listed << " open rooms in " << std::setprecision(1)
+                  << millisecondsSince(started) << " ms" << std::endl;
+        manager.shutdown();
+        return placed == options.players ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Matchmaking benchmark error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,200 @@
+// Heap held per connected session. Counts live heap bytes around a
+// RoomManager holding N users in rooms, with a database that discards writes
+// so only the lobby's own state is measured, then again while listing
+// snapshots of every room and user are held, as they are between changes.
+//
+//   LobbySessionMemory --users 100000 --room-size 4
+#include <malloc.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "in_memory_database.hpp"
+#include "logger.hpp"
+#include "room_manager.hpp"
+
+namespace {
+
+// Usable size of every live block, so frees subtract what allocations added
+std::atomic<std::int64_t> liveBytes{0};
+
+const std::size_t kDefaultAlignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+// Every replaced operator new below allocates here and every operator delete
+// frees through release(), so the array, sized, aligned and nothrow forms all
+// pair with each other and are all counted
+void* allocate(std::size_t size, std::size_t alignment) noexcept {
+    size = size ? size : 1;
+    void* block = alignment <= kDefaultAlignment
+        ? std::malloc(size)
+        : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if (block) {
+        liveBytes.fetch_add(static_cast<std::int64_t>(malloc_usable_size(block)), std::memory_order_relaxed);
+    }
+    return block;
+}
+
+void* allocateOrThrow(std::size_t size, std::size_t alignment) {
+    if (void* block = allocate(size, alignment)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+// Out of line: inlined into a delete expression, GCC pairs the free() with
+// the new expression and reports -Wmismatched-new-delete
+[[gnu::noinline]] void release(void* block) noexcept {
+    if (block) {
+        liveBytes.fetch_sub(static_cast<std::int64_t>(malloc_usable_size(block)), std::memory_order_relaxed);
+        std::free(block);
+    }
+}
+
+} // namespace
+
+void* operator new(std::size_t size) { return allocateOrThrow(size, kDefaultAlignment); }
+void* operator new[](std::size_t size) { return allocateOrThrow(size, kDefaultAlignment); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return allocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return allocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate(size, kDefaultAlignment); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocate(size, kDefaultAlignment); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* block) noexcept { release(block); }
+void operator delete[](void* block) noexcept { release(block); }
+void operator delete(void* block, std::size_t) noexcept { release(block); }
+void operator delete[](void* block, std::size_t) noexcept { release(block); }
+void operator delete(void* block, std::align_val_t) noexcept { release(block); }
+void operator delete[](void* block, std::align_val_t) noexcept { release(block); }
+void operator delete(void* block, std::size_t, std::align_val_t) noexcept { release(block); }
+void operator delete[](void* block, std::size_t, std::align_val_t) noexcept { release(block); }
+void operator delete(void* block, const std::nothrow_t&) noexcept { release(block); }
+void operator delete[](void* block, const std::nothrow_t&) noexcept { release(block); }
+void operator delete(void* block, std::align_val_t, const std::nothrow_t&) noexcept { release(block); }
+void operator delete[](void* block, std::align_val_t, const std::nothrow_t&) noexcept { release(block); }
+
+namespace {
+
+// Accepts every write and keeps nothing
+class DiscardingDatabase : public InMemoryDatabase {
+public:
+    DiscardingDatabase() : InMemoryDatabase("memory://") {}
+
+    bool insertUser(const User&) override { return true; }
+    bool updateUser(const User&) override { return true; }
+    bool insertRoom(const Room&) override { return true; }
+    std::size_t bulkWrite(const std::vector<PersistenceRecord>& records) override { return records.size(); }
+};
+
+struct Options {
+    std::size_t users = 100000;
+    std::size_t roomSize = 4;   // Players per room; the first creates it
+};
+
+void printUsage() {
+    std::cout << "Usage: LobbySessionMemory [options]\n"
+              << "  --users N            Sessions to hold (default 100000)\n"
+              << "  --room-size N        Players per room, at most 4 (default 4)\n";
+}
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--help" || flag == "-h") {
+            printUsage();
+            std::exit(0);
+        }
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for " + flag);
+        }
+        std::string value = argv[++i];
+        if (flag == "--users") {
+            options.users = std::max(1UL, std::stoul(value));
+        } else if (flag == "--room-size") {
+            options.roomSize = std::min(4UL, std::max(1UL, std::stoul(value)));
+        } else {
+            throw std::runtime_error("Unknown option: " + flag);
+        }
+    }
+    return options;
+}
+
+// Waits for the write-behind queue to hand everything to the database, so
+// queued records are not counted as state
+void waitForPersistence(RoomManager& manager) {
+    for (int i = 0; i < 1000; ++i) {
+        PersistenceStats stats = manager.getPersistenceStats();
+        if (stats.queueDepth == 0 && stats.written + stats.coalesced + stats.failed >= stats.enqueued) {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::cerr << "Persistence queue did not drain; numbers include queued records" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        Options options = parseOptions(argc, argv);
+        Logger::instance().setLevel(LogLevel::Warn);
+        std::vector<std::string> userIds;
+        userIds.reserve(options.users);
+        for (std::size_t i = 0; i < options.users; ++i) {
+            userIds.push_back("user_" + std::to_string(i));
+        }
+
+        auto manager = std::make_unique<RoomManager>(std::make_shared<DiscardingDatabase>());
+        waitForPersistence(*manager);
+        std::int64_t empty = liveBytes.load();
+
+        std::string roomId;
+        for (std::size_t i = 0; i < options.users; ++i) {
+            manager->addUser(User(userIds[i], "Player" + std::to_string(i)));
+            if (i % options.roomSize == 0) {
+                roomId = manager->createRoom("Room " + std::to_string(i), userIds[i]);
+            } else {
+                manager->joinRoom(roomId, userIds[i]);
+            }
+        }
+        waitForPersistence(*manager);
+        std::int64_t state = liveBytes.load() - empty;
+
+        auto rooms = manager->getAllRooms();
+        auto users = manager->getOnlineUsers();
+        std::int64_t withSnapshots = liveBytes.load() - empty;
+
+        double sessions = static_cast<double>(options.users);
+        std::cout << options.users << " sessions in " << rooms->size() << " rooms of " << options.roomSize << "\n"
+                  << std::fixed << std::setprecision(0)
+                  << "  state only:                 " << static_cast<double>(state) / sessions << " B/session\n"
+                  << "  plus room/user snapshots:   " << static_cast<double>(withSnapshots) / sessions
+                  << " B/session (" << users->size() << " users listed)" << std::endl;
+
+        rooms.reset();
+        users.reset();
+        manager->shutdown();
+        manager.reset();
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Session memory error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,213 @@
+// Warm start time to ready. Builds a lobby of users in rooms on a durable
+// in-memory database, takes a periodic (unclean) snapshot, makes more changes
+// as if the server kept running until it crashed, then shuts down cleanly.
+// Three restores are timed into fresh managers: from the crash snapshot, which
+// reconciles later changes and deletions from the database; from the clean
+// shutdown snapshot; and with no snapshot, loading the database whole.
+// The database is in process, so the reconcile phase shows the restore's own
+// cost plus a full scan per range, not Mongo round trips (see --latency-us).
+//
+//   LobbyWarmStartBench --users 1000000 --rooms 200000 --changes 20000 --threads 4
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "in_memory_database.hpp"
+#include "logger.hpp"
+#include "room_manager.hpp"
+
+namespace {
+
+// The in-memory store, treated as if it outlived the process so restore
+// reconciles against it
+class DurableMemoryDatabase : public InMemoryDatabase {
+public:
+    using InMemoryDatabase::InMemoryDatabase;
+    bool isDurable() const override { return true; }
+};
+
+struct Options {
+    std::size_t users = 1000000;
+    std::size_t rooms = 200000;
+    std::size_t changes = 20000;   // Made after the periodic snapshot
+    std::size_t threads = std::max(1U, std::thread::hardware_concurrency());
+    long latencyUs = 0;            // Simulated database round trip
+    std::string path = (std::filesystem::temp_directory_path() / "lobby_warm_start.snapshot").string();
+};
+
+void printUsage() {
+    std::cout << "Usage: LobbyWarmStartBench [options]\n"
+              << "  --users N            Online users (default 1000000)\n"
+              << "  --rooms N            Rooms, filled with up to 4 of the users (default 200000)\n"
+              << "  --changes N          Joins, leaves and disconnects after the snapshot (default 20000)\n"
+              << "  --threads N          Restore threads (default: hardware threads)\n"
+              << "  --latency-us N       Simulated database round trip (default 0)\n"
+              << "  --path FILE          Snapshot file (default in the temp directory)\n";
+}
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--help" || flag == "-h") {
+            printUsage();
+            std::exit(0);
+        }
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for " + flag);
+        }
+        std::string value = argv[++i];
+        if (flag == "--users") {
+            options.users = std::max(1UL, std::stoul(value));
+        } else if (flag == "--rooms") {
+            options.rooms = std::stoul(value);
+        } else if (flag == "--changes") {
+            options.changes = std::stoul(value);
+        } else if (flag == "--threads") {
+            options.threads = std::max(1UL, std::stoul(value));
+        } else if (flag == "--latency-us") {
+            options.latencyUs = std::max(0L, std::stol(value));
+        } else if (flag == "--path") {
+            options.path = value;
+        } else {
+            throw std::runtime_error("Unknown option: " + flag);
+        }
+    }
+    if (options.rooms > options.users) {
+        throw std::runtime_error("--rooms must not exceed --users; every room needs a host");
+    }
+    return options;
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point started) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+}
+
+// Waits for the write-behind queue to reach the database, as it would have
+// before the snapshot's changes were lost
+void waitForPersistence(RoomManager& manager) {
+    for (int i = 0; i < 6000; ++i) {
+        PersistenceStats stats = manager.getPersistenceStats();
+        if (stats.queueDepth == 0 && stats.written + stats.coalesced + stats.failed >= stats.enqueued) {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::cerr << "Persistence queue did not drain; the database is missing changes" << std::endl;
+}
+
+// Runs one restore into a fresh manager and reports it; false when the
+// restored lobby differs from the one that was shut down
+bool timeRestore(const char* label, const std::string& path, const std::shared_ptr<DatabaseManager>& db,
+                 std::size_t threads, std::size_t expectedRooms, std::size_t expectedUsers) {
+    RoomManager manager(db);
+    RestoreStats stats = manager.restore(path, threads);
+    bool matches = stats.rooms == expectedRooms && stats.users == expectedUsers;
+    std::cout << std::left << std::setw(14) << label << std::right << std::setw(9) << stats.totalMs
+              << std::setw(11) << stats.snapshotMs << std::setw(11) << stats.reconcileMs << std::setw(9)
+              << stats.indexMs << std::setw(10) << stats.updatedFromDatabase << std::setw(9) << stats.removedStale
+              << "  " << stats.rooms << " rooms, " << stats.users << " users"
+              << (matches ? "" : " (MISMATCH)") << std::endl;
+    manager.shutdown();
+    return matches;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        Options options = parseOptions(argc, argv);
+        Logger::instance().setLevel(LogLevel::Warn);
+        auto db = std::make_shared<DurableMemoryDatabase>("memory://?latencyUs=" + std::to_string(options.latencyUs));
+        std::string crashPath = options.path + ".crash";
+
+        std::size_t expectedRooms = 0;
+        std::size_t expectedUsers = 0;
+        {
+            RoomManager source(db);
+            source.startSnapshots(options.path, std::chrono::milliseconds(0));
+
+            auto started = std::chrono::steady_clock::now();
+            std::size_t roomSize = options.rooms == 0 ? 0 : std::min<std::size_t>(4, options.users / options.rooms);
+            std::vector<std::string> roomIds;
+            roomIds.reserve(options.rooms);
+            for (std::size_t i = 0; i < options.users; ++i) {
+                std::string userId = "user_" + std::to_string(i);
+                source.addUser(User(userId, "Player" + std::to_string(i)));
+                std::size_t room = roomSize == 0 ? options.rooms : i / roomSize;
+                if (room >= options.rooms) {
+                    continue;
+                }
+                if (i % roomSize == 0) {
+                    roomIds.push_back(source.createRoom("Room " + std::to_string(room), userId));
+                } else {
+                    source.joinRoom(roomIds.back(), userId);
+                }
+            }
+            waitForPersistence(source);
+            std::cout << "Built " << options.rooms << " rooms and " << options.users << " users in " << std::fixed
+                      << std::setprecision(0) << millisecondsSince(started) << " ms" << std::endl;
+
+            // The last periodic snapshot before the crash, taken once the build
+            // is older than the reconcile overlap so only later changes reload
+            std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+            started = std::chrono::steady_clock::now();
+            if (!source.writeSnapshot(false)) {
+                throw std::runtime_error("Could not write " + options.path);
+            }
+            double writeMs = millisecondsSince(started);
+            std::filesystem::copy_file(options.path, crashPath, std::filesystem::copy_options::overwrite_existing);
+            std::cout << "Snapshot: " << std::setprecision(1)
+                      << static_cast<double>(std::filesystem::file_size(options.path)) / (1024.0 * 1024.0)
+                      << " MB written in " << std::setprecision(0) << writeMs << " ms" << std::endl;
+
+            // Changes only the database sees: hosts leave (the room keeps its
+            // other players, or goes), lobby users drop, new users arrive
+            for (std::size_t i = 0; i < options.changes; ++i) {
+                std::size_t pick = (i * 7919) % options.users;
+                switch (i % 3) {
+                    case 0:
+                        if (!roomIds.empty()) {
+                            source.leaveRoom(roomIds[pick % roomIds.size()], "user_" + std::to_string(
+                                                 (pick % roomIds.size()) * roomSize));
+                        }
+                        break;
+                    case 1:
+                        source.removeUser("user_" + std::to_string(pick));
+                        break;
+                    case 2:
+                        source.addUser(User("late_" + std::to_string(i), "Late" + std::to_string(i)));
+                        break;
+                }
+            }
+            waitForPersistence(source);
+            expectedRooms = source.getAllRooms()->size();
+            expectedUsers = source.getOnlineUsers()->size();
+            // Writes the clean snapshot
+            source.shutdown();
+        }
+
+        std::cout << "Restoring with " << options.threads << " thread(s), " << options.changes
+                  << " changes after the crash snapshot\n"
+                  << std::left << std::setw(14) << "start" << std::right << std::setw(9) << "total ms"
+                  << std::setw(11) << "snapshot" << std::setw(11) << "database" << std::setw(9) << "indexes"
+                  << std::setw(10) << "updated" << std::setw(9) << "removed" << std::endl;
+        bool ok = timeRestore("after crash", crashPath, db, options.threads, expectedRooms, expectedUsers);
+        ok = timeRestore("after clean", options.path, db, options.threads, expectedRooms, expectedUsers) && ok;
+        ok = timeRestore("no snapshot", "", db, options.threads, expectedRooms, expectedUsers) && ok;
+
+        std::remove(options.path.c_str());
+        std::remove(crashPath.c_str());
+        return ok ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Warm start benchmark error: " << e.what() << std::endl;
+        return 1;
+    }
+}
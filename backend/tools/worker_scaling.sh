@@ -0,0 +1,50 @@
+#!/bin/bash
+# Requests/sec against the number of WebSocket worker threads. Starts the
+# server with an in-memory store once per WORKER_THREADS value, loads it with
+# LobbyLoadGenerator and prints one line per run.
+#
+#   tools/worker_scaling.sh build/GameLobbyServer build/LobbyLoadGenerator
+#
+# WORKERS, USERS, DURATION, MIX and PORT override the defaults below. Run the
+# generator on other cores than the server (or another machine), otherwise the
+# two compete for the same CPUs and the curve flattens early.
+set -euo pipefail
+
+SERVER=${1:?usage: worker_scaling.sh SERVER LOAD_GENERATOR}
+GENERATOR=${2:?usage: worker_scaling.sh SERVER LOAD_GENERATOR}
+WORKERS=${WORKERS:-"1 2 4 8"}
+USERS=${USERS:-2000}
+DURATION=${DURATION:-30}
+MIX=${MIX:-"chat=70,join=10,leave=10,create=5,rooms=5"}
+PORT=${PORT:-9102}
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+waitForPort() {
+    for _ in $(seq 1 100); do
+        if (exec 3<>"/dev/tcp/127.0.0.1/$1") 2>/dev/null; then
+            return 0
+        fi
+        sleep 0.1
+    done
+    echo "Server did not open port $1" >&2
+    return 1
+}
+
+printf "%-8s %14s %18s\n" workers requests/s messages_recv/s
+for workers in $WORKERS; do
+    MONGODB_URI=memory:// SNAPSHOT_PATH= WORKER_THREADS=$workers WEBSOCKET_PORT=$PORT \
+        LOG_LEVEL=warn "$SERVER" >"$OUT/server-$workers.log" 2>&1 &
+    server=$!
+    waitForPort "$PORT"
+
+    "$GENERATOR" --url "ws://127.0.0.1:$PORT" --users "$USERS" --duration "$DURATION" --mix "$MIX" \
+        --label "workers=$workers" >"$OUT/generator-$workers.log"
+
+    kill -TERM "$server"
+    wait "$server" || true
+
+    requests=$(awk '/^Requests\/sec:/ { sub(",", "", $2); print $2 }' "$OUT/generator-$workers.log")
+    received=$(awk '/^Messages received\/sec:/ { print $3 }' "$OUT/generator-$workers.log")
+    printf "%-8s %14.0f %18.0f\n" "$workers" "$requests" "$received"
+done
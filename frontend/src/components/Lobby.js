@@ -1,4 +1,4 @@
-import React, { useState, useEffect } from 'react';
+import React, { useState, useEffect, useRef } from 'react';
 import RoomList from './RoomList';
 import UserList from './UserList';
 import Chat from './Chat';
@@ -12,6 +12,14 @@ function Lobby({ user }) {
   const [showCreateRoom, setShowCreateRoom] = useState(false);
   const [chatMessages, setChatMessages] = useState([]);
 
+  // Room deltas are checked against the latest versions synchronously, before
+  // React re-renders, so the list is mirrored in a ref
+  const roomsRef = useRef([]);
+  const commitRooms = (nextRooms) => {
+    roomsRef.current = nextRooms;
+    setRooms(nextRooms);
+  };
+
   useEffect(() => {
     // Request initial data
     WebSocketService.getRooms();
@@ -19,37 +27,104 @@ function Lobby({ user }) {
 
     // Set up event handlers for real-time updates
     WebSocketService.on('room_update', handleRoomUpdate);
+    WebSocketService.on('lobby_delta', handleLobbyDelta);
+    WebSocketService.on('player_joined', handlePlayerJoined);
+    WebSocketService.on('player_left', handlePlayerLeft);
+    WebSocketService.on('status_changed', handleStatusChanged);
     WebSocketService.on('user_update', handleUserUpdate);
+    WebSocketService.on('user_delta', handleUserDelta);
     WebSocketService.on('chat_message', handleChatMessage);
+    WebSocketService.on('chat_history', handleChatHistory);
     WebSocketService.on('room_created', handleRoomCreated);
     WebSocketService.on('room_joined', handleRoomJoined);
     WebSocketService.on('room_left', handleRoomLeft);
 
     return () => {
       WebSocketService.off('room_update', handleRoomUpdate);
+      WebSocketService.off('lobby_delta', handleLobbyDelta);
+      WebSocketService.off('player_joined', handlePlayerJoined);
+      WebSocketService.off('player_left', handlePlayerLeft);
+      WebSocketService.off('status_changed', handleStatusChanged);
       WebSocketService.off('user_update', handleUserUpdate);
+      WebSocketService.off('user_delta', handleUserDelta);
       WebSocketService.off('chat_message', handleChatMessage);
+      WebSocketService.off('chat_history', handleChatHistory);
       WebSocketService.off('room_created', handleRoomCreated);
       WebSocketService.off('room_joined', handleRoomJoined);
       WebSocketService.off('room_left', handleRoomLeft);
     };
   }, []);
 
+  // Keeps whichever copy of a room is newer
+  const newerRoom = (current, next) =>
+    !current || (next.version || 0) >= (current.version || 0) ? next : current;
+
   const handleRoomUpdate = (data) => {
     if (data.rooms) {
-      setRooms(data.rooms);
+      commitRooms(data.rooms);
     } else if (data.room) {
-      setRooms(prevRooms => {
-        const updatedRooms = [...prevRooms];
-        const index = updatedRooms.findIndex(room => room.id === data.room.id);
-        if (index >= 0) {
-          updatedRooms[index] = data.room;
-        } else {
-          updatedRooms.push(data.room);
+      const updatedRooms = [...roomsRef.current];
+      const index = updatedRooms.findIndex(room => room.id === data.room.id);
+      if (index >= 0) {
+        updatedRooms[index] = newerRoom(updatedRooms[index], data.room);
+      } else {
+        updatedRooms.push(data.room);
+      }
+      commitRooms(updatedRooms);
+    }
+  };
+
+  const handleLobbyDelta = (data) => {
+    const removed = new Set(data.removed || []);
+    const updated = new Map((data.updated || []).map(room => [room.id, room]));
+
+    const nextRooms = roomsRef.current
+      .filter(room => !removed.has(room.id))
+      .map(room => {
+        const next = updated.get(room.id);
+        if (next) {
+          updated.delete(room.id);
+          return newerRoom(room, next);
         }
-        return updatedRooms;
+        return room;
       });
+    commitRooms([...nextRooms, ...updated.values()]);
+  };
+
+  // Applies a room delta if it is the next version; a skipped version means a
+  // delta was missed, so a fresh snapshot is requested instead
+  const applyRoomDelta = (data, apply) => {
+    const index = roomsRef.current.findIndex(room => room.id === data.roomId);
+    if (index < 0) {
+      WebSocketService.getRoom(data.roomId);
+      return;
+    }
+    const room = roomsRef.current[index];
+    if (data.version <= room.version) {
+      return;
+    }
+    if (data.version !== room.version + 1) {
+      WebSocketService.getRoom(data.roomId);
+      return;
     }
+    const updatedRooms = [...roomsRef.current];
+    updatedRooms[index] = { ...apply(room), version: data.version };
+    commitRooms(updatedRooms);
+  };
+
+  const handlePlayerJoined = (data) => {
+    applyRoomDelta(data, room => ({ ...room, players: [...room.players, data.userId] }));
+  };
+
+  const handlePlayerLeft = (data) => {
+    applyRoomDelta(data, room => ({
+      ...room,
+      players: room.players.filter(playerId => playerId !== data.userId)
+    }));
+  };
+
+  const handleStatusChanged = (data) => {
+    applyRoomDelta(data, room => ({ ...room, status: data.status }));
   };
 
   const handleUserUpdate = (data) => {
@@ -58,6 +133,20 @@ function Lobby({ user }) {
     }
   };
 
+  const handleUserDelta = (data) => {
+    const removed = new Set(data.removed || []);
+    const updated = new Map((data.updated || []).map(user => [user.id, user]));
+
+    setUsers(prevUsers => {
+      const known = new Set(prevUsers.map(user => user.id));
+      const nextUsers = prevUsers
+        .filter(user => !removed.has(user.id))
+        .map(user => updated.get(user.id) || user);
+      const added = [...updated.values()].filter(user => !known.has(user.id));
+      return [...nextUsers, ...added];
+    });
+  };
+
   const handleChatMessage = (data) => {
     setChatMessages(prevMessages => [...prevMessages, {
       id: Date.now(),
@@ -68,6 +157,21 @@ function Lobby({ user }) {
     }]);
   };
 
+  const handleChatHistory = (data) => {
+    // Sent right after joining; history precedes any live messages already shown
+    const history = (data.messages || []).map((entry, index) => ({
+      id: `${entry.timestamp}-${index}`,
+      username: entry.username,
+      message: entry.message,
+      timestamp: new Date(entry.timestamp).toLocaleTimeString(),
+      roomId: entry.roomId
+    }));
+    setChatMessages(prevMessages => [
+      ...history,
+      ...prevMessages.filter(message => message.roomId === data.roomId)
+    ]);
+  };
+
   const handleRoomCreated = (data) => {
     console.log('Room created:', data.roomId);
     setShowCreateRoom(false);
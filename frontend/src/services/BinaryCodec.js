@@ -0,0 +1,218 @@
+// Compact binary lobby protocol ("lobby.bin.v1"), mirroring
+// backend/src/binary_codec.cpp. Field order and type codes must match.
+//
+//   message := typeCode:u8 object
+//   object  := presence:varint field*   (bit i set => schema field i follows)
+//   string  := length:varint utf8-bytes
+//   int     := zigzag varint, bool := u8, list := count:varint item*
+
+export const BINARY_SUBPROTOCOL = 'lobby.bin.v1';
+export const JSON_SUBPROTOCOL = 'lobby.json.v1';
+
+const STRING = 'string';
+const BOOL = 'bool';
+const INT = 'int';
+const OBJECT = 'object';
+const STRING_LIST = 'stringList';
+const OBJECT_LIST = 'objectList';
+
+const ROOM_FIELDS = [
+  ['id', STRING],
+  ['name', STRING],
+  ['gameType', STRING],
+  ['players', STRING_LIST],
+  ['maxPlayers', INT],
+  ['status', INT],
+  ['version', INT]
+];
+
+const USER_FIELDS = [
+  ['id', STRING],
+  ['username', STRING],
+  ['currentRoom', STRING]
+];
+
+const CHAT_FIELDS = [
+  ['roomId', STRING],
+  ['userId', STRING],
+  ['username', STRING],
+  ['message', STRING],
+  ['timestamp', INT]
+];
+
+const dataField = (fields) => [['data', OBJECT, fields]];
+
+const CLIENT_MESSAGES = [
+  [1, 'auth', dataField([['userId', STRING], ['username', STRING]])],
+  [2, 'create_room', dataField([['name', STRING], ['gameType', STRING]])],
+  [3, 'join_room', dataField([['roomId', STRING]])],
+  [4, 'leave_room', dataField([['roomId', STRING]])],
+  [5, 'chat_message', dataField([['roomId', STRING], ['message', STRING]])],
+  [6, 'get_rooms', dataField([])],
+  [7, 'get_users', dataField([])],
+  [8, 'quick_match', dataField([['gameType', STRING]])],
+  [9, 'get_room', dataField([['roomId', STRING]])]
+];
+
+const SERVER_MESSAGES = [
+  [1, 'auth_success', [['user', OBJECT, USER_FIELDS]]],
+  [2, 'room_created', [['roomId', STRING]]],
+  [3, 'room_joined', [['roomId', STRING]]],
+  [4, 'room_left', [['roomId', STRING]]],
+  [5, 'chat_message', [['roomId', STRING], ['userId', STRING], ['username', STRING], ['message', STRING]]],
+  [6, 'room_update', [['room', OBJECT, ROOM_FIELDS], ['rooms', OBJECT_LIST, ROOM_FIELDS]]],
+  [7, 'lobby_delta', [['updated', OBJECT_LIST, ROOM_FIELDS], ['removed', STRING_LIST]]],
+  [8, 'user_update', [['users', OBJECT_LIST, USER_FIELDS]]],
+  [9, 'error', [['success', BOOL], ['data', STRING], ['error', STRING]]],
+  [10, 'chat_history', [['roomId', STRING], ['messages', OBJECT_LIST, CHAT_FIELDS]]],
+  [11, 'player_joined', [['roomId', STRING], ['userId', STRING], ['version', INT]]],
+  [12, 'player_left', [['roomId', STRING], ['userId', STRING], ['version', INT]]],
+  [13, 'status_changed', [['roomId', STRING], ['status', INT], ['version', INT]]],
+  [14, 'user_delta', [['updated', OBJECT_LIST, USER_FIELDS], ['removed', STRING_LIST]]]
+];
+
+const clientByType = new Map(CLIENT_MESSAGES.map(schema => [schema[1], schema]));
+
+const encoder = new TextEncoder();
+const decoder = new TextDecoder();
+
+class Writer {
+  constructor() {
+    this.bytes = [];
+  }
+
+  varint(value) {
+    // Presence masks and lengths stay well below 2^53, so plain arithmetic is safe
+    while (value >= 0x80) {
+      this.bytes.push((value % 0x80) | 0x80);
+      value = Math.floor(value / 0x80);
+    }
+    this.bytes.push(value);
+  }
+
+  string(value) {
+    const utf8 = encoder.encode(String(value));
+    this.varint(utf8.length);
+    for (const byte of utf8) {
+      this.bytes.push(byte);
+    }
+  }
+
+  field(kind, value, fields) {
+    switch (kind) {
+      case STRING: this.string(value); break;
+      case BOOL: this.bytes.push(value ? 1 : 0); break;
+      case INT: this.varint(value >= 0 ? value * 2 : -value * 2 - 1); break;
+      case OBJECT: this.object(fields, value); break;
+      case STRING_LIST:
+        this.varint(value.length);
+        value.forEach(item => this.string(item));
+        break;
+      case OBJECT_LIST:
+        this.varint(value.length);
+        value.forEach(item => this.object(fields, item));
+        break;
+      default: throw new Error(`Unknown field kind: ${kind}`);
+    }
+  }
+
+  object(fields, value = {}) {
+    let presence = 0;
+    fields.forEach(([name], i) => {
+      if (value[name] !== undefined && value[name] !== null) {
+        presence += 2 ** i;
+      }
+    });
+    this.varint(presence);
+    fields.forEach(([name, kind, nested], i) => {
+      if (Math.floor(presence / 2 ** i) % 2) {
+        this.field(kind, value[name], nested);
+      }
+    });
+  }
+}
+
+class Reader {
+  constructor(buffer) {
+    this.bytes = new Uint8Array(buffer);
+    this.pos = 0;
+  }
+
+  byte() {
+    if (this.pos >= this.bytes.length) {
+      throw new Error('Truncated binary message');
+    }
+    return this.bytes[this.pos++];
+  }
+
+  varint() {
+    let value = 0;
+    let scale = 1;
+    for (;;) {
+      const byte = this.byte();
+      value += (byte & 0x7f) * scale;
+      if (!(byte & 0x80)) {
+        return value;
+      }
+      scale *= 0x80;
+    }
+  }
+
+  string() {
+    const length = this.varint();
+    if (this.pos + length > this.bytes.length) {
+      throw new Error('Truncated binary message');
+    }
+    const value = decoder.decode(this.bytes.subarray(this.pos, this.pos + length));
+    this.pos += length;
+    return value;
+  }
+
+  field(kind, fields) {
+    switch (kind) {
+      case STRING: return this.string();
+      case BOOL: return this.byte() !== 0;
+      case INT: {
+        const raw = this.varint();
+        return raw % 2 ? -(raw + 1) / 2 : raw / 2;
+      }
+      case OBJECT: return this.object(fields);
+      case STRING_LIST: return Array.from({ length: this.varint() }, () => this.string());
+      case OBJECT_LIST: return Array.from({ length: this.varint() }, () => this.object(fields));
+      default: throw new Error(`Unknown field kind: ${kind}`);
+    }
+  }
+
+  object(fields) {
+    const presence = this.varint();
+    const value = {};
+    fields.forEach(([name, kind, nested], i) => {
+      if (Math.floor(presence / 2 ** i) % 2) {
+        value[name] = this.field(kind, nested);
+      }
+    });
+    return value;
+  }
+}
+
+export function encodeClientMessage(message) {
+  const schema = clientByType.get(message.type);
+  if (!schema) {
+    throw new Error(`No binary schema for message type: ${message.type}`);
+  }
+  const writer = new Writer();
+  writer.bytes.push(schema[0]);
+  writer.object(schema[2], message);
+  return new Uint8Array(writer.bytes).buffer;
+}
+
+export function decodeServerMessage(buffer) {
+  const reader = new Reader(buffer);
+  const schema = SERVER_MESSAGES[reader.byte() - 1];
+  if (!schema) {
+    throw new Error('Unknown binary message type');
+  }
+  const message = reader.object(schema[2]);
+  message.type = schema[1];
+  return message;
+}
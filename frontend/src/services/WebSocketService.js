@@ -1,3 +1,10 @@
+import {
+    BINARY_SUBPROTOCOL,
+    JSON_SUBPROTOCOL,
+    encodeClientMessage,
+    decodeServerMessage
+} from './BinaryCodec';
+
 class WebSocketService {
     constructor() {
         this.ws = null;
@@ -6,11 +13,20 @@ class WebSocketService {
         this.reconnectAttempts = 0;
         this.maxReconnectAttempts = 5;
         this.reconnectInterval = 3000;
+        // Offer the compact binary protocol when enabled; the server falls back to JSON
+        this.useBinary = process.env.REACT_APP_WIRE_PROTOCOL === 'binary';
+    }
+
+    isBinary() {
+        return this.ws !== null && this.ws.protocol === BINARY_SUBPROTOCOL;
     }
 
     connect(url = 'ws://localhost:9002') {
         try {
-            this.ws = new WebSocket(url);
+            this.ws = this.useBinary
+                ? new WebSocket(url, [BINARY_SUBPROTOCOL, JSON_SUBPROTOCOL])
+                : new WebSocket(url);
+            this.ws.binaryType = 'arraybuffer';
             this.setupEventHandlers();
         } catch (error) {
             console.error('WebSocket connection failed:', error);
@@ -28,7 +44,9 @@ class WebSocketService {
 
         this.ws.onmessage = (event) => {
             try {
-                const message = JSON.parse(event.data);
+                const message = typeof event.data === 'string'
+                    ? JSON.parse(event.data)
+                    : decodeServerMessage(event.data);
                 console.log('WebSocket message received:', message);
                 this.triggerHandler('message', message);
 
@@ -59,7 +77,7 @@ class WebSocketService {
 
     send(message) {
         if (this.isConnected && this.ws.readyState === WebSocket.OPEN) {
-            this.ws.send(JSON.stringify(message));
+            this.ws.send(this.isBinary() ? encodeClientMessage(message) : JSON.stringify(message));
             return true;
         } else {
             console.warn('WebSocket not connected. Message not sent:', message);
@@ -70,35 +88,50 @@ class WebSocketService {
     authenticate(userId, username) {
         return this.send({
             type: 'auth',
-            data: JSON.stringify({ userId, username })
+            data: { userId, username }
         });
     }
 
     createRoom(name, gameType = 'Generic') {
         return this.send({
             type: 'create_room',
-            data: JSON.stringify({ name, gameType })
+            data: { name, gameType }
         });
     }
 
     joinRoom(roomId) {
         return this.send({
             type: 'join_room',
-            data: JSON.stringify({ roomId })
+            data: { roomId }
         });
     }
 
     leaveRoom(roomId) {
         return this.send({
             type: 'leave_room',
-            data: JSON.stringify({ roomId })
+            data: { roomId }
         });
     }
 
     sendChatMessage(roomId, message) {
         return this.send({
             type: 'chat_message',
-            data: JSON.stringify({ roomId, message })
+            data: { roomId, message }
+        });
+    }
+
+    quickMatch(gameType = 'Generic') {
+        return this.send({
+            type: 'quick_match',
+            data: { gameType }
+        });
+    }
+
+    // Full snapshot of one room, used to resync after a missed delta
+    getRoom(roomId) {
+        return this.send({
+            type: 'get_room',
+            data: { roomId }
         });
     }
 